@@ -0,0 +1,231 @@
+/*
+ *	BIRD -- Glue for Benchmark Drivers
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: Benchmark glue
+ *
+ * The benchmark drivers (ospf-bench.c, ospf-replay.c) are linked with
+ * the nest, filters and protocols, but not with sysdep/unix/main.c and
+ * krt.c. This module provides the few functions these would, the
+ * configuration text the drivers generate or load and parse as usual,
+ * and the report of OSPF statistics shared by the drivers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "nest/bird.h"
+#include "lib/lists.h"
+#include "lib/resource.h"
+#include "lib/string.h"
+#include "nest/protocol.h"
+#include "nest/iface.h"
+#include "nest/cli.h"
+#include "conf/conf.h"
+#include "proto/ospf/ospf.h"
+
+#include "lib/unix.h"
+#include "lib/krt.h"
+#include "bench/sim.h"
+
+/*
+ *	Sysdep glue normally provided by main.c and krt.c
+ */
+
+cli *cmd_reconfig_stored_cli = NULL;
+struct protocol proto_unix_iface = { name: "Device" };
+
+void
+sysdep_preconfig(struct config *c)
+{
+  init_list(&c->logfiles);
+}
+
+int
+sysdep_commit(struct config *new, struct config *old UNUSED)
+{
+  log_switch(0, &new->logfiles, new->syslog_name);
+  return 0;
+}
+
+void
+sysdep_shutdown_done(void)
+{
+  exit(0);
+}
+
+/* There is no control socket, so no CLI commands are ever run */
+int cli_get_command(cli *c UNUSED) { return 0; }
+void cli_write_trigger(cli *c UNUSED) { }
+void cmd_check_config(char *name UNUSED) { }
+void cmd_reconfig(char *name UNUSED, int type UNUSED, int timeout UNUSED) { }
+void cmd_reconfig_confirm(void) { }
+void cmd_reconfig_undo(void) { }
+void cmd_reconfig_undo_notify(void) { }
+void cmd_shutdown(void) { }
+
+struct proto_config *
+kif_init_config(int class UNUSED)
+{
+  cf_error("Device protocol is not supported by the benchmark");
+}
+
+struct proto_config *
+krt_init_config(int class UNUSED)
+{
+  cf_error("Kernel protocol is not supported by the benchmark");
+}
+
+/* Prefer the global address, the link-local one is found by OSPFv3 */
+struct ifa *
+kif_choose_primary(struct iface *i)
+{
+  struct ifa *a;
+
+  WALK_LIST(a, i->addrs)
+    if (a->scope > SCOPE_LINK)
+      return a;
+
+  return EMPTY_LIST(i->addrs) ? NULL : HEAD(i->addrs);
+}
+
+
+/*
+ *	Configuration
+ */
+
+static char *cf_text;
+static unsigned cf_len, cf_size, cf_pos;
+
+static void
+cf_grow(void)
+{
+  cf_size = cf_size ? 2 * cf_size : 65536;
+  cf_text = xrealloc(cf_text, cf_size);
+}
+
+void
+cf_printf(char *fmt, ...)
+{
+  va_list args;
+  int l;
+
+  for (;;)
+  {
+    va_start(args, fmt);
+    l = bvsnprintf(cf_text + cf_len, cf_size - cf_len, fmt, args);
+    va_end(args);
+    if (l >= 0)
+      break;
+
+    cf_grow();
+  }
+  cf_len += l;
+}
+
+/* Append a configuration file to the text */
+void
+cf_load(char *name)
+{
+  FILE *f = fopen(name, "r");
+  size_t l;
+
+  if (!f)
+    die("Cannot open %s: %m", name);
+
+  do
+  {
+    if (cf_len == cf_size)
+      cf_grow();
+    l = fread(cf_text + cf_len, 1, cf_size - cf_len, f);
+    cf_len += l;
+  }
+  while (l);
+
+  if (ferror(f))
+    die("Error reading %s: %m", name);
+  fclose(f);
+}
+
+static int
+cf_read_text(byte *dest, unsigned int len, int fd UNUSED)
+{
+  len = MIN(len, cf_len - cf_pos);
+  memcpy(dest, cf_text + cf_pos, len);
+  cf_pos += len;
+  return len;
+}
+
+/**
+ * cf_parse_text - parse the configuration text
+ * @name: name of the configuration
+ *
+ * Parses the text built by cf_printf() and cf_load(), a configuration
+ * error is fatal.
+ */
+struct config *
+cf_parse_text(char *name)
+{
+  struct config *c = config_alloc(name);
+
+  cf_read_hook = cf_read_text;
+  if (!config_parse(c))
+    die("Configuration error at line %d: %s", c->err_lino, c->err_msg);
+
+  return c;
+}
+
+
+/*
+ *	Reports
+ */
+
+char *bench_pkt_names[] = { NULL, "Hello", "DB description", "LS request", "LS update", "LS ack" };
+
+/**
+ * bench_report_stats - print OSPF statistics
+ * @po: OSPF instances
+ * @cnt: number of instances
+ *
+ * Prints timing of OSPF phases and packets sent, summed over the
+ * instances (maximum for the longest run).
+ */
+void
+bench_report_stats(struct proto_ospf **po, unsigned cnt)
+{
+  struct ospf_phase_stats s, *ps;
+  u32 pkts;
+  u64 bytes;
+  unsigned i, j;
+
+  printf("\n  %-20s %10s %12s %10s %10s\n", "Phase", "Runs", "Total (us)", "Avg (us)", "Max (us)");
+  for (j = 0; j < OSPF_PH_MAX; j++)
+  {
+    bzero(&s, sizeof(s));
+    for (i = 0; i < cnt; i++)
+    {
+      ps = &po[i]->stats[j];
+      s.count += ps->count;
+      s.total += ps->total;
+      s.max = MAX(s.max, ps->max);
+    }
+    printf("  %-20s %10u %12llu %10llu %10u\n", ospf_phase_names[j], s.count,
+	   (unsigned long long) s.total, (unsigned long long) (s.count ? s.total / s.count : 0), s.max);
+  }
+
+  printf("\n  %-20s %10s %12s\n", "Packets sent", "Count", "Bytes");
+  for (j = HELLO_P; j <= LSACK_P; j++)
+  {
+    pkts = 0;
+    bytes = 0;
+    for (i = 0; i < cnt; i++)
+    {
+      pkts += po[i]->tx_packets[j];
+      bytes += po[i]->tx_bytes[j];
+    }
+    printf("  %-20s %10u %12llu\n", bench_pkt_names[j], pkts, (unsigned long long) bytes);
+  }
+}
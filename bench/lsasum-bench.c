@@ -0,0 +1,364 @@
+/*
+ *	BIRD -- LSA Checksum Test and Benchmark
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: LSA checksum benchmark
+ *
+ * lsasum-bench checks lsasum_check() and lsasum_calculate() against a
+ * naive byte by byte Fletcher checksum as described in RFC 1008. Random
+ * LSAs of random lengths up to the maximum (64 kB) at random alignments,
+ * with the body following the header or separate, and LSAs of all 0xff
+ * bytes (the worst case for the accumulators) are compared. Any mismatch
+ * is fatal.
+ *
+ * Then the time per LSA of the naive checksum and of lsasum_check() is
+ * measured for a range of LSA lengths. On x86 CPUs supporting AVX2, an
+ * AVX2 variant of the vector loop of lsalib.c (32 bytes per step instead
+ * of 16) is checked and measured as well, to see whether it would be
+ * worth its separate code path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "nest/bird.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "proto/ospf/ospf.h"
+
+#include "lib/unix.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define HAVE_AVX2_TEST
+#include <immintrin.h>
+#endif
+
+char *bird_name = "lsasum-bench";
+
+#define LSA_MAX_LEN	0xfffc
+#define MODX		4102
+
+static unsigned tests = 100000;
+static unsigned seed = 1;
+static unsigned bytes_per_run = 64 << 20;	/* Checksummed per measurement */
+
+static u8 *buf;
+
+
+/*
+ *	Reference checksums
+ */
+
+static u16
+naive_finish(int c0, int c1, unsigned length)
+{
+  int x, y;
+
+  x = (int)((length - 15) * c0 - c1) % 255;
+  if (x <= 0)
+    x += 255;
+  y = 510 - c0 - x;
+  if (y > 255)
+    y -= 255;
+
+  return (x << 8) | y;
+}
+
+/* RFC 1008 checksum of a LSA in network byte order, returned in host order */
+static u16
+naive_check(u8 *lsa, unsigned length)
+{
+  u8 *p, *q, *ep = lsa + length;
+  int c0 = 0, c1 = 0;
+
+  lsa[16] = lsa[17] = 0;
+
+  for (p = lsa + 2; p < ep; p = q)
+  {
+    q = MIN(p + MODX, ep);
+    for (; p < q; p++)
+    {
+      c0 += *p;
+      c1 += c0;
+    }
+    c0 %= 255;
+    c1 %= 255;
+  }
+
+  return naive_finish(c0, c1, length - 2);
+}
+
+#ifdef HAVE_AVX2_TEST
+
+__attribute__((target("avx2")))
+static u64
+avx2_hsum(__m256i v)
+{
+  u64 a[4];
+
+  _mm256_storeu_si256((__m256i *) a, v);
+  return a[0] + a[1] + a[2] + a[3];
+}
+
+/* Same as lsasum_check() with body following the header, 32-byte steps */
+__attribute__((target("avx2")))
+static u16
+avx2_check(u8 *lsa, unsigned length)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i wlo = _mm256_set_epi16(17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32);
+  const __m256i whi = _mm256_set_epi16(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+  u8 *p = lsa + 2, *ep = lsa + length;
+  u64 c0 = 0, c1 = 0;
+
+  lsa[16] = lsa[17] = 0;
+
+  while ((ep - p) >= 32)
+  {
+    unsigned n = MIN((ep - p) / 32, 512), i;
+    __m256i vs0 = zero, vps = zero, vs1 = zero;
+
+    for (i = 0; i < n; i++)
+    {
+      /* Lanes hold bytes 0-7 and 16-23, 8-15 and 24-31 of the block */
+      __m256i d = _mm256_permute4x64_epi64(_mm256_loadu_si256((__m256i *) p), 0xd8);
+
+      vps = _mm256_add_epi64(vps, vs0);
+      vs0 = _mm256_add_epi64(vs0, _mm256_sad_epu8(d, zero));
+      vs1 = _mm256_add_epi32(vs1, _mm256_madd_epi16(_mm256_unpacklo_epi8(d, zero), wlo));
+      vs1 = _mm256_add_epi32(vs1, _mm256_madd_epi16(_mm256_unpackhi_epi8(d, zero), whi));
+      p += 32;
+    }
+
+    c1 += 32 * n * c0 + 32 * avx2_hsum(vps) + avx2_hsum(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(vs1)))
+      + avx2_hsum(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(vs1, 1)));
+    c0 += avx2_hsum(vs0);
+  }
+
+  for (; p < ep; p++)
+  {
+    c0 += *p;
+    c1 += c0;
+  }
+
+  return naive_finish(c0 % 255, c1 % 255, length - 2);
+}
+
+#endif
+
+
+/*
+ *	Equivalence test
+ */
+
+static void
+random_lsa(u8 *lsa, unsigned length, int ones)
+{
+  struct ospf_lsa_header *h = (struct ospf_lsa_header *) lsa;
+  unsigned i;
+
+  for (i = 0; i < length; i++)
+    lsa[i] = ones ? 0xff : random();
+
+  h->length = htons(length);
+}
+
+static void
+test_fail(char *fn, unsigned length, unsigned align, u16 got, u16 exp)
+{
+  die("%s: length %u, alignment %u: checksum %04x, expected %04x", fn, length, align, got, exp);
+}
+
+static void
+test_one(unsigned length, unsigned align, int ones)
+{
+  struct ospf_lsa_header *h = (struct ospf_lsa_header *) (buf + align);
+  struct ospf_lsa_header hh, nh;
+  u8 *body = buf + 2 * LSA_MAX_LEN + align;
+  unsigned blen = length - sizeof(struct ospf_lsa_header);
+  u32 *hb = (u32 *) (buf + 4 * LSA_MAX_LEN);
+  unsigned i;
+  u16 exp, sum;
+
+  random_lsa((u8 *) h, length, ones);
+  exp = naive_check((u8 *) h, length);
+
+  sum = ntohs(lsasum_check(h, NULL));
+  if (sum != exp)
+    test_fail("lsasum_check", length, align, sum, exp);
+
+  /* The same with separate body */
+  random_lsa((u8 *) h, length, ones);
+  memcpy(body, h + 1, blen);
+  memset(h + 1, 0x55, blen);
+  sum = ntohs(lsasum_check(h, body));
+  memcpy(h + 1, body, blen);
+  exp = naive_check((u8 *) h, length);
+  if (sum != exp)
+    test_fail("lsasum_check (body)", length, align, sum, exp);
+
+#ifdef HAVE_AVX2_TEST
+  if (__builtin_cpu_supports("avx2"))
+  {
+    sum = avx2_check((u8 *) h, length);
+    if (sum != exp)
+      test_fail("avx2_check", length, align, sum, exp);
+  }
+#endif
+
+  /* LSAs in the LSDB are kept in host byte order */
+  if (length % 4)
+    return;
+
+  memcpy(&nh, h, sizeof(nh));
+  ntohlsah(&nh, &hh);
+  for (i = 0; i < blen / 4; i++)
+    hb[i] = get_u32(body + 4 * i);
+
+  lsasum_calculate(&hh, hb);
+  if (hh.checksum != exp)
+    test_fail("lsasum_calculate", length, align, hh.checksum, exp);
+}
+
+static void
+test_all(void)
+{
+  unsigned i, length, align;
+  unsigned hdr = sizeof(struct ospf_lsa_header);
+
+  for (length = hdr; length <= 2048; length++)
+    for (align = 0; align < 16; align++)
+      test_one(length, align, 0);
+
+  for (i = 0; i < tests; i++)
+  {
+    /* Mostly short LSAs, some up to the maximum */
+    length = hdr + random() % ((i % 16) ? 512 : (LSA_MAX_LEN - hdr + 1));
+    test_one(length, random() % 16, 0);
+  }
+
+  for (length = LSA_MAX_LEN - 64; length <= LSA_MAX_LEN; length++)
+    test_one(length, length % 16, 1);
+
+  printf("Equivalence: %u LSAs ok\n", (2049 - hdr) * 16 + tests + 65);
+}
+
+
+/*
+ *	Benchmark
+ */
+
+static u64
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define BENCH_NAIVE	0
+#define BENCH_LSASUM	1
+#define BENCH_AVX2	2
+
+static double
+bench_one(int fn, unsigned length)
+{
+  struct ospf_lsa_header *h = (struct ospf_lsa_header *) buf;
+  unsigned i, runs = MAX(bytes_per_run / length, 1000);
+  volatile u16 sink = 0;
+  u64 t;
+
+  random_lsa(buf, length, 0);
+
+  t = now_ns();
+  for (i = 0; i < runs; i++)
+    switch (fn)
+    {
+    case BENCH_NAIVE:	sink += naive_check(buf, length); break;
+    case BENCH_LSASUM:	sink += lsasum_check(h, NULL); break;
+#ifdef HAVE_AVX2_TEST
+    case BENCH_AVX2:	sink += avx2_check(buf, length); break;
+#endif
+    }
+  t = now_ns() - t;
+
+  return (double) t / runs;
+}
+
+static void
+bench_all(void)
+{
+  static unsigned lengths[] = { 36, 48, 64, 100, 128, 256, 512, 1024, 1500, 4096, 16384, 65532 };
+  int avx2 = 0;
+  unsigned i;
+
+#ifdef HAVE_AVX2_TEST
+  avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+  printf("\n  %8s %12s %12s %12s %10s\n", "Length", "Naive (ns)", "lsasum (ns)", "AVX2 (ns)", "lsasum B/ns");
+  for (i = 0; i < ARRAY_SIZE(lengths); i++)
+  {
+    double n = bench_one(BENCH_NAIVE, lengths[i]);
+    double l = bench_one(BENCH_LSASUM, lengths[i]);
+
+    printf("  %8u %12.1f %12.1f", lengths[i], n, l);
+    if (avx2)
+      printf(" %12.1f", bench_one(BENCH_AVX2, lengths[i]));
+    else
+      printf(" %12s", "-");
+    printf(" %10.2f\n", lengths[i] / l);
+  }
+}
+
+
+/*
+ *	Main
+ */
+
+static void
+usage(void)
+{
+  fprintf(stderr, "Usage: %s [-n <tests>] [-s <seed>] [-b <MB per measurement>]\n", bird_name);
+  exit(1);
+}
+
+static void
+parse_args(int argc, char **argv)
+{
+  int c;
+
+  while ((c = getopt(argc, argv, "n:s:b:")) >= 0)
+    switch (c)
+    {
+    case 'n': tests = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    case 'b': bytes_per_run = atoi(optarg) << 20; break;
+    default:
+      usage();
+    }
+
+  if (optind < argc)
+    usage();
+}
+
+int
+main(int argc, char **argv)
+{
+  parse_args(argc, argv);
+  log_switch(0, NULL, NULL);
+  srandom(seed);
+
+  /* Header and body areas and the host order body, with room for alignment */
+  buf = xmalloc(5 * LSA_MAX_LEN + 64);
+
+  test_all();
+  bench_all();
+  return 0;
+}
@@ -0,0 +1,415 @@
+/*
+ *	BIRD -- OSPF LSA Database Index Benchmark
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: LSA database index benchmark
+ *
+ * lsdb-bench compares the open addressing index of the LSA database
+ * (ospf_hash_get(), ospf_hash_find() and ospf_hash_delete() of
+ * topology.c) with the chained hash table it replaced, which is kept
+ * here as it was. For each database size, keys shaped like those of a
+ * large AS are generated: router and network LSAs of the routers in the
+ * area, summary LSAs of a few area border routers and external LSAs,
+ * with LSA IDs taken from consecutive prefixes.
+ *
+ * For both tables the time per operation of inserting all keys, looking
+ * them up in random order, looking up missing keys and replacing random
+ * keys (delete and insert, so the tables shrink and grow) is reported,
+ * together with the memory of the index per LSA. The results of lookups
+ * are checked against each other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "nest/bird.h"
+#include "lib/resource.h"
+#include "lib/string.h"
+#include "proto/ospf/ospf.h"
+
+#include "lib/unix.h"
+
+char *bird_name = "lsdb-bench";
+
+static unsigned sizes[16] = { 10000, 100000, 1000000 };
+static unsigned nsizes = 3;
+static unsigned seed = 1;
+
+struct lsdb_key {
+  u32 domain, id, rt, type;
+};
+
+
+/*
+ *	Chained hash table, as in topology.c before the open addressing index
+ */
+
+#define HASH_DEF_ORDER 6
+#define HASH_HI_MARK *4
+#define HASH_HI_STEP 2
+#define HASH_HI_MAX 16
+#define HASH_LO_MARK /5
+#define HASH_LO_STEP 2
+#define HASH_LO_MIN 8
+
+struct chain_entry {
+  struct chain_entry *next;
+  struct top_hash_entry e;
+};
+
+struct chain_graph {
+  pool *pool;
+  slab *hash_slab;
+  struct chain_entry **hash_table;
+  unsigned int hash_size;
+  unsigned int hash_order;
+  unsigned int hash_mask;
+  unsigned int hash_entries;
+  unsigned int hash_entries_min, hash_entries_max;
+};
+
+static void
+chain_ht_alloc(struct chain_graph *f)
+{
+  f->hash_size = 1 << f->hash_order;
+  f->hash_mask = f->hash_size - 1;
+  if (f->hash_order > HASH_HI_MAX - HASH_HI_STEP)
+    f->hash_entries_max = ~0;
+  else
+    f->hash_entries_max = f->hash_size HASH_HI_MARK;
+  if (f->hash_order < HASH_LO_MIN + HASH_LO_STEP)
+    f->hash_entries_min = 0;
+  else
+    f->hash_entries_min = f->hash_size HASH_LO_MARK;
+  f->hash_table = mb_allocz(f->pool, f->hash_size * sizeof(struct chain_entry *));
+}
+
+static inline u32
+chain_hash_u32(u32 a)
+{
+  a ^= a >> 16;
+  a ^= a << 10;
+  return a;
+}
+
+static inline unsigned
+chain_hash(struct chain_graph *f, u32 domain, u32 lsaid, u32 rtrid, u32 type)
+{
+  return (
+#ifdef OSPFv2
+	  ((type == LSA_T_NET) ? 0 : chain_hash_u32(rtrid)) +
+	  chain_hash_u32(lsaid) +
+#else /* OSPFv3 */
+	  chain_hash_u32(rtrid) +
+	  ((type == LSA_T_RT) ? 0 : chain_hash_u32(lsaid)) +
+#endif
+	  type + domain) & f->hash_mask;
+}
+
+static struct chain_graph *
+chain_new(pool *pool)
+{
+  struct chain_graph *f = mb_allocz(pool, sizeof(struct chain_graph));
+
+  f->pool = pool;
+  f->hash_slab = sl_new(f->pool, sizeof(struct chain_entry));
+  f->hash_order = HASH_DEF_ORDER;
+  chain_ht_alloc(f);
+  return f;
+}
+
+static void
+chain_rehash(struct chain_graph *f, int step)
+{
+  unsigned int oldn, oldh;
+  struct chain_entry **n, **oldt, **newt, *e, *x;
+
+  oldn = f->hash_size;
+  oldt = f->hash_table;
+  f->hash_order += step;
+  chain_ht_alloc(f);
+  newt = f->hash_table;
+
+  for (oldh = 0; oldh < oldn; oldh++)
+  {
+    e = oldt[oldh];
+    while (e)
+    {
+      x = e->next;
+      n = newt + chain_hash(f, e->e.domain, e->e.lsa.id, e->e.lsa.rt, e->e.lsa.type);
+      e->next = *n;
+      *n = e;
+      e = x;
+    }
+  }
+  mb_free(oldt);
+}
+
+static struct top_hash_entry *
+chain_find(struct chain_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
+{
+  struct chain_entry *e = f->hash_table[chain_hash(f, domain, lsa, rtr, type)];
+
+  while (e && (e->e.lsa.id != lsa || e->e.lsa.type != type || e->e.lsa.rt != rtr || e->e.domain != domain))
+    e = e->next;
+
+  return e ? &e->e : NULL;
+}
+
+static struct top_hash_entry *
+chain_get(struct chain_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
+{
+  struct chain_entry **ee = f->hash_table + chain_hash(f, domain, lsa, rtr, type);
+  struct chain_entry *e = *ee;
+
+  while (e && (e->e.lsa.id != lsa || e->e.lsa.rt != rtr || e->e.lsa.type != type || e->e.domain != domain))
+    e = e->next;
+
+  if (e)
+    return &e->e;
+
+  e = sl_alloc(f->hash_slab);
+  e->e.color = OUTSPF;
+  e->e.dist = LSINFINITY;
+  e->e.nhs = NULL;
+  e->e.lb = IPA_NONE;
+  e->e.lsa.id = lsa;
+  e->e.lsa.rt = rtr;
+  e->e.lsa.type = type;
+  e->e.lsa_body = NULL;
+  e->e.lsa_wire = NULL;
+  e->e.an.next = NULL;
+  e->e.domain = domain;
+  e->next = *ee;
+  *ee = e;
+  if (f->hash_entries++ > f->hash_entries_max)
+    chain_rehash(f, HASH_HI_STEP);
+  return &e->e;
+}
+
+static void
+chain_delete(struct chain_graph *f, struct top_hash_entry *en)
+{
+  struct chain_entry *e = SKIP_BACK(struct chain_entry, e, en);
+  struct chain_entry **ee = f->hash_table +
+    chain_hash(f, en->domain, en->lsa.id, en->lsa.rt, en->lsa.type);
+
+  while (*ee)
+  {
+    if (*ee == e)
+    {
+      *ee = e->next;
+      sl_free(f->hash_slab, e);
+      if (f->hash_entries-- < f->hash_entries_min)
+	chain_rehash(f, -HASH_LO_STEP);
+      return;
+    }
+    ee = &((*ee)->next);
+  }
+  bug("chain_delete() called for invalid node");
+}
+
+
+/*
+ *	Keys
+ */
+
+/* Keys of a LSDB of n LSAs, in random order */
+static struct lsdb_key *
+lsdb_keys(unsigned n)
+{
+  struct lsdb_key *keys = xmalloc(n * sizeof(struct lsdb_key));
+  unsigned rtrs = MAX(n / 16, 16), abrs = 16;
+  unsigned i, j;
+
+  for (i = 0; i < n; i++)
+  {
+    struct lsdb_key *k = &keys[i];
+    u32 r = 0x0a000001 + random() % rtrs;
+
+    if (i < rtrs)
+    {
+      k->type = LSA_T_RT;
+      k->rt = 0x0a000001 + i;
+#ifdef OSPFv2
+      k->id = k->rt;
+#else
+      k->id = 0;
+#endif
+    }
+    else if (i < 2 * rtrs)
+    {
+      k->type = LSA_T_NET;
+      k->rt = r;
+#ifdef OSPFv2
+      k->id = 0xac100001 + 4 * (i - rtrs);
+#else
+      k->id = i - rtrs;
+#endif
+    }
+    else if (i < n / 2)
+    {
+      k->type = LSA_T_SUM_NET;
+      k->rt = 0x0a000001 + random() % abrs;
+      k->id = 0xc0000000 + ((i - 2 * rtrs) << 8);
+    }
+    else
+    {
+      k->type = LSA_T_EXT;
+      k->rt = r;
+      k->id = 0x0b000000 + ((i - n / 2) << 8);
+    }
+
+    /* Area 1, external LSAs are AS-wide */
+    k->domain = (k->type == LSA_T_EXT) ? 0 : 1;
+  }
+
+  for (i = n - 1; i > 0; i--)
+  {
+    struct lsdb_key t;
+
+    j = random() % (i + 1);
+    t = keys[i];
+    keys[i] = keys[j];
+    keys[j] = t;
+  }
+
+  return keys;
+}
+
+
+/*
+ *	Benchmark
+ */
+
+#define OP_INSERT	0
+#define OP_FIND		1
+#define OP_MISS		2
+#define OP_REPLACE	3
+#define OP_MAX		4
+
+static char *op_names[] = { "Insert", "Find", "Find missing", "Replace" };
+
+static u64
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+bench_size(unsigned n)
+{
+  struct lsdb_key *keys = lsdb_keys(n);
+  struct top_hash_entry **ents = xmalloc(n * sizeof(struct top_hash_entry *));
+  struct top_hash_entry **cents = xmalloc(n * sizeof(struct top_hash_entry *));
+  unsigned *repl = xmalloc(n * sizeof(unsigned));
+  double t_open[OP_MAX], t_chain[OP_MAX];
+  pool *p = rp_new(&root_pool, "LSDB bench");
+  struct top_graph *gr = ospf_top_new(p);
+  struct chain_graph *cg = chain_new(p);
+  struct top_hash_entry *e;
+  unsigned i, m_open, m_chain;
+  u64 t;
+
+#define TIME(res, code) do { t = now_ns(); code; res = (double) (now_ns() - t) / n; } while (0)
+#define K(i) keys[i].domain, keys[i].id, keys[i].rt, keys[i].type
+
+  for (i = 0; i < n; i++)
+    repl[i] = random() % n;
+
+  /* Open addressing index */
+  TIME(t_open[OP_INSERT], for (i = 0; i < n; i++) ents[i] = ospf_hash_get(gr, K(i)));
+  TIME(t_open[OP_FIND], for (i = 0; i < n; i++) if (ospf_hash_find(gr, K(n - 1 - i)) != ents[n - 1 - i]) die("Find failed"));
+  TIME(t_open[OP_MISS], for (i = 0; i < n; i++) if (ospf_hash_find(gr, keys[i].domain, keys[i].id ^ 0x80000000, keys[i].rt, keys[i].type)) die("Find missing failed"));
+  TIME(t_open[OP_REPLACE], for (i = 0; i < n; i++) { ospf_hash_delete(gr, ents[repl[i]]); ents[repl[i]] = ospf_hash_get(gr, K(repl[i])); });
+  m_open = ((gr->tab.mask + 1) + (gr->old.ents ? gr->old.mask + 1 : 0)) *
+    (sizeof(struct top_key) + sizeof(struct top_hash_entry *));
+
+  /* Chained hash table */
+  TIME(t_chain[OP_INSERT], for (i = 0; i < n; i++) cents[i] = chain_get(cg, K(i)));
+  TIME(t_chain[OP_FIND], for (i = 0; i < n; i++) if (chain_find(cg, K(n - 1 - i)) != cents[n - 1 - i]) die("Find failed"));
+  TIME(t_chain[OP_MISS], for (i = 0; i < n; i++) if (chain_find(cg, keys[i].domain, keys[i].id ^ 0x80000000, keys[i].rt, keys[i].type)) die("Find missing failed"));
+  TIME(t_chain[OP_REPLACE], for (i = 0; i < n; i++) { chain_delete(cg, cents[repl[i]]); cents[repl[i]] = chain_get(cg, K(repl[i])); });
+  m_chain = cg->hash_size * sizeof(struct chain_entry *) + n * sizeof(struct chain_entry *);
+
+  /* Both must hold the same LSAs */
+  for (i = 0; i < n; i++)
+  {
+    e = ospf_hash_find(gr, K(i));
+    if (!e || (e != ents[i]) || (chain_find(cg, K(i)) != cents[i]))
+      die("Tables differ");
+  }
+  if (gr->hash_entries != cg->hash_entries)
+    die("Tables differ in size");
+
+  printf("\n  %u LSAs\n", n);
+  printf("  %-20s %14s %14s\n", "Operation (ns)", "Open address", "Chained");
+  for (i = 0; i < OP_MAX; i++)
+    printf("  %-20s %14.1f %14.1f\n", op_names[i], t_open[i], t_chain[i]);
+  printf("  %-20s %14.1f %14.1f\n", "Index B/LSA", (double) m_open / n, (double) m_chain / n);
+
+  ospf_top_free(gr);
+  rfree(p);
+  xfree(keys);
+  xfree(ents);
+  xfree(cents);
+  xfree(repl);
+}
+
+
+/*
+ *	Main
+ */
+
+static void
+usage(void)
+{
+  fprintf(stderr, "Usage: %s [-s <seed>] [<LSAs> ...]\n", bird_name);
+  exit(1);
+}
+
+static void
+parse_args(int argc, char **argv)
+{
+  int c;
+
+  while ((c = getopt(argc, argv, "s:")) >= 0)
+    switch (c)
+    {
+    case 's': seed = atoi(optarg); break;
+    default:
+      usage();
+    }
+
+  if (optind < argc)
+    for (nsizes = 0; (optind < argc) && (nsizes < ARRAY_SIZE(sizes)); optind++)
+      if ((sizes[nsizes++] = atoi(argv[optind])) < 32)
+	usage();
+
+  if (optind < argc)
+    usage();
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned i;
+
+  parse_args(argc, argv);
+  log_switch(0, NULL, NULL);
+  srandom(seed);
+  resource_init();
+
+  for (i = 0; i < nsizes; i++)
+    bench_size(sizes[i]);
+
+  return 0;
+}
@@ -0,0 +1,928 @@
+/*
+ *	BIRD -- OSPF Convergence Benchmark
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: OSPF benchmark
+ *
+ * ospf-bench runs a number of OSPF instances in one process, connected
+ * by point-to-point links of the simulated network (see sim-io.c) in a
+ * ring, grid, random or hub and spoke topology. Router i is the protocol
+ * r<i> with its own routing table t<i> and one interface r<i>-<k> for
+ * each link k, the configuration is generated and parsed as usual.
+ *
+ * The network is run in steps of one second of simulated time until all
+ * adjacencies are Full, all routers of each connected part of the network
+ * have the same LSDB, the routing table calculation is done everywhere and
+ * every table holds a route for each prefix of its part of the network.
+ * Optionally some links are then brought down and the same is measured
+ * again. For each phase the time of these milestones, the number of SPF
+ * runs, the CPU time of the timed OSPF phases, the packets and bytes sent
+ * and at the end the memory of each instance are reported.
+ *
+ * With -g, graceful restart is enabled and router 0 is restarted in three
+ * scenarios: with unchanged topology, with one of its links going down
+ * and with a link elsewhere going down during the grace period. Besides
+ * the milestones, the end of restart mode, the time neighbors did not
+ * announce their adjacency to the restarting router and the time other
+ * routers missed some routes are reported and checked.
+ *
+ * With -C, packets received by router 0 are captured to a file, which
+ * may be replayed by ospf-replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nest/bird.h"
+#include "lib/lists.h"
+#include "lib/resource.h"
+#include "lib/timer.h"
+#include "lib/string.h"
+#include "nest/route.h"
+#include "nest/protocol.h"
+#include "nest/iface.h"
+#include "nest/cli.h"
+#include "nest/locks.h"
+#include "conf/conf.h"
+#include "proto/ospf/ospf.h"
+
+#include "lib/unix.h"
+#include "lib/krt.h"
+#include "bench/sim.h"
+
+#define BT_RING		0
+#define BT_GRID		1
+#define BT_RANDOM	2
+#define BT_HUB		3
+
+static char *bench_topo_names[] = { "ring", "grid", "random", "hub" };
+
+struct bench_link {
+  unsigned a, b;			/* Routers, interface indices are 2k+1 and 2k+2 */
+  int up;
+};
+
+static unsigned routers = 16;
+static int topology = BT_GRID;
+static unsigned degree = 4;		/* Average degree of random topology */
+static unsigned hubs = 2;
+static unsigned stubs;			/* Stub networks per router */
+static unsigned failures;		/* Links to bring down after convergence */
+static unsigned seed = 1;
+static unsigned limit = 600;		/* Seconds of simulated time per phase */
+static char *proto_opts = "";
+static char *iface_opts = "";
+static int verbose;
+static int gr_scenarios;
+static char *capture_file;		/* Capture of router 0 */
+
+static struct bench_link *links;
+static unsigned nlinks;
+static struct proto_ospf **rtr;		/* OSPF instances by router */
+static unsigned *comp;			/* Connected part of the network by router */
+static unsigned *comp_links, *comp_size;
+static u64 *digest;			/* LSDB digests by router */
+
+
+char *bird_name = "ospf-bench";
+
+
+/*
+ *	Topology
+ */
+
+static int
+bench_has_link(unsigned a, unsigned b)
+{
+  unsigned k;
+
+  for (k = 0; k < nlinks; k++)
+    if (((links[k].a == a) && (links[k].b == b)) ||
+	((links[k].a == b) && (links[k].b == a)))
+      return 1;
+
+  return 0;
+}
+
+static void
+bench_add_link(unsigned a, unsigned b)
+{
+  links[nlinks].a = a;
+  links[nlinks].b = b;
+  links[nlinks].up = 1;
+  nlinks++;
+}
+
+static void
+bench_topology(void)
+{
+  unsigned i, j, max, w;
+
+  switch (topology)
+  {
+  case BT_RING:
+    links = xmalloc(routers * sizeof(struct bench_link));
+    for (i = 0; i < routers; i++)
+      if ((i + 1 < routers) || (routers > 2))
+	bench_add_link(i, (i + 1) % routers);
+    break;
+
+  case BT_GRID:
+    for (w = 1; w * w < routers; w++)
+      ;
+    links = xmalloc(2 * routers * sizeof(struct bench_link));
+    for (i = 0; i < routers; i++)
+    {
+      if ((i % w + 1 < w) && (i + 1 < routers))
+	bench_add_link(i, i + 1);
+      if (i + w < routers)
+	bench_add_link(i, i + w);
+    }
+    break;
+
+  case BT_RANDOM:
+    /* A random spanning tree keeps the network connected */
+    max = MAX(routers * degree / 2, routers - 1);
+    links = xmalloc(max * sizeof(struct bench_link));
+    for (i = 1; i < routers; i++)
+      bench_add_link(random() % i, i);
+
+    max = MIN(max, routers * (routers - 1) / 2);
+    while (nlinks < max)
+    {
+      i = random() % routers;
+      j = random() % routers;
+      if ((i != j) && !bench_has_link(i, j))
+	bench_add_link(i, j);
+    }
+    break;
+
+  case BT_HUB:
+    hubs = MIN(hubs, routers);
+    links = xmalloc((hubs * (hubs - 1) / 2 + (routers - hubs) * hubs) * sizeof(struct bench_link));
+    for (i = 0; i < hubs; i++)
+      for (j = i + 1; j < hubs; j++)
+	bench_add_link(i, j);
+    for (i = hubs; i < routers; i++)
+      for (j = 0; j < hubs; j++)
+	bench_add_link(j, i);
+    break;
+  }
+}
+
+static unsigned
+bench_comp_find(unsigned i)
+{
+  while (comp[i] != i)
+    i = comp[i] = comp[comp[i]];
+
+  return i;
+}
+
+/* Find connected parts of the network and count their routers and links */
+static void
+bench_components(void)
+{
+  unsigned i, k, a, b;
+
+  for (i = 0; i < routers; i++)
+  {
+    comp[i] = i;
+    comp_links[i] = comp_size[i] = 0;
+  }
+
+  for (k = 0; k < nlinks; k++)
+    if (links[k].up)
+    {
+      a = bench_comp_find(links[k].a);
+      b = bench_comp_find(links[k].b);
+      if (a != b)
+	comp[a] = b;
+    }
+
+  for (i = 0; i < routers; i++)
+    comp_size[comp[i] = bench_comp_find(i)]++;
+
+  for (k = 0; k < nlinks; k++)
+    if (links[k].up)
+      comp_links[comp[links[k].a]]++;
+}
+
+
+/*
+ *	Interfaces
+ */
+
+static inline unsigned
+bench_if_router(unsigned idx)
+{
+  struct bench_link *l = &links[(idx - 1) / 2];
+  return (idx & 1) ? l->a : l->b;
+}
+
+static struct iface *
+bench_if_update(unsigned idx, unsigned flags)
+{
+  struct iface f = {};
+
+  bsnprintf(f.name, sizeof(f.name), "r%u-%u", bench_if_router(idx), (idx - 1) / 2);
+  f.flags = flags;
+  f.mtu = 1500;
+  f.index = idx;
+  return if_update(&f);
+}
+
+static void
+bench_ifa_update(struct iface *i, ip_addr ip, ip_addr prefix, unsigned pxlen, ip_addr brd, int scope)
+{
+  struct ifa a = {};
+
+  a.iface = i;
+  a.ip = ip;
+  a.prefix = prefix;
+  a.pxlen = pxlen;
+  a.brd = brd;
+  a.scope = scope;
+  ifa_update(&a);
+}
+
+/*
+ * In IPv4, link k has the prefix 10.0.0.0 + 4k/30, in IPv6 the prefix
+ * 2001:db8:k::/64 and each interface also a link-local address.
+ */
+static void
+bench_ifaces(void)
+{
+  unsigned idx, k, e;
+  struct iface *i;
+
+  if_start_update();
+  for (idx = 1; idx <= 2 * nlinks; idx++)
+  {
+    k = (idx - 1) / 2;
+    e = (idx - 1) % 2;
+    i = bench_if_update(idx, IF_ADMIN_UP | IF_LINK_UP | IF_MULTIACCESS | IF_BROADCAST | IF_MULTICAST);
+
+#ifndef IPV6
+    u32 px = 0x0a000000 + 4 * k;
+    bench_ifa_update(i, ipa_from_u32(px + 1 + e), ipa_from_u32(px), 30, ipa_from_u32(px + 3), SCOPE_UNIVERSE);
+#else
+    bench_ifa_update(i, _MI(0xfe800000, 0, 0, idx), _MI(0xfe800000, 0, 0, 0), 64, IPA_NONE, SCOPE_LINK);
+    bench_ifa_update(i, _MI(0x20010db8, k, 0, 1 + e), _MI(0x20010db8, k, 0, 0), 64, IPA_NONE, SCOPE_UNIVERSE);
+#endif
+
+    sim_link(idx, idx + 1 - 2 * e);
+  }
+  if_end_update();
+}
+
+static void
+bench_link_down(unsigned k)
+{
+  links[k].up = 0;
+  sim_unlink(2 * k + 1);
+  bench_if_update(2 * k + 1, IF_LINK_UP | IF_MULTIACCESS | IF_BROADCAST | IF_MULTICAST);
+  bench_if_update(2 * k + 2, IF_LINK_UP | IF_MULTIACCESS | IF_BROADCAST | IF_MULTICAST);
+}
+
+
+/*
+ *	Configuration
+ */
+
+static void
+bench_stubnet(unsigned i, unsigned j)
+{
+#ifndef IPV6
+  unsigned n = i * stubs + j;
+  cf_printf("    stubnet 100.%u.%u.%u/32;\n", 64 + (n >> 16), (n >> 8) & 0xff, n & 0xff);
+#else
+  cf_printf("    stubnet 2001:db8:ffff:%x:%x::/80;\n", i, j);
+#endif
+}
+
+static struct config *
+bench_config(void)
+{
+  unsigned i, j;
+
+  cf_printf("router id 255.255.255.255;\n");
+  cf_printf("log stderr %s;\n", verbose ? "all" : "{ warning, error, fatal, bug }");
+
+  for (i = 0; i < routers; i++)
+  {
+    cf_printf("table t%u;\n", i);
+    cf_printf("protocol ospf r%u {\n  table t%u;\n  router id %R;\n  %s%s\n", i, i, i + 1,
+	      gr_scenarios ? "graceful restart; " : "", proto_opts);
+    if (!i && capture_file)
+      cf_printf("  capture \"%s\";\n", capture_file);
+    cf_printf("  area 0 {\n");
+    for (j = 0; j < stubs; j++)
+      bench_stubnet(i, j);
+    cf_printf("    interface \"r%u-*\" { type ptp; %s };\n  };\n}\n", i, iface_opts);
+  }
+
+  return cf_parse_text("ospf-bench");
+}
+
+/* Find instances by their names, r<i> is router i */
+static void
+bench_protos(struct config *c)
+{
+  struct proto_config *pc;
+
+  WALK_LIST(pc, c->protos)
+    if (pc->protocol == &proto_ospf)
+      rtr[atoi(pc->name + 1)] = (struct proto_ospf *) pc->proto;
+}
+
+
+/*
+ *	Measurement
+ */
+
+struct bench_phase {
+  char *name;
+  bird_clock_t start;
+  bird_clock_t full, sync, routes, done;	/* Milestones relative to start, -1 if not reached */
+  unsigned adj, adj_exp;			/* Full adjacencies found and expected */
+  unsigned lsas, nets;				/* LSAs and routes per router (minimum) */
+  u64 wall;
+
+  int gr;					/* Graceful restart of gr_router */
+  unsigned gr_router;
+  int down_link;				/* Link to bring down at down_at, or -1 */
+  bird_clock_t down_at;
+  int gr_entered, gr_expired;
+  bird_clock_t gr_end;				/* End of restart mode, -1 if not yet */
+  unsigned gr_kept;				/* Seconds routes were kept for kernel */
+  unsigned gr_adj_lost;				/* Neighbor-seconds without adjacency */
+  unsigned gr_routes_lost;			/* Router-seconds with missing routes */
+  int gr_helping;				/* Maximum of helping neighbors */
+};
+
+static inline int
+bench_up(unsigned i)
+{
+  return rtr[i]->proto.proto_state == PS_UP;
+}
+
+static int
+bench_full(struct bench_phase *ph)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+  unsigned i, k;
+
+  ph->adj = ph->adj_exp = 0;
+  for (k = 0; k < nlinks; k++)
+    ph->adj_exp += links[k].up ? 2 : 0;
+
+  for (i = 0; i < routers; i++)
+    if (bench_up(i))
+      WALK_LIST(ifa, rtr[i]->iface_list)
+	WALK_LIST(n, ifa->neigh_list)
+	  if (n->state == NEIGHBOR_FULL)
+	    ph->adj++;
+
+  return ph->adj == ph->adj_exp;
+}
+
+/* Order independent digest of area and AS scope LSAs, without MaxAge ones */
+static u64
+bench_lsdb_digest(struct proto_ospf *po, unsigned *count)
+{
+  struct top_hash_entry *en;
+  u64 sum = 0, x;
+
+  *count = 0;
+  WALK_SLIST(en, po->lsal)
+  {
+    if (!en->lsa_body || (en->lsa.age == LSA_MAXAGE) ||
+	(LSA_SCOPE(&en->lsa) == LSA_SCOPE_LINK))
+      continue;
+
+    x = (((u64) en->lsa.type << 32) | en->lsa.id) * 0x9e3779b97f4a7c15ULL;
+    x ^= (((u64) en->lsa.rt << 32) | (u32) en->lsa.sn) * 0xc2b2ae3d27d4eb4fULL;
+    x ^= x >> 31;
+    sum += x;
+    (*count)++;
+  }
+
+  return sum;
+}
+
+static int
+bench_sync(struct bench_phase *ph)
+{
+  unsigned i, count;
+
+  ph->lsas = ~0;
+  for (i = 0; i < routers; i++)
+  {
+    if (!bench_up(i))
+      return 0;
+
+    digest[i] = bench_lsdb_digest(rtr[i], &count);
+    ph->lsas = MIN(ph->lsas, count);
+  }
+
+  for (i = 0; i < routers; i++)
+    if (digest[i] != digest[comp[i]])
+      return 0;
+
+  return 1;
+}
+
+static unsigned
+bench_nets(unsigned i)
+{
+  unsigned nets = 0;
+
+  FIB_WALK(&rtr[i]->proto.table->fib, fn)
+    {
+      if (((net *) fn)->routes)
+	nets++;
+    }
+  FIB_WALK_END;
+
+  return nets;
+}
+
+/* Each table has a route for every link and for the stub networks of other routers of its part */
+static inline int
+bench_routes_ok(unsigned i, unsigned nets)
+{
+  return nets == comp_links[comp[i]] + (comp_size[comp[i]] - 1) * stubs;
+}
+
+static int
+bench_routes(struct bench_phase *ph)
+{
+  unsigned i, nets, ok = 1;
+
+  ph->nets = ~0;
+  for (i = 0; i < routers; i++)
+  {
+    nets = bench_nets(i);
+    ph->nets = MIN(ph->nets, nets);
+    if (!bench_routes_ok(i, nets))
+      ok = 0;
+  }
+
+  return ok;
+}
+
+static int
+bench_idle(void)
+{
+  unsigned i;
+
+  for (i = 0; i < routers; i++)
+    if (!bench_up(i) || rtr[i]->calcrt || !EMPTY_LIST(rtr[i]->rt_dirty))
+      return 0;
+
+  return 1;
+}
+
+/*
+ * Graceful restart scenarios: until the restarting router leaves restart
+ * mode, each of its neighbors on up links should keep announcing the
+ * adjacency (see NEIGH_ADJ()) unless it stops helping, other routers
+ * should keep their routes and kernel syncers should keep its routes.
+ */
+static int
+bench_gr_adj(unsigned j, unsigned idx, u32 rid)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+
+  if (!bench_up(j))
+    return 0;
+
+  WALK_LIST(ifa, rtr[j]->iface_list)
+    if (ifa->iface->index == idx)
+      WALK_LIST(n, ifa->neigh_list)
+	if ((n->rid == rid) && NEIGH_ADJ(n))
+	  return 1;
+
+  return 0;
+}
+
+static void
+bench_gr_check(struct bench_phase *ph, bird_clock_t t)
+{
+  unsigned r = ph->gr_router;
+  struct proto_ospf *po = rtr[r];
+  unsigned i, k;
+  int helping = 0;
+
+  if (ph->gr_end >= 0)
+    return;
+
+  if (bench_up(r) && !po->gr_restart)
+  {
+    /* Restart mode has been left, or was not entered at all */
+    ph->gr_end = t;
+    ph->gr_expired = ph->gr_entered && (now - po->gr_start >= (bird_clock_t) po->gr_time);
+    return;
+  }
+
+  if (bench_up(r))
+    ph->gr_entered = 1;
+
+  if (proto_gr_active(&po->proto))
+    ph->gr_kept++;
+
+  for (k = 0; k < nlinks; k++)
+    if (links[k].up && (links[k].a == r))
+      ph->gr_adj_lost += !bench_gr_adj(links[k].b, 2 * k + 2, po->router_id);
+    else if (links[k].up && (links[k].b == r))
+      ph->gr_adj_lost += !bench_gr_adj(links[k].a, 2 * k + 1, po->router_id);
+
+  for (i = 0; i < routers; i++)
+    if ((i != r) && bench_up(i))
+    {
+      helping += rtr[i]->gr_helping;
+      ph->gr_routes_lost += !bench_routes_ok(i, bench_nets(i));
+    }
+
+  ph->gr_helping = MAX(ph->gr_helping, helping);
+}
+
+/* Milestones are the times since which their conditions hold */
+static int
+bench_reached(bird_clock_t *m, int ok, bird_clock_t t)
+{
+  if (!ok)
+    *m = -1;
+  else if (*m < 0)
+    *m = t;
+
+  return ok;
+}
+
+static void
+bench_check(struct bench_phase *ph)
+{
+  bird_clock_t t = now - ph->start;
+  int ok;
+
+  ok = bench_reached(&ph->full, bench_full(ph), t);
+  ok = bench_reached(&ph->sync, ok && bench_sync(ph), t);
+  ok = bench_reached(&ph->routes, ok && bench_routes(ph), t);
+
+  if (ph->gr)
+  {
+    bench_gr_check(ph, t);
+    ok = ok && (ph->gr_end >= 0);
+  }
+
+  if (ok && bench_idle())
+    ph->done = t;
+}
+
+static void
+bench_reset(void)
+{
+  struct proto_ospf *po;
+  unsigned i;
+
+  for (i = 0; i < routers; i++)
+  {
+    po = rtr[i];
+    po->spf_runs = 0;
+    bzero(po->tx_packets, sizeof(po->tx_packets));
+    bzero(po->tx_bytes, sizeof(po->tx_bytes));
+    bzero(po->stats, OSPF_PH_MAX * sizeof(struct ospf_phase_stats));
+  }
+  bzero(&sim_stats, sizeof(sim_stats));
+}
+
+static void
+bench_run(struct bench_phase *ph)
+{
+  u64 start = tm_now_us();
+
+  ph->start = now;
+  ph->full = ph->sync = ph->routes = ph->done = ph->gr_end = -1;
+
+  while ((ph->done < 0) && (now - ph->start <= (bird_clock_t) limit))
+  {
+    if ((ph->down_link >= 0) && (now - ph->start == ph->down_at))
+    {
+      bench_link_down(ph->down_link);
+      bench_components();
+    }
+
+    sim_run();
+    bench_check(ph);
+    sim_tick();
+  }
+
+  ph->wall = tm_now_us() - start;
+}
+
+
+/*
+ *	Report
+ */
+
+static void
+bench_milestone(char *name, bird_clock_t t, char *fmt, unsigned val)
+{
+  if (t < 0)
+    printf("  %-20s not reached in %u s\n", name, limit);
+  else
+  {
+    printf("  %-20s after %d s", name, (int) t);
+    if (fmt)
+      printf(fmt, val);
+    printf("\n");
+  }
+}
+
+static void
+bench_report(struct bench_phase *ph)
+{
+  u32 spf = 0;
+  unsigned i;
+
+  printf("\n%s:\n", ph->name);
+  printf("  %-20s %u of %u\n", "Full adjacencies", ph->adj, ph->adj_exp);
+  bench_milestone("All Full", ph->full, NULL, 0);
+  bench_milestone("LSDB synchronised", ph->sync, ", %u LSAs per router", ph->lsas);
+  bench_milestone("Routes installed", ph->routes, ", %u per router", ph->nets);
+  bench_milestone("Converged", ph->done, NULL, 0);
+
+  if (ph->gr)
+  {
+    if (!ph->gr_entered)
+      printf("  %-20s not entered\n", "Restart mode");
+    else if (ph->gr_end < 0)
+      printf("  %-20s not left in %u s\n", "Restart mode", limit);
+    else
+      printf("  %-20s left after %d s, %s\n", "Restart mode", (int) ph->gr_end,
+	     ph->gr_expired ? "grace period expired" : "completed");
+    printf("  %-20s %u s\n", "Kernel routes kept", ph->gr_kept);
+    printf("  %-20s %d\n", "Helping neighbors", ph->gr_helping);
+    printf("  %-20s %u neighbor-seconds\n", "Adjacency lost", ph->gr_adj_lost);
+    printf("  %-20s %u router-seconds\n", "Routes missing", ph->gr_routes_lost);
+  }
+
+  for (i = 0; i < routers; i++)
+    spf += rtr[i]->spf_runs;
+  printf("  %-20s %u (%.1f per router)\n", "SPF runs", spf, (double) spf / routers);
+
+  bench_report_stats(rtr, routers);
+  printf("  %-20s %10llu %12llu, %llu dropped\n", "Delivered",
+	 (unsigned long long) sim_stats.packets, (unsigned long long) sim_stats.bytes,
+	 (unsigned long long) sim_stats.dropped);
+
+  printf("\n  %-20s %.3f s\n", "Wall time", ph->wall / 1000000.0);
+}
+
+static void
+bench_report_memory(void)
+{
+  size_t m, total = 0, max = 0;
+  unsigned i;
+
+  for (i = 0; i < routers; i++)
+  {
+    m = rmemsize(rtr[i]->proto.pool);
+    total += m;
+    max = MAX(max, m);
+  }
+
+  printf("\nMemory per router:     %zu kB average, %zu kB maximum\n",
+	 total / routers / 1024, max / 1024);
+}
+
+
+/*
+ *	Scenarios
+ */
+
+static void
+bench_phase_init(struct bench_phase *ph, char *name)
+{
+  bzero(ph, sizeof(struct bench_phase));
+  ph->name = name;
+  ph->down_link = -1;
+}
+
+/* Restart the instance as the restart command does, its messages are dropped */
+static void
+bench_restart(unsigned i)
+{
+  cli *c = cli_new(NULL);
+
+  this_cli = c;
+  proto_cmd_restart(&rtr[i]->proto, 0, 0);
+  this_cli = NULL;
+  cli_free(c);
+}
+
+/* Random up link of router r (own) or another one in its part, -1 if there is none */
+static int
+bench_pick_link(unsigned r, int own)
+{
+  unsigned k, cnt = 0;
+  int pick = -1;
+
+  for (k = 0; k < nlinks; k++)
+    if (links[k].up && (comp[links[k].a] == comp[r]) &&
+	(((links[k].a == r) || (links[k].b == r)) == own))
+      if (!(random() % ++cnt))
+	pick = k;
+
+  return pick;
+}
+
+#define GR_PLAIN	0		/* Unchanged topology */
+#define GR_OWN_LINK	1		/* Link of restarting router goes down */
+#define GR_OTHER_LINK	2		/* Another link goes down */
+
+static int
+bench_gr_scenario(char *name, int type)
+{
+  struct bench_phase ph;
+  unsigned i;
+  int ok, helping = 0;
+
+  bench_phase_init(&ph, name);
+  ph.gr = 1;
+  ph.gr_router = 0;
+  ph.down_at = 1;
+  if (type != GR_PLAIN)
+  {
+    ph.down_link = bench_pick_link(0, type == GR_OWN_LINK);
+    if ((ph.down_link < 0) || (bench_pick_link(0, 1) < 0))
+    {
+      printf("\n%s:\n  skipped, no suitable link\n", name);
+      return 1;
+    }
+  }
+
+  bench_reset();
+  bench_restart(ph.gr_router);
+  bench_run(&ph);
+  bench_report(&ph);
+
+  for (i = 0; i < routers; i++)
+    helping += rtr[i]->gr_helping;
+
+  /* All scenarios have to converge and end helper mode */
+  ok = (ph.done >= 0) && ph.gr_entered && (ph.gr_kept > 0) && !helping;
+
+  switch (type)
+  {
+  case GR_PLAIN:
+    /* Nobody notices the restart */
+    ok = ok && !ph.gr_expired && !ph.gr_adj_lost && !ph.gr_routes_lost;
+    break;
+
+  case GR_OTHER_LINK:
+    /* Helpers stop helping on a topology change */
+    ok = ok && (ph.gr_adj_lost > 0);
+    break;
+  }
+
+  printf("  %-20s %s\n", "Result", ok ? "ok" : "FAILED");
+  return ok;
+}
+
+
+/*
+ *	Main
+ */
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+	  "Usage: %s [-n <routers>] [-t ring|grid|random|hub] [-d <degree>] [-H <hubs>]\n"
+	  "       [-p <stubnets>] [-f <failures>] [-s <seed>] [-l <limit>]\n"
+	  "       [-o <protocol options>] [-i <interface options>] [-C <capture>] [-g] [-v]\n", bird_name);
+  exit(1);
+}
+
+static void
+parse_args(int argc, char **argv)
+{
+  int c, i;
+
+  while ((c = getopt(argc, argv, "n:t:d:H:p:f:s:l:o:i:C:gv")) >= 0)
+    switch (c)
+    {
+    case 'n': routers = atoi(optarg); break;
+    case 'd': degree = atoi(optarg); break;
+    case 'H': hubs = atoi(optarg); break;
+    case 'p': stubs = atoi(optarg); break;
+    case 'f': failures = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    case 'l': limit = atoi(optarg); break;
+    case 'o': proto_opts = optarg; break;
+    case 'i': iface_opts = optarg; break;
+    case 'C': capture_file = optarg; break;
+    case 'g': gr_scenarios = 1; break;
+    case 'v': verbose = 1; break;
+    case 't':
+      for (i = 0; (i < (int) ARRAY_SIZE(bench_topo_names)) && strcmp(optarg, bench_topo_names[i]); i++)
+	;
+      if (i == ARRAY_SIZE(bench_topo_names))
+	usage();
+      topology = i;
+      break;
+    default:
+      usage();
+    }
+
+  if ((optind < argc) || (routers < 2) || !hubs)
+    usage();
+}
+
+int
+main(int argc, char **argv)
+{
+  struct bench_phase ph;
+  unsigned i, k;
+  int ok;
+
+  parse_args(argc, argv);
+  log_switch(0, NULL, NULL);
+  srandom(seed);
+
+  bench_topology();
+#ifndef IPV6
+  if ((nlinks >= (1 << 22)) || (routers * stubs >= (1 << 22)))
+    die("Too many links or stub networks");
+#else
+  if ((routers > 0x10000) || (stubs > 0x10000))
+    die("Too many routers or stub networks");
+#endif
+
+  resource_init();
+  olock_init();
+  sim_init(2 * nlinks);
+  rt_init();
+  if_init();
+  roa_init();
+  config_init();
+  cli_init();
+  protos_build();
+
+  rtr = xmalloc(routers * sizeof(struct proto_ospf *));
+  comp = xmalloc(routers * sizeof(unsigned));
+  comp_links = xmalloc(routers * sizeof(unsigned));
+  comp_size = xmalloc(routers * sizeof(unsigned));
+  digest = xmalloc(routers * sizeof(u64));
+
+  bench_ifaces();
+  bench_components();
+
+  struct config *c = bench_config();
+  config_commit(c, RECONFIG_HARD, 0);
+  bench_protos(c);
+
+  printf("OSPF benchmark: %s topology, %u routers, %u links, seed %u\n",
+	 bench_topo_names[topology], routers, nlinks, seed);
+
+  bench_phase_init(&ph, "Initial convergence");
+  bench_run(&ph);
+  bench_report(&ph);
+  ok = (ph.done >= 0);
+
+  if (ok && failures)
+  {
+    bench_reset();
+    for (i = 0; (i < failures) && (i < nlinks); i++)
+    {
+      do
+	k = random() % nlinks;
+      while (!links[k].up);
+      bench_link_down(k);
+    }
+    bench_components();
+
+    bench_phase_init(&ph, "Reconvergence after link failures");
+    bench_run(&ph);
+    bench_report(&ph);
+    ok = (ph.done >= 0);
+  }
+
+  if (ok && gr_scenarios)
+  {
+    ok = bench_gr_scenario("Graceful restart", GR_PLAIN) & ok;
+    ok = bench_gr_scenario("Graceful restart, own link down", GR_OWN_LINK) & ok;
+    ok = bench_gr_scenario("Graceful restart, other link down", GR_OTHER_LINK) & ok;
+  }
+
+  bench_report_memory();
+  return ok ? 0 : 1;
+}
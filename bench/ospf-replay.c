@@ -0,0 +1,496 @@
+/*
+ *	BIRD -- OSPF Capture Replay
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: OSPF capture replay
+ *
+ * ospf-replay feeds the packets of a file written by the OSPF capture
+ * option (see proto/ospf/capture.h) to one OSPF instance running on the
+ * simulated network (see sim-io.c), so a flooding problem seen in a live
+ * network can be reproduced and profiled offline. The instance gets one
+ * interface for each interface name found in the capture, with addresses
+ * guessed from the captured packets. It is configured either by the
+ * generated configuration (router ID of the captured router, all
+ * interfaces point-to-point in area 0) or by a given configuration file.
+ *
+ * Packets are injected to the sockets of the instance and go through the
+ * same receive path as in the daemon. The simulated clock follows the
+ * times of the capture. Nothing sent by the instance reaches anyone, so
+ * the captured neighbors never finish database exchange with it. Instead,
+ * the driver creates senders of non-hello packets it does not know yet
+ * (captures usually start in the middle of adjacencies) and moves each
+ * neighbor that should form an adjacency through the neighbor state
+ * machine to Full, so the captured LS updates are processed and flooded
+ * as in the captured network. Hellos list the captured router, so its
+ * router ID has to be used. At the end, the timing of OSPF phases, the
+ * packets sent and the size of the LSDB are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nest/bird.h"
+#include "lib/lists.h"
+#include "lib/resource.h"
+#include "lib/timer.h"
+#include "lib/string.h"
+#include "nest/route.h"
+#include "nest/protocol.h"
+#include "nest/iface.h"
+#include "nest/cli.h"
+#include "nest/locks.h"
+#include "conf/conf.h"
+#include "proto/ospf/ospf.h"
+
+#include "lib/unix.h"
+#include "bench/sim.h"
+
+#define REPLAY_TAIL	10		/* Seconds run after the last packet */
+#define REPLAY_BUFSIZE	65536
+
+struct replay_iface {
+  char name[16];			/* Name in the capture, index is position + 1 */
+  ip_addr ip;				/* Unicast destination, if any was seen */
+  ip_addr peer;				/* First sender */
+  int local;				/* ip is valid */
+  unsigned maxlen;			/* Longest packet */
+};
+
+char *bird_name = "ospf-replay";
+
+static char *router_id;
+static char *config_file;
+static char *proto_opts = "";
+static char *iface_opts = "";
+static int verbose;
+
+static char *capture_name;
+static FILE *capture;
+static byte *buf;
+static struct replay_iface *rifs;
+static unsigned nrifs;
+static u32 first_time, last_time;
+static unsigned records;
+static u32 rx_packets[LSACK_P + 1];
+static u64 rx_bytes[LSACK_P + 1];
+
+static struct proto_ospf *po;
+
+
+/*
+ *	Capture file
+ */
+
+static void
+replay_open(void)
+{
+  struct ospf_capture_file hdr;
+
+  if (!(capture = fopen(capture_name, "r")))
+    die("Cannot open %s: %m", capture_name);
+
+  if ((fread(&hdr, sizeof(hdr), 1, capture) != 1) ||
+      (ntohl(hdr.magic) != OSPF_CAPTURE_MAGIC) ||
+      (ntohs(hdr.version) != OSPF_CAPTURE_VERSION) ||
+      (ntohs(hdr.ospf_version) != OSPF_VERSION))
+    die("%s is not an OSPFv%d capture file", capture_name, OSPF_VERSION);
+}
+
+/* Read the next record to rec and the packet to buf, fields are converted to host order */
+static int
+replay_read(struct ospf_capture_rec *rec)
+{
+  if (fread(rec, sizeof(*rec), 1, capture) != 1)
+  {
+    if (ferror(capture))
+      die("Error reading %s: %m", capture_name);
+    return 0;
+  }
+
+  rec->time = ntohl(rec->time);
+  rec->length = ntohs(rec->length);
+  rec->iface[sizeof(rec->iface) - 1] = 0;
+  ipa_ntoh(rec->src);
+  ipa_ntoh(rec->dst);
+
+  if (rec->length && (fread(buf, BIRD_ALIGN(rec->length, 4), 1, capture) != 1))
+    die("%s is truncated", capture_name);
+
+  return 1;
+}
+
+static unsigned
+replay_iface_find(char *name)
+{
+  unsigned i;
+
+  for (i = 0; i < nrifs; i++)
+    if (!strcmp(rifs[i].name, name))
+      return i + 1;
+
+  return 0;
+}
+
+/* First pass, find interfaces and their addresses */
+static void
+replay_scan(void)
+{
+  struct ospf_capture_rec rec;
+  struct replay_iface *ri;
+  unsigned idx;
+  int c;
+
+  while (replay_read(&rec))
+  {
+    if (!records++)
+      first_time = rec.time;
+    last_time = rec.time;
+
+    if (!(idx = replay_iface_find(rec.iface)))
+    {
+      rifs = xrealloc(rifs, (nrifs + 1) * sizeof(struct replay_iface));
+      ri = &rifs[nrifs++];
+      bzero(ri, sizeof(struct replay_iface));
+      strcpy(ri->name, rec.iface);
+      ri->peer = rec.src;
+      idx = nrifs;
+    }
+
+    ri = &rifs[idx - 1];
+    c = ipa_classify(rec.dst);
+    if (!ri->local && (c >= 0) && (c & IADDR_HOST))
+    {
+      ri->ip = rec.dst;
+      ri->local = 1;
+    }
+    ri->maxlen = MAX(ri->maxlen, rec.length);
+  }
+
+  if (!records)
+    die("%s has no packets", capture_name);
+
+  fseek(capture, sizeof(struct ospf_capture_file), SEEK_SET);
+}
+
+
+/*
+ *	Interfaces
+ */
+
+static void
+replay_ifa_update(struct iface *i, ip_addr ip, unsigned pxlen, int scope)
+{
+  struct ifa a = {};
+
+  a.iface = i;
+  a.ip = ip;
+  a.prefix = ipa_and(ip, ipa_mkmask(pxlen));
+  a.pxlen = pxlen;
+#ifndef IPV6
+  a.brd = ipa_or(ip, ipa_not(ipa_mkmask(pxlen)));
+#endif
+  a.scope = scope;
+  ifa_update(&a);
+}
+
+/*
+ * In IPv4, the address is the unicast destination seen, or the peer with
+ * the two lowest bits flipped, with the longest prefix up to /30 covering
+ * the peer. In IPv6, the interface gets a link-local address and the
+ * global one if it was the destination of a packet.
+ */
+static void
+replay_ifaces(void)
+{
+  struct replay_iface *ri;
+  struct iface f, *i;
+  unsigned idx;
+
+  if_start_update();
+  for (idx = 1; idx <= nrifs; idx++)
+  {
+    ri = &rifs[idx - 1];
+    bzero(&f, sizeof(f));
+    strcpy(f.name, ri->name);
+    f.flags = IF_ADMIN_UP | IF_LINK_UP | IF_MULTIACCESS | IF_BROADCAST | IF_MULTICAST;
+    f.mtu = MAX(1500, ri->maxlen + SIZE_OF_IP_HEADER);
+    f.index = idx;
+    i = if_update(&f);
+
+#ifndef IPV6
+    ip_addr ip = ri->local ? ri->ip : ipa_from_u32(ipa_to_u32(ri->peer) ^ 3);
+    unsigned pxlen = 30;
+
+    while (pxlen && !ipa_in_net(ri->peer, ipa_and(ip, ipa_mkmask(pxlen)), pxlen))
+      pxlen--;
+    replay_ifa_update(i, ip, pxlen, SCOPE_UNIVERSE);
+#else
+    int local_ll = ri->local && ((ipa_classify(ri->ip) & IADDR_SCOPE_MASK) == SCOPE_LINK);
+
+    replay_ifa_update(i, local_ll ? ri->ip : _MI(0xfe800000, 0, 0xffffffff, idx), 64, SCOPE_LINK);
+    if (ri->local && !local_ll)
+      replay_ifa_update(i, ri->ip, 64, SCOPE_UNIVERSE);
+#endif
+  }
+  if_end_update();
+}
+
+
+/*
+ *	Configuration
+ */
+
+static void
+replay_config(void)
+{
+  struct config *c;
+  struct proto_config *pc;
+
+  if (config_file)
+    cf_load(config_file);
+  else
+  {
+    cf_printf("router id %s;\n", router_id);
+    cf_printf("log stderr %s;\n", verbose ? "all" : "{ warning, error, fatal, bug }");
+    cf_printf("protocol ospf replay {\n  router id %s;\n  %s\n", router_id, proto_opts);
+    cf_printf("  area 0 {\n    interface \"*\" { type ptp; %s };\n  };\n}\n", iface_opts);
+  }
+
+  c = cf_parse_text("ospf-replay");
+  config_commit(c, RECONFIG_HARD, 0);
+
+  WALK_LIST(pc, c->protos)
+    if (pc->protocol == &proto_ospf)
+    {
+      po = (struct proto_ospf *) pc->proto;
+      return;
+    }
+
+  die("No OSPF protocol configured");
+}
+
+
+/*
+ *	Replay
+ */
+
+static struct ospf_iface *
+replay_ospf_iface(unsigned idx, ip_addr src)
+{
+  struct ospf_iface *ifa, *res = NULL;
+
+  WALK_LIST(ifa, po->iface_list)
+    if ((ifa->type != OSPF_IT_VLINK) && ifa->sk && (ifa->iface->index == idx))
+    {
+      if (ipa_in_net(src, ifa->addr->prefix, ifa->addr->pxlen))
+	return ifa;
+
+      if (!res)
+	res = ifa;
+    }
+
+  return res;
+}
+
+/* Create the unknown sender of a non-hello packet, as if its hello was seen */
+static void
+replay_neigh(unsigned idx, struct ospf_capture_rec *rec)
+{
+  struct ospf_packet *ps = (struct ospf_packet *) buf;
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+  u32 rid;
+
+  if ((rec->length < sizeof(struct ospf_packet)) || (ps->type == HELLO_P) ||
+      !(ifa = replay_ospf_iface(idx, rec->src)) || (ntohl(ps->areaid) != ifa->oa->areaid))
+    return;
+
+  rid = ntohl(ps->routerid);
+#ifdef OSPFv2
+  if ((ifa->type == OSPF_IT_BCAST) || (ifa->type == OSPF_IT_NBMA) || (ifa->type == OSPF_IT_PTMP))
+    n = find_neigh_by_ip(ifa, rec->src);
+  else
+    n = find_neigh(ifa, rid);
+#else
+  n = find_neigh(ifa, rid);
+#endif
+
+  if (!n && rid && (rid != po->router_id))
+  {
+    n = ospf_neighbor_new(ifa, rid, rec->src);
+    ospf_neigh_sm(n, INM_HELLOREC);
+  }
+}
+
+/* Move neighbors on the way to adjacency to Full */
+static void
+replay_drive(void)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+
+  WALK_LIST(ifa, po->iface_list)
+    WALK_LIST(n, ifa->neigh_list)
+    {
+      if (n->state == NEIGHBOR_INIT)
+	ospf_neigh_sm(n, INM_2WAYREC);
+      if (n->state == NEIGHBOR_EXSTART)
+	ospf_neigh_sm(n, INM_NEGDONE);
+      if (n->state == NEIGHBOR_EXCHANGE)
+	ospf_neigh_sm(n, INM_EXDONE);
+      if (n->state == NEIGHBOR_LOADING)
+	ospf_neigh_sm(n, INM_LOADDONE);
+    }
+}
+
+static void
+replay_run(void)
+{
+  struct ospf_capture_rec rec;
+  struct ospf_packet *ps = (struct ospf_packet *) buf;
+  bird_clock_t at;
+  unsigned idx;
+
+  while (replay_read(&rec))
+  {
+    at = boot_time + (bird_clock_t) (rec.time - first_time);
+    while (now < at)
+    {
+      sim_tick();
+      sim_run();
+    }
+
+    idx = replay_iface_find(rec.iface);
+    replay_neigh(idx, &rec);
+    sim_inject(idx, rec.src, rec.dst, rec.ttl, buf, rec.length);
+    sim_run();
+    replay_drive();
+
+    if ((rec.length >= sizeof(struct ospf_packet)) && (ps->type >= HELLO_P) && (ps->type <= LSACK_P))
+    {
+      rx_packets[ps->type]++;
+      rx_bytes[ps->type] += rec.length;
+    }
+  }
+
+  at = now + REPLAY_TAIL;
+  while (now < at)
+  {
+    sim_tick();
+    sim_run();
+  }
+}
+
+
+/*
+ *	Report
+ */
+
+static void
+replay_report(u64 wall)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+  struct top_hash_entry *en;
+  unsigned adj = 0, lsas = 0, j;
+
+  WALK_LIST(ifa, po->iface_list)
+    WALK_LIST(n, ifa->neigh_list)
+      if (n->state == NEIGHBOR_FULL)
+	adj++;
+
+  WALK_SLIST(en, po->lsal)
+    if (en->lsa_body && (en->lsa.age != LSA_MAXAGE))
+      lsas++;
+
+  printf("OSPF replay of %s: %u records, %u interfaces, %u s of capture\n",
+	 capture_name, records, nrifs, last_time - first_time);
+  printf("  %-20s %u\n", "Full adjacencies", adj);
+  printf("  %-20s %u\n", "LSAs", lsas);
+  printf("  %-20s %u\n", "SPF runs", po->spf_runs);
+
+  printf("\n  %-20s %10s %12s\n", "Packets replayed", "Count", "Bytes");
+  for (j = HELLO_P; j <= LSACK_P; j++)
+    printf("  %-20s %10u %12llu\n", bench_pkt_names[j], rx_packets[j], (unsigned long long) rx_bytes[j]);
+  printf("  %-20s %10llu %12llu\n", "Delivered",
+	 (unsigned long long) sim_stats.packets, (unsigned long long) sim_stats.bytes);
+
+  bench_report_stats(&po, 1);
+
+  printf("\n  %-20s %.3f s\n", "Wall time", wall / 1000000.0);
+  printf("  %-20s %zu kB\n", "Memory", rmemsize(po->proto.pool) / 1024);
+}
+
+
+/*
+ *	Main
+ */
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+	  "Usage: %s -r <router id> [-o <protocol options>] [-i <interface options>] [-v] <capture>\n"
+	  "       %s -c <config file> [-v] <capture>\n", bird_name, bird_name);
+  exit(1);
+}
+
+static void
+parse_args(int argc, char **argv)
+{
+  int c;
+
+  while ((c = getopt(argc, argv, "r:c:o:i:v")) >= 0)
+    switch (c)
+    {
+    case 'r': router_id = optarg; break;
+    case 'c': config_file = optarg; break;
+    case 'o': proto_opts = optarg; break;
+    case 'i': iface_opts = optarg; break;
+    case 'v': verbose = 1; break;
+    default:
+      usage();
+    }
+
+  if ((optind + 1 != argc) || (!router_id == !config_file))
+    usage();
+
+  capture_name = argv[optind];
+}
+
+int
+main(int argc, char **argv)
+{
+  u64 start;
+
+  parse_args(argc, argv);
+  log_switch(0, NULL, NULL);
+
+  buf = xmalloc(REPLAY_BUFSIZE);
+  replay_open();
+  replay_scan();
+
+  resource_init();
+  olock_init();
+  sim_init(nrifs);
+  rt_init();
+  if_init();
+  roa_init();
+  config_init();
+  cli_init();
+  protos_build();
+
+  replay_ifaces();
+  replay_config();
+  sim_run();
+
+  start = tm_now_us();
+  replay_run();
+  replay_report(tm_now_us() - start);
+
+  return 0;
+}
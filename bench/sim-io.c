@@ -0,0 +1,623 @@
+/*
+ *	BIRD -- Simulated Network for Benchmarks
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/**
+ * DOC: Simulated network
+ *
+ * This module replaces the timer and socket parts of sysdep/unix/io.c
+ * when many protocol instances are run inside one process by a benchmark
+ * driver. The clock is virtual and advanced by sim_tick(), so the times
+ * reported by protocols (adjacency times, LSA ages) are seconds of
+ * simulated time, while tm_now_us() still reads the real clock and
+ * measures the CPU cost of the work done.
+ *
+ * Interfaces are numbered by their index (as in &iface) and two of them
+ * may be connected by sim_link(). Only %SK_IP sockets bound to an
+ * interface are supported. A packet sent by sk_send_to() is copied to an
+ * in-memory queue and delivered by sim_run() to the sockets on the other
+ * end of the link: to the socket owning the destination address if there
+ * is one, otherwise (multicast) to all of them. In IPv4 a minimal IP
+ * header is prepended, as raw sockets receive one. Packets from outside
+ * (e.g. read from a capture file) are queued by sim_inject().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nest/bird.h"
+#include "lib/lists.h"
+#include "lib/resource.h"
+#include "lib/timer.h"
+#include "lib/socket.h"
+#include "lib/event.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "nest/iface.h"
+
+#include "bench/sim.h"
+
+#ifdef IPV6
+#define SIM_HDR 0
+#else
+#define SIM_HDR 20
+#endif
+
+struct sim_stats sim_stats;
+
+/*
+ *	Files
+ */
+
+/* Only log files are opened, they live as long as the process */
+void *
+tracked_fopen(pool *p UNUSED, char *name, char *mode)
+{
+  return fopen(name, mode);
+}
+
+void
+rm_file_and_queue_async_config(const char *filename UNUSED)
+{
+  log(L_WARN "Reconfiguration requested, not supported by the simulated network");
+}
+
+/*
+ *	Timers
+ */
+
+#define SIM_WHEEL 1024			/* Buckets of the timer wheel, by expires */
+
+/* Initialized, so that they are not common symbols pulling io.o from birdlib.a */
+bird_clock_t now = 1, now_real = 1, boot_time = 1;
+static list sim_wheel[SIM_WHEEL];
+
+static void
+tm_free(resource *r)
+{
+  timer *t = (timer *) r;
+
+  tm_stop(t);
+}
+
+static void
+tm_dump(resource *r)
+{
+  timer *t = (timer *) r;
+
+  debug("(code %p, data %p, ", t->hook, t->data);
+  if (t->expires)
+    debug("expires in %d sec)\n", t->expires - now);
+  else
+    debug("inactive)\n");
+}
+
+static struct resclass tm_class = {
+  "Timer",
+  sizeof(timer),
+  tm_free,
+  tm_dump,
+  NULL,
+  NULL
+};
+
+timer *
+tm_new(pool *p)
+{
+  timer *t = ralloc(p, &tm_class);
+  return t;
+}
+
+void
+tm_start(timer *t, unsigned after)
+{
+  bird_clock_t when;
+
+  if (t->randomize)
+    after += random() % (t->randomize + 1);
+  when = now + after;
+  if (t->expires == when)
+    return;
+  if (t->expires)
+    rem_node(&t->n);
+  t->expires = when;
+  add_tail(&sim_wheel[when % SIM_WHEEL], &t->n);
+}
+
+void
+tm_stop(timer *t)
+{
+  if (t->expires)
+    {
+      rem_node(&t->n);
+      t->expires = 0;
+    }
+}
+
+void
+tm_dump_all(void)
+{
+}
+
+u64
+tm_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Times are printed as seconds of simulated time */
+void
+tm_format_datetime(char *x, struct timeformat *fmt_spec UNUSED, bird_clock_t t)
+{
+  bsprintf(x, "%d", (int) (t - boot_time));
+}
+
+bird_clock_t
+tm_parse_datetime(char *x UNUSED)
+{
+  return 0;
+}
+
+/*
+ * Expired timers are first moved from their bucket to a private list, so
+ * the hooks may start and stop any timers, including the expired ones.
+ */
+static int
+sim_shot(void)
+{
+  list due;
+  node *n, *m;
+  timer *t;
+  int fired = 0;
+
+  init_list(&due);
+  for (;;)
+    {
+      list *l = &sim_wheel[now % SIM_WHEEL];
+
+      WALK_LIST_DELSAFE(n, m, *l)
+	if (SKIP_BACK(timer, n, n)->expires <= now)
+	  {
+	    rem_node(n);
+	    add_tail(&due, n);
+	  }
+
+      if (EMPTY_LIST(due))
+	return fired;
+
+      while ((n = HEAD(due))->next)
+	{
+	  t = SKIP_BACK(timer, n, n);
+	  rem_node(n);
+	  t->expires = 0;
+	  if (t->recurrent)
+	    tm_start(t, t->recurrent);
+	  t->hook(t);
+	  sim_stats.timers++;
+	  fired++;
+	}
+    }
+}
+
+/*
+ *	Sockets
+ */
+
+struct sim_packet {
+  node n;
+  unsigned ifindex;			/* Receiving interface */
+  ip_addr src, dst;
+  int ttl;
+  int injected;				/* By sim_inject(), the interface need not be linked */
+  unsigned len;
+  byte data[0];
+};
+
+static unsigned sim_ifaces;
+static list *sim_socks;			/* Open sockets by interface index */
+static unsigned *sim_peer;		/* Other end of the link by interface index, 0 if down */
+static list sim_queue;			/* Packets in flight (struct sim_packet) */
+static unsigned sim_queued;
+
+int sk_priority_control = 7;
+
+static void
+sk_alloc_bufs(sock *s)
+{
+  if (!s->rbuf && s->rbsize)
+    s->rbuf = s->rbuf_alloc = xmalloc(s->rbsize);
+  s->rpos = s->rbuf;
+  if (!s->tbuf && s->tbsize)
+    s->tbuf = s->tbuf_alloc = xmalloc(s->tbsize);
+  s->tpos = s->ttx = s->tbuf;
+}
+
+static void
+sk_free_bufs(sock *s)
+{
+  if (s->rbuf_alloc)
+    {
+      xfree(s->rbuf_alloc);
+      s->rbuf = s->rbuf_alloc = NULL;
+    }
+  if (s->tbuf_alloc)
+    {
+      xfree(s->tbuf_alloc);
+      s->tbuf = s->tbuf_alloc = NULL;
+    }
+}
+
+static void
+sk_free(resource *r)
+{
+  sock *s = (sock *) r;
+
+  sk_free_bufs(s);
+  if (s->fd >= 0)
+    rem_node(&s->n);
+}
+
+static void
+sk_dump(resource *r)
+{
+  sock *s = (sock *) r;
+
+  debug("(IP, ud=%p, sa=%I, dp=%d, ttl=%d, if=%s)\n",
+	s->data, s->saddr, s->dport, s->ttl, s->iface ? s->iface->name : "none");
+}
+
+static struct resclass sk_class = {
+  "Socket",
+  sizeof(sock),
+  sk_free,
+  sk_dump,
+  NULL,
+  NULL
+};
+
+sock *
+sock_new(pool *p)
+{
+  sock *s = ralloc(p, &sk_class);
+  s->pool = p;
+  s->tos = s->priority = s->ttl = -1;
+  s->fd = -1;
+  return s;
+}
+
+int
+sk_open(sock *s)
+{
+  if ((s->type != SK_IP) || !s->iface || (s->iface->index > sim_ifaces))
+    {
+      log(L_ERR "Simulated network supports only IP sockets on its interfaces");
+      return -1;
+    }
+
+  /* The interface index serves as the file descriptor */
+  s->fd = s->iface->index;
+  sk_alloc_bufs(s);
+  add_tail(&sim_socks[s->fd], &s->n);
+  return 0;
+}
+
+void
+sk_reallocate(sock *s)
+{
+  sk_free_bufs(s);
+  sk_alloc_bufs(s);
+}
+
+static struct sim_packet *
+sim_queue_packet(unsigned ifindex, ip_addr src, ip_addr dst, int ttl, void *data, unsigned len)
+{
+  struct sim_packet *pkt = xmalloc(sizeof(struct sim_packet) + SIM_HDR + len);
+
+  pkt->ifindex = ifindex;
+  pkt->src = src;
+  pkt->dst = dst;
+  pkt->ttl = ttl;
+  pkt->injected = 0;
+  pkt->len = SIM_HDR + len;
+#ifndef IPV6
+  bzero(pkt->data, SIM_HDR);
+  pkt->data[0] = 0x45;
+  put_u16(pkt->data + 2, pkt->len);
+#endif
+  memcpy(pkt->data + SIM_HDR, data, len);
+
+  add_tail(&sim_queue, &pkt->n);
+  sim_queued++;
+  return pkt;
+}
+
+int
+sk_send_to(sock *s, unsigned len, ip_addr addr, unsigned port UNUSED)
+{
+  unsigned peer = sim_peer[s->fd];
+
+  if (!peer)
+    {
+      sim_stats.dropped++;
+      return 1;
+    }
+
+  sim_queue_packet(peer, s->saddr, addr, (s->ttl < 0) ? 64 : s->ttl, s->tbuf, len);
+  return 1;
+}
+
+int
+sk_send(sock *s, unsigned len)
+{
+  return sk_send_to(s, len, s->daddr, s->dport);
+}
+
+int
+sk_set_ttl(sock *s, int ttl)
+{
+  s->ttl = ttl;
+  return 0;
+}
+
+int
+sk_set_min_ttl(sock *s UNUSED, int ttl UNUSED)
+{
+  return 0;
+}
+
+int
+sk_set_md5_auth(sock *s UNUSED, ip_addr a UNUSED, struct iface *ifa UNUSED, char *passwd UNUSED)
+{
+  log(L_ERR "Simulated network does not support MD5 authentication");
+  return -1;
+}
+
+int
+sk_rx_ready(sock *s UNUSED)
+{
+  return 0;
+}
+
+int
+sk_setup_multicast(sock *s UNUSED)
+{
+  return 0;
+}
+
+int
+sk_join_group(sock *s UNUSED, ip_addr maddr UNUSED)
+{
+  return 0;
+}
+
+int
+sk_leave_group(sock *s UNUSED, ip_addr maddr UNUSED)
+{
+  return 0;
+}
+
+int
+sk_set_broadcast(sock *s UNUSED, int enable UNUSED)
+{
+  return 0;
+}
+
+#ifdef IPV6
+
+int
+sk_set_ipv6_checksum(sock *s UNUSED, int offset UNUSED)
+{
+  return 0;
+}
+
+int
+sk_set_icmp_filter(sock *s UNUSED, int p1 UNUSED, int p2 UNUSED)
+{
+  return 0;
+}
+
+#endif
+
+void
+sk_dump_all(void)
+{
+  unsigned i;
+  node *n;
+
+  debug("Open sockets:\n");
+  for (i = 1; i <= sim_ifaces; i++)
+    WALK_LIST(n, sim_socks[i])
+    {
+      sock *s = SKIP_BACK(sock, n, n);
+      debug("%p ", s);
+      sk_dump(&s->r);
+    }
+  debug("\n");
+}
+
+static void
+sim_rx(sock *s, struct sim_packet *pkt)
+{
+  memcpy(s->rbuf, pkt->data, pkt->len);
+  s->rpos = s->rbuf + pkt->len;
+  s->faddr = pkt->src;
+  s->laddr = pkt->dst;
+  s->lifindex = pkt->ifindex;
+  if (s->flags & SKF_TTL_RX)
+    s->ttl = pkt->ttl;
+
+  if (s->rx_hook(s, pkt->len))
+    s->rpos = s->rbuf;
+
+  sim_stats.packets++;
+  sim_stats.bytes += pkt->len;
+}
+
+/* Packets sent by the rx hooks wait for the next call */
+static int
+sim_deliver(void)
+{
+  struct sim_packet *pkt;
+  unsigned cnt = sim_queued;
+  node *n, *m;
+  sock *s;
+  int ucast;
+
+  for (; cnt; cnt--)
+    {
+      pkt = SKIP_BACK(struct sim_packet, n, HEAD(sim_queue));
+      rem_node(&pkt->n);
+      sim_queued--;
+
+      if (!sim_peer[pkt->ifindex] && !pkt->injected)
+	{
+	  sim_stats.dropped++;
+	  xfree(pkt);
+	  continue;
+	}
+
+      ucast = 0;
+      WALK_LIST(n, sim_socks[pkt->ifindex])
+	if (ipa_equal(SKIP_BACK(sock, n, n)->saddr, pkt->dst))
+	  ucast = 1;
+
+      WALK_LIST_DELSAFE(n, m, sim_socks[pkt->ifindex])
+      {
+	s = SKIP_BACK(sock, n, n);
+	if ((!ucast || ipa_equal(s->saddr, pkt->dst)) && s->rx_hook && (pkt->len <= s->rbsize))
+	  sim_rx(s, pkt);
+      }
+
+      xfree(pkt);
+    }
+
+  return sim_queued;
+}
+
+/*
+ *	Main loop
+ */
+
+/**
+ * sim_init - initialize the simulated network
+ * @ifaces: number of interfaces, they have indices 1 to @ifaces
+ */
+void
+sim_init(unsigned ifaces)
+{
+  unsigned i;
+
+  for (i = 0; i < SIM_WHEEL; i++)
+    init_list(&sim_wheel[i]);
+  init_list(&sim_queue);
+  init_list(&global_event_list);
+
+  sim_ifaces = ifaces;
+  sim_socks = xmalloc((ifaces + 1) * sizeof(list));
+  for (i = 0; i <= ifaces; i++)
+    init_list(&sim_socks[i]);
+  sim_peer = xmalloc((ifaces + 1) * sizeof(unsigned));
+  bzero(sim_peer, (ifaces + 1) * sizeof(unsigned));
+
+  now = boot_time = 1;
+  now_real = time(NULL);
+}
+
+/**
+ * sim_link - connect two interfaces
+ * @a: index of the first interface
+ * @b: index of the second interface
+ */
+void
+sim_link(unsigned a, unsigned b)
+{
+  sim_peer[a] = b;
+  sim_peer[b] = a;
+}
+
+/**
+ * sim_unlink - disconnect an interface
+ * @a: index of the interface
+ *
+ * Packets sent to or from @a are lost from now on, including those
+ * already queued for delivery.
+ */
+void
+sim_unlink(unsigned a)
+{
+  unsigned b = sim_peer[a];
+
+  sim_peer[a] = 0;
+  if (b)
+    sim_peer[b] = 0;
+}
+
+/**
+ * sim_inject - receive a packet from outside of the simulated network
+ * @ifindex: receiving interface
+ * @src: source address
+ * @dst: destination address
+ * @ttl: TTL of the packet
+ * @data: packet without IP header
+ * @len: length of @data
+ *
+ * The packet is delivered by the next sim_run() as if it came over a link
+ * to @ifindex, which need not be connected.
+ */
+void
+sim_inject(unsigned ifindex, ip_addr src, ip_addr dst, int ttl, void *data, unsigned len)
+{
+  sim_queue_packet(ifindex, src, dst, ttl, data, len)->injected = 1;
+}
+
+/**
+ * sim_run - process everything due at the current time
+ *
+ * Runs events, delivers packets and calls expired timers until none of
+ * them is left. Delivery takes no simulated time.
+ *
+ * Result: nonzero if anything was done.
+ */
+int
+sim_run(void)
+{
+  int busy, any = 0;
+
+  do
+    {
+      busy = 0;
+      if (!EMPTY_LIST(global_event_list))
+	{
+	  ev_run_list(&global_event_list);
+	  sim_stats.events++;
+	  busy = 1;
+	}
+      if (sim_queued)
+	{
+	  sim_deliver();
+	  busy = 1;
+	}
+      if (sim_shot())
+	busy = 1;
+      any |= busy;
+    }
+  while (busy);
+
+  return any;
+}
+
+/**
+ * sim_tick - advance the simulated clock by one second
+ */
+void
+sim_tick(void)
+{
+  now++;
+  now_real++;
+}
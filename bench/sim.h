@@ -0,0 +1,40 @@
+/*
+ *	BIRD -- Simulated Network for Benchmarks
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_BENCH_SIM_H_
+#define _BIRD_BENCH_SIM_H_
+
+struct sim_stats {
+  u64 packets;			/* Packets delivered to sockets */
+  u64 bytes;			/* Bytes of these, including IP header in IPv4 */
+  u64 dropped;			/* Packets lost on links that were down */
+  u64 timers;			/* Timer hooks called */
+  u64 events;			/* Rounds of the global event list */
+};
+
+extern struct sim_stats sim_stats;
+
+/* sim-io.c */
+
+void sim_init(unsigned ifaces);
+void sim_link(unsigned a, unsigned b);
+void sim_unlink(unsigned a);
+int sim_run(void);
+void sim_tick(void);
+void sim_inject(unsigned ifindex, ip_addr src, ip_addr dst, int ttl, void *data, unsigned len);
+
+/* glue.c */
+
+struct proto_ospf;
+
+extern char *bench_pkt_names[];
+
+void cf_printf(char *fmt, ...);
+void cf_load(char *name);
+struct config *cf_parse_text(char *name);
+void bench_report_stats(struct proto_ospf **po, unsigned cnt);
+
+#endif
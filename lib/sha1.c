@@ -0,0 +1,154 @@
+/*
+ *	BIRD Library -- SHA-1 Hash Function and HMAC (RFC 3174, RFC 2104)
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "nest/bird.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "lib/sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_transform(u32 *h, const byte *data, unsigned blocks)
+{
+  u32 w[80], a, b, c, d, e, t;
+  int i;
+
+  for (; blocks--; data += SHA1_BLOCK_SIZE)
+  {
+    for (i = 0; i < 16; i++)
+      w[i] = get_u32((byte *) data + 4 * i);
+    for (; i < 80; i++)
+      w[i] = ROL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+    for (i = 0; i < 80; i++)
+    {
+      if (i < 20)
+	t = ((b & c) | (~b & d)) + 0x5a827999;
+      else if (i < 40)
+	t = (b ^ c ^ d) + 0x6ed9eba1;
+      else if (i < 60)
+	t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+      else
+	t = (b ^ c ^ d) + 0xca62c1d6;
+
+      t += ROL(a, 5) + e + w[i];
+      e = d; d = c; c = ROL(b, 30); b = a; a = t;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+}
+
+void
+sha1_init(struct sha1_context *ctx)
+{
+  ctx->h[0] = 0x67452301;
+  ctx->h[1] = 0xefcdab89;
+  ctx->h[2] = 0x98badcfe;
+  ctx->h[3] = 0x10325476;
+  ctx->h[4] = 0xc3d2e1f0;
+  ctx->len = 0;
+}
+
+void
+sha1_update(struct sha1_context *ctx, const byte *data, unsigned len)
+{
+  unsigned pos = ctx->len % SHA1_BLOCK_SIZE;
+  unsigned n;
+
+  ctx->len += len;
+
+  if (pos)
+  {
+    n = MIN(len, SHA1_BLOCK_SIZE - pos);
+    memcpy(ctx->buf + pos, data, n);
+    data += n;
+    len -= n;
+
+    if (pos + n < SHA1_BLOCK_SIZE)
+      return;
+
+    sha1_transform(ctx->h, ctx->buf, 1);
+  }
+
+  if (n = len / SHA1_BLOCK_SIZE)
+  {
+    sha1_transform(ctx->h, data, n);
+    data += n * SHA1_BLOCK_SIZE;
+    len -= n * SHA1_BLOCK_SIZE;
+  }
+
+  memcpy(ctx->buf, data, len);
+}
+
+void
+sha1_final(struct sha1_context *ctx, byte *digest)
+{
+  unsigned pos = ctx->len % SHA1_BLOCK_SIZE;
+  u64 bits = ctx->len * 8;
+  int i;
+
+  ctx->buf[pos++] = 0x80;
+  if (pos > SHA1_BLOCK_SIZE - 8)
+  {
+    bzero(ctx->buf + pos, SHA1_BLOCK_SIZE - pos);
+    sha1_transform(ctx->h, ctx->buf, 1);
+    pos = 0;
+  }
+
+  bzero(ctx->buf + pos, SHA1_BLOCK_SIZE - 8 - pos);
+  put_u32(ctx->buf + SHA1_BLOCK_SIZE - 8, bits >> 32);
+  put_u32(ctx->buf + SHA1_BLOCK_SIZE - 4, bits);
+  sha1_transform(ctx->h, ctx->buf, 1);
+
+  for (i = 0; i < 5; i++)
+    put_u32(digest + 4 * i, ctx->h[i]);
+}
+
+void
+sha1_hmac_init(struct sha1_hmac_context *ctx, const byte *key, unsigned keylen)
+{
+  byte buf[SHA1_BLOCK_SIZE];
+  int i;
+
+  bzero(buf, sizeof(buf));
+  if (keylen > SHA1_BLOCK_SIZE)
+  {
+    sha1_init(&ctx->ictx);
+    sha1_update(&ctx->ictx, key, keylen);
+    sha1_final(&ctx->ictx, buf);
+  }
+  else
+    memcpy(buf, key, keylen);
+
+  for (i = 0; i < SHA1_BLOCK_SIZE; i++)
+    buf[i] ^= 0x36;
+  sha1_init(&ctx->ictx);
+  sha1_update(&ctx->ictx, buf, SHA1_BLOCK_SIZE);
+
+  for (i = 0; i < SHA1_BLOCK_SIZE; i++)
+    buf[i] ^= 0x36 ^ 0x5c;
+  sha1_init(&ctx->octx);
+  sha1_update(&ctx->octx, buf, SHA1_BLOCK_SIZE);
+}
+
+void
+sha1_hmac(struct sha1_hmac_context *ctx, const byte *data, unsigned len, byte *mac)
+{
+  struct sha1_context c;
+  byte dg[SHA1_SIZE];
+
+  c = ctx->ictx;
+  sha1_update(&c, data, len);
+  sha1_final(&c, dg);
+
+  c = ctx->octx;
+  sha1_update(&c, dg, SHA1_SIZE);
+  sha1_final(&c, mac);
+}
@@ -0,0 +1,35 @@
+/*
+ *	BIRD Library -- SHA-1 Hash Function and HMAC
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_SHA1_H_
+#define _BIRD_SHA1_H_
+
+#define SHA1_SIZE	20	/* Size of digest */
+#define SHA1_BLOCK_SIZE	64
+
+struct sha1_context {
+  u32 h[5];
+  u64 len;			/* Number of bytes hashed so far */
+  byte buf[SHA1_BLOCK_SIZE];	/* Partial block, len % SHA1_BLOCK_SIZE bytes */
+};
+
+void sha1_init(struct sha1_context *ctx);
+void sha1_update(struct sha1_context *ctx, const byte *data, unsigned len);
+void sha1_final(struct sha1_context *ctx, byte *digest);
+
+/*
+ * HMAC context keeps hash states after the inner and outer padded key, so
+ * computing a MAC costs just hashing of the data and of the inner digest.
+ */
+struct sha1_hmac_context {
+  struct sha1_context ictx;
+  struct sha1_context octx;
+};
+
+void sha1_hmac_init(struct sha1_hmac_context *ctx, const byte *key, unsigned keylen);
+void sha1_hmac(struct sha1_hmac_context *ctx, const byte *data, unsigned len, byte *mac);
+
+#endif /* _BIRD_SHA1_H_ */
@@ -0,0 +1,259 @@
+/*
+ *	BIRD Library -- SHA-256 Hash Function and HMAC (FIPS 180-4, RFC 2104)
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+/*
+ * Besides the portable implementation, the block transform has a variant
+ * using x86 SHA extensions (SHA-NI). It is selected at runtime by CPUID when
+ * the first context is initialized.
+ */
+
+#include "nest/bird.h"
+#include "lib/string.h"
+#include "lib/unaligned.h"
+#include "lib/sha256.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define SHA256_SHANI
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+static const u32 sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_transform_generic(u32 *h, const byte *data, unsigned blocks)
+{
+  u32 w[64], s[8], t1, t2;
+  int i;
+
+  for (; blocks--; data += SHA256_BLOCK_SIZE)
+  {
+    for (i = 0; i < 16; i++)
+      w[i] = get_u32((byte *) data + 4 * i);
+    for (; i < 64; i++)
+      w[i] = w[i-16] + (ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3)) +
+	w[i-7] + (ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10));
+
+    memcpy(s, h, sizeof(s));
+
+    for (i = 0; i < 64; i++)
+    {
+      t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+	((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+      t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+	((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+      s[7] = s[6]; s[6] = s[5]; s[5] = s[4]; s[4] = s[3] + t1;
+      s[3] = s[2]; s[2] = s[1]; s[1] = s[0]; s[0] = t1 + t2;
+    }
+
+    for (i = 0; i < 8; i++)
+      h[i] += s[i];
+  }
+}
+
+#ifdef SHA256_SHANI
+
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_transform_shani(u32 *h, const byte *data, unsigned blocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i st0, st1, abef, cdgh, msg, tmp, w[4];
+  int g;
+
+  /* Reorder state to ABEF and CDGH */
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *) &h[0]), 0xb1);
+  st1 = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *) &h[4]), 0x1b);
+  st0 = _mm_alignr_epi8(tmp, st1, 8);
+  st1 = _mm_blend_epi16(st1, tmp, 0xf0);
+
+  for (; blocks--; data += SHA256_BLOCK_SIZE)
+  {
+    abef = st0;
+    cdgh = st1;
+
+    /* Four rounds per group, message schedule is kept in ring w[] */
+    for (g = 0; g < 16; g++)
+    {
+      if (g < 4)
+	w[g] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (data + 16 * g)), mask);
+      else
+      {
+	tmp = _mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]);
+	tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+	w[g & 3] = _mm_sha256msg2_epu32(tmp, w[(g + 3) & 3]);
+      }
+
+      msg = _mm_add_epi32(w[g & 3], _mm_loadu_si128((__m128i *) &sha256_k[4 * g]));
+      st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      st0 = _mm_sha256rnds2_epu32(st0, st1, msg);
+    }
+
+    st0 = _mm_add_epi32(st0, abef);
+    st1 = _mm_add_epi32(st1, cdgh);
+  }
+
+  /* Reorder state back to ABCD and EFGH */
+  tmp = _mm_shuffle_epi32(st0, 0x1b);
+  st1 = _mm_shuffle_epi32(st1, 0xb1);
+  st0 = _mm_blend_epi16(tmp, st1, 0xf0);
+  st1 = _mm_alignr_epi8(st1, tmp, 8);
+  _mm_storeu_si128((__m128i *) &h[0], st0);
+  _mm_storeu_si128((__m128i *) &h[4], st1);
+}
+
+static int
+sha256_have_shani(void)
+{
+  unsigned a, b, c, d;
+
+  /* SSSE3 and SSE4.1 */
+  if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & (1 << 9)) || !(c & (1 << 19)))
+    return 0;
+
+  /* SHA */
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+
+  __cpuid_count(7, 0, a, b, c, d);
+  return !!(b & (1 << 29));
+}
+
+#endif
+
+static void (*sha256_transform)(u32 *h, const byte *data, unsigned blocks);
+
+void
+sha256_init(struct sha256_context *ctx)
+{
+  if (!sha256_transform)
+  {
+    sha256_transform = sha256_transform_generic;
+#ifdef SHA256_SHANI
+    if (sha256_have_shani())
+      sha256_transform = sha256_transform_shani;
+#endif
+  }
+
+  ctx->h[0] = 0x6a09e667;
+  ctx->h[1] = 0xbb67ae85;
+  ctx->h[2] = 0x3c6ef372;
+  ctx->h[3] = 0xa54ff53a;
+  ctx->h[4] = 0x510e527f;
+  ctx->h[5] = 0x9b05688c;
+  ctx->h[6] = 0x1f83d9ab;
+  ctx->h[7] = 0x5be0cd19;
+  ctx->len = 0;
+}
+
+void
+sha256_update(struct sha256_context *ctx, const byte *data, unsigned len)
+{
+  unsigned pos = ctx->len % SHA256_BLOCK_SIZE;
+  unsigned n;
+
+  ctx->len += len;
+
+  if (pos)
+  {
+    n = MIN(len, SHA256_BLOCK_SIZE - pos);
+    memcpy(ctx->buf + pos, data, n);
+    data += n;
+    len -= n;
+
+    if (pos + n < SHA256_BLOCK_SIZE)
+      return;
+
+    sha256_transform(ctx->h, ctx->buf, 1);
+  }
+
+  if (n = len / SHA256_BLOCK_SIZE)
+  {
+    sha256_transform(ctx->h, data, n);
+    data += n * SHA256_BLOCK_SIZE;
+    len -= n * SHA256_BLOCK_SIZE;
+  }
+
+  memcpy(ctx->buf, data, len);
+}
+
+void
+sha256_final(struct sha256_context *ctx, byte *digest)
+{
+  unsigned pos = ctx->len % SHA256_BLOCK_SIZE;
+  u64 bits = ctx->len * 8;
+  int i;
+
+  ctx->buf[pos++] = 0x80;
+  if (pos > SHA256_BLOCK_SIZE - 8)
+  {
+    bzero(ctx->buf + pos, SHA256_BLOCK_SIZE - pos);
+    sha256_transform(ctx->h, ctx->buf, 1);
+    pos = 0;
+  }
+
+  bzero(ctx->buf + pos, SHA256_BLOCK_SIZE - 8 - pos);
+  put_u32(ctx->buf + SHA256_BLOCK_SIZE - 8, bits >> 32);
+  put_u32(ctx->buf + SHA256_BLOCK_SIZE - 4, bits);
+  sha256_transform(ctx->h, ctx->buf, 1);
+
+  for (i = 0; i < 8; i++)
+    put_u32(digest + 4 * i, ctx->h[i]);
+}
+
+void
+sha256_hmac_init(struct sha256_hmac_context *ctx, const byte *key, unsigned keylen)
+{
+  byte buf[SHA256_BLOCK_SIZE];
+  int i;
+
+  bzero(buf, sizeof(buf));
+  if (keylen > SHA256_BLOCK_SIZE)
+  {
+    sha256_init(&ctx->ictx);
+    sha256_update(&ctx->ictx, key, keylen);
+    sha256_final(&ctx->ictx, buf);
+  }
+  else
+    memcpy(buf, key, keylen);
+
+  for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+    buf[i] ^= 0x36;
+  sha256_init(&ctx->ictx);
+  sha256_update(&ctx->ictx, buf, SHA256_BLOCK_SIZE);
+
+  for (i = 0; i < SHA256_BLOCK_SIZE; i++)
+    buf[i] ^= 0x36 ^ 0x5c;
+  sha256_init(&ctx->octx);
+  sha256_update(&ctx->octx, buf, SHA256_BLOCK_SIZE);
+}
+
+void
+sha256_hmac(struct sha256_hmac_context *ctx, const byte *data, unsigned len, byte *mac)
+{
+  struct sha256_context c;
+  byte dg[SHA256_SIZE];
+
+  c = ctx->ictx;
+  sha256_update(&c, data, len);
+  sha256_final(&c, dg);
+
+  c = ctx->octx;
+  sha256_update(&c, dg, SHA256_SIZE);
+  sha256_final(&c, mac);
+}
@@ -0,0 +1,35 @@
+/*
+ *	BIRD Library -- SHA-256 Hash Function and HMAC
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_SHA256_H_
+#define _BIRD_SHA256_H_
+
+#define SHA256_SIZE	32	/* Size of digest */
+#define SHA256_BLOCK_SIZE	64
+
+struct sha256_context {
+  u32 h[8];
+  u64 len;			/* Number of bytes hashed so far */
+  byte buf[SHA256_BLOCK_SIZE];	/* Partial block, len % SHA256_BLOCK_SIZE bytes */
+};
+
+void sha256_init(struct sha256_context *ctx);
+void sha256_update(struct sha256_context *ctx, const byte *data, unsigned len);
+void sha256_final(struct sha256_context *ctx, byte *digest);
+
+/*
+ * HMAC context keeps hash states after the inner and outer padded key, so
+ * computing a MAC costs just hashing of the data and of the inner digest.
+ */
+struct sha256_hmac_context {
+  struct sha256_context ictx;
+  struct sha256_context octx;
+};
+
+void sha256_hmac_init(struct sha256_hmac_context *ctx, const byte *key, unsigned keylen);
+void sha256_hmac(struct sha256_hmac_context *ctx, const byte *data, unsigned len, byte *mac);
+
+#endif /* _BIRD_SHA256_H_ */
@@ -8,6 +8,7 @@
 
 #include "nest/bird.h"
 #include "nest/route.h"
+#include "nest/protocol.h"
 #include "nest/cli.h"
 #include "conf/conf.h"
 #include "nest/cmds.h"
@@ -63,7 +64,7 @@ cmd_show_symbols(struct sym_show_data *sd)
     }
 }
 
-static void
+void
 print_size(char *dsc, size_t val)
 {
   char *px = " kMG";
@@ -90,6 +91,12 @@ cmd_show_memory(void)
   print_size("Route attributes:", rmemsize(rta_pool));
   print_size("ROA tables:", rmemsize(roa_pool));
   print_size("Protocols:", rmemsize(proto_pool));
+
+  struct proto *p;
+  WALK_LIST(p, active_proto_list)
+    if (p->proto->show_memory)
+      p->proto->show_memory(p);
+
   print_size("Total:", rmemsize(&root_pool));
   cli_msg(0, "");
 }
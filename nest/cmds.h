@@ -16,4 +16,5 @@ struct f_inst;
 void cmd_show_status(void);
 void cmd_show_symbols(struct sym_show_data *sym);
 void cmd_show_memory(void);
+void print_size(char *dsc, size_t val);
 void cmd_eval(struct f_inst *expr);
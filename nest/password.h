@@ -13,10 +13,17 @@
 
 #define MD5_AUTH_SIZE 16
 
+/* Authentication algorithms */
+#define ALG_UNDEFINED	0	/* Protocol default */
+#define ALG_MD5		1	/* Keyed MD5 */
+#define ALG_HMAC_SHA1	2
+#define ALG_HMAC_SHA256	3
+
 struct password_item {
   node n;
   char *password;
   int id;
+  int alg;			/* ALG_*, for cryptographic authentication */
   bird_clock_t accfrom, accto, genfrom, gento;
 };
 
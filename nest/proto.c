@@ -31,6 +31,7 @@ list active_proto_list;
 static list inactive_proto_list;
 static list initial_proto_list;
 static list flush_proto_list;
+static list proto_gr_list;		/* Graceful restart state by protocol name */
 static struct proto *initial_device_proto;
 
 static event *proto_flush_event;
@@ -760,6 +761,7 @@ protos_build(void)
   init_list(&inactive_proto_list);
   init_list(&initial_proto_list);
   init_list(&flush_proto_list);
+  init_list(&proto_gr_list);
   proto_build(&proto_device);
 #ifdef CONFIG_RADV
   proto_build(&proto_radv);
@@ -1087,6 +1089,146 @@ proto_notify_limit(struct announce_hook *ah, struct proto_limit *l, int dir, u32
     }
 }
 
+/*
+ * Routes of a protocol doing graceful restart are kept in the kernel
+ * forwarding table while the protocol relearns them. The protocol takes
+ * a lock for the restart and may also ask for a hold of a given time,
+ * which survives the protocol instance (e.g. when it is restarted by
+ * reconfiguration) and tells the next instance that the restart was
+ * prepared. The state is kept by protocol name and kernel syncers keep
+ * only withdrawn routes whose source is restarting (proto_gr_active()).
+ */
+
+struct proto_gr {
+  node n;
+  char *name;
+  unsigned id;				/* Nonzero, stored by kernel syncers */
+  int locks;
+  bird_clock_t until;			/* End of hold */
+};
+
+#define PROTO_GR_MAX_ID 255		/* IDs are stored in a byte of fib node */
+
+static unsigned proto_gr_ids;
+
+static struct proto_gr *
+proto_gr_find(struct proto *p, int create)
+{
+  struct proto_gr *g;
+
+  WALK_LIST(g, proto_gr_list)
+    if (!strcmp(g->name, p->name))
+      return g;
+
+  if (!create || (proto_gr_ids >= PROTO_GR_MAX_ID))
+    return NULL;
+
+  g = mb_allocz(proto_pool, sizeof(struct proto_gr));
+  g->name = mb_alloc(proto_pool, strlen(p->name) + 1);
+  strcpy(g->name, p->name);
+  g->id = ++proto_gr_ids;
+  add_tail(&proto_gr_list, &g->n);
+  return g;
+}
+
+/**
+ * proto_gr_lock - start graceful restart of a protocol
+ * @p: restarting protocol
+ *
+ * Kernel syncers do not remove routes of the protocol missing in the
+ * routing table until a matching proto_gr_unlock() is called.
+ */
+void
+proto_gr_lock(struct proto *p)
+{
+  struct proto_gr *g = proto_gr_find(p, 1);
+
+  if (g)
+    g->locks++;
+}
+
+/**
+ * proto_gr_unlock - finish graceful restart of a protocol
+ * @p: restarting protocol
+ *
+ * When the last lock is released, any pending hold is cancelled too.
+ */
+void
+proto_gr_unlock(struct proto *p)
+{
+  struct proto_gr *g = proto_gr_find(p, 0);
+
+  if (!g)
+    return;
+
+  ASSERT(g->locks > 0);
+  if (!--g->locks)
+    g->until = 0;
+}
+
+/**
+ * proto_gr_hold - keep stale routes for a given time
+ * @p: protocol shutting down
+ * @time: time in seconds
+ *
+ * This is used by a protocol shutting down gracefully, so its routes
+ * are kept until the restarted protocol takes a lock.
+ */
+void
+proto_gr_hold(struct proto *p, unsigned time)
+{
+  struct proto_gr *g = proto_gr_find(p, 1);
+
+  if (g && (g->until < now + (bird_clock_t) time))
+    g->until = now + time;
+}
+
+/**
+ * proto_gr_prepared - check whether a restart was prepared
+ * @p: starting protocol
+ *
+ * Returns 1 if the previous instance of the protocol was shut down
+ * gracefully and its hold has not expired yet.
+ */
+int
+proto_gr_prepared(struct proto *p)
+{
+  struct proto_gr *g = proto_gr_find(p, 0);
+
+  return g && (g->until > now);
+}
+
+/**
+ * proto_gr_active - check whether routes of a protocol are kept
+ * @p: source protocol of a route
+ *
+ * Returns a nonzero ID of the restart if the protocol is restarting,
+ * which may be later checked by proto_gr_id_active(), or 0 otherwise.
+ */
+unsigned
+proto_gr_active(struct proto *p)
+{
+  struct proto_gr *g;
+
+  if (EMPTY_LIST(proto_gr_list))
+    return 0;
+
+  g = proto_gr_find(p, 0);
+  return (g && (g->locks || (g->until > now))) ? g->id : 0;
+}
+
+int
+proto_gr_id_active(unsigned id)
+{
+  struct proto_gr *g;
+
+  WALK_LIST(g, proto_gr_list)
+    if (g->id == id)
+      return g->locks || (g->until > now);
+
+  return 0;
+}
+
 /**
  * proto_notify_state - notify core about protocol state change
  * @p: protocol the state of which has changed
@@ -55,6 +55,7 @@ struct protocol {
   void (*get_route_info)(struct rte *, byte *buf, struct ea_list *attrs); /* Get route information (for `show route' command) */
   int (*get_attr)(struct eattr *, byte *buf, int buflen);	/* ASCIIfy dynamic attribute (returns GA_*) */
   void (*show_proto_info)(struct proto *);	/* Show protocol info (for `show protocols all' command) */
+  void (*show_memory)(struct proto *);		/* Show protocol memory details (for `show memory' command) */
   void (*copy_config)(struct proto_config *, struct proto_config *);	/* Copy config from given protocol instance */
 };
 
@@ -321,6 +322,17 @@ extern list active_proto_list;
 
 void proto_notify_state(struct proto *p, unsigned state);
 
+/*
+ *	Graceful restart
+ */
+
+void proto_gr_lock(struct proto *p);
+void proto_gr_unlock(struct proto *p);
+void proto_gr_hold(struct proto *p, unsigned time);
+int proto_gr_prepared(struct proto *p);
+unsigned proto_gr_active(struct proto *p);
+int proto_gr_id_active(unsigned id);
+
 /*
  *  [F] The feeder machine: (implemented in core routines)
  *
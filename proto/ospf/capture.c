@@ -0,0 +1,99 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include <stdio.h>
+
+#include "ospf.h"
+
+/*
+ * Packet capture writes every packet accepted by ospf_rx_hook() for a
+ * known interface to a binary file (see capture.h for the format), so a
+ * flooding storm can be reproduced and profiled offline. Writes go through
+ * the stdio buffer, which is flushed on each dispatcher tick. When a write
+ * fails, the capture is closed. Captures are replayed by the standalone
+ * bench/ospf-replay driver.
+ */
+
+void
+ospf_capture_open(struct proto_ospf *po, char *name)
+{
+  struct proto *p = &po->proto;
+  struct ospf_capture_file hdr;
+  FILE *f;
+
+  ospf_capture_close(po);
+
+  if (!name)
+    return;
+
+  if (!(f = fopen(name, "w")))
+  {
+    log(L_ERR "%s: Cannot open capture file %s: %m", p->name, name);
+    return;
+  }
+
+  hdr.magic = htonl(OSPF_CAPTURE_MAGIC);
+  hdr.version = htons(OSPF_CAPTURE_VERSION);
+  hdr.ospf_version = htons(OSPF_VERSION);
+  if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+  {
+    log(L_ERR "%s: Error writing capture file %s: %m", p->name, name);
+    fclose(f);
+    return;
+  }
+
+  OSPF_TRACE(D_EVENTS, "Capturing packets to %s", name);
+  po->capture = f;
+}
+
+void
+ospf_capture_close(struct proto_ospf *po)
+{
+  if (!po->capture)
+    return;
+
+  fclose(po->capture);
+  po->capture = NULL;
+}
+
+void
+ospf_capture_flush(struct proto_ospf *po)
+{
+  struct proto *p = &po->proto;
+
+  if (po->capture && fflush(po->capture))
+  {
+    log(L_ERR "%s: Error writing capture file: %m", p->name);
+    ospf_capture_close(po);
+  }
+}
+
+void
+ospf_capture_packet(struct ospf_iface *ifa, sock *sk, void *pkt, int size)
+{
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
+  struct ospf_capture_rec rec;
+  static u32 pad = 0;
+
+  bzero(&rec, sizeof(rec));
+  rec.time = htonl(now_real);
+  rec.length = htons(size);
+  rec.ttl = sk->ttl;
+  memcpy(rec.iface, ifa->iface->name, sizeof(rec.iface));
+  rec.src = sk->faddr;
+  rec.dst = sk->laddr;
+  ipa_hton(rec.src);
+  ipa_hton(rec.dst);
+
+  if ((fwrite(&rec, sizeof(rec), 1, po->capture) != 1) ||
+      (size && (fwrite(pkt, size, 1, po->capture) != 1)) ||
+      ((size % 4) && (fwrite(&pad, 4 - (size % 4), 1, po->capture) != 1)))
+  {
+    log(L_ERR "%s: Error writing capture file: %m", p->name);
+    ospf_capture_close(po);
+  }
+}
@@ -0,0 +1,43 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_OSPF_CAPTURE_H_
+#define _BIRD_OSPF_CAPTURE_H_
+
+/*
+ * Capture file format. The file starts with struct ospf_capture_file,
+ * followed by records. Each record is struct ospf_capture_rec followed by
+ * the OSPF packet (without IP header) as received, padded to a multiple of
+ * 4 bytes. All fields are in network byte order.
+ */
+
+#define OSPF_CAPTURE_MAGIC	0x4f535043	/* "OSPC" */
+#define OSPF_CAPTURE_VERSION	1
+
+struct ospf_capture_file
+{
+  u32 magic;
+  u16 version;
+  u16 ospf_version;		/* 2 or 3, defines size of addresses */
+};
+
+struct ospf_capture_rec
+{
+  u32 time;			/* Real time of reception (seconds) */
+  u16 length;			/* Length of packet data */
+  u8 ttl;
+  u8 padding;
+  char iface[16];		/* Name of receiving interface */
+  ip_addr src;
+  ip_addr dst;
+};
+
+void ospf_capture_open(struct proto_ospf *po, char *name);
+void ospf_capture_close(struct proto_ospf *po);
+void ospf_capture_flush(struct proto_ospf *po);
+void ospf_capture_packet(struct ospf_iface *ifa, sock *sk, void *pkt, int size);
+
+#endif /* _BIRD_OSPF_CAPTURE_H_ */
@@ -21,6 +21,10 @@ struct ospf_dbdes_packet
 
 #define hton_opt(X) X
 #define ntoh_opt(X) X
+
+/* Neighbors flood opaque LSAs (grace-LSAs) to us only if we set O-bit,
+   types 9-11 are all accepted (stored and flooded) */
+#define dbdes_opt(ifa) ((ifa)->oa->options | OPT_O)
 #endif
 
 
@@ -37,6 +41,8 @@ struct ospf_dbdes_packet
 
 #define hton_opt(X) htonl(X)
 #define ntoh_opt(X) ntohl(X)
+
+#define dbdes_opt(ifa) ((ifa)->oa->options | ospf_auth_opt(ifa))
 #endif
 
   
@@ -63,6 +69,65 @@ static void ospf_dump_dbdes(struct proto *p, struct ospf_dbdes_packet *pkt)
 }
 
 
+/**
+ * ospf_dbdes_snap_get - assign database summary snapshot to a neighbor
+ * @n: neighbor entering Exchange state
+ *
+ * The current snapshot of the interface is reused if the LSA db has not
+ * changed since it was taken, otherwise a new one is taken. LSAs changed
+ * later are flooded to the neighbor, as it is already in Exchange state.
+ */
+void
+ospf_dbdes_snap_get(struct ospf_neighbor *n)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct proto_ospf *po = ifa->oa->po;
+  struct ospf_dbdes_snap *s = ifa->dbsnap;
+  struct top_hash_entry *en;
+
+  ospf_dbdes_snap_put(n);
+
+  if (!s || (s->gen != po->lsdb_gen))
+  {
+    s = mb_alloc(ifa->pool, sizeof(struct ospf_dbdes_snap) +
+		 po->gr->hash_entries * sizeof(struct ospf_lsa_header));
+    s->gen = po->lsdb_gen;
+    s->refs = 0;
+    s->count = 0;
+
+    WALK_SLIST(en, po->lsal)
+      if (ospf_lsa_flooding_allowed(&en->lsa, en->domain, ifa))
+      {
+	lsa_update_age(en);
+	htonlsah(&en->lsa, &s->lsa[s->count++]);
+      }
+
+    /* Older snapshot, if any, stays with its neighbors */
+    ifa->dbsnap = s;
+  }
+
+  s->refs++;
+  n->dbsnap = s;
+  n->dbpos = 0;
+}
+
+void
+ospf_dbdes_snap_put(struct ospf_neighbor *n)
+{
+  struct ospf_dbdes_snap *s = n->dbsnap;
+
+  if (!s)
+    return;
+
+  n->dbsnap = NULL;
+  if (--s->refs)
+    return;
+
+  if (n->ifa->dbsnap == s)
+    n->ifa->dbsnap = NULL;
+  mb_free(s);
+}
+
 /**
  * ospf_dbdes_send - transmit database description packet
  * @n: neighbor
@@ -83,7 +148,7 @@ ospf_dbdes_send(struct ospf_neighbor *n, int next)
   struct ospf_area *oa = ifa->oa;
   struct proto_ospf *po = oa->po;
   struct proto *p = &po->proto;
-  u16 length, i, j;
+  u16 length;
 
   /* FIXME ??? */
   if ((oa->rt == NULL) || (EMPTY_LIST(po->lsal)))
@@ -97,7 +162,7 @@ ospf_dbdes_send(struct ospf_neighbor *n, int next)
     op = &pkt->ospf_packet;
     ospf_pkt_fill_hdr(ifa, pkt, DBDES_P);
     pkt->iface_mtu = (ifa->type == OSPF_IT_VLINK) ? 0 : htons(ifa->iface->mtu);
-    pkt->options = hton_opt(oa->options);
+    pkt->options = hton_opt(dbdes_opt(ifa));
     pkt->imms = n->myimms;
     pkt->ddseq = htonl(n->dds);
     length = sizeof(struct ospf_dbdes_packet);
@@ -112,8 +177,8 @@ ospf_dbdes_send(struct ospf_neighbor *n, int next)
 
     if (next)
     {
-      snode *sn;
-      struct ospf_lsa_header *lsa;
+      struct ospf_dbdes_snap *s = n->dbsnap;
+      unsigned int cnt = 0;
 
       pkt = n->ldbdes;
       op = (struct ospf_packet *) pkt;
@@ -121,52 +186,29 @@ ospf_dbdes_send(struct ospf_neighbor *n, int next)
       ospf_pkt_fill_hdr(ifa, pkt, DBDES_P);
       pkt->iface_mtu = (ifa->type == OSPF_IT_VLINK) ? 0 : htons(ifa->iface->mtu);
       pkt->ddseq = htonl(n->dds);
-      pkt->options = hton_opt(oa->options);
-
-      j = i = (ospf_pkt_maxsize(ifa) - sizeof(struct ospf_dbdes_packet)) / sizeof(struct ospf_lsa_header);	/* Number of possible lsaheaders to send */
-      lsa = (n->ldbdes + sizeof(struct ospf_dbdes_packet));
+      pkt->options = hton_opt(dbdes_opt(ifa));
 
       if (n->myimms.bit.m)
       {
-	sn = s_get(&(n->dbsi));
-
-	DBG("Number of LSA: %d\n", j);
-	for (; i > 0; i--)
-	{
-	  struct top_hash_entry *en= (struct top_hash_entry *) sn;
-
-          if (ospf_lsa_flooding_allowed(&en->lsa, en->domain, ifa))
-          {
-	    htonlsah(&(en->lsa), lsa);
-	    DBG("Working on: %d\n", i);
-	    DBG("\tX%01x %-1R %-1R %p\n", en->lsa.type, en->lsa.id, en->lsa.rt, en->lsa_body);
+	/* Number of possible lsaheaders to send */
+	cnt = (ospf_pkt_maxsize(ifa) - sizeof(struct ospf_dbdes_packet)) / sizeof(struct ospf_lsa_header);
+	if (cnt > s->count - n->dbpos)
+	  cnt = s->count - n->dbpos;
 
-	    lsa++;
-          }
-          else i++;	/* No lsa added */
+	DBG("Number of LSA: %d\n", cnt);
+	memcpy(pkt + 1, s->lsa + n->dbpos, cnt * sizeof(struct ospf_lsa_header));
+	n->dbpos += cnt;
 
-	  if (sn == STAIL(po->lsal))
-          {
-            i--;
-	    break;
-          }
-
-	  sn = sn->next;
-	}
-
-	if (sn == STAIL(po->lsal))
+	if (n->dbpos == s->count)
 	{
-	  DBG("Number of LSA NOT sent: %d\n", i);
 	  DBG("M bit unset.\n");
 	  n->myimms.bit.m = 0;	/* Unset more bit */
 	}
-
-	s_put(&(n->dbsi), sn);
       }
 
       pkt->imms.byte = n->myimms.byte;
 
-      length = (j - i) * sizeof(struct ospf_lsa_header) +
+      length = cnt * sizeof(struct ospf_lsa_header) +
 	sizeof(struct ospf_dbdes_packet);
       op->length = htons(length);
 
@@ -212,7 +254,7 @@ static void
 ospf_dbdes_reqladd(struct ospf_dbdes_packet *ps, struct ospf_neighbor *n)
 {
   struct ospf_lsa_header *plsa, lsa;
-  struct top_hash_entry *he, *sn;
+  struct top_hash_entry *he;
   struct ospf_area *oa = n->ifa->oa;
   struct top_graph *gr = oa->po->gr;
   struct ospf_packet *op;
@@ -228,17 +270,20 @@ ospf_dbdes_reqladd(struct ospf_dbdes_packet *ps, struct ospf_neighbor *n)
   for (i = 0; i < j; i++)
   {
     ntohlsah(plsa + i, &lsa);
+
+#ifdef OSPFv2
+    /* They would be rejected in LSUPD, so the request would never be done */
+    if (ospf_lsa_unknown_type(lsa.type))
+      continue;
+#endif
+
     u32 dom = ospf_lsa_domain(lsa.type, n->ifa);
     if (((he = ospf_hash_find_header(gr, dom, &lsa)) == NULL) ||
 	(lsa_comp(&lsa, &(he->lsa)) == 1))
     {
       /* Is this condition necessary? */
-      if (ospf_hash_find_header(n->lsrqh, dom, &lsa) == NULL)
-      {
-	sn = ospf_hash_get_header(n->lsrqh, dom, &lsa);
-	ntohlsah(plsa + i, &(sn->lsa));
-	s_add_tail(&(n->lsrql), SNODE sn);
-      }
+      if (ospf_lsr_find(n, dom, &lsa) == NULL)
+	ospf_lsr_add(n, dom, &lsa);
     }
   }
 }
@@ -10,6 +10,21 @@
 #ifndef _BIRD_OSPF_DBDES_H_
 #define _BIRD_OSPF_DBDES_H_
 
+/*
+ * Database summary snapshot, LSA headers of the LSA db in network order,
+ * in the form they are sent in DBDES packets. Neighbors entering Exchange
+ * state on the same interface share the snapshot unless the db changed.
+ */
+struct ospf_dbdes_snap
+{
+  u32 gen;			/* po->lsdb_gen when the snapshot was taken */
+  u32 refs;			/* Number of neighbors using the snapshot */
+  u32 count;			/* Number of headers in lsa */
+  struct ospf_lsa_header lsa[];
+};
+
+void ospf_dbdes_snap_get(struct ospf_neighbor *n);
+void ospf_dbdes_snap_put(struct ospf_neighbor *n);
 void ospf_dbdes_send(struct ospf_neighbor *n, int next);
 void ospf_dbdes_receive(struct ospf_packet *ps, struct ospf_iface *ifa,
 			struct ospf_neighbor *n);
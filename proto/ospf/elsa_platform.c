@@ -178,7 +178,7 @@ uint32_t elsai_lsa_get_age(elsa_lsa lsa)
   struct top_hash_entry *en = lsa->hash_entry;
 
   assert(en);
-  return en->lsa.age;
+  return lsa_get_age(en);
 }
 
 void elsai_lsa_get_body(elsa_lsa lsa, unsigned char **body, size_t *body_len)
@@ -204,24 +204,16 @@ static elsa_lsa find_next_entry(elsa_client client,
                                 elsa_lsa lsa,
                                 elsa_lsatype type)
 {
-  int i;
+  unsigned i;
   struct top_graph *gr = client->gr;
   struct top_hash_entry *e;
-  for (i = lsa->hash_bin ; i < gr->hash_size ; i++)
-    if ((e=gr->hash_table[i]))
+  for (i = lsa->hash_bin ; (e = ospf_hash_walk(gr, &i)) ; i++)
+    if (e->lsa.type == type)
       {
-        while (e)
-          {
-            if (e->lsa.type != type)
-              {
-                e = e->next;
-                continue;
-              }
-            lsa->hash_entry = e;
-            lsa->swapped = true;
-            lsa->hash_bin = i;
-            return lsa;
-          }
+        lsa->hash_entry = e;
+        lsa->swapped = true;
+        lsa->hash_bin = i;
+        return lsa;
       }
   return NULL;
 }
@@ -243,13 +235,6 @@ elsa_lsa elsai_get_lsa_by_type_next(elsa_client client, elsa_lsa lsa)
 
   assert(lsa->hash_entry);
   type = lsa->hash_entry->lsa.type;
-  while (lsa->hash_entry->next)
-    {
-      lsa->hash_entry = lsa->hash_entry->next;
-      /* lsa->swapped = true; - should be already! */
-      if (lsa->hash_entry->lsa.type == type)
-          return lsa;
-    }
   lsa->hash_bin++;
   return find_next_entry(client, lsa, type);
 }
@@ -369,7 +354,7 @@ void elsai_lsa_originate(elsa_client client,
   struct ospf_lsa_header lsa;
   void *tmp;
 
-  tmp = mb_alloc(client->proto.pool, body_len);
+  tmp = ospf_lsa_alloc(client->gr, body_len);
   if (!tmp)
     return;
   lsa.age = 0;
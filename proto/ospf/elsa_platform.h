@@ -39,7 +39,7 @@ typedef struct elsa_usp_struct *elsa_ac_usp;
 typedef struct MD5Context *elsa_md5;
 
 struct elsa_lsa_struct {
-  int hash_bin;
+  unsigned hash_bin;
   bool swapped; /* is it swapped to host order? if so, we must reverse it*/
   struct top_hash_entry *hash_entry;
   unsigned char dummy_lsa_buf[65540];
@@ -0,0 +1,545 @@
+/*
+ *	BIRD -- OSPF Graceful Restart
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "ospf.h"
+
+/*
+ * Graceful restart (RFC 3623, RFC 5187 for OSPFv3) lets the router to be
+ * restarted without the rest of the network noticing it.
+ *
+ * When the protocol is shut down with graceful restart enabled, a
+ * grace-LSA is flooded through each interface instead of 1-way Hellos and
+ * kernel syncers are asked to keep our routes (proto_gr_hold()). When the
+ * protocol is started again within the grace period, the router is in
+ * restart mode: it does not originate its
+ * router- and network-LSAs nor calculates routes, self-originated LSAs
+ * received from neighbors are accepted (and marked stale), and kernel
+ * routes are kept by proto_gr_lock(). The restart ends when all
+ * adjacencies listed in our pre-restart router-LSAs are reestablished or
+ * when the grace period expires. Then the self-originated LSAs are adopted
+ * (so their sequence numbers continue), the grace-LSAs are flushed, routes
+ * are calculated and stale LSAs not originated again are flushed.
+ *
+ * In helper mode, a full neighbor which floods a grace-LSA is still
+ * announced as adjacent (see NEIGH_ADJ()) even if its state drops, until
+ * it becomes full again, flushes the grace-LSA, the grace period expires
+ * or a topology change is seen.
+ */
+
+static inline int
+gr_lsa_topology(u32 type)
+{
+  switch (type)
+    {
+    case LSA_T_RT:
+    case LSA_T_NET:
+    case LSA_T_SUM_NET:
+    case LSA_T_SUM_RT:
+    case LSA_T_EXT:
+    case LSA_T_NSSA:
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/* Premature aging of a self-originated LSA */
+static void
+gr_flush_lsa(struct proto_ospf *po, struct top_hash_entry *en)
+{
+  en->lsa.sn += 1;
+  en->lsa.age = LSA_MAXAGE;
+  lsasum_calculate(&en->lsa, en->lsa_body);
+  ospf_lsupd_flood(po, NULL, NULL, &en->lsa, en->domain, 0);
+  flush_lsa(en, po);
+}
+
+static void
+gr_originate_lsa(struct ospf_iface *ifa, u32 reason)
+{
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
+  struct ospf_lsa_header lsa;
+  u32 tlv[6];
+  void *body;
+  int i = 0;
+
+  OSPF_TRACE(D_EVENTS, "Originating grace-LSA for iface %s", ifa->iface->name);
+
+  lsa.age = 0;
+  lsa.type = LSA_T_GR;
+
+#ifdef OSPFv2
+  lsa.options = ifa->oa->options;
+  lsa.id = GR_LSA_ID;
+#else /* OSPFv3 */
+  lsa.id = ifa->iface_id;
+#endif
+
+  lsa.rt = po->router_id;
+  u32 dom = ospf_lsa_domain(lsa.type, ifa);
+  lsa.sn = get_seqnum(ospf_hash_find_header(po->gr, dom, &lsa));
+
+  /* TLVs are stored in host order, as other LSA bodies */
+  tlv[i++] = (GR_TLV_PERIOD << 16) | 4;
+  tlv[i++] = po->gr_time;
+  tlv[i++] = (GR_TLV_REASON << 16) | 1;
+  tlv[i++] = reason << 24;
+#ifdef OSPFv2
+  tlv[i++] = (GR_TLV_ADDR << 16) | 4;
+  tlv[i++] = ipa_to_u32(ifa->addr->ip);
+#endif
+
+  body = ospf_lsa_alloc(po->gr, i * sizeof(u32));
+  memcpy(body, tlv, i * sizeof(u32));
+
+  lsa.length = sizeof(struct ospf_lsa_header) + i * sizeof(u32);
+  lsasum_calculate(&lsa, body);
+  lsa_install_new(po, &lsa, dom, body);
+  ospf_lsupd_flood(po, NULL, NULL, &lsa, dom, 1);
+}
+
+static void
+gr_timer_hook(timer *t)
+{
+  struct proto_ospf *po = t->data;
+
+  ospf_gr_exit(po, "grace period expired");
+}
+
+/**
+ * ospf_gr_start - enter restart mode
+ * @po: OSPF protocol
+ *
+ * Called when the protocol is started with graceful restart enabled.
+ * Restart mode is entered only if the previous instance of the protocol
+ * was shut down gracefully (see ospf_gr_shutdown()), otherwise (e.g. at
+ * boot) it is a normal start.
+ */
+void
+ospf_gr_start(struct proto_ospf *po)
+{
+  struct proto *p = &po->proto;
+
+  if (!po->gr_restarter || !proto_gr_prepared(p))
+    return;
+
+  OSPF_TRACE(D_EVENTS, "Graceful restart started");
+
+  po->gr_restart = 1;
+  po->gr_start = now;
+  po->gr_timer = tm_new(p->pool);
+  po->gr_timer->data = po;
+  po->gr_timer->randomize = 0;
+  po->gr_timer->hook = gr_timer_hook;
+  po->gr_timer->recurrent = 0;
+  tm_start(po->gr_timer, po->gr_time);
+  proto_gr_lock(p);
+}
+
+/**
+ * ospf_gr_shutdown - prepare for graceful restart
+ * @po: OSPF protocol
+ *
+ * Floods grace-LSAs through all active interfaces and asks kernel syncers
+ * to keep our routes for the grace period. Returns 1 if the shutdown is
+ * graceful, 0 otherwise (then neighbors should be told by 1-way Hellos).
+ * The restart state does not survive BIRD itself, so its shutdown is not
+ * graceful.
+ */
+int
+ospf_gr_shutdown(struct proto_ospf *po)
+{
+  struct ospf_iface *ifa;
+
+  if (po->gr_restart)
+  {
+    po->gr_restart = 0;
+    tm_stop(po->gr_timer);
+    proto_gr_unlock(&po->proto);
+  }
+
+  if (!po->gr_restarter || config->shutdown)
+    return 0;
+
+  WALK_LIST(ifa, po->iface_list)
+    if (!ifa->stub && (ifa->type != OSPF_IT_VLINK) && (ifa->state > OSPF_IS_LOOP))
+      gr_originate_lsa(ifa, GR_REASON_RESTART);
+
+  /* Send them now, there is no next time */
+  ospf_lsupd_flush_queues(po);
+  proto_gr_hold(&po->proto, po->gr_time);
+
+  return 1;
+}
+
+/* Check whether links of our pre-restart router-LSA are reestablished */
+static int
+gr_area_done(struct ospf_area *oa)
+{
+  struct proto_ospf *po = oa->po;
+  struct top_hash_entry *en = ospf_hash_find_rt(po->gr, oa->areaid, po->router_id);
+  struct ospf_lsa_rt_link *ln;
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+  unsigned int i, max;
+  int found;
+
+  /* Without pre-restart router-LSA, wait at least for the dead interval */
+  if (!en)
+  {
+    WALK_LIST(ifa, po->iface_list)
+      if ((ifa->oa == oa) && (now < po->gr_start + (bird_clock_t) ifa->deadint))
+	return 0;
+
+    return 1;
+  }
+
+  ln = (struct ospf_lsa_rt_link *) ((struct ospf_lsa_rt *) en->lsa_body + 1);
+  max = lsa_rt_count(&en->lsa);
+
+  for (i = 0; i < max; i++, ln++)
+  {
+    found = 0;
+
+    switch (ln->type)
+      {
+      case LSART_PTP:
+      case LSART_VLNK:
+	WALK_LIST(ifa, po->iface_list)
+	  if ((n = find_neigh(ifa, ln->id)) && (n->state == NEIGHBOR_FULL))
+	    found = 1;
+	break;
+
+      case LSART_NET:
+	WALK_LIST(ifa, po->iface_list)
+	  if ((ifa->oa == oa) && ifa->addr &&
+#ifdef OSPFv2
+	      (ipa_to_u32(ifa->addr->ip) == ln->data) &&
+#else /* OSPFv3 */
+	      (ifa->iface_id == ln->lif) &&
+#endif
+	      bcast_net_active(ifa))
+	    found = 1;
+	break;
+
+      default:
+	found = 1;
+      }
+
+    if (!found)
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * ospf_gr_check_exit - check whether restart mode may be left
+ * @po: OSPF protocol
+ *
+ * Called periodically from ospf_disp(). Restart mode is left successfully
+ * when DR elections are done, no database exchange is in progress and all
+ * adjacencies of our pre-restart router-LSAs are full again.
+ */
+void
+ospf_gr_check_exit(struct proto_ospf *po)
+{
+  struct ospf_area *oa;
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+
+  if (!po->gr_restart)
+    return;
+
+  WALK_LIST(ifa, po->iface_list)
+  {
+    if (ifa->state == OSPF_IS_WAITING)
+      return;
+
+    WALK_LIST(n, ifa->neigh_list)
+      if ((n->state >= NEIGHBOR_EXSTART) && (n->state < NEIGHBOR_FULL))
+	return;
+  }
+
+  WALK_LIST(oa, po->area_list)
+    if (!gr_area_done(oa))
+      return;
+
+  ospf_gr_exit(po, "completed");
+}
+
+/**
+ * ospf_gr_exit - leave restart mode
+ * @po: OSPF protocol
+ * @reason: reason for the log message
+ */
+void
+ospf_gr_exit(struct proto_ospf *po, char *reason)
+{
+  struct proto *p = &po->proto;
+  struct top_hash_entry *en, *enx;
+  struct ospf_area *oa;
+  struct ospf_iface *ifa;
+
+  log(L_INFO "%s: Graceful restart %s", p->name, reason);
+
+  po->gr_restart = 0;
+  tm_stop(po->gr_timer);
+  proto_gr_unlock(p);
+
+  /* Adopt our LSAs received during the restart, they are originated again */
+  WALK_LIST(oa, po->area_list)
+  {
+    if ((oa->rt = ospf_hash_find_rt(po->gr, oa->areaid, po->router_id)))
+      oa->rt->stale = 0;
+#ifdef OSPFv3
+    if ((oa->pxr_lsa = ospf_hash_find(po->gr, oa->areaid, 0, po->router_id, LSA_T_PREFIX)))
+      oa->pxr_lsa->stale = 0;
+#endif
+
+    /*
+     * Originate router-LSAs now, regardless of MinLSInterval since the
+     * adopted ones were received. The SPF below needs the positions of our
+     * links (rt_pos_beg, rt_pos_end) set by the origination.
+     */
+    originate_rt_lsa(oa);
+#ifdef OSPFv3
+    originate_prefix_rt_lsa(oa);
+#endif
+    oa->origrt = 0;
+  }
+
+  WALK_LIST(ifa, po->iface_list)
+  {
+    if ((ifa->type == OSPF_IT_VLINK) || !ifa->addr)
+      continue;
+
+    u32 dom = ifa->oa->areaid;
+#ifdef OSPFv2
+    if ((ifa->net_lsa = ospf_hash_find(po->gr, dom, ipa_to_u32(ifa->addr->ip), po->router_id, LSA_T_NET)))
+      ifa->net_lsa->stale = 0;
+#else /* OSPFv3 */
+    if ((ifa->net_lsa = ospf_hash_find(po->gr, dom, ifa->iface_id, po->router_id, LSA_T_NET)))
+      ifa->net_lsa->stale = 0;
+    if ((ifa->pxn_lsa = ospf_hash_find(po->gr, dom, ifa->iface_id, po->router_id, LSA_T_PREFIX)))
+      ifa->pxn_lsa->stale = 0;
+#endif
+    schedule_net_lsa(ifa);
+  }
+
+  WALK_SLIST_DELSAFE(en, enx, po->lsal)
+    if (lsa_is_grace(&en->lsa) && (en->lsa.rt == po->router_id))
+      gr_flush_lsa(po, en);
+
+  po->gr_cleanup = 1;
+  schedule_rtcalc(po);
+}
+
+/**
+ * ospf_gr_cleanup - flush stale LSAs
+ * @po: OSPF protocol
+ *
+ * Called after the first routing table calculation after the restart.
+ * Self-originated LSAs received during the restart and not originated
+ * again since then are flushed.
+ */
+void
+ospf_gr_cleanup(struct proto_ospf *po)
+{
+  struct proto *p = &po->proto;
+  struct top_hash_entry *en, *enx;
+
+  po->gr_cleanup = 0;
+
+  WALK_SLIST_DELSAFE(en, enx, po->lsal)
+    if (en->stale)
+    {
+      OSPF_TRACE(D_EVENTS, "Flushing stale LSA: Type: %04x, Id: %R, Rt: %R",
+		 en->lsa.type, en->lsa.id, en->lsa.rt);
+      gr_flush_lsa(po, en);
+    }
+}
+
+static void
+gr_helper_start(struct ospf_neighbor *n, struct top_hash_entry *en, u32 period, u32 reason)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
+  struct ospf_rxmt *e;
+  u32 age = lsa_get_age(en);
+
+  if (!po->gr_helper || po->gr_restart)
+    return;
+
+  if (age >= period)
+    return;
+
+  if (!n->gr_active)
+  {
+    if (n->state != NEIGHBOR_FULL)
+      return;
+
+    /* RFC 3623 3.1 (2) - no topology change waits for the neighbor */
+    if (n->rxmt_count)
+      WALK_LIST(e, ifa->rxmt_list)
+	if (ospf_rxmt_test(e, n) && gr_lsa_topology(e->lsa.type))
+	{
+	  OSPF_TRACE(D_EVENTS, "Not helping neighbor %R to restart, topology changed", n->rid);
+	  return;
+	}
+
+    log(L_INFO "%s: Helping neighbor %R on %s to restart (reason %u, %u s)",
+	p->name, n->rid, ifa->iface->name, reason, period - age);
+
+    n->gr_active = 1;
+    po->gr_helping++;
+  }
+
+  tm_start(n->gr_timer, period - age);
+}
+
+/**
+ * ospf_gr_helper_exit - stop helping a neighbor to restart
+ * @n: OSPF neighbor
+ * @reason: reason for the log message
+ *
+ * If the neighbor is not full, it is no longer announced as adjacent.
+ */
+void
+ospf_gr_helper_exit(struct ospf_neighbor *n, char *reason)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
+
+  if (!n->gr_active)
+    return;
+
+  log(L_INFO "%s: Graceful restart of neighbor %R %s", p->name, n->rid, reason);
+
+  n->gr_active = 0;
+  tm_stop(n->gr_timer);
+  po->gr_helping--;
+
+  if (n->state != NEIGHBOR_FULL)
+  {
+    ifa->fadj--;
+
+    if (n->state < NEIGHBOR_2WAY)
+      ospf_iface_sm(ifa, ISM_NEICH);
+  }
+
+  schedule_rt_lsa(ifa->oa);
+  if (ifa->type == OSPF_IT_VLINK) schedule_rt_lsa(ifa->voa);
+  schedule_net_lsa(ifa);
+}
+
+void
+ospf_gr_helper_timeout(timer *t)
+{
+  ospf_gr_helper_exit(t->data, "timed out");
+}
+
+/* Parse TLVs of a grace-LSA */
+static void
+gr_parse_lsa(struct top_hash_entry *en, u32 *period, u32 *reason, ip_addr *addr)
+{
+  u32 *body = en->lsa_body;
+  unsigned int i = 0, len = (en->lsa.length - sizeof(struct ospf_lsa_header)) / sizeof(u32);
+
+  *period = 0;
+  *reason = GR_REASON_UNKNOWN;
+  *addr = IPA_NONE;
+
+  while (i < len)
+  {
+    u32 type = body[i] >> 16;
+    u32 size = body[i] & 0xffff;
+    i++;
+
+    if ((i + (size + 3) / 4) > len)
+      break;
+
+    if ((type == GR_TLV_PERIOD) && (size == 4))
+      *period = body[i];
+    else if ((type == GR_TLV_REASON) && (size == 1))
+      *reason = body[i] >> 24;
+#ifdef OSPFv2
+    else if ((type == GR_TLV_ADDR) && (size == 4))
+      *addr = ipa_from_u32(body[i]);
+#endif
+
+    i += (size + 3) / 4;
+  }
+}
+
+static void
+gr_grace_lsa(struct proto_ospf *po, struct top_hash_entry *en)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n = NULL;
+  u32 period, reason;
+  ip_addr addr;
+
+  WALK_LIST(ifa, po->iface_list)
+    if (ifa->iface_id == en->domain)
+      break;
+
+  if (!NODE_VALID(ifa))
+    return;
+
+  gr_parse_lsa(en, &period, &reason, &addr);
+
+  /* On multiaccess networks, the neighbor is identified by its address */
+  if (ipa_nonzero(addr) &&
+      ((ifa->type == OSPF_IT_BCAST) || (ifa->type == OSPF_IT_NBMA) || (ifa->type == OSPF_IT_PTMP)))
+    n = find_neigh_by_ip(ifa, addr);
+  else
+    n = find_neigh(ifa, en->lsa.rt);
+
+  if (!n || (n->rid != en->lsa.rt))
+    return;
+
+  if (en->lsa.age == LSA_MAXAGE)
+    ospf_gr_helper_exit(n, "completed");
+  else
+    gr_helper_start(n, en, period, reason);
+}
+
+/**
+ * ospf_gr_lsa_installed - process LSA installed into the database
+ * @po: OSPF protocol
+ * @en: new LSA
+ * @change: whether the LSA content was changed
+ *
+ * Grace-LSAs of neighbors start or end helper mode. In helper mode, a
+ * changed topology LSA ends helper mode of all affected neighbors.
+ */
+void
+ospf_gr_lsa_installed(struct proto_ospf *po, struct top_hash_entry *en, int change)
+{
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n, *nx;
+
+  if (en->lsa.type == LSA_T_GR)
+  {
+    if (lsa_is_grace(&en->lsa) && (en->lsa.rt != po->router_id))
+      gr_grace_lsa(po, en);
+    return;
+  }
+
+  if (!change || !po->gr_helping || !gr_lsa_topology(en->lsa.type))
+    return;
+
+  WALK_LIST(ifa, po->iface_list)
+    WALK_LIST_DELSAFE(n, nx, ifa->neigh_list)
+      if (n->gr_active && (n->rid != en->lsa.rt) &&
+	  ospf_lsa_flooding_allowed(&en->lsa, en->domain, ifa))
+	ospf_gr_helper_exit(n, "aborted, topology changed");
+}
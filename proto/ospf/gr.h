@@ -0,0 +1,38 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_OSPF_GR_H_
+#define _BIRD_OSPF_GR_H_
+
+#ifdef OSPFv2
+#define GR_OPAQUE_TYPE	3
+#define GR_LSA_ID	(GR_OPAQUE_TYPE << 24)	/* Opaque ID 0 */
+
+/* Other link-local opaque LSAs are just stored and flooded */
+#define lsa_is_grace(lsa) (((lsa)->type == LSA_T_GR) && (((lsa)->id >> 24) == GR_OPAQUE_TYPE))
+#else /* OSPFv3 */
+#define lsa_is_grace(lsa) ((lsa)->type == LSA_T_GR)
+#endif
+
+/* Grace-LSA TLVs, RFC 3623 Appendix A */
+#define GR_TLV_PERIOD	1
+#define GR_TLV_REASON	2
+#define GR_TLV_ADDR	3
+
+#define GR_REASON_UNKNOWN	0
+#define GR_REASON_RESTART	1
+#define GR_REASON_UPGRADE	2
+
+void ospf_gr_start(struct proto_ospf *po);
+int ospf_gr_shutdown(struct proto_ospf *po);
+void ospf_gr_check_exit(struct proto_ospf *po);
+void ospf_gr_exit(struct proto_ospf *po, char *reason);
+void ospf_gr_cleanup(struct proto_ospf *po);
+void ospf_gr_lsa_installed(struct proto_ospf *po, struct top_hash_entry *en, int change);
+void ospf_gr_helper_exit(struct ospf_neighbor *n, char *reason);
+void ospf_gr_helper_timeout(timer *t);
+
+#endif /* _BIRD_OSPF_GR_H_ */
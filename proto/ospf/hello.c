@@ -142,10 +142,8 @@ ospf_hello_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
                ntohl(ps_i->routerid),
                ifa->iface->name);
 
-    n = ospf_neighbor_new(ifa);
+    n = ospf_neighbor_new(ifa, ntohl(ps_i->routerid), faddr);
 
-    n->rid = ntohl(ps_i->routerid);
-    n->ip = faddr;
     n->dr = ntohl(ps->dr);
     n->bdr = ntohl(ps->bdr);
     n->priority = ps->priority;
@@ -157,7 +155,7 @@ ospf_hello_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
   else if (!ipa_equal(faddr, n->ip))
   {
     OSPF_TRACE(D_EVENTS, "Neighbor address changed from %I to %I", n->ip, faddr);
-    n->ip = faddr;
+    ospf_neigh_set_ip(n, faddr);
   }
 #endif
 
@@ -285,7 +283,7 @@ ospf_hello_send(struct ospf_iface *ifa, int kind, struct ospf_neighbor *dirn)
   pkt->iface_id = htonl(ifa->iface_id);
 
   pkt->options3 = ifa->oa->options >> 16;
-  pkt->options2 = ifa->oa->options >> 8;
+  pkt->options2 = (ifa->oa->options | ospf_auth_opt(ifa)) >> 8;
 #endif
   pkt->options = ifa->oa->options;
 
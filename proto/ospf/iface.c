@@ -212,6 +212,9 @@ ospf_iface_down(struct ospf_iface *ifa)
   if (ifa->wait_timer)
     tm_stop(ifa->wait_timer);
 
+  ospf_txq_flush(ifa);
+  ospf_lsack_drop(ifa);
+
   if (ifa->type == OSPF_IT_VLINK)
   {
     ifa->vifa = NULL;
@@ -289,6 +292,8 @@ ospf_iface_chstate(struct ospf_iface *ifa, u8 state)
   if ((oldstate == OSPF_IS_DR) && (ifa->net_lsa != NULL))
   {
     ifa->net_lsa->lsa.age = LSA_MAXAGE;
+    po->lsdb_gen++;
+    lsa_age_schedule(po, ifa->net_lsa);
     if (state >= OSPF_IS_WAITING)
       ospf_lsupd_flush_nlsa(po, ifa->net_lsa);
 
@@ -520,6 +525,7 @@ ospf_iface_new(struct ospf_area *oa, struct ifa *addr, struct ospf_iface_patt *i
   ifa->oa = oa;
   ifa->cf = ip;
   ifa->pool = pool;
+  init_list(&ifa->auth_keys);
 
   ifa->cost = ip->cost;
   ifa->rxmtint = ip->rxmtint;
@@ -537,9 +543,11 @@ ospf_iface_new(struct ospf_area *oa, struct ifa *addr, struct ospf_iface_patt *i
   ifa->ecmp_weight = ip->ecmp_weight;
   ifa->check_ttl = (ip->ttl_security == 1);
 
-#ifdef OSPFv2
   ifa->autype = ip->autype;
   ifa->passwords = ip->passwords;
+  ospf_iface_auth_init(ifa);
+
+#ifdef OSPFv2
   ifa->ptp_netmask = addr ? !(addr->flags & IA_PEER) : 0;
   if (ip->ptp_netmask < 2)
     ifa->ptp_netmask = ip->ptp_netmask;
@@ -577,6 +585,9 @@ ospf_iface_new(struct ospf_area *oa, struct ifa *addr, struct ospf_iface_patt *i
   ifa->iface_id = (ifa->type != OSPF_IT_VLINK) ? iface->index : oa->po->last_vlink_id++;
 
   init_list(&ifa->neigh_list);
+  ospf_neigh_hash_init(ifa);
+  ospf_rxmt_init(ifa);
+  ospf_txq_init(ifa);
   init_list(&ifa->nbma_list);
 
   WALK_LIST(nb, ip->nbma_list)
@@ -683,6 +694,12 @@ ospf_iface_reconfigure(struct ospf_iface *ifa, struct ospf_iface_patt *new)
     ospf_iface_change_timer(ifa->hello_timer, ifa->helloint);
   }
 
+  /* TX RATE */
+  if (ifa->tx_rate != new->tx_rate)
+    OSPF_TRACE(D_EVENTS, "Changing tx rate on interface %s from %u to %u",
+	       ifname, ifa->tx_rate, new->tx_rate);
+  ospf_txq_init(ifa);
+
   /* RXMT TIMER */
   if (ifa->rxmtint != new->rxmtint)
   {
@@ -729,7 +746,6 @@ ospf_iface_reconfigure(struct ospf_iface *ifa, struct ospf_iface_patt *new)
     ifa->inftransdelay = new->inftransdelay;
   }
 
-#ifdef OSPFv2	
   /* AUTHENTICATION */
   if (ifa->autype != new->autype)
   {
@@ -739,7 +755,7 @@ ospf_iface_reconfigure(struct ospf_iface *ifa, struct ospf_iface_patt *new)
 
   /* Update passwords */
   ifa->passwords = new->passwords;
-#endif
+  ospf_iface_auth_init(ifa);
 
   /* Remaining options are just for proper interfaces */
   if (ifa->type == OSPF_IT_VLINK)
@@ -1094,6 +1110,17 @@ ospf_iface_change_mtu(struct proto_ospf *po, struct ospf_iface *ifa)
   struct ospf_neighbor *n;
   OSPF_TRACE(D_EVENTS, "Changing MTU on interface %s", ifa->iface->name);
 
+  /* Flood queue was sized for the old MTU, queued packets may be too large */
+  ospf_lsupd_flush_queue(ifa);
+  ospf_lsack_flush(ifa);
+  ospf_lsack_drop(ifa);
+  ospf_txq_flush(ifa);
+  if (ifa->flood_buf)
+  {
+    mb_free(ifa->flood_buf);
+    ifa->flood_buf = NULL;
+  }
+
   if (ifa->sk)
   {
     ifa->sk->rbsize = rxbufsize(ifa);
@@ -1202,6 +1229,9 @@ ospf_iface_info(struct ospf_iface *ifa)
   cli_msg(-1015, "\tWait timer: %u", ifa->waitint);
   cli_msg(-1015, "\tDead timer: %u", ifa->deadint);
   cli_msg(-1015, "\tRetransmit timer: %u", ifa->rxmtint);
+  if (ifa->tx_rate)
+    cli_msg(-1015, "\tTX rate: %u pkts/s, burst %u, queued %u, dropped %u",
+	    ifa->tx_rate, ifa->tx_burst, ifa->txq_count, ifa->txq_drops);
   if ((ifa->type == OSPF_IT_BCAST) || (ifa->type == OSPF_IT_NBMA))
   {
     cli_msg(-1015, "\tDesigned router (ID): %R", ifa->drid);
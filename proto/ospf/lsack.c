@@ -36,104 +36,218 @@ static void ospf_dump_lsack(struct proto *p, struct ospf_lsack_packet *pkt)
 
 
 /*
- * =====================================
- * Note, that h is in network endianity!
- * =====================================
+ * Acknowledgements are not sent one packet per received LS Update.
+ * Direct acks are collected per neighbor, delayed acks of all neighbors
+ * of an interface are collected in one buffer (ifa->ack_buf). Both are
+ * sent by ospf_lsack_flush() from po->flood_event, which runs after the
+ * current batch of received packets is processed, so acks for LSAs that
+ * arrive together are packed in as few LS Ack packets as possible. The
+ * delayed ack buffer is also sent when it fills an MTU-sized packet.
  */
 
-void
-ospf_lsack_enqueue(struct ospf_neighbor *n, struct ospf_lsa_header *h,
-		   int queue)
+static void
+ospf_lsack_send_pkt(struct ospf_iface *ifa, struct ospf_neighbor *n)
 {
-  struct lsah_n *no = mb_alloc(n->pool, sizeof(struct lsah_n));
-  memcpy(&no->lsa, h, sizeof(struct ospf_lsa_header));
-  add_tail(&n->ackl[queue], NODE no);
-  DBG("Adding (%s) ack for %R, ID: %R, RT: %R, Type: %u\n", s_queue[queue],
-      n->rid, ntohl(h->id), ntohl(h->rt), h->type);
+  if (n)
+  {
+    ospf_send_to(ifa, n->ip);
+    return;
+  }
+
+  switch (ifa->type)
+  {
+  case OSPF_IT_BCAST:
+    if ((ifa->state == OSPF_IS_DR) || (ifa->state == OSPF_IS_BACKUP))
+      ospf_send_to_all(ifa);
+    else if (ifa->cf->real_bcast)
+      ospf_send_to_bdr(ifa);
+    else
+      ospf_send_to(ifa, AllDRouters);
+    break;
+
+  case OSPF_IT_NBMA:
+    if ((ifa->state == OSPF_IS_DR) || (ifa->state == OSPF_IS_BACKUP))
+      ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
+    else
+      ospf_send_to_bdr(ifa);
+    break;
+
+  case OSPF_IT_PTP:
+    ospf_send_to_all(ifa);
+    break;
+
+  case OSPF_IT_PTMP:
+    ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
+    break;
+
+  case OSPF_IT_VLINK:
+    ospf_send_to(ifa, ifa->vip);
+    break;
+
+  default:
+    bug("Bug in ospf_lsack_send_pkt()");
+  }
 }
 
-void
-ospf_lsack_send(struct ospf_neighbor *n, int queue)
+/* Send @num acks prepared in the tx buffer, to neighbor @n or as delayed acks when @n is NULL */
+static void
+ospf_lsack_send(struct ospf_iface *ifa, struct ospf_neighbor *n, unsigned num)
 {
-  struct ospf_packet *op;
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
   struct ospf_lsack_packet *pk;
-  u16 len, i = 0;
-  struct ospf_lsa_header *h;
-  struct lsah_n *no;
-  struct ospf_iface *ifa = n->ifa;
-  struct proto *p = &n->ifa->oa->po->proto;
-
-  if (EMPTY_LIST(n->ackl[queue]))
-    return;
+  struct ospf_packet *op;
 
   pk = ospf_tx_buffer(ifa);
   op = &pk->ospf_packet;
 
-  ospf_pkt_fill_hdr(n->ifa, pk, LSACK_P);
-  h = pk->lsh;
+  ospf_pkt_fill_hdr(ifa, pk, LSACK_P);
+  op->length = htons(sizeof(struct ospf_lsack_packet) + num * sizeof(struct ospf_lsa_header));
+
+  OSPF_PACKET(ospf_dump_lsack, pk, "LSACK packet sent via %s", ifa->iface->name);
+
+  po->ack_lsas += num;
+  po->ack_packets++;
 
-  while (!EMPTY_LIST(n->ackl[queue]))
+  ospf_lsack_send_pkt(ifa, n);
+}
+
+static inline unsigned
+ospf_lsack_max(struct ospf_iface *ifa)
+{
+  return (ospf_pkt_maxsize(ifa) - sizeof(struct ospf_lsack_packet)) /
+    sizeof(struct ospf_lsa_header);
+}
+
+static inline int
+ospf_lsack_can_send(struct ospf_iface *ifa)
+{
+  return ifa->sk && (ifa->state > OSPF_IS_DOWN);
+}
+
+static void
+ospf_lsack_send_delayed(struct ospf_iface *ifa)
+{
+  struct ospf_lsack_packet *pk;
+
+  if (ifa->ack_count && ospf_lsack_can_send(ifa))
   {
-    no = (struct lsah_n *) HEAD(n->ackl[queue]);
-    memcpy(h + i, &no->lsa, sizeof(struct ospf_lsa_header));
-    DBG("Iter %u ID: %R, RT: %R, Type: %04x\n", i, ntohl((h + i)->id),
-	ntohl((h + i)->rt), (h + i)->type);
-    i++;
+    pk = ospf_tx_buffer(ifa);
+    memcpy(pk->lsh, ifa->ack_buf, ifa->ack_count * sizeof(struct ospf_lsa_header));
+    ospf_lsack_send(ifa, NULL, ifa->ack_count);
+  }
+
+  ifa->ack_count = 0;
+}
+
+static void
+ospf_lsack_send_direct(struct ospf_neighbor *n)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct ospf_lsack_packet *pk = NULL;
+  unsigned max = ospf_lsack_max(ifa);
+  struct lsah_n *no;
+  unsigned i = 0;
+
+  if (ospf_lsack_can_send(ifa))
+    pk = ospf_tx_buffer(ifa);
+
+  while (!EMPTY_LIST(n->ackl))
+  {
+    no = (struct lsah_n *) HEAD(n->ackl);
+    if (pk)
+      memcpy(pk->lsh + i, &no->lsa, sizeof(struct ospf_lsa_header));
     rem_node(NODE no);
     mb_free(no);
-    if ((i * sizeof(struct ospf_lsa_header) +
-	 sizeof(struct ospf_lsack_packet)) > ospf_pkt_maxsize(n->ifa))
+
+    if (pk && (++i == max))
     {
-      if (!EMPTY_LIST(n->ackl[queue]))
-      {
-	len =
-	  sizeof(struct ospf_lsack_packet) +
-	  i * sizeof(struct ospf_lsa_header);
-	op->length = htons(len);
-	DBG("Sending and continuing! Len=%u\n", len);
-
-	OSPF_PACKET(ospf_dump_lsack, pk, "LSACK packet sent via %s", ifa->iface->name);
-
-	if (ifa->type == OSPF_IT_BCAST)
-	{
-	  if ((ifa->state == OSPF_IS_DR) || (ifa->state == OSPF_IS_BACKUP))
-	    ospf_send_to_all(ifa);
-	  else if (ifa->cf->real_bcast)
-	    ospf_send_to_bdr(ifa);
-	  else
-	    ospf_send_to(ifa, AllDRouters);
-	}
-	else
-	{
-	  if ((ifa->state == OSPF_IS_DR) || (ifa->state == OSPF_IS_BACKUP))
-	    ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
-	  else
-	    ospf_send_to_bdr(ifa);
-	}
-
-	ospf_pkt_fill_hdr(n->ifa, pk, LSACK_P);
-	i = 0;
-      }
+      ospf_lsack_send(ifa, n, i);
+      i = 0;
     }
   }
 
-  len = sizeof(struct ospf_lsack_packet) + i * sizeof(struct ospf_lsa_header);
-  op->length = htons(len);
-  DBG("Sending! Len=%u\n", len);
+  if (i)
+    ospf_lsack_send(ifa, n, i);
+}
 
-  OSPF_PACKET(ospf_dump_lsack, pk, "LSACK packet sent via %s", ifa->iface->name);
+/*
+ * =====================================
+ * Note, that h is in network endianity!
+ * =====================================
+ */
 
-  if (ifa->type == OSPF_IT_BCAST)
+void
+ospf_lsack_enqueue(struct ospf_neighbor *n, struct ospf_lsa_header *h,
+		   int queue)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct proto_ospf *po = ifa->oa->po;
+
+  DBG("Adding (%s) ack for %R, ID: %R, RT: %R, Type: %u\n", s_queue[queue],
+      n->rid, ntohl(h->id), ntohl(h->rt), h->type);
+
+  ev_schedule(po->flood_event);
+
+  if (queue == ACKL_DIRECT)
   {
-    if ((ifa->state == OSPF_IS_DR) || (ifa->state == OSPF_IS_BACKUP))
-      ospf_send_to_all(ifa);
-    else if (ifa->cf->real_bcast)
-      ospf_send_to_bdr(ifa);
-    else
-      ospf_send_to(ifa, AllDRouters);
+    struct lsah_n *no = mb_alloc(n->pool, sizeof(struct lsah_n));
+    memcpy(&no->lsa, h, sizeof(struct ospf_lsa_header));
+    add_tail(&n->ackl, NODE no);
+    ifa->ack_direct = 1;
+    return;
+  }
+
+  if (!ifa->ack_buf)
+  {
+    ifa->ack_size = (ospf_pkt_bufsize(ifa) - sizeof(struct ospf_lsack_packet)) /
+      sizeof(struct ospf_lsa_header);
+    ifa->ack_buf = mb_alloc(ifa->pool, ifa->ack_size * sizeof(struct ospf_lsa_header));
+  }
+
+  memcpy(ifa->ack_buf + ifa->ack_count, h, sizeof(struct ospf_lsa_header));
+  ifa->ack_count++;
+
+  /* Packet is full, the limit may be lower than ack_size due to MTU or authentication */
+  if ((ifa->ack_count >= ospf_lsack_max(ifa)) || (ifa->ack_count >= ifa->ack_size))
+    ospf_lsack_send_delayed(ifa);
+}
+
+/**
+ * ospf_lsack_flush - send acknowledgements waiting on interface
+ * @ifa: OSPF interface
+ */
+void
+ospf_lsack_flush(struct ospf_iface *ifa)
+{
+  struct ospf_neighbor *n;
+
+  if (ifa->ack_direct)
+  {
+    WALK_LIST(n, ifa->neigh_list)
+      ospf_lsack_send_direct(n);
+    ifa->ack_direct = 0;
+  }
+
+  ospf_lsack_send_delayed(ifa);
+}
+
+/**
+ * ospf_lsack_drop - drop acknowledgements waiting on interface
+ * @ifa: OSPF interface
+ *
+ * Used when the interface goes down or its MTU changes, direct acks die
+ * with their neighbors.
+ */
+void
+ospf_lsack_drop(struct ospf_iface *ifa)
+{
+  ifa->ack_count = 0;
+  if (ifa->ack_buf)
+  {
+    mb_free(ifa->ack_buf);
+    ifa->ack_buf = NULL;
   }
-  else
-    ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
 }
 
 void
@@ -142,7 +256,7 @@ ospf_lsack_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 {
   struct proto *p = &ifa->oa->po->proto;
   struct ospf_lsa_header lsa;
-  struct top_hash_entry *en;
+  struct ospf_rxmt *en;
   unsigned int i, lsano;
 
   unsigned int size = ntohs(ps_i->length);
@@ -166,7 +280,8 @@ ospf_lsack_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
   {
     ntohlsah(ps->lsh + i, &lsa);
     u32 dom = ospf_lsa_domain(lsa.type, n->ifa);
-    if ((en = ospf_hash_find_header(n->lsrth, dom, &lsa)) == NULL)
+    if (((en = ospf_rxmt_find(n->ifa, dom, &lsa)) == NULL) ||
+	!ospf_rxmt_test(en, n))
       continue;			/* pg 155 */
 
     if (lsa_comp(&lsa, &en->lsa) != CMP_SAME)	/* pg 156 */
@@ -186,7 +301,6 @@ ospf_lsack_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 
     DBG("Deleting LS Id: %R RT: %R Type: %u from LS Retl for neighbor %R\n",
 	lsa.id, lsa.rt, lsa.type, n->rid);
-    s_rem_node(SNODE en);
-    ospf_hash_delete(n->lsrth, en);
+    ospf_rxmt_clear(n, en);
   }
 }
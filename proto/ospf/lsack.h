@@ -18,8 +18,9 @@ struct lsah_n
 
 void ospf_lsack_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 			struct ospf_neighbor *n);
-void ospf_lsack_send(struct ospf_neighbor *n, int queue);
 void ospf_lsack_enqueue(struct ospf_neighbor *n, struct ospf_lsa_header *h,
 			int queue);
+void ospf_lsack_flush(struct ospf_iface *ifa);
+void ospf_lsack_drop(struct ospf_iface *ifa);
 
 #endif /* _BIRD_OSPF_LSACK_H_ */
@@ -8,6 +8,10 @@
 
 #include "ospf.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void
 flush_lsa(struct top_hash_entry *en, struct proto_ospf *po)
 {
@@ -20,12 +24,24 @@ flush_lsa(struct top_hash_entry *en, struct proto_ospf *po)
 	     "Going to remove LSA Type: %04x, Id: %R, Rt: %R, Age: %u, Seqno: 0x%x",
 	     en->lsa.type, en->lsa.id, en->lsa.rt, en->lsa.age, en->lsa.sn);
 #ifdef ELSA_ENABLED
-  elsa_notify_deleting_lsa(po->elsa, elsa_lsa);
+  OSPF_TIMED(po, OSPF_PH_ELSA_DELETING, elsa_notify_deleting_lsa(po->elsa, elsa_lsa));
 #endif /* ELSA_ENABLED */
   s_rem_node(SNODE en);
+  po->lsdb_gen++;
+  if (en->an.next)
+    rem_node(&en->an);
+  u16 len = en->lsa.length - sizeof(struct ospf_lsa_header);
   if (en->lsa_body != NULL)
-    mb_free(en->lsa_body);
+  {
+#ifdef OSPFv3
+    ospf_prefix_remove(po->gr, en);
+#endif
+    ospf_lsa_free(po->gr, en->lsa_body, len);
+  }
   en->lsa_body = NULL;
+  if (en->lsa_wire != NULL)
+    ospf_lsa_free(po->gr, en->lsa_wire, len);
+  en->lsa_wire = NULL;
   ospf_hash_delete(po->gr, en);
 }
 
@@ -41,57 +57,147 @@ ospf_flush_area(struct proto_ospf *po, u32 areaid)
   }
 }
 
+#define AGE_WHEEL_ORDER 12		/* 4096 s, must be larger than LSA_MAXAGE */
+#define AGE_WHEEL_SIZE (1 << AGE_WHEEL_ORDER)
+#define AGE_WHEEL_MASK (AGE_WHEEL_SIZE - 1)
+
+void
+ospf_age_init(struct proto_ospf *po)
+{
+  int i;
+
+  po->age_wheel = mb_alloc(po->proto.pool, AGE_WHEEL_SIZE * sizeof(list));
+  for (i = 0; i < AGE_WHEEL_SIZE; i++)
+    init_list(&po->age_wheel[i]);
+  po->age_last = now;
+}
+
+/**
+ * lsa_age_schedule - schedule next aging event of LSA
+ * @po: OSPF protocol
+ * @en: LSA entry in the database
+ *
+ * Every LSA in the database is linked to a bucket of the aging wheel
+ * according to the time of its next aging event. That is the refresh
+ * for LSAs originated by the router itself and reaching %LSA_MAXAGE
+ * for other LSAs. LSAs already having %LSA_MAXAGE are scheduled for the
+ * next run of ospf_age(). It has to be called whenever @inst_t,
+ * @ini_age or @lsa.age of @en is changed.
+ */
+void
+lsa_age_schedule(struct proto_ospf *po, struct top_hash_entry *en)
+{
+  bird_clock_t t;
+
+  if (en->lsa.age == LSA_MAXAGE)
+    t = now;
+  else
+    t = en->inst_t - en->ini_age +
+      ((en->lsa.rt == po->router_id) ? LSREFRESHTIME : LSA_MAXAGE);
+
+  if (t <= po->age_last)
+    t = po->age_last + 1;
+
+  if (en->an.next)
+    rem_node(&en->an);
+
+  en->age_t = t;
+  add_tail(&po->age_wheel[t & AGE_WHEEL_MASK], &en->an);
+}
+
+static void
+lsa_age_one(struct proto_ospf *po, struct top_hash_entry *en, int flush)
+{
+  struct proto *p = &po->proto;
+  bird_clock_t age;
+
+  if (en->lsa.age == LSA_MAXAGE)
+  {
+    if (flush)
+      flush_lsa(en, po);
+    else
+      lsa_age_schedule(po, en);
+    return;
+  }
+
+  age = en->ini_age + (now - en->inst_t);
+
+  if ((en->lsa.rt == po->router_id) && (age >= LSREFRESHTIME))
+  {
+    OSPF_TRACE(D_EVENTS, "Refreshing my LSA: Type: %u, Id: %R, Rt: %R",
+	       en->lsa.type, en->lsa.id, en->lsa.rt);
+    en->lsa.sn++;
+    en->lsa.age = 0;
+    en->inst_t = now;
+    en->ini_age = 0;
+    po->lsdb_gen++;
+    lsasum_calculate(&en->lsa, en->lsa_body);
+    ospf_lsupd_flood(po, NULL, NULL, &en->lsa, en->domain, 1);
+    lsa_age_schedule(po, en);
+    return;
+  }
+
+  if (age >= LSA_MAXAGE)
+  {
+    if (flush)
+    {
+      flush_lsa(en, po);
+      schedule_rtcalc(po);
+      return;
+    }
+    else
+    {
+      en->lsa.age = LSA_MAXAGE;
+      po->lsdb_gen++;
+    }
+  }
+
+  lsa_age_schedule(po, en);
+}
+
 /**
  * ospf_age
  * @po: ospf protocol
  *
- * This function is periodicaly invoked from ospf_disp(). It computes the new
- * age of all LSAs and old (@age is higher than %LSA_MAXAGE) LSAs are flushed
- * whenever possible. If an LSA originated by the router itself is older
- * than %LSREFRESHTIME a new instance is originated.
+ * This function is periodicaly invoked from ospf_disp(). It processes LSAs
+ * from buckets of the aging wheel scheduled since its last invocation. Old
+ * (@age is higher than %LSA_MAXAGE) LSAs are flushed whenever possible. If
+ * an LSA originated by the router itself is older than %LSREFRESHTIME a new
+ * instance is originated. Ages of other LSAs are not touched, they are
+ * computed on demand by lsa_get_age().
  *
  * The RFC says that a router should check the checksum of every LSA to detect
  * hardware problems. BIRD does not do this to minimalize CPU utilization.
- *
- * If routing table calculation is scheduled, it also invalidates the old routing
- * table calculation results.
  */
 void
 ospf_age(struct proto_ospf *po)
 {
-  struct proto *p = &po->proto;
-  struct top_hash_entry *en, *nxt;
+  struct top_hash_entry *en;
+  node *n, *nxt;
+  list *l;
   int flush = can_flush_lsa(po);
+  bird_clock_t t = po->age_last;
 
-  WALK_SLIST_DELSAFE(en, nxt, po->lsal)
+  /* Do not walk the wheel more than once */
+  if ((now - t) > AGE_WHEEL_SIZE)
+    t = now - AGE_WHEEL_SIZE;
+
+  while (t < now)
   {
-    if (en->lsa.age == LSA_MAXAGE)
-    {
-      if (flush)
-	flush_lsa(en, po);
-      continue;
-    }
-    if ((en->lsa.rt == po->router_id) && (en->lsa.age >= LSREFRESHTIME))
-    {
-      OSPF_TRACE(D_EVENTS, "Refreshing my LSA: Type: %u, Id: %R, Rt: %R",
-		 en->lsa.type, en->lsa.id, en->lsa.rt);
-      en->lsa.sn++;
-      en->lsa.age = 0;
-      en->inst_t = now;
-      en->ini_age = 0;
-      lsasum_calculate(&en->lsa, en->lsa_body);
-      ospf_lsupd_flood(po, NULL, NULL, &en->lsa, en->domain, 1);
-      continue;
-    }
-    if ((en->lsa.age = (en->ini_age + (now - en->inst_t))) >= LSA_MAXAGE)
+    po->age_last = ++t;
+    l = &po->age_wheel[t & AGE_WHEEL_MASK];
+
+    WALK_LIST_DELSAFE(n, nxt, *l)
     {
-      if (flush)
-      {
-	flush_lsa(en, po);
-	schedule_rtcalc(po);
-      }
-      else
-	en->lsa.age = LSA_MAXAGE;
+      en = SKIP_BACK(struct top_hash_entry, an, n);
+
+      /* Scheduled for the next round of the wheel */
+      if (en->age_t > now)
+	continue;
+
+      rem_node(n);
+      n->next = NULL;
+      lsa_age_one(po, en, flush);
     }
   }
 }
@@ -181,92 +287,165 @@ buf_dump(const char *hdr, const byte *buf, int blen)
 }
 */
 
-#define MODX 4102		/* larges signed value without overflow */
-
 /* Fletcher Checksum -- Refer to RFC1008. */
-#define MODX                 4102
 #define LSA_CHECKSUM_OFFSET    15
 
-/* FIXME This is VERY uneficient, I have huge endianity problems */
+/*
+ * The Fletcher sums are kept in 64-bit accumulators. For any LSA (at most
+ * 64 kB long) they cannot overflow, so the modulo is done just once at the
+ * end instead of in every MODX bytes as RFC 1008 suggests.
+ */
+
+static inline u16
+lsasum_finish(u64 s0, u64 s1, u16 length)
+{
+  int c0 = s0 % 255;
+  int c1 = s1 % 255;
+  int x, y;
+
+  x = (int)((length - LSA_CHECKSUM_OFFSET) * c0 - c1) % 255;
+  if (x <= 0)
+    x += 255;
+  y = 510 - c0 - x;
+  if (y > 255)
+    y -= 255;
+
+  return (x << 8) | y;
+}
+
+#ifdef __SSE2__
+
+#define SUM_VEC_MAX 1024	/* Blocks before lanes of vps could overflow */
+
+static inline u64
+lsasum_hsum(__m128i v)
+{
+  u32 a[4];
+
+  _mm_storeu_si128((__m128i *) a, v);
+  return (u64) a[0] + a[1] + a[2] + a[3];
+}
+
+/* Sums of n 16-byte blocks, s1 is updated as if bytes were added one by one */
+static const u8 *
+lsasum_vec(const u8 *p, unsigned int n, u64 *s0, u64 *s1)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wlo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+  const __m128i whi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+  __m128i vs0 = zero, vps = zero, vs1 = zero;
+  unsigned int i;
+
+  for (i = 0; i < n; i++)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i *) p);
+
+    vps = _mm_add_epi32(vps, vs0);
+    vs0 = _mm_add_epi32(vs0, _mm_sad_epu8(d, zero));
+    vs1 = _mm_add_epi32(vs1, _mm_madd_epi16(_mm_unpacklo_epi8(d, zero), wlo));
+    vs1 = _mm_add_epi32(vs1, _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), whi));
+    p += 16;
+  }
+
+  *s1 += 16 * n * *s0 + 16 * lsasum_hsum(vps) + lsasum_hsum(vs1);
+  *s0 += lsasum_hsum(vs0);
+  return p;
+}
+
+#endif
+
+/* Add len bytes from p to the Fletcher sums */
+static void
+lsasum_block(const u8 *p, unsigned int len, u64 *s0, u64 *s1)
+{
+  const u8 *ep = p + len;
+  u64 c0, c1;
+
+#ifdef __SSE2__
+  while ((ep - p) >= 16)
+  {
+    unsigned int n = MIN((ep - p) / 16, SUM_VEC_MAX);
+    p = lsasum_vec(p, n, s0, s1);
+  }
+#endif
+
+  c0 = *s0;
+  c1 = *s1;
+
+  for (; (ep - p) >= 4; p += 4)
+  {
+    c1 += 4 * c0 + 4 * p[0] + 3 * p[1] + 2 * p[2] + p[3];
+    c0 += p[0] + p[1] + p[2] + p[3];
+  }
+
+  for (; p < ep; p++)
+  {
+    c0 += *p;
+    c1 += c0;
+  }
+
+  *s0 = c0;
+  *s1 = c1;
+}
+
+/**
+ * lsasum_calculate - calculate checksum of LSA in host byte order
+ * @h: LSA header
+ * @body: LSA body
+ *
+ * Computes the Fletcher checksum of the LSA as it will look on the wire
+ * and stores it to @h->checksum (in host byte order). Neither @h nor @body
+ * are swapped in place, body words are converted on the fly.
+ */
 void
 lsasum_calculate(struct ospf_lsa_header *h, void *body)
 {
-  u16 length = h->length;
+  struct ospf_lsa_header n;
+  u32 *b = body;
+  unsigned int i, words;
+  u64 c0 = 0, c1 = 0;
 
-  //  log(L_WARN "Checksum %R %R %d start (len %d)", h->id, h->rt, h->type, length);
-  htonlsah(h, h);
-  htonlsab1(body, length - sizeof(struct ospf_lsa_header));
+  htonlsah(h, &n);
+  n.checksum = 0;
 
-  /*
-  char buf[1024];
-  memcpy(buf, h, sizeof(struct ospf_lsa_header));
-  memcpy(buf + sizeof(struct ospf_lsa_header), body, length - sizeof(struct ospf_lsa_header));
-  buf_dump("CALC", buf, length);
-  */
+  /* Skip Age field */
+  lsasum_block(((u8 *) &n) + 2, sizeof(struct ospf_lsa_header) - 2, &c0, &c1);
 
-  (void) lsasum_check(h, body);
-
-  //  log(L_WARN "Checksum result %4x", h->checksum);
+  words = (h->length - sizeof(struct ospf_lsa_header)) / sizeof(u32);
+  for (i = 0; i < words; i++)
+  {
+    u32 w = b[i];
+    c1 += 4 * c0 + 4 * (w >> 24) + 3 * ((w >> 16) & 0xff) + 2 * ((w >> 8) & 0xff) + (w & 0xff);
+    c0 += (w >> 24) + ((w >> 16) & 0xff) + ((w >> 8) & 0xff) + (w & 0xff);
+  }
 
-  ntohlsah(h, h);
-  ntohlsab1(body, length - sizeof(struct ospf_lsa_header));
+  h->checksum = lsasum_finish(c0, c1, h->length - 2);
 }
 
 /*
  * Note, that this function expects that LSA is in big endianity
  * It also returns value in big endian
+ *
+ * If @body is NULL, the body is expected to follow the header.
  */
 u16
 lsasum_check(struct ospf_lsa_header *h, void *body)
 {
-  u8 *sp, *ep, *p, *q, *b;
-  int c0 = 0, c1 = 0;
-  int x, y;
-  u16 length;
+  u16 length = ntohs(h->length);
+  u64 c0 = 0, c1 = 0;
 
-  b = body;
-  sp = (char *) h;
-  sp += 2; /* Skip Age field */
-  length = ntohs(h->length) - 2;
   h->checksum = 0;
 
-  for (ep = sp + length; sp < ep; sp = q)
-  {				/* Actually MODX is very large, do we need the for-cyclus? */
-    q = sp + MODX;
-    if (q > ep)
-      q = ep;
-    for (p = sp; p < q; p++)
-    {
-      /* 
-       * I count with bytes from header and than from body
-       * but if there is no body, it's appended to header
-       * (probably checksum in update receiving) and I go on
-       * after header
-       */
-      if ((b == NULL) || (p < (u8 *) (h + 1)))
-      {
-	c0 += *p;
-      }
-      else
-      {
-	c0 += *(b + (p - (u8 *) (h + 1)));
-      }
-
-      c1 += c0;
-    }
-    c0 %= 255;
-    c1 %= 255;
+  /* Skip Age field */
+  if (body == NULL)
+    lsasum_block(((u8 *) h) + 2, length - 2, &c0, &c1);
+  else
+  {
+    lsasum_block(((u8 *) h) + 2, sizeof(struct ospf_lsa_header) - 2, &c0, &c1);
+    lsasum_block(body, length - sizeof(struct ospf_lsa_header), &c0, &c1);
   }
 
-  x = (int)((length - LSA_CHECKSUM_OFFSET) * c0 - c1) % 255;
-  if (x <= 0)
-    x += 255;
-  y = 510 - c0 - x;
-  if (y > 255)
-    y -= 255;
-
-  ((u8 *) & h->checksum)[0] = x;
-  ((u8 *) & h->checksum)[1] = y;
+  h->checksum = htons(lsasum_finish(c0, c1, length - 2));
   return h->checksum;
 }
 
@@ -512,6 +691,30 @@ lsa_validate(struct ospf_lsa_header *lsa, void *body)
     }
 }
 
+/**
+ * lsa_get_wire - get LSA body in network byte order
+ * @po: OSPF protocol
+ * @en: LSA in the database
+ *
+ * Sent LSAs (flooded, retransmitted or requested) are copied from a network
+ * byte order copy of the body. The copy is made when the LSA is sent for the
+ * first time and kept until the LSA is replaced or flushed, so LSAs that are
+ * never sent (or only flooded as received) have no second copy.
+ */
+void *
+lsa_get_wire(struct proto_ospf *po, struct top_hash_entry *en)
+{
+  u16 len = en->lsa.length - sizeof(struct ospf_lsa_header);
+
+  if (!en->lsa_wire && len)
+  {
+    en->lsa_wire = ospf_lsa_alloc(po->gr, len);
+    htonlsab(en->lsa_body, en->lsa_wire, len);
+  }
+
+  return en->lsa_wire;
+}
+
 /**
  * lsa_install_new - install new LSA into database
  * @po: OSPF protocol
@@ -526,7 +729,7 @@ lsa_validate(struct ospf_lsa_header *lsa, void *body)
 struct top_hash_entry *
 lsa_install_new(struct proto_ospf *po, struct ospf_lsa_header *lsa, u32 domain, void *body)
 {
-  /* LSA can be temporarrily, but body must be mb_allocated. */
+  /* LSA can be temporarrily, but body must be allocated by ospf_lsa_alloc(). */
   int change = 0;
   struct top_hash_entry *en;
 #ifdef ELSA_ENABLED
@@ -558,17 +761,35 @@ lsa_install_new(struct proto_ospf *po, struct ospf_lsa_header *lsa, u32 domain,
   s_add_tail(&po->lsal, SNODE en);
   en->inst_t = now;
   if (en->lsa_body != NULL)
-    mb_free(en->lsa_body);
+  {
+#ifdef OSPFv3
+    ospf_prefix_remove(po->gr, en);
+#endif
+    ospf_lsa_free(po->gr, en->lsa_body, en->lsa.length - sizeof(struct ospf_lsa_header));
+  }
+  if (en->lsa_wire != NULL)
+  {
+    ospf_lsa_free(po->gr, en->lsa_wire, en->lsa.length - sizeof(struct ospf_lsa_header));
+    en->lsa_wire = NULL;
+  }
   en->lsa_body = body;
+#ifdef OSPFv3
+  ospf_prefix_add(po->gr, en);
+#endif
   memcpy(&en->lsa, lsa, sizeof(struct ospf_lsa_header));
   en->ini_age = en->lsa.age;
+  en->stale = 0;
+  po->lsdb_gen++;
+  lsa_age_schedule(po, en);
+
+  ospf_gr_lsa_installed(po, en, change);
 
   if (change)
   {
     schedule_rtcalc(po);
 #ifdef ELSA_ENABLED
     elsa_lsa = elsa_platform_wrap_lsa(po, en);
-    elsa_notify_changed_lsa(po->elsa, elsa_lsa);
+    OSPF_TIMED(po, OSPF_PH_ELSA_CHANGED, elsa_notify_changed_lsa(po->elsa, elsa_lsa));
 #endif /* ELSA_ENABLED */
   }
 
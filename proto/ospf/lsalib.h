@@ -26,6 +26,30 @@ static inline void htonlsab1(void *h, u16 len) { htonlsab(h, h, len); };
 static inline void ntohlsab1(void *n, u16 len) { ntohlsab(n, n, len); };
 #endif
 
+/*
+ * The age of LSAs in the database is not updated periodically, it is
+ * computed from the installation time when needed. The stored age
+ * (en->lsa.age) is valid only when it is LSA_MAXAGE.
+ */
+static inline u16
+lsa_get_age(struct top_hash_entry *en)
+{
+  bird_clock_t age;
+
+  if (en->lsa.age == LSA_MAXAGE)
+    return LSA_MAXAGE;
+
+  age = en->ini_age + (now - en->inst_t);
+  return (age < LSA_MAXAGE) ? age : LSA_MAXAGE;
+}
+
+/* Update the stored age before the LSA header is used */
+static inline u16
+lsa_update_age(struct top_hash_entry *en)
+{
+  return en->lsa.age = lsa_get_age(en);
+}
+
 void lsasum_calculate(struct ospf_lsa_header *header, void *body);
 u16 lsasum_check(struct ospf_lsa_header *h, void *body);
 #define CMP_NEWER 1
@@ -33,7 +57,10 @@ u16 lsasum_check(struct ospf_lsa_header *h, void *body);
 #define CMP_OLDER -1
 int lsa_comp(struct ospf_lsa_header *l1, struct ospf_lsa_header *l2);
 int lsa_validate(struct ospf_lsa_header *lsa, void *body);
+void *lsa_get_wire(struct proto_ospf *po, struct top_hash_entry *en);
 struct top_hash_entry * lsa_install_new(struct proto_ospf *po, struct ospf_lsa_header *lsa, u32 domain, void *body);
+void ospf_age_init(struct proto_ospf *po);
+void lsa_age_schedule(struct proto_ospf *po, struct top_hash_entry *en);
 void ospf_age(struct proto_ospf *po);
 void flush_lsa(struct top_hash_entry *en, struct proto_ospf *po);
 void ospf_flush_area(struct proto_ospf *po, u32 areaid);
@@ -8,6 +8,107 @@
 
 #include "ospf.h"
 
+#define LSR_HASH_DEF_ORDER 4
+#define LSR_HASH_SIZE(n) (1 << (n)->lsrq_hash_order)
+
+static inline unsigned int
+lsr_hash(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h)
+{
+  u32 x = (h->id * 0x9e3779b9) ^ h->rt ^ (h->type << 16) ^ domain;
+  return (x ^ (x >> 16)) & (LSR_HASH_SIZE(n) - 1);
+}
+
+static void
+lsr_rehash(struct ospf_neighbor *n)
+{
+  struct ospf_lsr *e;
+  unsigned int h;
+
+  mb_free(n->lsrq_hash);
+  n->lsrq_hash_order += 2;
+  n->lsrq_hash = mb_allocz(n->pool, LSR_HASH_SIZE(n) * sizeof(struct ospf_lsr *));
+
+  WALK_SLIST(e, n->lsrql)
+  {
+    h = lsr_hash(n, e->domain, &e->lsa);
+    e->next = n->lsrq_hash[h];
+    n->lsrq_hash[h] = e;
+  }
+}
+
+void
+ospf_lsr_init(struct ospf_neighbor *n)
+{
+  s_init_list(&(n->lsrql));
+  n->lsrq_hash_order = LSR_HASH_DEF_ORDER;
+  n->lsrq_hash = mb_allocz(n->pool, LSR_HASH_SIZE(n) * sizeof(struct ospf_lsr *));
+  n->lsrq_count = 0;
+  n->lsrq_slab = sl_new(n->pool, sizeof(struct ospf_lsr));
+}
+
+void
+ospf_lsr_free(struct ospf_neighbor *n)
+{
+  rfree(n->lsrq_slab);
+  mb_free(n->lsrq_hash);
+}
+
+struct ospf_lsr *
+ospf_lsr_find(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_lsr *e = n->lsrq_hash[lsr_hash(n, domain, h)];
+
+  while (e && ((e->lsa.id != h->id) || (e->lsa.rt != h->rt) ||
+	       (e->lsa.type != h->type) || (e->domain != domain)))
+    e = e->next;
+
+  return e;
+}
+
+/**
+ * ospf_lsr_add - add LSA to link state request list
+ * @n: neighbor
+ * @domain: LSA domain
+ * @h: LSA header
+ *
+ * The LSA must not be in the list yet.
+ */
+struct ospf_lsr *
+ospf_lsr_add(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_lsr *e = sl_alloc(n->lsrq_slab);
+  unsigned int hv;
+
+  e->lsa = *h;
+  e->domain = domain;
+  s_add_tail(&n->lsrql, SNODE e);
+
+  if (++n->lsrq_count > 4 * LSR_HASH_SIZE(n))
+    lsr_rehash(n);
+  else
+  {
+    hv = lsr_hash(n, domain, h);
+    e->next = n->lsrq_hash[hv];
+    n->lsrq_hash[hv] = e;
+  }
+
+  return e;
+}
+
+void
+ospf_lsr_remove(struct ospf_neighbor *n, struct ospf_lsr *e)
+{
+  struct ospf_lsr **ee = &n->lsrq_hash[lsr_hash(n, e->domain, &e->lsa)];
+
+  while (*ee != e)
+    ee = &(*ee)->next;
+
+  *ee = e->next;
+  s_rem_node(SNODE e);
+  sl_free(n->lsrq_slab, e);
+  n->lsrq_count--;
+}
+
 
 struct ospf_lsreq_packet
 {
@@ -36,7 +137,7 @@ void
 ospf_lsreq_send(struct ospf_neighbor *n)
 {
   snode *sn;
-  struct top_hash_entry *en;
+  struct ospf_lsr *en;
   struct ospf_lsreq_packet *pk;
   struct ospf_packet *op;
   struct ospf_lsreq_header *lsh;
@@ -63,7 +164,7 @@ ospf_lsreq_send(struct ospf_neighbor *n)
 
   for (; i > 0; i--)
   {
-    en = (struct top_hash_entry *) sn;
+    en = (struct ospf_lsr *) sn;
     lsh->type = htonl(en->lsa.type);
     lsh->rt = htonl(en->lsa.rt);
     lsh->id = htonl(en->lsa.id);
@@ -10,6 +10,24 @@
 #ifndef _BIRD_OSPF_LSREQ_H_
 #define _BIRD_OSPF_LSREQ_H_
 
+/*
+ * Link state request list entry. Only the LSA header and domain are kept,
+ * entries are indexed by a per-neighbor hash (see ospf_lsr_find()).
+ */
+struct ospf_lsr
+{
+  snode n;			/* Node in n->lsrql */
+  struct ospf_lsr *next;	/* Next in hash chain */
+  struct ospf_lsa_header lsa;
+  u32 domain;
+};
+
+void ospf_lsr_init(struct ospf_neighbor *n);
+void ospf_lsr_free(struct ospf_neighbor *n);
+struct ospf_lsr *ospf_lsr_find(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h);
+struct ospf_lsr *ospf_lsr_add(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h);
+void ospf_lsr_remove(struct ospf_neighbor *n, struct ospf_lsr *e);
+
 void ospf_lsreq_send(struct ospf_neighbor *n);
 void ospf_lsreq_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 			struct ospf_neighbor *n);
@@ -74,10 +74,32 @@ static void ospf_dump_lsupd(struct proto *p, struct ospf_lsupd_packet *pkt)
 
 #ifdef OSPFv2
 
+/* Other LSA types are rejected, see RFC 2328 13. (2), RFC 5250 3.1 */
+int
+ospf_lsa_unknown_type(u32 type)
+{
+  switch (type)
+    {
+    case LSA_T_RT:
+    case LSA_T_NET:
+    case LSA_T_SUM_NET:
+    case LSA_T_SUM_RT:
+    case LSA_T_EXT:
+    case LSA_T_NSSA:
+    case LSA_T_GR:
+    case LSA_T_OPQ_AREA:
+    case LSA_T_OPQ_AS:
+      return 0;
+
+    default:
+      return 1;
+    }
+}
+
 int
 ospf_lsa_flooding_allowed(struct ospf_lsa_header *lsa, u32 domain, struct ospf_iface *ifa)
 {
-  if (lsa->type == LSA_T_EXT)
+  if ((lsa->type == LSA_T_EXT) || (lsa->type == LSA_T_OPQ_AS))
     {
       if (ifa->type == OSPF_IT_VLINK)
 	return 0;
@@ -85,6 +107,8 @@ ospf_lsa_flooding_allowed(struct ospf_lsa_header *lsa, u32 domain, struct ospf_i
 	return 0;
       return 1;
     }
+  else if (lsa->type == LSA_T_GR)
+    return ifa->iface_id == domain;
   else
     return ifa->oa->areaid == domain;
 }
@@ -104,6 +128,7 @@ unknown_lsa_type(struct ospf_lsa_header *lsa)
     case LSA_T_NSSA:
     case LSA_T_LINK:
     case LSA_T_PREFIX:
+    case LSA_T_GR:
       return 0;
 
     default:
@@ -147,6 +172,252 @@ ospf_lsa_flooding_allowed(struct ospf_lsa_header *lsa, u32 domain, struct ospf_i
 
 #endif
 
+static void
+ospf_lsupd_send_queue(struct ospf_iface *ifa)
+{
+  struct proto *p = &ifa->oa->po->proto;
+  struct ospf_lsupd_packet *pk;
+  struct ospf_packet *op;
+
+  pk = ospf_tx_buffer(ifa);
+  op = &pk->ospf_packet;
+
+  ospf_pkt_fill_hdr(ifa, pk, LSUPD_P);
+  pk->lsano = htonl(ifa->flood_lsano);
+  memcpy(pk + 1, ifa->flood_buf, ifa->flood_len);
+  op->length = htons(sizeof(struct ospf_lsupd_packet) + ifa->flood_len);
+
+  OSPF_PACKET(ospf_dump_lsupd, pk, "LSUPD packet flooded via %s", ifa->iface->name);
+
+  switch (ifa->type)
+  {
+  case OSPF_IT_BCAST:
+    if ((ifa->state == OSPF_IS_BACKUP) || (ifa->state == OSPF_IS_DR))
+      ospf_send_to_all(ifa);
+    else if (ifa->cf->real_bcast)
+      ospf_send_to_bdr(ifa);
+    else
+      ospf_send_to(ifa, AllDRouters);
+    break;
+
+  case OSPF_IT_NBMA:
+    if ((ifa->state == OSPF_IS_BACKUP) || (ifa->state == OSPF_IS_DR))
+      ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
+    else
+      ospf_send_to_bdr(ifa);
+    break;
+
+  case OSPF_IT_PTP:
+    ospf_send_to_all(ifa);
+    break;
+
+  case OSPF_IT_PTMP:
+    ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
+    break;
+
+  case OSPF_IT_VLINK:
+    ospf_send_to(ifa, ifa->vip);
+    break;
+
+  default:
+    bug("Bug in ospf_lsupd_send_queue()");
+  }
+}
+
+/**
+ * ospf_lsupd_flush_queue - send LSAs queued for flooding
+ * @ifa: OSPF interface
+ *
+ * LSAs flooded through an interface are not sent immediately, they are
+ * collected in a per-interface queue and sent packed in as few LS Update
+ * packets as possible. The queue is flushed when the next LSA would not
+ * fit into the packet and from ospf_lsupd_flush_queues() event, which is
+ * run after the current batch of received packets is processed.
+ */
+void
+ospf_lsupd_flush_queue(struct ospf_iface *ifa)
+{
+  if (!ifa->flood_lsano)
+    return;
+
+  if (ifa->sk && (ifa->state > OSPF_IS_DOWN))
+    ospf_lsupd_send_queue(ifa);
+
+  ifa->flood_len = 0;
+  ifa->flood_lsano = 0;
+}
+
+/* Hook of po->flood_event, also sends acks collected during the batch */
+void
+ospf_lsupd_flush_queues(void *ptr)
+{
+  struct proto_ospf *po = ptr;
+  struct ospf_iface *ifa;
+
+  WALK_LIST(ifa, po->iface_list)
+  {
+    ospf_lsupd_flush_queue(ifa);
+    ospf_lsack_flush(ifa);
+  }
+}
+
+/* Remove older instances of LSA @hh from LSAs in @buf, returns their number */
+static unsigned
+lsupd_remove_older(byte *buf, unsigned *len, struct ospf_lsa_header *hh)
+{
+  struct ospf_lsa_header *lh, lsa;
+  unsigned pos = 0, l, num = 0;
+  u32 id = htonl(hh->id), rt = htonl(hh->rt);
+
+  while (pos < *len)
+  {
+    lh = (struct ospf_lsa_header *) (buf + pos);
+    l = ntohs(lh->length);
+
+    if ((lh->id == id) && (lh->rt == rt))
+    {
+      ntohlsah(lh, &lsa);
+      if ((lsa.type == hh->type) && (lsa_comp(&lsa, hh) == CMP_OLDER))
+      {
+	memmove(buf + pos, buf + pos + l, *len - pos - l);
+	*len -= l;
+	num++;
+	continue;
+      }
+    }
+
+    pos += l;
+  }
+
+  return num;
+}
+
+/*
+ * A newer instance of an LSA supersedes the older one waiting in the flood
+ * queue or in queued LS Update packets (when the interface is paced), so
+ * that the old instance is not sent at all.
+ */
+static void
+ospf_lsupd_supersede(struct ospf_iface *ifa, struct ospf_lsa_header *hh)
+{
+  struct ospf_txq_packet *q, *qx;
+  struct ospf_lsupd_packet *pk;
+  unsigned len, num;
+
+  if (ifa->flood_lsano)
+  {
+    len = ifa->flood_len;
+    ifa->flood_lsano -= lsupd_remove_older(ifa->flood_buf, &len, hh);
+    ifa->flood_len = len;
+  }
+
+  WALK_LIST_DELSAFE(q, qx, ifa->txq)
+  {
+    pk = (struct ospf_lsupd_packet *) q->data;
+    if (pk->ospf_packet.type != LSUPD_P)
+      continue;
+
+    len = ntohs(pk->ospf_packet.length) - sizeof(struct ospf_lsupd_packet);
+    num = lsupd_remove_older((byte *) (pk + 1), &len, hh);
+    if (!num)
+      continue;
+
+    if (num == ntohl(pk->lsano))
+    {
+      ospf_txq_remove(ifa, q);
+      continue;
+    }
+
+    pk->lsano = htonl(ntohl(pk->lsano) - num);
+    pk->ospf_packet.length = htons(sizeof(struct ospf_lsupd_packet) + len);
+  }
+}
+
+/**
+ * ospf_lsupd_age_queued - age LSAs of a packet leaving the transmit queue
+ * @pkt: LS Update packet (without authentication data)
+ * @delay: time the packet spent in the queue
+ *
+ * Ages in queued packets were set when the packet was built, the time
+ * spent waiting for tokens is added before the packet is sent.
+ */
+void
+ospf_lsupd_age_queued(struct ospf_packet *pkt, unsigned delay)
+{
+  struct ospf_lsupd_packet *pk = (struct ospf_lsupd_packet *) pkt;
+  struct ospf_lsa_header *lh;
+  byte *pos = (byte *) (pk + 1);
+  byte *end = (byte *) pk + ntohs(pkt->length);
+  unsigned i, num = ntohl(pk->lsano);
+  unsigned age;
+
+  for (i = 0; (i < num) && (pos + sizeof(struct ospf_lsa_header) <= end); i++)
+  {
+    lh = (struct ospf_lsa_header *) pos;
+    age = ntohs(lh->age);
+    if (age < LSA_MAXAGE)
+      lh->age = htons(MIN(age + delay, LSA_MAXAGE));
+    pos += ntohs(lh->length);
+  }
+}
+
+static void
+ospf_lsupd_enqueue(struct proto_ospf *po, struct ospf_iface *ifa,
+		   struct ospf_lsa_header *hn, struct ospf_lsa_header *hh, u32 domain)
+{
+  struct ospf_lsa_header *lh;
+  unsigned max = ospf_pkt_maxsize(ifa) - sizeof(struct ospf_lsupd_packet);
+  u16 len = hh->length;
+  u16 age;
+
+  ospf_lsupd_supersede(ifa, hh);
+
+  /* The packet would be too large, send the queue first */
+  if (ifa->flood_len + len > max)
+    ospf_lsupd_flush_queue(ifa);
+
+  if (!ifa->flood_buf)
+  {
+    ifa->flood_size = ospf_pkt_bufsize(ifa) - sizeof(struct ospf_lsupd_packet);
+    ifa->flood_buf = mb_alloc(ifa->pool, ifa->flood_size);
+  }
+
+  /* LSA larger than MTU is sent alone, but it must fit in a tx buffer
+     (which shrinks when authentication is enabled by reconfiguration) */
+  if (len > ospf_pkt_bufsize(ifa) - sizeof(struct ospf_lsupd_packet))
+  {
+    log(L_WARN "OSPF: LSA too large to send (Type: %04x, Id: %R, Rt: %R)",
+	hh->type, hh->id, hh->rt);
+    return;
+  }
+
+  lh = (struct ospf_lsa_header *) ((u8 *) ifa->flood_buf + ifa->flood_len);
+
+  /* Copy LSA into the queue */
+  if (hn)
+  {
+    memcpy(lh, hn, len);
+  }
+  else
+  {
+    struct top_hash_entry *en;
+
+    htonlsah(hh, lh);
+    en = ospf_hash_find_header(po->gr, domain, hh);
+    memcpy(lh + 1, lsa_get_wire(po, en), len - sizeof(struct ospf_lsa_header));
+  }
+
+  age = ntohs(lh->age);
+  age += ifa->inftransdelay;
+  if (age > LSA_MAXAGE)
+    age = LSA_MAXAGE;
+  lh->age = htons(age);
+
+  ifa->flood_len += len;
+  ifa->flood_lsano++;
+  ev_schedule(po->flood_event);
+}
+
 /**
  * ospf_lsupd_flood - send received or generated lsa to the neighbors
  * @po: OSPF protocol
@@ -167,9 +438,9 @@ ospf_lsupd_flood(struct proto_ospf *po,
 {
   struct ospf_iface *ifa;
   struct ospf_neighbor *nn;
-  struct top_hash_entry *en;
-  struct proto *p = &po->proto;
+  struct ospf_lsr *lsr;
   int ret, retval = 0;
+  u64 start = tm_now_us();
 
   /* pg 148 */
   WALK_LIST(ifa, po->iface_list)
@@ -193,33 +464,25 @@ ospf_lsupd_flood(struct proto_ospf *po,
       /* 13.3 (1b) */
       if (nn->state < NEIGHBOR_FULL)
       {
-	if ((en = ospf_hash_find_header(nn->lsrqh, domain, hh)) != NULL)
+	if ((lsr = ospf_lsr_find(nn, domain, hh)) != NULL)
 	{
 	  DBG("That LSA found in lsreq list for neigh %R\n", nn->rid);
 
-	  switch (lsa_comp(hh, &en->lsa))
+	  switch (lsa_comp(hh, &lsr->lsa))
 	  {
 	  case CMP_OLDER:
 	    continue;
 	    break;
 	  case CMP_SAME:
-	    s_rem_node(SNODE en);
-	    if (en->lsa_body != NULL)
-	      mb_free(en->lsa_body);
-	    en->lsa_body = NULL;
 	    DBG("Removing from lsreq list for neigh %R\n", nn->rid);
-	    ospf_hash_delete(nn->lsrqh, en);
+	    ospf_lsr_remove(nn, lsr);
 	    if ((EMPTY_SLIST(nn->lsrql)) && (nn->state == NEIGHBOR_LOADING))
 	      ospf_neigh_sm(nn, INM_LOADDONE);
 	    continue;
 	    break;
 	  case CMP_NEWER:
-	    s_rem_node(SNODE en);
-	    if (en->lsa_body != NULL)
-	      mb_free(en->lsa_body);
-	    en->lsa_body = NULL;
 	    DBG("Removing from lsreq list for neigh %R\n", nn->rid);
-	    ospf_hash_delete(nn->lsrqh, en);
+	    ospf_lsr_remove(nn, lsr);
 	    if ((EMPTY_SLIST(nn->lsrql)) && (nn->state == NEIGHBOR_LOADING))
 	      ospf_neigh_sm(nn, INM_LOADDONE);
 	    break;
@@ -240,26 +503,11 @@ ospf_lsupd_flood(struct proto_ospf *po,
 	   that type of LSA (for LSA types with U-bit == 0). But as we does not support
 	   any optional LSA types, this is not needed yet */
 
-	if ((en = ospf_hash_find_header(nn->lsrth, domain, hh)) == NULL)
-	{
-	  en = ospf_hash_get_header(nn->lsrth, domain, hh);
-	}
-	else
-	{
-	  s_rem_node(SNODE en);
-	}
-	s_add_tail(&nn->lsrtl, SNODE en);
-	memcpy(&en->lsa, hh, sizeof(struct ospf_lsa_header));
+	ospf_rxmt_add(nn, domain, hh);
 	DBG("Adding that LSA for flood to %I\n", nn->ip);
       }
       else
-      {
-	if ((en = ospf_hash_find_header(nn->lsrth, domain, hh)) != NULL)
-	{
-	  s_rem_node(SNODE en);
-	  ospf_hash_delete(nn->lsrth, en);
-	}
-      }
+	ospf_rxmt_remove(nn, domain, hh);
 
       ret = 1;
     }
@@ -276,83 +524,10 @@ ospf_lsupd_flood(struct proto_ospf *po,
       retval = 1;
     }
 
-    {
-      u16 len, age;
-      struct ospf_lsupd_packet *pk;
-      struct ospf_packet *op;
-      struct ospf_lsa_header *lh;
-
-      pk = ospf_tx_buffer(ifa);
-      op = &pk->ospf_packet;
-
-      ospf_pkt_fill_hdr(ifa, pk, LSUPD_P);
-      pk->lsano = htonl(1);
-
-      lh = (struct ospf_lsa_header *) (pk + 1);
-
-      /* Copy LSA into the packet */
-      if (hn)
-      {
-	memcpy(lh, hn, ntohs(hn->length));
-      }
-      else
-      {
-	u8 *help;
-	struct top_hash_entry *en;
-
-	htonlsah(hh, lh);
-	help = (u8 *) (lh + 1);
-	en = ospf_hash_find_header(po->gr, domain, hh);
-	htonlsab(en->lsa_body, help, hh->length - sizeof(struct ospf_lsa_header));
-      }
-
-      len = sizeof(struct ospf_lsupd_packet) + ntohs(lh->length);
-
-      age = ntohs(lh->age);
-      age += ifa->inftransdelay;
-      if (age > LSA_MAXAGE)
-	age = LSA_MAXAGE;
-      lh->age = htons(age);
-
-      op->length = htons(len);
-
-      OSPF_PACKET(ospf_dump_lsupd, pk, "LSUPD packet flooded via %s", ifa->iface->name);
-
-      switch (ifa->type)
-      {
-      case OSPF_IT_BCAST:
-	if ((ifa->state == OSPF_IS_BACKUP) || (ifa->state == OSPF_IS_DR))
-	  ospf_send_to_all(ifa);
-	else if (ifa->cf->real_bcast)
-	  ospf_send_to_bdr(ifa);
-	else
-	  ospf_send_to(ifa, AllDRouters);
-	break;
-
-      case OSPF_IT_NBMA:
-	if ((ifa->state == OSPF_IS_BACKUP) || (ifa->state == OSPF_IS_DR))
-	  ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
-	else
-	  ospf_send_to_bdr(ifa);
-	break;
-
-      case OSPF_IT_PTP:
-	ospf_send_to_all(ifa);
-	break;
-
-      case OSPF_IT_PTMP:
-	ospf_send_to_agt(ifa, NEIGHBOR_EXCHANGE);
-	break;
-
-      case OSPF_IT_VLINK:
-	ospf_send_to(ifa, ifa->vip);
-	break;
-
-      default:
-	bug("Bug in ospf_lsupd_flood()");
-      }
-    }
+    ospf_lsupd_enqueue(po, ifa, hn, hh, domain);
   }
+
+  ospf_stats_add(po, OSPF_PH_FLOOD, start);
   return retval;
 }
 
@@ -411,9 +586,10 @@ ospf_lsupd_send_list(struct ospf_neighbor *n, list * l)
       }
 
       /* Copy the LSA to the packet */
+      lsa_update_age(en);
       htonlsah(&(en->lsa), (struct ospf_lsa_header *) (buf + len));
-      htonlsab(en->lsa_body, buf + len + sizeof(struct ospf_lsa_header),
-	       en->lsa.length - sizeof(struct ospf_lsa_header));
+      memcpy(buf + len + sizeof(struct ospf_lsa_header), lsa_get_wire(oa->po, en),
+	     en->lsa.length - sizeof(struct ospf_lsa_header));
       len = len2;
       lsano++;
       lsr = NODE_NEXT(lsr);
@@ -431,12 +607,86 @@ ospf_lsupd_send_list(struct ospf_neighbor *n, list * l)
   }
 }
 
+/*
+ * Batched validation stage of ospf_lsupd_receive(). An LS Update received
+ * during database exchange carries many LSAs, so lengths and checksums of
+ * a batch of them are checked in one pass, their headers converted and LSDB
+ * index slots prefetched before the (much longer) per-LSA processing.
+ */
+
+#ifndef LSUPD_BATCH
+#define LSUPD_BATCH 32		/* 1 disables batching, for comparison */
+#endif
+
+#define LSUPD_OK	0
+#define LSUPD_BADSUM	1	/* Bad checksum, skip the LSA */
+#define LSUPD_SHORT	2	/* Packet too short, stop processing */
+#define LSUPD_BADLEN	3	/* Bad LSA length, stop processing */
+
+struct lsupd_item
+{
+  struct ospf_lsa_header *lsa;	/* LSA in the packet (network byte order) */
+  struct ospf_lsa_header lsatmp; /* Its header in host byte order */
+  u32 domain;
+  u16 chsum;			/* Received checksum */
+  u8 state;
+};
+
+/* Fill at most @num items, the batch ends with the first length error */
+static unsigned int
+lsupd_batch(struct ospf_iface *ifa, struct ospf_lsupd_packet *ps, unsigned int size,
+	    unsigned int *offset, unsigned int num, struct lsupd_item *batch)
+{
+  struct proto_ospf *po = ifa->oa->po;
+  unsigned int bound = size - sizeof(struct ospf_lsa_header);
+  unsigned int i;
+
+  num = MIN(num, LSUPD_BATCH);
+  for (i = 0; i < num; i++)
+  {
+    struct lsupd_item *it = &batch[i];
+
+    if (*offset > bound)
+    {
+      it->state = LSUPD_SHORT;
+      return i + 1;
+    }
+
+    struct ospf_lsa_header *lsa = (void *) (((u8 *) ps) + *offset);
+    unsigned int lsalen = ntohs(lsa->length);
+    *offset += lsalen;
+    it->lsa = lsa;
+
+    if ((*offset > size) || ((lsalen % 4) != 0) ||
+	(lsalen <= sizeof(struct ospf_lsa_header)))
+    {
+      it->state = LSUPD_BADLEN;
+      return i + 1;
+    }
+
+    /* pg 143 (1) */
+    it->chsum = lsa->checksum;
+    if (it->chsum != lsasum_check(lsa, NULL))
+    {
+      it->state = LSUPD_BADSUM;
+      continue;
+    }
+
+    ntohlsah(lsa, &it->lsatmp);
+    /* FIXME domain should be link id for unknown LSA types with zero Ubit */
+    it->domain = ospf_lsa_domain(it->lsatmp.type, ifa);
+    it->state = LSUPD_OK;
+    ospf_hash_prefetch(po->gr, it->domain, &it->lsatmp);
+  }
+
+  return i;
+}
+
 void
 ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 		   struct ospf_neighbor *n)
 {
 
-  struct ospf_neighbor *ntmp;
   struct proto_ospf *po = ifa->oa->po;
   struct proto *p = &po->proto;
   unsigned int i, max, sendreq = 1;
@@ -464,7 +714,8 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
   ospf_neigh_sm(n, INM_HELLOREC);	/* Questionable */
 
   unsigned int offset = sizeof(struct ospf_lsupd_packet);
-  unsigned int bound = size - sizeof(struct ospf_lsa_header);
+  struct lsupd_item batch[LSUPD_BATCH];
+  unsigned int bpos = 0, bcnt = 0;
 
   max = ntohl(ps->lsano);
   for (i = 0; i < max; i++)
@@ -472,45 +723,47 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
     struct ospf_lsa_header lsatmp;
     struct top_hash_entry *lsadb;
 
-    if (offset > bound)
+    if (bpos == bcnt)
+    {
+      bcnt = lsupd_batch(ifa, ps, size, &offset, max - i, batch);
+      bpos = 0;
+    }
+
+    struct lsupd_item *it = &batch[bpos++];
+    struct ospf_lsa_header *lsa = it->lsa;
+
+    if (it->state == LSUPD_SHORT)
     {
       log(L_WARN "Received lsupd from %I is too short!", n->ip);
       ospf_neigh_sm(n, INM_BADLSREQ);
       return;
     }
 
-    struct ospf_lsa_header *lsa = (void *) (((u8 *) ps) + offset);
-    unsigned int lsalen = ntohs(lsa->length);
-    offset += lsalen;
-
-    if ((offset > size) || ((lsalen % 4) != 0) ||
-	(lsalen <= sizeof(struct ospf_lsa_header)))
+    if (it->state == LSUPD_BADLEN)
     {
       log(L_WARN "Received LSA from %I with bad length", n->ip);
       ospf_neigh_sm(n, INM_BADLSREQ);
       break;
     }
 
-    /* pg 143 (1) */
-    u16 chsum = lsa->checksum;
-    if (chsum != lsasum_check(lsa, NULL))
+    if (it->state == LSUPD_BADSUM)
     {
-      log(L_WARN "Received bad lsa checksum from %I: %x %x", n->ip, chsum, lsa->checksum);
+      log(L_WARN "Received bad lsa checksum from %I: %x %x", n->ip, it->chsum, lsa->checksum);
       continue;
     }
 
-    ntohlsah(lsa, &lsatmp);
+    lsatmp = it->lsatmp;
 
 #ifdef OSPFv2
     /* pg 143 (2) */
-    if ((lsatmp.type == 0) || (lsatmp.type == 6) || (lsatmp.type > LSA_T_NSSA))
+    if (ospf_lsa_unknown_type(lsatmp.type))
     {
       log(L_WARN "Unknown LSA type from %I", n->ip);
       continue;
     }
 
     /* pg 143 (3) */
-    if ((lsatmp.type == LSA_T_EXT) && !oa_is_ext(ifa->oa))
+    if ((LSA_SCOPE(&lsatmp) == LSA_SCOPE_AS) && !oa_is_ext(ifa->oa))
     {
       log(L_WARN "Received External LSA in stub area from %I", n->ip);
       continue;
@@ -536,9 +789,10 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
     DBG("Update Type: %u ID: %R RT: %R, Sn: 0x%08x Age: %u, Sum: %u\n",
 	lsatmp.type, lsatmp.id, lsatmp.rt, lsatmp.sn, lsatmp.age, lsatmp.checksum);
 
-    /* FIXME domain should be link id for unknown LSA types with zero Ubit */
-    u32 domain = ospf_lsa_domain(lsatmp.type, ifa);
+    u32 domain = it->domain;
     lsadb = ospf_hash_find_header(po->gr, domain, &lsatmp);
+    if (lsadb)
+      lsa_update_age(lsadb);
 
 #ifdef LOCAL_DEBUG
     if (lsadb)
@@ -580,8 +834,15 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
       }
 #endif
 
+      /*
+       * During graceful restart, our LSAs unknown since the restart are
+       * accepted, they are either adopted or flushed after the restart.
+       */
+      if (self && po->gr_restart && (!lsadb || lsadb->stale))
+	self = -1;
+
       /* pg 145 (5f) - premature aging of self originated lsa */
-      if (self)
+      if (self > 0)
       {
 	if ((lsatmp.age == LSA_MAXAGE) && (lsatmp.sn == LSA_MAXSEQNO))
 	{
@@ -597,7 +858,8 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
         dummy_the.lsa = lsatmp;
         dummy_the.lsa_body = lsa + 1;
         dummy_elsa_lsa = elsa_platform_wrap_lsa(po, &dummy_the);
-        elsa_notify_duplicate_lsa(po->elsa, dummy_elsa_lsa);
+        OSPF_TIMED(po, OSPF_PH_ELSA_DUPLICATE,
+                   elsa_notify_duplicate_lsa(po->elsa, dummy_elsa_lsa));
 #endif /* ELSA_ENABLED */
 
 	if (lsadb)
@@ -607,6 +869,8 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
 	  lsadb->lsa.age = 0;
 	  lsadb->inst_t = now;
 	  lsadb->ini_age = 0;
+	  po->lsdb_gen++;
+	  lsa_age_schedule(po, lsadb);
 	  lsasum_calculate(&lsadb->lsa, lsadb->lsa_body);
 	  ospf_lsupd_flood(po, NULL, NULL, &lsadb->lsa, domain, 1);
 	}
@@ -637,16 +901,7 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
       /* Must be done before (5b), otherwise it also removes the new entries from (5b) */
       if (lsadb)
 	WALK_LIST(ift, po->iface_list)
-	  WALK_LIST(ntmp, ift->neigh_list)
-      {
-	struct top_hash_entry *en;
-	if (ntmp->state > NEIGHBOR_EXSTART)
-	  if ((en = ospf_hash_find_header(ntmp->lsrth, domain, &lsadb->lsa)) != NULL)
-	  {
-	    s_rem_node(SNODE en);
-	    ospf_hash_delete(ntmp->lsrth, en);
-	  }
-      }
+	  ospf_rxmt_remove_all(ift, domain, &lsadb->lsa);
 
       /* pg 144 (5b) */
       if (ospf_lsupd_flood(po, n, lsa, &lsatmp, domain, 1) == 0)
@@ -670,8 +925,9 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
       }				/* FIXME lsack? */
 
       /* pg 144 (5d) */
-      void *body = mb_alloc(p->pool, lsatmp.length - sizeof(struct ospf_lsa_header));
-      ntohlsab(lsa + 1, body, lsatmp.length - sizeof(struct ospf_lsa_header));
+      u16 blen = lsatmp.length - sizeof(struct ospf_lsa_header);
+      void *body = ospf_lsa_alloc(po->gr, blen);
+      ntohlsab(lsa + 1, body, blen);
 
       /* We will do validation check after flooding and
 	 acknowledging given LSA to minimize problems
@@ -679,11 +935,12 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
       if (lsa_validate(&lsatmp, body) == 0)
       {
 	log(L_WARN "Received invalid LSA from %I", n->ip);
-	mb_free(body);
+	ospf_lsa_free(po->gr, body, blen);
 	continue;
       }
 
       lsadb = lsa_install_new(po, &lsatmp, domain, body);
+      lsadb->stale = (self < 0);
       DBG("New LSA installed in DB\n");
 
 #ifdef OSPFv3
@@ -701,13 +958,10 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
     /* pg145 (7) */
     if (lsa_comp(&lsatmp, &lsadb->lsa) == CMP_SAME)
     {
-      struct top_hash_entry *en;
       DBG("PG145(7) Got the same LSA\n");
-      if ((en = ospf_hash_find_header(n->lsrth, lsadb->domain, &lsadb->lsa)) != NULL)
+      if (ospf_rxmt_remove(n, lsadb->domain, &lsadb->lsa))
       {
 	/* pg145 (7a) */
-	s_rem_node(SNODE en);
-	ospf_hash_delete(n->lsrth, en);
 
 	if (ifa->state == OSPF_IS_BACKUP)
 	{
@@ -742,9 +996,6 @@ ospf_lsupd_receive(struct ospf_packet *ps_i, struct ospf_iface *ifa,
     }
   }
 
-  /* Send direct LSAs */
-  ospf_lsack_send(n, ACKL_DIRECT);
-
   if (sendreq && (n->state == NEIGHBOR_LOADING))
   {
     ospf_lsreq_send(n);		/* Ask for another part of neighbor's database */
@@ -759,6 +1010,8 @@ ospf_lsupd_flush_nlsa(struct proto_ospf *po, struct top_hash_entry *en)
 
   lsa->age = LSA_MAXAGE;
   lsa->sn = LSA_MAXSEQNO;
+  po->lsdb_gen++;
+  lsa_age_schedule(po, en);
   lsasum_calculate(lsa, en->lsa_body);
   OSPF_TRACE(D_EVENTS, "Premature aging self originated lsa!");
   OSPF_TRACE(D_EVENTS, "Type: %04x, Id: %R, Rt: %R", lsa->type, lsa->id, lsa->rt);
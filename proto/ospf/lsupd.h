@@ -18,8 +18,14 @@ void ospf_lsupd_receive(struct ospf_packet *ps_i,
 int ospf_lsupd_flood(struct proto_ospf *po,
 		     struct ospf_neighbor *n, struct ospf_lsa_header *hn,
 		     struct ospf_lsa_header *hh, u32 domain, int rtl);
+void ospf_lsupd_flush_queue(struct ospf_iface *ifa);
+void ospf_lsupd_flush_queues(void *ptr);
 void ospf_lsupd_flush_nlsa(struct proto_ospf *po, struct top_hash_entry *en);
+void ospf_lsupd_age_queued(struct ospf_packet *pkt, unsigned delay);
 int ospf_lsa_flooding_allowed(struct ospf_lsa_header *lsa, u32 domain, struct ospf_iface *ifa);
+#ifdef OSPFv2
+int ospf_lsa_unknown_type(u32 type);
+#endif
 
 
 #endif /* _BIRD_OSPF_LSUPD_H_ */
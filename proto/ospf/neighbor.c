@@ -26,22 +26,19 @@ const char *ospf_inm[] =
 };
 
 static void neigh_chstate(struct ospf_neighbor *n, u8 state);
+static int can_do_adj(struct ospf_neighbor *n);
+
+#define NEIGH_EXCHANGING(s) (((s) >= NEIGHBOR_EXSTART) && ((s) < NEIGHBOR_FULL))
 static struct ospf_neighbor *electbdr(list nl);
 static struct ospf_neighbor *electdr(list nl);
 static void neighbor_timer_hook(timer * timer);
 static void rxmt_timer_hook(timer * timer);
-static void ackd_timer_hook(timer * t);
 
 static void
 init_lists(struct ospf_neighbor *n)
 {
-  s_init_list(&(n->lsrql));
-  n->lsrqh = ospf_top_new(n->pool);
+  ospf_lsr_init(n);
   s_init(&(n->lsrqi), &(n->lsrql));
-
-  s_init_list(&(n->lsrtl));
-  n->lsrth = ospf_top_new(n->pool);
-  s_init(&(n->lsrti), &(n->lsrtl));
 }
 
 /* Resets LSA request and retransmit lists.
@@ -51,29 +48,122 @@ init_lists(struct ospf_neighbor *n)
 static void
 reset_lists(struct ospf_neighbor *n)
 {
-  ospf_top_free(n->lsrqh);
-  ospf_top_free(n->lsrth);
+  ospf_lsr_free(n);
+  ospf_rxmt_flush_neigh(n);
   init_lists(n);
 }
 
+/*
+ * Neighbors of an interface are indexed by router ID and by address,
+ * packet dispatch looks them up for every received packet.
+ */
+
+#define NEIGH_HASH_DEF_ORDER 4
+#define NEIGH_HASH_MAX_ORDER 16
+#define NEIGH_HASH_SIZE(ifa) (1 << (ifa)->neigh_hash_order)
+
+static inline struct ospf_neighbor **
+neigh_rid_slot(struct ospf_iface *ifa, u32 rid)
+{
+  return &ifa->neigh_rid_hash[(rid * 0x9e3779b9) >> (32 - ifa->neigh_hash_order)];
+}
+
+static inline struct ospf_neighbor **
+neigh_ip_slot(struct ospf_iface *ifa, ip_addr ip)
+{
+  return &ifa->neigh_ip_hash[ipa_hash(ip) & (NEIGH_HASH_SIZE(ifa) - 1)];
+}
+
+static void
+neigh_hash_alloc(struct ospf_iface *ifa)
+{
+  ifa->neigh_rid_hash = mb_allocz(ifa->pool, NEIGH_HASH_SIZE(ifa) * sizeof(struct ospf_neighbor *));
+  ifa->neigh_ip_hash = mb_allocz(ifa->pool, NEIGH_HASH_SIZE(ifa) * sizeof(struct ospf_neighbor *));
+}
+
+static inline void
+neigh_hash_add(struct ospf_neighbor *n)
+{
+  struct ospf_neighbor **nn;
+
+  nn = neigh_rid_slot(n->ifa, n->rid);
+  n->next_rid = *nn;
+  *nn = n;
+
+  nn = neigh_ip_slot(n->ifa, n->ip);
+  n->next_ip = *nn;
+  *nn = n;
+}
+
+static inline void
+neigh_hash_rem_ip(struct ospf_neighbor *n)
+{
+  struct ospf_neighbor **nn = neigh_ip_slot(n->ifa, n->ip);
+
+  while (*nn != n)
+    nn = &(*nn)->next_ip;
+  *nn = n->next_ip;
+}
+
+static inline void
+neigh_hash_rem(struct ospf_neighbor *n)
+{
+  struct ospf_neighbor **nn = neigh_rid_slot(n->ifa, n->rid);
+
+  while (*nn != n)
+    nn = &(*nn)->next_rid;
+  *nn = n->next_rid;
+
+  neigh_hash_rem_ip(n);
+}
+
+static void
+neigh_rehash(struct ospf_iface *ifa)
+{
+  struct ospf_neighbor *n;
+
+  mb_free(ifa->neigh_rid_hash);
+  mb_free(ifa->neigh_ip_hash);
+  ifa->neigh_hash_order++;
+  neigh_hash_alloc(ifa);
+
+  WALK_LIST(n, ifa->neigh_list)
+    neigh_hash_add(n);
+}
+
+void
+ospf_neigh_hash_init(struct ospf_iface *ifa)
+{
+  ifa->neigh_hash_order = NEIGH_HASH_DEF_ORDER;
+  ifa->neigh_count = 0;
+  neigh_hash_alloc(ifa);
+}
+
 struct ospf_neighbor *
-ospf_neighbor_new(struct ospf_iface *ifa)
+ospf_neighbor_new(struct ospf_iface *ifa, u32 rid, ip_addr ip)
 {
   struct proto *p = (struct proto *) (ifa->oa->po);
-  struct proto_ospf *po = ifa->oa->po;
   struct pool *pool = rp_new(p->pool, "OSPF Neighbor");
   struct ospf_neighbor *n = mb_allocz(pool, sizeof(struct ospf_neighbor));
 
   n->pool = pool;
   n->ifa = ifa;
+  n->rid = rid;
+  n->ip = ip;
   add_tail(&ifa->neigh_list, NODE n);
+
+  if ((++ifa->neigh_count > 2 * NEIGH_HASH_SIZE(ifa)) &&
+      (ifa->neigh_hash_order < NEIGH_HASH_MAX_ORDER))
+    neigh_rehash(ifa);
+  else
+    neigh_hash_add(n);
   n->adj = 0;
   n->csn = 0;
   n->ldbdes = mb_allocz(pool, ifa->iface->mtu);
   n->state = NEIGHBOR_DOWN;
 
   init_lists(n);
-  s_init(&(n->dbsi), &(po->lsal));
+  ospf_rxmt_add_neigh(n);
 
   n->inactim = tm_new(pool);
   n->inactim->data = n;
@@ -82,6 +172,12 @@ ospf_neighbor_new(struct ospf_iface *ifa)
   n->inactim->recurrent = 0;
   DBG("%s: Installing inactivity timer.\n", p->name);
 
+  n->gr_timer = tm_new(pool);
+  n->gr_timer->data = n;
+  n->gr_timer->randomize = 0;
+  n->gr_timer->hook = ospf_gr_helper_timeout;
+  n->gr_timer->recurrent = 0;
+
   n->rxmt_timer = tm_new(pool);
   n->rxmt_timer->data = n;
   n->rxmt_timer->randomize = 0;
@@ -90,15 +186,7 @@ ospf_neighbor_new(struct ospf_iface *ifa)
   tm_start(n->rxmt_timer, n->ifa->rxmtint);
   DBG("%s: Installing rxmt timer.\n", p->name);
 
-  n->ackd_timer = tm_new(pool);
-  n->ackd_timer->data = n;
-  n->ackd_timer->randomize = 0;
-  n->ackd_timer->hook = ackd_timer_hook;
-  n->ackd_timer->recurrent = ifa->rxmtint / 2;
-  init_list(&n->ackl[ACKL_DIRECT]);
-  init_list(&n->ackl[ACKL_DELAY]);
-  tm_start(n->ackd_timer, n->ifa->rxmtint / 2);
-  DBG("%s: Installing ackd timer.\n", p->name);
+  init_list(&n->ackl);
 
   return (n);
 }
@@ -125,17 +213,36 @@ neigh_chstate(struct ospf_neighbor *n, u8 state)
     struct proto_ospf *po = ifa->oa->po;
     struct proto *p = &po->proto;
 
+    if (n->gr_active && (state == NEIGHBOR_DOWN))
+      ospf_gr_helper_exit(n, "aborted, neighbor is down");
+
     n->state = state;
 
     OSPF_TRACE(D_EVENTS, "Neighbor %I changes state from \"%s\" to \"%s\".",
 	       n->ip, ospf_ns[oldstate], ospf_ns[state]);
 
+    if (oldstate == NEIGHBOR_EXCHANGE)
+      ospf_dbdes_snap_put(n);
+
+    if (!NEIGH_EXCHANGING(oldstate) && NEIGH_EXCHANGING(state))
+      po->exchanges++;
+
+    if (NEIGH_EXCHANGING(oldstate) && !NEIGH_EXCHANGING(state))
+    {
+      po->exchanges--;
+
+      /* Let waiting neighbors start their exchange */
+      if (po->exchange_limit)
+	ev_schedule(po->adj_event);
+    }
+
     if ((state == NEIGHBOR_2WAY) && (oldstate < NEIGHBOR_2WAY))
       ospf_iface_sm(ifa, ISM_NEICH);
-    if ((state < NEIGHBOR_2WAY) && (oldstate >= NEIGHBOR_2WAY))
+    if ((state < NEIGHBOR_2WAY) && (oldstate >= NEIGHBOR_2WAY) && !n->gr_active)
       ospf_iface_sm(ifa, ISM_NEICH);
 
-    if (oldstate == NEIGHBOR_FULL)	/* Decrease number of adjacencies */
+    /* Restarting neighbor stays adjacent while we help it, see gr.c */
+    if ((oldstate == NEIGHBOR_FULL) && !n->gr_active)	/* Decrease number of adjacencies */
     {
       ifa->fadj--;
       schedule_rt_lsa(ifa->oa);
@@ -145,13 +252,23 @@ neigh_chstate(struct ospf_neighbor *n, u8 state)
 
     if (state == NEIGHBOR_FULL)	/* Increase number of adjacencies */
     {
-      ifa->fadj++;
-      schedule_rt_lsa(ifa->oa);
-      if (ifa->type == OSPF_IT_VLINK) schedule_rt_lsa(ifa->voa);
-      schedule_net_lsa(ifa);
+      po->adj_full++;
+      po->adj_full_time += now - n->adj_start;
+
+      if (n->gr_active)
+	ospf_gr_helper_exit(n, "completed");
+      else
+      {
+	ifa->fadj++;
+	schedule_rt_lsa(ifa->oa);
+	if (ifa->type == OSPF_IT_VLINK) schedule_rt_lsa(ifa->voa);
+	schedule_net_lsa(ifa);
+      }
     }
     if (state == NEIGHBOR_EXSTART)
     {
+      if (oldstate < NEIGHBOR_EXSTART)
+	n->adj_start = now;
       if (n->adj == 0)		/* First time adjacency */
       {
 	n->dds = random_u32();
@@ -315,6 +432,46 @@ can_do_adj(struct ospf_neighbor *n)
   return i;
 }
 
+/*
+ * Neighbors in ExStart, Exchange and Loading states are counted in
+ * po->exchanges. When po->exchange_limit is reached, neighbors that could
+ * form an adjacency wait in 2-Way state and ospf_neigh_adj_event() starts
+ * them when an exchange finishes.
+ */
+static void
+start_adj(struct ospf_neighbor *n)
+{
+  struct proto_ospf *po = n->ifa->oa->po;
+  struct proto *p = &po->proto;
+
+  if (po->exchange_limit && (po->exchanges >= po->exchange_limit))
+  {
+    OSPF_TRACE(D_EVENTS, "Postponing adjacency with %I, %d exchanges in progress",
+	       n->ip, po->exchanges);
+    return;
+  }
+
+  neigh_chstate(n, NEIGHBOR_EXSTART);
+}
+
+void
+ospf_neigh_adj_event(void *data)
+{
+  struct proto_ospf *po = data;
+  struct ospf_iface *ifa;
+  struct ospf_neighbor *n;
+
+  WALK_LIST(ifa, po->iface_list)
+    WALK_LIST(n, ifa->neigh_list)
+    {
+      if (po->exchange_limit && (po->exchanges >= po->exchange_limit))
+	return;
+
+      if ((n->state == NEIGHBOR_2WAY) && can_do_adj(n))
+	start_adj(n);
+    }
+}
+
 /**
  * ospf_neigh_sm - ospf neighbor state machine
  * @n: neighor
@@ -357,24 +514,15 @@ ospf_neigh_sm(struct ospf_neighbor *n, int event)
     if (n->state < NEIGHBOR_2WAY)
       neigh_chstate(n, NEIGHBOR_2WAY);
     if ((n->state == NEIGHBOR_2WAY) && can_do_adj(n))
-      neigh_chstate(n, NEIGHBOR_EXSTART);
+      start_adj(n);
     break;
   case INM_NEGDONE:
     if (n->state == NEIGHBOR_EXSTART)
     {
       neigh_chstate(n, NEIGHBOR_EXCHANGE);
 
-      /* Reset DB summary list iterator */
-      s_get(&(n->dbsi));
-      s_init(&(n->dbsi), &po->lsal);
-
-      while (!EMPTY_LIST(n->ackl[ACKL_DELAY]))
-      {
-	struct lsah_n *no;
-	no = (struct lsah_n *) HEAD(n->ackl[ACKL_DELAY]);
-	rem_node(NODE no);
-	mb_free(no);
-      }
+      /* Take DB summary snapshot */
+      ospf_dbdes_snap_get(n);
     }
     else
       bug("NEGDONE and I'm not in EXSTART?");
@@ -391,9 +539,7 @@ ospf_neigh_sm(struct ospf_neighbor *n, int event)
     case NEIGHBOR_2WAY:
       /* Can In build adjacency? */
       if (can_do_adj(n))
-      {
-	neigh_chstate(n, NEIGHBOR_EXSTART);
-      }
+	start_adj(n);
       break;
     default:
       if (n->state >= NEIGHBOR_EXSTART)
@@ -532,7 +678,7 @@ struct ospf_neighbor *
 find_neigh(struct ospf_iface *ifa, u32 rid)
 {
   struct ospf_neighbor *n;
-  WALK_LIST(n, ifa->neigh_list)
+  for (n = *neigh_rid_slot(ifa, rid); n; n = n->next_rid)
     if (n->rid == rid)
       return n;
   return NULL;
@@ -542,12 +688,25 @@ struct ospf_neighbor *
 find_neigh_by_ip(struct ospf_iface *ifa, ip_addr ip)
 {
   struct ospf_neighbor *n;
-  WALK_LIST(n, ifa->neigh_list)
+  for (n = *neigh_ip_slot(ifa, ip); n; n = n->next_ip)
     if (ipa_equal(n->ip, ip))
       return n;
   return NULL;
 }
 
+void
+ospf_neigh_set_ip(struct ospf_neighbor *n, ip_addr ip)
+{
+  struct ospf_neighbor **nn;
+
+  neigh_hash_rem_ip(n);
+  n->ip = ip;
+
+  nn = neigh_ip_slot(n->ifa, ip);
+  n->next_ip = *nn;
+  *nn = n;
+}
+
 /* Neighbor is inactive for a long time. Remove it. */
 static void
 neighbor_timer_hook(timer * timer)
@@ -559,6 +718,14 @@ neighbor_timer_hook(timer * timer)
   OSPF_TRACE(D_EVENTS,
 	     "Inactivity timer fired on interface %s for neighbor %I / %R.",
 	     ifa->iface->name, n->ip, n->rid);
+
+  /* Restarting neighbor may be silent until its grace period expires */
+  if (n->gr_active)
+  {
+    tm_start(n->inactim, ifa->deadint);
+    return;
+  }
+
   ospf_neigh_remove(n);
 }
 
@@ -575,8 +742,10 @@ ospf_neigh_remove(struct ospf_neighbor *n)
       nn->found = 0;
   }
 
-  s_get(&(n->dbsi));
   neigh_chstate(n, NEIGHBOR_DOWN);
+  ospf_rxmt_flush_neigh(n);
+  neigh_hash_rem(n);
+  ifa->neigh_count--;
   rem_node(NODE n);
   rfree(n->pool);
   OSPF_TRACE(D_EVENTS, "Deleting neigbor.");
@@ -620,7 +789,6 @@ rxmt_timer_hook(timer * timer)
 {
   struct ospf_neighbor *n = (struct ospf_neighbor *) timer->data;
   // struct proto *p = &n->ifa->oa->po->proto;
-  struct top_hash_entry *en;
 
   DBG("%s: RXMT timer fired on interface %s for neigh: %I.\n",
       p->name, n->ifa->iface->name, n->ip);
@@ -641,19 +809,21 @@ rxmt_timer_hook(timer * timer)
     ospf_lsreq_send(n);	/* EXCHANGE or LOADING */
   else
   {
-    if (!EMPTY_SLIST(n->lsrtl))	/* FULL */
+    /* FULL, retransmissions wait while paced packets are queued */
+    if (n->rxmt_count && EMPTY_LIST(n->ifa->txq))
     {
       list uplist;
       slab *upslab;
       struct l_lsr_head *llsh;
+      struct ospf_rxmt *en;
 
       init_list(&uplist);
       upslab = sl_new(n->pool, sizeof(struct l_lsr_head));
 
-      WALK_SLIST(en, n->lsrtl)
+      WALK_LIST(en, n->ifa->rxmt_list)
       {
-	if ((SNODE en)->next == (SNODE en))
-	  bug("RTList is cycled");
+	if (!ospf_rxmt_test(en, n))
+	  continue;
 	llsh = sl_alloc(upslab);
 	llsh->lsh.id = en->lsa.id;
 	llsh->lsh.rt = en->lsa.rt;
@@ -667,10 +837,3 @@ rxmt_timer_hook(timer * timer)
     }
   }
 }
-
-static void
-ackd_timer_hook(timer * t)
-{
-  struct ospf_neighbor *n = t->data;
-  ospf_lsack_send(n, ACKL_DELAY);
-}
@@ -10,8 +10,11 @@
 #ifndef _BIRD_OSPF_NEIGHBOR_H_
 #define _BIRD_OSPF_NEIGHBOR_H_
 
-struct ospf_neighbor *ospf_neighbor_new(struct ospf_iface *ifa);
+void ospf_neigh_hash_init(struct ospf_iface *ifa);
+struct ospf_neighbor *ospf_neighbor_new(struct ospf_iface *ifa, u32 rid, ip_addr ip);
+void ospf_neigh_set_ip(struct ospf_neighbor *n, ip_addr ip);
 void ospf_neigh_sm(struct ospf_neighbor *n, int event);
+void ospf_neigh_adj_event(void *data);
 void bdr_election(struct ospf_iface *ifa);
 struct ospf_neighbor *find_neigh(struct ospf_iface *ifa, u32 rid);
 struct ospf_neighbor *find_neigh_by_ip(struct ospf_iface *ifa, ip_addr ip);
@@ -82,13 +82,13 @@
  * for building adjacency and for exchange of routing messages.
  *
  * BIRD's OSPF implementation respects RFC2328 in every detail, but
- * some of internal algorithms do differ. The RFC recommends making a snapshot
- * of the link-state database when a new adjacency is forming and sending
- * the database description packets based on the information in this
- * snapshot. The database can be quite large in some networks, so
- * rather we walk through a &slist structure which allows us to
- * continue even if the actual LSA we were working with is deleted. New
- * LSAs are added at the tail of this &slist.
+ * some of internal algorithms do differ. As the RFC recommends, a snapshot
+ * of the link-state database is made when a new adjacency is forming and
+ * the database description packets are sent based on the information in
+ * this snapshot. The database can be quite large in some networks, so
+ * the snapshot (LSA headers already in network order) is shared by all
+ * neighbors on an interface that start the exchange while the database
+ * does not change.
  *
  * We also don't keep a separate OSPF routing table, because the core
  * helps us by being able to recognize when a route is updated
@@ -101,6 +101,7 @@
 
 #include <stdlib.h>
 #include "ospf.h"
+#include "nest/cmds.h"
 
 
 static int ospf_reload_routes(struct proto *p);
@@ -233,6 +234,7 @@ ospf_start(struct proto *p)
 
   po->router_id = proto_get_router_id(p->cf);
   po->rid_is_random = proto_get_rid_is_random(p->cf);
+  ospf_stats_init(po);
 #ifdef OSPFv3
   po->dridd = c->dridd;
   if (c->elsa_path) {
@@ -250,6 +252,11 @@ ospf_start(struct proto *p)
   po->stub_router = c->stub_router;
   po->ebit = 0;
   po->ecmp = c->ecmp;
+  po->exchange_limit = c->exchange_limit;
+  po->export_delay = c->export_delay;
+  po->gr_restarter = c->gr_restart;
+  po->gr_helper = c->gr_helper;
+  po->gr_time = c->gr_time;
   po->tick = c->tick;
   po->disp_timer = tm_new(p->pool);
   po->disp_timer->data = po;
@@ -257,16 +264,40 @@ ospf_start(struct proto *p)
   po->disp_timer->hook = ospf_disp;
   po->disp_timer->recurrent = po->tick;
   tm_start(po->disp_timer, 1);
+  po->flood_event = ev_new(p->pool);
+  po->flood_event->hook = ospf_lsupd_flush_queues;
+  po->flood_event->data = po;
+  po->adj_event = ev_new(p->pool);
+  po->adj_event->hook = ospf_neigh_adj_event;
+  po->adj_event->data = po;
+  po->ext_timer = tm_new(p->pool);
+  po->ext_timer->data = po;
+  po->ext_timer->randomize = 0;
+  po->ext_timer->hook = ospf_ext_timer;
+  po->ext_timer->recurrent = 0;
+  init_list(&po->ext_queue);
+  po->ext_slab = sl_new(p->pool, sizeof(struct ospf_ext_req));
   po->lsab_size = 256;
   po->lsab_used = 0;
   po->lsab = mb_alloc(p->pool, po->lsab_size);
   po->nhpool = lp_new(p->pool, 12*sizeof(struct mpnh));
+  ospf_nh_init(po);
   init_list(&(po->iface_list));
   init_list(&(po->area_list));
   fib_init(&po->rtf, p->pool, sizeof(ort), 0, ospf_rt_initort);
+  init_list(&po->rt_list);
+  init_list(&po->rt_old);
+  init_list(&po->rt_dirty);
+  po->sum_gen = 1;
   po->areano = 0;
   po->gr = ospf_top_new(p->pool);
   s_init_list(&(po->lsal));
+  ospf_age_init(po);
+
+  ospf_gr_start(po);
+
+  po->capture_name = c->capture;
+  ospf_capture_open(po, c->capture);
 
   WALK_LIST(ac, c->area_list)
     ospf_area_add(po, ac, 0);
@@ -493,19 +524,29 @@ ospf_disp(timer * timer)
     area_disp(oa);
 
   /* Age LSA DB */
-  ospf_age(po);
+  OSPF_TIMED(po, OSPF_PH_AGE, ospf_age(po));
+
+  ospf_capture_flush(po);
 
 #ifdef ELSA_ENABLED
   calcrt = po->calcrt;
 #endif /* ELSA_ENABLED */
 
-  /* Calculate routing table */
-  if (po->calcrt)
+  /* Check whether graceful restart is done */
+  if (po->gr_restart)
+    ospf_gr_check_exit(po);
+
+  /* Calculate routing table, not during graceful restart */
+  if (po->calcrt && !po->gr_restart)
     ospf_rt_spf(po);
 
+  /* Flush LSAs not originated again after graceful restart */
+  if (po->gr_cleanup && !po->calcrt)
+    ospf_gr_cleanup(po);
+
 #ifdef ELSA_ENABLED
   /* Call the ELSA dispatch callback */
-  elsa_dispatch(po->elsa, calcrt);
+  OSPF_TIMED(po, OSPF_PH_ELSA_DISPATCH, elsa_dispatch(po->elsa, calcrt));
 #endif /* ELSA_ENABLED */
 }
 
@@ -565,7 +606,8 @@ ospf_store_tmp_attrs(struct rte *rt, struct ea_list *attrs)
  * RFC does not define any action that should be taken before router
  * shutdown. To make my neighbors react as fast as possible, I send
  * them hello packet with empty neighbor list. They should start
- * their neighbor state machine with event %NEIGHBOR_1WAY.
+ * their neighbor state machine with event %NEIGHBOR_1WAY. When graceful
+ * restart is enabled, grace-LSAs are sent instead (see ospf_gr_shutdown()).
  */
 
 static int
@@ -576,8 +618,11 @@ ospf_shutdown(struct proto *p)
   OSPF_TRACE(D_EVENTS, "Shutdown requested");
 
   /* And send to all my neighbors 1WAY */
-  WALK_LIST(ifa, po->iface_list)
-    ospf_iface_shutdown(ifa);
+  if (!ospf_gr_shutdown(po))
+    WALK_LIST(ifa, po->iface_list)
+      ospf_iface_shutdown(ifa);
+
+  ospf_capture_close(po);
 
   /* Cleanup locked rta entries */
   FIB_WALK(&po->rtf, nftmp)
@@ -599,6 +644,16 @@ ospf_rt_notify(struct proto *p, rtable *tbl UNUSED, net * n, rte * new, rte * ol
 
   if (!new)
   {
+    /* Let rt_sync() remove the entry if it is not needed */
+    ri_mark(po, nf);
+    ri_dirty(po, nf);
+
+    if (po->export_delay)
+    {
+      ospf_ext_enqueue(po, nf, 0, IPA_NONE, 0, 1);
+      return;
+    }
+
     if (fn->x1 != EXT_EXPORT)
       return;
 
@@ -624,7 +679,10 @@ ospf_rt_notify(struct proto *p, rtable *tbl UNUSED, net * n, rte * new, rte * ol
       (ospf_iface_find((struct proto_ospf *) p, new->attrs->iface) != NULL))
     gw = new->attrs->gw;
 
-  originate_ext_lsa(oa, fn, EXT_EXPORT, metric, gw, tag, 1);
+  if (po->export_delay)
+    ospf_ext_enqueue(po, nf, metric, gw, tag, 0);
+  else
+    originate_ext_lsa(oa, fn, EXT_EXPORT, metric, gw, tag, 1);
 }
 
 static void
@@ -771,6 +829,22 @@ ospf_reconfigure(struct proto *p, struct proto_config *c)
 
   po->stub_router = new->stub_router;
   po->ecmp = new->ecmp;
+  po->exchange_limit = new->exchange_limit;
+  ev_schedule(po->adj_event);
+  po->export_delay = new->export_delay;
+  if (!po->export_delay)
+    ospf_ext_flush(po);
+  po->gr_restarter = new->gr_restart;
+  po->gr_helper = new->gr_helper;
+  po->gr_time = new->gr_time;
+
+  /* Reopen capture file if changed, the name is kept in the config */
+  int capture_changed = (!po->capture_name != !new->capture) ||
+    (new->capture && strcmp(po->capture_name, new->capture));
+  po->capture_name = new->capture;
+  if (capture_changed)
+    ospf_capture_open(po, new->capture);
+
   po->tick = new->tick;
   po->disp_timer->recurrent = po->tick;
   tm_start(po->disp_timer, 1);
@@ -814,6 +888,8 @@ ospf_reconfigure(struct proto *p, struct proto_config *c)
     if (oa->marked)
       ospf_area_remove(oa);
 
+  /* Area options and networks may have changed */
+  po->sum_gen++;
   schedule_rtcalc(po);
 
   return 1;
@@ -864,9 +940,22 @@ ospf_sh(struct proto *p)
   cli_msg(-1014, "%s:", p->name);
   cli_msg(-1014, "RFC1583 compatibility: %s", (po->rfc1583 ? "enable" : "disabled"));
   cli_msg(-1014, "Stub router: %s", (po->stub_router ? "Yes" : "No"));
+  cli_msg(-1014, "Graceful restart: %s%s", (po->gr_restarter ? "enabled" : "disabled"),
+	  (po->gr_restart ? ", restarting" : ""));
+  cli_msg(-1014, "Graceful restart helper: %s, helping %d neighbors",
+	  (po->gr_helper ? "enabled" : "disabled"), po->gr_helping);
   cli_msg(-1014, "RT scheduler tick: %d", po->tick);
   cli_msg(-1014, "Number of areas: %u", po->areano);
   cli_msg(-1014, "Number of LSAs in DB:\t%u", po->gr->hash_entries);
+  cli_msg(-1014, "Routing table calculations: %u", po->spf_runs);
+  cli_msg(-1014, "Adjacencies reached Full: %u, average time %u s", po->adj_full,
+	  po->adj_full ? po->adj_full_time / po->adj_full : 0);
+  cli_msg(-1014, "Sent packets: %u hello, %u dbdes, %u lsreq, %u lsupd (%lu B), %u lsack",
+	  po->tx_packets[HELLO_P], po->tx_packets[DBDES_P], po->tx_packets[LSREQ_P],
+	  po->tx_packets[LSUPD_P], (unsigned long) po->tx_bytes[LSUPD_P],
+	  po->tx_packets[LSACK_P]);
+  cli_msg(-1014, "Acknowledged LSAs: %u in %u lsack packets (%u packets saved)",
+	  po->ack_lsas, po->ack_packets, po->ack_lsas - po->ack_packets);
 
   WALK_LIST(oa, po->area_list)
   {
@@ -952,64 +1041,122 @@ ospf_sh_iface(struct proto *p, char *iff)
   cli_msg(0, "");
 }
 
-/* lsa_compare_for_state() - Compare function for 'show ospf state'
- *
- * First we want to separate network-LSAs and other LSAs (because network-LSAs
- * will be presented as network nodes and other LSAs together as router nodes)
- * Network-LSAs are sorted according to network prefix, other LSAs are sorted
- * according to originating router id (to get all LSA needed to represent one
- * router node together). Then, according to LSA type, ID and age.
- *
- * For OSPFv3, we have to handle also Prefix-LSAs. We would like to put each
- * immediately after the referenced LSA. We will make faked LSA based on ref_
- * values
+/*
+ * 'show ospf state' and 'show ospf lsadb' are printed by CLI continuations,
+ * at most OSPF_SHOW_MAX LSAs per event. When a command is issued, keys of the
+ * interesting LSAs (after applying filters) are collected into an array and
+ * sorted. Each LSA is looked up again by its key when it is printed, LSAs
+ * flushed in the meantime are skipped.
  */
 
-#ifdef OSPFv3
+#ifdef DEBUGGING
+#define OSPF_SHOW_MAX 4
+#else
+#define OSPF_SHOW_MAX 64
+#endif
 
-static struct ospf_lsa_header *
-fake_lsa_from_prefix_lsa(struct ospf_lsa_header *dst, struct ospf_lsa_header *src,
-			 struct ospf_lsa_prefix *px)
+struct ospf_show_lsa
 {
-  dst->age = src->age;
-  dst->type = px->ref_type;
-  dst->id = px->ref_id;
-  dst->rt = px->ref_rt;
-  dst->sn = src->sn;
+  u32 domain, type, id, rt;	/* LSA identity */
+  u32 stype, sid, srt;		/* Sort position, the referenced LSA for prefix-LSAs */
+};
 
-  return dst;
-}
+struct ospf_state_show
+{
+  struct proto_ospf *po;
+  struct config *running_on_config;
+  int verbose, reachable;
+  struct ospf_show_lsa *hea;	/* Area-scoped LSAs */
+  struct ospf_show_lsa *hex;	/* AS-external LSAs */
+  byte *hex_shown;		/* AS-external LSA presented under its ASBR */
+  unsigned j1, jx;		/* Number of LSAs in hea and hex */
+  unsigned i, ix, ox;		/* Positions in hea, hex and hex for other ASBRs */
+  struct ospf_lsa_header cnode;	/* Currently opened node */
+  byte cnode_open, closing, hdr;
+  u32 last_area, last_rt;
+};
+
+struct ospf_lsadb_show
+{
+  struct proto_ospf *po;
+  struct config *running_on_config;
+  struct ospf_show_lsa *hea;
+  unsigned num, i;
+  int last_dscope;
+  u32 last_domain;
+};
+
+static void
+ospf_show_key(struct ospf_show_lsa *l, struct top_hash_entry *he)
+{
+  l->domain = he->domain;
+  l->stype = l->type = he->lsa.type;
+  l->sid = l->id = he->lsa.id;
+  l->srt = l->rt = he->lsa.rt;
 
+#ifdef OSPFv3
+  if (he->lsa.type == LSA_T_PREFIX)
+  {
+    struct ospf_lsa_prefix *px = he->lsa_body;
+    l->stype = px->ref_type;
+    l->sid = px->ref_id;
+    l->srt = px->ref_rt;
+  }
 #endif
+}
+
+static inline struct top_hash_entry *
+ospf_show_find(struct proto_ospf *po, struct ospf_show_lsa *l)
+{
+  struct top_hash_entry *he = ospf_hash_find(po->gr, l->domain, l->id, l->rt, l->type);
+  return (he && he->lsa_body) ? he : NULL;
+}
 
+/* Returns 0 when the continuation should be stopped */
 static int
-lsa_compare_for_state(const void *p1, const void *p2)
+ospf_show_check(struct cli *c, struct proto_ospf *po, struct config *cf)
 {
-  struct top_hash_entry * he1 = * (struct top_hash_entry **) p1;
-  struct top_hash_entry * he2 = * (struct top_hash_entry **) p2;
-  struct ospf_lsa_header *lsa1 = &(he1->lsa);
-  struct ospf_lsa_header *lsa2 = &(he2->lsa);
-
-  if (he1->domain < he2->domain)
-    return -1;
-  if (he1->domain > he2->domain)
-    return 1;
+  if (cf != config)
+  {
+    cli_printf(c, 8004, "Stopped due to reconfiguration");
+    return 0;
+  }
 
-#ifdef OSPFv3
-  struct ospf_lsa_header lsatmp1, lsatmp2;
+  if (po->proto.proto_state != PS_UP)
+  {
+    cli_printf(c, 8005, "Protocol is down");
+    return 0;
+  }
 
-  int px1 = (lsa1->type == LSA_T_PREFIX);
-  int px2 = (lsa2->type == LSA_T_PREFIX);
+  /* show_lsa_*() functions print to this_cli */
+  this_cli = c;
+  return 1;
+}
 
-  if (px1)
-    lsa1 = fake_lsa_from_prefix_lsa(&lsatmp1, lsa1, he1->lsa_body);
+#define CMP(a, b) do { if ((a) < (b)) return -1; if ((a) > (b)) return 1; } while (0)
 
-  if (px2)
-    lsa2 = fake_lsa_from_prefix_lsa(&lsatmp2, lsa2, he2->lsa_body);
-#endif
+/* lsa_compare_for_state() - Compare function for 'show ospf state'
+ *
+ * First we want to separate network-LSAs and other LSAs (because network-LSAs
+ * will be presented as network nodes and other LSAs together as router nodes)
+ * Network-LSAs are sorted according to network prefix, other LSAs are sorted
+ * according to originating router id (to get all LSA needed to represent one
+ * router node together). Then, according to LSA type and ID.
+ *
+ * For OSPFv3, we have to handle also Prefix-LSAs. We would like to put each
+ * immediately after the referenced LSA, so they are sorted by their ref_
+ * values (stored in the sort position by ospf_show_key()).
+ */
+static int
+lsa_compare_for_state(const void *p1, const void *p2)
+{
+  const struct ospf_show_lsa *l1 = p1;
+  const struct ospf_show_lsa *l2 = p2;
+
+  CMP(l1->domain, l2->domain);
 
-  int nt1 = (lsa1->type == LSA_T_NET);
-  int nt2 = (lsa2->type == LSA_T_NET);
+  int nt1 = (l1->stype == LSA_T_NET);
+  int nt2 = (l2->stype == LSA_T_NET);
 
   if (nt1 != nt2)
     return nt1 - nt2;
@@ -1018,71 +1165,42 @@ lsa_compare_for_state(const void *p1, const void *p2)
   {
 #ifdef OSPFv3
     /* In OSPFv3, neworks are named base on ID of DR */
-    if (lsa1->rt < lsa2->rt)
-      return -1;
-    if (lsa1->rt > lsa2->rt)
-      return 1;
+    CMP(l1->srt, l2->srt);
 #endif
 
     /* For OSPFv2, this is IP of the network,
        for OSPFv3, this is interface ID */
-    if (lsa1->id < lsa2->id)
-      return -1;
-    if (lsa1->id > lsa2->id)
-      return 1;
-
-#ifdef OSPFv3
-    if (px1 != px2)
-      return px1 - px2;
-#endif
-
-    return lsa1->sn - lsa2->sn;
+    CMP(l1->sid, l2->sid);
   }
   else
   {
-    if (lsa1->rt < lsa2->rt)
-      return -1;
-    if (lsa1->rt > lsa2->rt)
-      return 1;
-
-    if (lsa1->type < lsa2->type)
-      return -1;
-    if (lsa1->type > lsa2->type)
-      return 1;
-
-    if (lsa1->id < lsa2->id)
-      return -1;
-    if (lsa1->id > lsa2->id)
-      return 1;
+    CMP(l1->srt, l2->srt);
+    CMP(l1->stype, l2->stype);
+    CMP(l1->sid, l2->sid);
+  }
 
 #ifdef OSPFv3
-    if (px1 != px2)
-      return px1 - px2;
+  int px1 = (l1->type == LSA_T_PREFIX);
+  int px2 = (l2->type == LSA_T_PREFIX);
+
+  if (px1 != px2)
+    return px1 - px2;
 #endif
 
-    return lsa1->sn - lsa2->sn;
-  }
+  CMP(l1->rt, l2->rt);
+  CMP(l1->id, l2->id);
+  return 0;
 }
 
 static int
 ext_compare_for_state(const void *p1, const void *p2)
 {
-  struct top_hash_entry * he1 = * (struct top_hash_entry **) p1;
-  struct top_hash_entry * he2 = * (struct top_hash_entry **) p2;
-  struct ospf_lsa_header *lsa1 = &(he1->lsa);
-  struct ospf_lsa_header *lsa2 = &(he2->lsa);
-
-  if (lsa1->rt < lsa2->rt)
-    return -1;
-  if (lsa1->rt > lsa2->rt)
-    return 1;
-
-  if (lsa1->id < lsa2->id)
-    return -1;
-  if (lsa1->id > lsa2->id)
-    return 1;
+  const struct ospf_show_lsa *l1 = p1;
+  const struct ospf_show_lsa *l2 = p2;
 
-  return lsa1->sn - lsa2->sn;
+  CMP(l1->rt, l2->rt);
+  CMP(l1->id, l2->id);
+  return 0;
 }
 
 static inline void
@@ -1224,9 +1342,6 @@ show_lsa_external(struct top_hash_entry *he)
   int pxlen, ebit, rt_fwaddr_valid;
   u32 rt_tag, rt_metric;
 
-  if (he->lsa.type == LSA_T_EXT)
-    he->domain = 0; /* Unmark the LSA */
-
   rt_metric = ext->metric & METRIC_MASK;
   ebit = ext->metric & LSA_EXT_EBIT;
 #ifdef OSPFv2
@@ -1299,228 +1414,342 @@ show_lsa_prefix(struct top_hash_entry *he, struct ospf_lsa_header *cnode)
 }
 #endif
 
-void
-ospf_sh_state(struct proto *p, int verbose, int reachable)
+static void
+ospf_sh_state_cleanup(struct cli *c)
 {
-  struct proto_ospf *po = (struct proto_ospf *) p;
-  struct ospf_lsa_header *cnode = NULL;
-  int num = po->gr->hash_entries;
-  unsigned int i, ix, j1, j2, jx;
-  u32 last_area = 0xFFFFFFFF;
+  struct ospf_state_show *d = c->rover;
 
-  if (p->proto_state != PS_UP)
-  {
-    cli_msg(-1016, "%s: is not up", p->name);
-    cli_msg(0, "");
-    return;
-  }
+  mb_free(d->hea);
+  mb_free(d->hex);
+  mb_free(d->hex_shown);
+  mb_free(d);
+}
 
-  /* We store interesting area-scoped LSAs in array hea and
-     global-scoped (LSA_T_EXT) LSAs in array hex */
+static void
+ospf_sh_state_lsa(struct ospf_state_show *d, struct top_hash_entry *he)
+{
+  struct proto_ospf *po = d->po;
+  struct ospf_lsa_header *cnode = &d->cnode;
 
-  struct top_hash_entry *hea[num];
-  struct top_hash_entry *hex[verbose ? num : 0];
-  struct top_hash_entry *he;
+  ASSERT((he->domain == d->last_area) && (he->lsa.rt == cnode->rt));
 
-  j1 = j2 = jx = 0;
-  WALK_SLIST(he, po->lsal)
+  switch (he->lsa.type)
   {
-    int accept;
+    case LSA_T_RT:
+      show_lsa_router(po, he, he->lsa.id == cnode->id, d->verbose);
+      break;
 
-    switch (he->lsa.type)
-      {
-      case LSA_T_RT:
-      case LSA_T_NET:
-	accept = 1;
-	break;
+    case LSA_T_NET:
+      show_lsa_network(he);
+      break;
+
+    case LSA_T_SUM_NET:
+      if (cnode->type == LSA_T_RT)
+	show_lsa_sum_net(he);
+      break;
+
+    case LSA_T_SUM_RT:
+      if (cnode->type == LSA_T_RT)
+	show_lsa_sum_rt(he);
+      break;
 
-      case LSA_T_SUM_NET:
-      case LSA_T_SUM_RT:
-      case LSA_T_NSSA:
 #ifdef OSPFv3
-      case LSA_T_PREFIX:
+    case LSA_T_PREFIX:
+      show_lsa_prefix(he, cnode);
+      break;
 #endif
-	accept = verbose;
-	break;
-
-      case LSA_T_EXT:
-	if (verbose)
-	{
-	  he->domain = 1; /* Abuse domain field to mark the LSA */
-	  hex[jx++] = he;
-	}
-      default:
-	accept = 0;
-      }
 
-    if (accept)
-      hea[j1++] = he;
-    else
-      j2++;
+    case LSA_T_EXT:
+    case LSA_T_NSSA:
+      show_lsa_external(he);
+      break;
   }
+}
 
-  if ((j1 + j2) != num)
-    die("Fatal mismatch");
-
-  qsort(hea, j1, sizeof(struct top_hash_entry *), lsa_compare_for_state);
-  qsort(hex, jx, sizeof(struct top_hash_entry *), ext_compare_for_state);
+/*
+ * This code is a bit tricky, we have a primary LSAs (router and
+ * network) that are presented as a node, and secondary LSAs that
+ * are presented as a part of a primary node. cnode represents an
+ * currently opened node (whose header was presented). The LSAs are
+ * sorted to get secondary LSAs just after related primary LSA (if
+ * available). We present secondary LSAs only when related primary
+ * LSA is opened.
+ *
+ * AS-external LSAs are stored separately as they might be presented
+ * several times (for each area when related ASBR is opened). When
+ * the node is closed (closing is set), related external routes are
+ * presented and marked in hex_shown. We also have to take into
+ * account that in OSPFv3, there might be more router-LSAs and only
+ * the first should be considered as a primary. This is handled by
+ * not closing old router-LSA when next one is processed (which is
+ * not opened because there is already one opened).
+ *
+ * Finally, AS-external LSAs not presented under any node are shown
+ * as 'other ASBRs'.
+ */
+static void
+ospf_sh_state_cont(struct cli *c)
+{
+  struct ospf_state_show *d = c->rover;
+  struct proto_ospf *po = d->po;
+  struct top_hash_entry *he;
+  struct ospf_show_lsa *l;
+  unsigned max = OSPF_SHOW_MAX;
 
-  /*
-   * This code is a bit tricky, we have a primary LSAs (router and
-   * network) that are presented as a node, and secondary LSAs that
-   * are presented as a part of a primary node. cnode represents an
-   * currently opened node (whose header was presented). The LSAs are
-   * sorted to get secondary LSAs just after related primary LSA (if
-   * available). We present secondary LSAs only when related primary
-   * LSA is opened.
-   *
-   * AS-external LSAs are stored separately as they might be presented
-   * several times (for each area when related ASBR is opened). When
-   * the node is closed, related external routes are presented. We
-   * also have to take into account that in OSPFv3, there might be
-   * more router-LSAs and only the first should be considered as a
-   * primary. This is handled by not closing old router-LSA when next
-   * one is processed (which is not opened because there is already
-   * one opened).
-   */
+  if (!ospf_show_check(c, po, d->running_on_config))
+    goto done;
 
-  ix = 0;
-  for (i = 0; i < j1; i++)
+  while ((d->i < d->j1) || d->closing)
   {
-    he = hea[i];
+    if (!max--)
+      return;
+
+    if (d->closing)
+    {
+      l = &d->hex[d->ix];
+      if ((d->ix < d->jx) && (l->rt <= d->cnode.rt))
+      {
+	if ((l->rt == d->cnode.rt) && (he = ospf_show_find(po, l)))
+	{
+	  show_lsa_external(he);
+	  d->hex_shown[d->ix] = 1;
+	}
+	d->ix++;
+      }
+      else
+	d->cnode_open = d->closing = 0;
+
+      continue;
+    }
+
+    l = &d->hea[d->i];
+    he = ospf_show_find(po, l);
 
     /* If there is no opened node, we open the LSA (if appropriate) or skip to the next one */
-    if (!cnode)
+    if (!d->cnode_open)
     {
-      if (((he->lsa.type == LSA_T_RT) || (he->lsa.type == LSA_T_NET))
-	  && ((he->color == INSPF) || !reachable))
+      if (he && ((he->lsa.type == LSA_T_RT) || (he->lsa.type == LSA_T_NET))
+	  && ((he->color == INSPF) || !d->reachable))
       {
-	cnode = &(he->lsa);
+	d->cnode = he->lsa;
+	d->cnode_open = 1;
 
-	if (he->domain != last_area)
+	if (he->domain != d->last_area)
 	{
 	  cli_msg(-1016, "");
 	  cli_msg(-1016, "area %R", he->domain);
-	  last_area = he->domain;
-	  ix = 0;
+	  d->last_area = he->domain;
+	  d->ix = 0;
 	}
       }
       else
+      {
+	d->i++;
 	continue;
+      }
     }
 
-    ASSERT(cnode && (he->domain == last_area) && (he->lsa.rt == cnode->rt));
+    if (he)
+      ospf_sh_state_lsa(d, he);
 
-    switch (he->lsa.type)
-    {
-      case LSA_T_RT:
-	show_lsa_router(po, he, he->lsa.id == cnode->id, verbose);
-	break;
+    d->i++;
+    l = &d->hea[d->i];
 
-      case LSA_T_NET:
-	show_lsa_network(he);
-	break;
+    /* In these cases, we close the current node */
+    if ((d->i == d->j1)
+	|| (l->domain != d->last_area)
+	|| (l->rt != d->cnode.rt)
+	|| (l->type == LSA_T_NET))
+      d->closing = 1;
+  }
 
-      case LSA_T_SUM_NET:
-	if (cnode->type == LSA_T_RT)
-	  show_lsa_sum_net(he);
-	break;
+  for (; d->ox < d->jx; d->ox++)
+  {
+    /* If it was not shown under its ASBR, we show it now. */
+    if (d->hex_shown[d->ox])
+      continue;
 
-      case LSA_T_SUM_RT:
-	if (cnode->type == LSA_T_RT)
-	  show_lsa_sum_rt(he);
-	break;
+    if (!max--)
+      return;
 
-#ifdef OSPFv3
-      case LSA_T_PREFIX:
-	show_lsa_prefix(he, cnode);
-	break;
-#endif
+    he = ospf_show_find(po, &d->hex[d->ox]);
+    if (!he || ((he->color != INSPF) && d->reachable))
+      continue;
 
-      case LSA_T_EXT:
-      case LSA_T_NSSA:
-	show_lsa_external(he);
-	break;
+    if (!d->hdr)
+    {
+      cli_msg(-1016, "");
+      cli_msg(-1016, "other ASBRs");
+      d->hdr = 1;
     }
 
-    /* In these cases, we close the current node */
-    if ((i+1 == j1)
-	|| (hea[i+1]->domain != last_area)
-	|| (hea[i+1]->lsa.rt != cnode->rt)
-	|| (hea[i+1]->lsa.type == LSA_T_NET))
+    if (he->lsa.rt != d->last_rt)
     {
-      while ((ix < jx) && (hex[ix]->lsa.rt < cnode->rt))
-	ix++;
-
-      while ((ix < jx) && (hex[ix]->lsa.rt == cnode->rt))
-	show_lsa_external(hex[ix++]);
-
-      cnode = NULL;
+      cli_msg(-1016, "");
+      cli_msg(-1016, "\trouter %R", he->lsa.rt);
+      d->last_rt = he->lsa.rt;
     }
+
+    show_lsa_external(he);
   }
 
-  int hdr = 0;
-  u32 last_rt = 0xFFFFFFFF;
-  for (ix = 0; ix < jx; ix++)
+  cli_printf(c, 0, "");
+
+done:
+  ospf_sh_state_cleanup(c);
+  c->cont = c->cleanup = NULL;
+}
+
+void
+ospf_sh_state(struct proto *p, int verbose, int reachable)
+{
+  struct proto_ospf *po = (struct proto_ospf *) p;
+  struct cli *c = this_cli;
+  struct ospf_state_show *d;
+  struct top_hash_entry *he;
+  int num = po->gr->hash_entries;
+
+  if (p->proto_state != PS_UP)
   {
-    he = hex[ix];
+    cli_msg(-1016, "%s: is not up", p->name);
+    cli_msg(0, "");
+    return;
+  }
 
-    /* If it is still marked, we show it now. */
-    if (he->domain)
-    {
-      he->domain = 0;
+  /* We store keys of interesting area-scoped LSAs in array hea and
+     global-scoped (LSA_T_EXT) LSAs in array hex */
 
-      if ((he->color != INSPF) && reachable)
-	continue;
+  d = mb_allocz(c->pool, sizeof(struct ospf_state_show));
+  d->po = po;
+  d->running_on_config = config;
+  d->verbose = verbose;
+  d->reachable = reachable;
+  d->hea = mb_alloc(c->pool, num * sizeof(struct ospf_show_lsa));
+  d->hex = mb_alloc(c->pool, (verbose ? num : 0) * sizeof(struct ospf_show_lsa));
+  d->last_area = 0xFFFFFFFF;
+  d->last_rt = 0xFFFFFFFF;
 
-      if (!hdr)
+  WALK_SLIST(he, po->lsal)
+  {
+    switch (he->lsa.type)
       {
-	cli_msg(-1016, "");
-	cli_msg(-1016, "other ASBRs");
-	hdr = 1;
-      }
+      case LSA_T_SUM_NET:
+      case LSA_T_SUM_RT:
+      case LSA_T_NSSA:
+#ifdef OSPFv3
+      case LSA_T_PREFIX:
+#endif
+	if (!verbose)
+	  break;
+	/* fall through */
 
-      if (he->lsa.rt != last_rt)
-      {
-	cli_msg(-1016, "");
-	cli_msg(-1016, "\trouter %R", he->lsa.rt);
-	last_rt = he->lsa.rt;
-      }
+      case LSA_T_RT:
+      case LSA_T_NET:
+	ospf_show_key(&d->hea[d->j1++], he);
+	break;
 
-      show_lsa_external(he);
-    }
+      case LSA_T_EXT:
+	if (verbose)
+	  ospf_show_key(&d->hex[d->jx++], he);
+	break;
+      }
   }
 
-  cli_msg(0, "");
+  d->hex_shown = mb_allocz(c->pool, d->jx);
+
+  qsort(d->hea, d->j1, sizeof(struct ospf_show_lsa), lsa_compare_for_state);
+  qsort(d->hex, d->jx, sizeof(struct ospf_show_lsa), ext_compare_for_state);
+
+  c->cont = ospf_sh_state_cont;
+  c->cleanup = ospf_sh_state_cleanup;
+  c->rover = d;
 }
 
 
 static int
 lsa_compare_for_lsadb(const void *p1, const void *p2)
 {
-  struct top_hash_entry * he1 = * (struct top_hash_entry **) p1;
-  struct top_hash_entry * he2 = * (struct top_hash_entry **) p2;
-  struct ospf_lsa_header *lsa1 = &(he1->lsa);
-  struct ospf_lsa_header *lsa2 = &(he2->lsa);
-  int sc1 = LSA_SCOPE(lsa1);
-  int sc2 = LSA_SCOPE(lsa2);
+  const struct ospf_show_lsa *l1 = p1;
+  const struct ospf_show_lsa *l2 = p2;
+  int sc1 = LSA_SCOPE(l1);
+  int sc2 = LSA_SCOPE(l2);
 
   if (sc1 != sc2)
     return sc2 - sc1;
 
-  if (he1->domain != he2->domain)
-    return he1->domain - he2->domain;
+  CMP(l1->domain, l2->domain);
+  CMP(l1->rt, l2->rt);
+  CMP(l1->id, l2->id);
+  CMP(l1->type, l2->type);
+  return 0;
+}
 
-  if (lsa1->rt != lsa2->rt)
-    return lsa1->rt - lsa2->rt;
+static void
+ospf_sh_lsadb_cleanup(struct cli *c)
+{
+  struct ospf_lsadb_show *d = c->rover;
 
-  if (lsa1->id != lsa2->id)
-    return lsa1->id - lsa2->id;
+  mb_free(d->hea);
+  mb_free(d);
+}
 
-  if (lsa1->type != lsa2->type)
-    return lsa1->type - lsa2->type;
+static void
+ospf_sh_lsadb_cont(struct cli *c)
+{
+  struct ospf_lsadb_show *d = c->rover;
+  struct top_hash_entry *he;
+  unsigned max = OSPF_SHOW_MAX;
+
+  if (!ospf_show_check(c, d->po, d->running_on_config))
+    goto done;
+
+  for (; d->i < d->num; d->i++)
+  {
+    if (!max--)
+      return;
+
+    if (!(he = ospf_show_find(d->po, &d->hea[d->i])))
+      continue;
+
+    struct ospf_lsa_header *lsa = &(he->lsa);
+    int dscope = LSA_SCOPE(lsa);
+
+    lsa_update_age(he);
+
+    if ((dscope != d->last_dscope) || (he->domain != d->last_domain))
+    {
+      cli_msg(-1017, "");
+      switch (dscope)
+      {
+	case LSA_SCOPE_AS:
+	  cli_msg(-1017, "Global");
+	  break;
+	case LSA_SCOPE_AREA:
+	  cli_msg(-1017, "Area %R", he->domain);
+	  break;
+	case LSA_SCOPE_LINK:
+	  {
+	    struct iface *ifa = if_find_by_index(he->domain);
+	    cli_msg(-1017, "Link %s", (ifa != NULL) ? ifa->name : "?");
+	  }
+	  break;
+      }
+      cli_msg(-1017, "");
+      cli_msg(-1017," Type   LS ID           Router           Age  Sequence  Checksum");
 
-  return lsa1->sn - lsa2->sn;
+      d->last_dscope = dscope;
+      d->last_domain = he->domain;
+    }
+
+    cli_msg(-1017," %04x  %-15R %-15R %5u  %08x    %04x",
+	    lsa->type, lsa->id, lsa->rt, lsa->age, lsa->sn, lsa->checksum);
+  }
+
+  cli_printf(c, 0, "");
+
+done:
+  ospf_sh_lsadb_cleanup(c);
+  c->cont = c->cleanup = NULL;
 }
 
 void
@@ -1528,10 +1757,9 @@ ospf_sh_lsadb(struct lsadb_show_data *ld)
 {
   struct proto *p = proto_get_named(ld->name, &proto_ospf);
   struct proto_ospf *po = (struct proto_ospf *) p;
-  int num = po->gr->hash_entries;
-  unsigned int i, j;
-  int last_dscope = -1;
-  u32 last_domain = 0;
+  struct cli *c = this_cli;
+  struct ospf_lsadb_show *d;
+  struct top_hash_entry *he;
 
   if (p->proto_state != PS_UP)
   {
@@ -1543,27 +1771,22 @@ ospf_sh_lsadb(struct lsadb_show_data *ld)
   if (ld->router == SH_ROUTER_SELF)
     ld->router = po->router_id;
 
-  struct top_hash_entry *hea[num];
-  struct top_hash_entry *he;
+  d = mb_allocz(c->pool, sizeof(struct ospf_lsadb_show));
+  d->po = po;
+  d->running_on_config = config;
+  d->hea = mb_alloc(c->pool, po->gr->hash_entries * sizeof(struct ospf_show_lsa));
+  d->last_dscope = -1;
 
-  j = 0;
+  /* Filters are applied here, so only matching LSAs are sorted */
   WALK_SLIST(he, po->lsal)
-    hea[j++] = he;
-
-  if (j != num)
-    die("Fatal mismatch");
-
-  qsort(hea, j, sizeof(struct top_hash_entry *), lsa_compare_for_lsadb);
-
-  for (i = 0; i < j; i++)
   {
-    struct ospf_lsa_header *lsa = &(hea[i]->lsa);
+    struct ospf_lsa_header *lsa = &(he->lsa);
     int dscope = LSA_SCOPE(lsa);
 
     if (ld->scope && (dscope != (ld->scope & 0xf000)))
       continue;
 
-    if ((ld->scope == LSA_SCOPE_AREA) && (hea[i]->domain != ld->area))
+    if ((ld->scope == LSA_SCOPE_AREA) && (he->domain != ld->area))
       continue;
 
     /* Ignore high nibble */
@@ -1576,38 +1799,27 @@ ospf_sh_lsadb(struct lsadb_show_data *ld)
     if (ld->router && (lsa->rt != ld->router))
       continue;
 
-    if ((dscope != last_dscope) || (hea[i]->domain != last_domain))
-    {
-      cli_msg(-1017, "");
-      switch (dscope)
-      {
-	case LSA_SCOPE_AS:
-	  cli_msg(-1017, "Global");
-	  break;
-	case LSA_SCOPE_AREA:
-	  cli_msg(-1017, "Area %R", hea[i]->domain);
-	  break;
-#ifdef OSPFv3
-	case LSA_SCOPE_LINK:
-	  {
-	    struct iface *ifa = if_find_by_index(hea[i]->domain);
-	    cli_msg(-1017, "Link %s", (ifa != NULL) ? ifa->name : "?");
-	  }
-	  break;
-#endif
-      }
-      cli_msg(-1017, "");
-      cli_msg(-1017," Type   LS ID           Router           Age  Sequence  Checksum");
+    ospf_show_key(&d->hea[d->num++], he);
+  }
 
-      last_dscope = dscope;
-      last_domain = hea[i]->domain;
-    }
+  qsort(d->hea, d->num, sizeof(struct ospf_show_lsa), lsa_compare_for_lsadb);
 
+  c->cont = ospf_sh_lsadb_cont;
+  c->cleanup = ospf_sh_lsadb_cleanup;
+  c->rover = d;
+}
 
-    cli_msg(-1017," %04x  %-15R %-15R %5u  %08x    %04x",
-	    lsa->type, lsa->id, lsa->rt, lsa->age, lsa->sn, lsa->checksum);
-  }
-  cli_msg(0, "");
+static void
+ospf_show_memory(struct proto *p)
+{
+  struct proto_ospf *po = (struct proto_ospf *) p;
+
+  if (p->proto_state != PS_UP)
+    return;
+
+  cli_msg(-1018, "%s:", p->name);
+  print_size("  Total:", rmemsize(p->pool));
+  ospf_top_show_memory(po->gr);
 }
 
 
@@ -1623,6 +1835,7 @@ struct protocol proto_ospf = {
   reconfigure:		ospf_reconfigure,
   get_status:		ospf_get_status,
   get_attr:		ospf_get_attr,
-  get_route_info:	ospf_get_route_info
+  get_route_info:	ospf_get_route_info,
+  show_memory:		ospf_show_memory
   // show_proto_info:	ospf_sh
 };
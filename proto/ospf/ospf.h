@@ -41,6 +41,7 @@ do { if ((p->debug & D_PACKETS) || OSPF_FORCE_DEBUG) \
 #include "lib/socket.h"
 #include "lib/timer.h"
 #include "lib/resource.h"
+#include "lib/event.h"
 #include "nest/protocol.h"
 #include "nest/iface.h"
 #include "nest/route.h"
@@ -77,6 +78,7 @@ do { if ((p->debug & D_PACKETS) || OSPF_FORCE_DEBUG) \
 #define DEFAULT_STUB_COST 1000
 #define DEFAULT_ECMP_LIMIT 16
 #define DEFAULT_TRANSINT 40
+#define DEFAULT_GR_TIME 120
 
 #ifdef OSPFv3
 #define DEFAULT_OSPFDRIDD 0  /* OSPF duplicate RID detection off by default */
@@ -94,6 +96,12 @@ struct ospf_config
   byte stub_router;
   byte abr;
   int ecmp;
+  int exchange_limit;		/* Max number of concurrent DB exchanges, 0 for unlimited */
+  unsigned export_delay;	/* Batching window for external LSAs, 0 for none */
+  byte gr_restart;		/* Perform graceful restart (RFC 3623) */
+  byte gr_helper;		/* Help neighbors to restart gracefully */
+  unsigned gr_time;		/* Grace period announced in grace-LSAs */
+  char *capture;		/* Packet capture file, see capture.c */
   list area_list;		/* list of struct ospf_area_config */
   list vlink_list;		/* list of struct ospf_iface_patt */
 #ifdef OSPFv3
@@ -162,6 +170,7 @@ struct ospf_area_config
 #ifdef OSPFv2
 #define OPT_P	0x08		/* flags P and N share position, see NSSA RFC */
 #define OPT_EA	0x10
+#define OPT_O	0x40		/* Opaque LSAs, RFC 5250 */
 
 /* VEB flags are are stored independently in 'u16 options' */
 #define OPT_RT_B  (0x01 << 8)
@@ -173,6 +182,7 @@ struct ospf_area_config
 #ifdef OSPFv3
 #define OPT_V6	0x01
 #define OPT_R	0x10
+#define OPT_AT	0x0400		/* Authentication trailer, RFC 7166 */
 
 /* VEB flags are are stored together with options in 'u32 options' */
 #define OPT_RT_B  (0x01 << 24)
@@ -197,6 +207,10 @@ struct ospf_iface
   pool *pool;
   sock *sk;			/* IP socket (for DD ...) */
   list neigh_list;		/* List of neigbours */
+  struct ospf_neighbor **neigh_rid_hash; /* Neighbors indexed by router ID */
+  struct ospf_neighbor **neigh_ip_hash;	/* Neighbors indexed by address */
+  u32 neigh_hash_order;
+  u32 neigh_count;		/* Number of neighbors in neigh_list */
   u32 cost;			/* Cost of iface */
   u32 waitint;			/* number of sec before changing state from wait */
   u32 rxmtint;			/* number of seconds between LSA retransmissions */
@@ -212,12 +226,12 @@ struct ospf_iface
 				   interface.  LSAs contained in the update */
   u16 helloint;			/* number of seconds between hello sending */
 
-#ifdef OSPFv2
   list *passwords;
   u16 autype;
+  u16 auth_size;		/* Space for authentication data (or trailer) in packets */
   u32 csn;                      /* Last used crypt seq number */
   bird_clock_t csn_use;         /* Last time when packet with that CSN was sent */
-#endif
+  list auth_keys;		/* Precomputed HMAC keys, see packet.c */
 
   ip_addr all_routers;		/*  */
   ip_addr drip;			/* Designated router */
@@ -275,6 +289,32 @@ struct ospf_iface
   struct top_hash_entry *pxn_lsa;	/* Originated prefix LSA */
 #endif
   int fadj;				/* Number of full adjacent neigh */
+  void *flood_buf;			/* LSAs queued for flooding (network order) */
+  u16 flood_size;			/* Size of flood_buf */
+  u16 flood_len;			/* Used part of flood_buf */
+  u32 flood_lsano;			/* Number of LSAs in flood_buf */
+  struct ospf_lsa_header *ack_buf;	/* Delayed acks of all neighbors (network order) */
+  u16 ack_size;				/* Size of ack_buf in headers */
+  u16 ack_count;			/* Used part of ack_buf */
+  u8 ack_direct;			/* Some neighbor has direct acks waiting */
+
+  u32 tx_rate;			/* LSUPD and LSACK packets per second, 0 for no limit */
+  u32 tx_burst;			/* Size of the token bucket */
+  u32 tx_tokens;		/* Packets that may be sent now */
+  bird_clock_t tx_refill;	/* Last refill of tokens */
+  list txq;			/* Packets waiting for tokens (struct ospf_txq_packet) */
+  u32 txq_count;		/* Number of packets in txq */
+  u32 txq_max;			/* Limit of txq_count, see ospf_txq_init() */
+  u32 txq_drops;		/* Packets dropped because txq was full */
+  timer *txq_timer;
+
+  struct ospf_dbdes_snap *dbsnap; /* Last taken DB summary snapshot, or NULL */
+
+  list rxmt_list;		/* Shared link state retransmission entries */
+  struct ospf_rxmt **rxmt_hash;	/* Hash table of rxmt_list, see rxmt.c */
+  u32 rxmt_hash_order;
+  u32 rxmt_words;		/* Size of neighbor bitmaps in entries */
+  u32 rxmt_count;		/* Number of entries in rxmt_list */
   list nbma_list;
   u8 priority;			/* A router priority for DR election */
   u8 ioprob;
@@ -393,11 +433,16 @@ struct ospf_lsa_header
 #define LSA_T_SUM_RT	4
 #define LSA_T_EXT	5
 #define LSA_T_NSSA	7
+#define LSA_T_GR	9	/* Link-local opaque LSA, grace-LSA is opaque type 3 */
+#define LSA_T_OPQ_AREA	10	/* Area-local opaque LSA, stored and flooded only */
+#define LSA_T_OPQ_AS	11	/* AS opaque LSA, stored and flooded only */
 
+#define LSA_SCOPE_LINK	0x0000
 #define LSA_SCOPE_AREA	0x2000
 #define LSA_SCOPE_AS	0x4000
 
-#define LSA_SCOPE(lsa)	(((lsa)->type == LSA_T_EXT) ? LSA_SCOPE_AS : LSA_SCOPE_AREA)
+#define LSA_SCOPE(lsa)	((((lsa)->type == LSA_T_EXT) || ((lsa)->type == LSA_T_OPQ_AS)) ? LSA_SCOPE_AS : \
+			 ((lsa)->type == LSA_T_GR) ? LSA_SCOPE_LINK : LSA_SCOPE_AREA)
 
 #else /* OSPFv3 */
   u16 type;
@@ -410,6 +455,7 @@ struct ospf_lsa_header
 #define LSA_T_NSSA	0x2007
 #define LSA_T_LINK	0x0008
 #define LSA_T_PREFIX	0x2009
+#define LSA_T_GR	0x000b
 
 #define LSA_UBIT	0x8000
 
@@ -687,6 +733,9 @@ struct ospf_neighbor
 #define NEIGHBOR_EXCHANGE 5
 #define NEIGHBOR_LOADING 6
 #define NEIGHBOR_FULL 7
+  u8 gr_active;			/* We are helping the neighbor to restart */
+  timer *gr_timer;		/* End of grace period of the neighbor */
+  bird_clock_t adj_start;	/* Time of entering ExStart */
   timer *inactim;		/* Inactivity timer */
   union imms imms;		/* I, M, Master/slave received */
   u32 dds;			/* DD Sequence number being sent */
@@ -707,22 +756,29 @@ struct ospf_neighbor
   u32 iface_id;			/* ID of Neighbour's iface connected to common network */
 #endif
 
-  siterator dbsi;		/* Database summary list iterator */
+  struct ospf_dbdes_snap *dbsnap; /* Database summary snapshot, see dbdes.c */
+  u32 dbpos;			/* Position of next LSA header in dbsnap */
   slist lsrql;			/* Link state request */
-  struct top_graph *lsrqh;	/* LSA graph */
+  struct ospf_lsr **lsrq_hash;	/* Index of lsrql, see lsreq.c */
+  u32 lsrq_hash_order;
+  u32 lsrq_count;
+  slab *lsrq_slab;
   siterator lsrqi;
-  slist lsrtl;			/* Link state retransmission list */
-  siterator lsrti;
-  struct top_graph *lsrth;
+  struct ospf_neighbor *next_rid;	/* Next in ifa->neigh_rid_hash chain */
+  struct ospf_neighbor *next_ip;	/* Next in ifa->neigh_ip_hash chain */
+  u32 rxmt_slot;		/* Bit in retransmission entries of ifa, see rxmt.c */
+  u32 rxmt_count;		/* Number of LSAs in retransmission list */
   void *ldbdes;			/* Last database description packet */
   timer *rxmt_timer;		/* RXMT timer */
-  list ackl[2];
+  list ackl;			/* Direct acks waiting for ospf_lsack_flush() */
 #define ACKL_DIRECT 0
 #define ACKL_DELAY 1
-  timer *ackd_timer;		/* Delayed ack timer */
-  u32 csn;                      /* Last received crypt seq number (for MD5) */
+  u64 csn;                      /* Last received crypt seq number */
 };
 
+/* Neighbor is announced as adjacent, also while we help it to restart */
+#define NEIGH_ADJ(n) (((n)->state == NEIGHBOR_FULL) || (n)->gr_active)
+
 /* Definitions for interface state machine */
 #define ISM_UP 0		/* Interface Up */
 #define ISM_WAITF 1		/* Wait timer fired */
@@ -760,6 +816,8 @@ struct ospf_area
   u32 options;			/* Optional features */
   byte origrt;			/* Rt lsa origination scheduled? */
   byte trcap;			/* Transit capability? */
+  byte sum_trcap;		/* Value of trcap known to summary decisions */
+  byte sum_translate;		/* Value of translate known to NSSA decisions */
   byte marked;			/* Used in OSPF reconfigure */
   byte translate;		/* Translator state (TRANS_*), for NSSA ABR  */
   timer *translator_timer;	/* For NSSA translator switch */
@@ -775,23 +833,61 @@ struct proto_ospf
 {
   struct proto proto;
   timer *disp_timer;		/* OSPF proto dispatcher */
+  event *flood_event;		/* Sends LSAs queued for flooding */
   unsigned tick;
   struct top_graph *gr;		/* LSA graph */
   slist lsal;			/* List of all LSA's */
+  list *age_wheel;		/* Aging events of LSAs, bucketed by second */
+  bird_clock_t age_last;	/* Last second processed by ospf_age() */
   int calcrt;			/* Routing table calculation scheduled?
 				   0=no, 1=normal, 2=forced reload */
   list iface_list;		/* Interfaces we really use */
   list area_list;
   int areano;			/* Number of area I belong to */
   struct fib rtf;		/* Routing table */
+  list rt_list;			/* Entries of rtf processed in SPF, see ri_mark() */
+  list rt_old;			/* Entries of rt_list not yet marked in this SPF */
+  list rt_dirty;		/* Entries of rtf to synchronise, see ri_dirty() */
   byte rfc1583;			/* RFC1583 compatibility */
   byte stub_router;		/* Do not forward transit traffic */
   byte ebit;			/* Did I originate any ext lsa? */
   byte ecmp;			/* Maximal number of nexthops in ECMP route, or 0 */
+  int exchange_limit;		/* Maximal number of concurrent DB exchanges, or 0 */
+  int exchanges;		/* Number of neighbors in ExStart, Exchange or Loading */
+  event *adj_event;		/* Starts postponed adjacencies */
+  unsigned export_delay;	/* Batching window for exported routes, or 0 */
+  timer *ext_timer;		/* End of the batching window */
+  list ext_queue;		/* Pending exports (struct ospf_ext_req) */
+  slab *ext_slab;
+  u32 lsdb_gen;			/* Incremented when an LSA is added, removed, changed or aged out */
+  byte gr_restarter;		/* Graceful restart enabled, see gr.c */
+  byte gr_helper;		/* Helper mode enabled */
+  byte gr_restart;		/* We are restarting gracefully */
+  byte gr_cleanup;		/* Flush stale self-originated LSAs after SPF */
+  unsigned gr_time;		/* Grace period */
+  int gr_helping;		/* Number of neighbors in helper mode */
+  timer *gr_timer;		/* End of our grace period */
+  bird_clock_t gr_start;	/* Start of our graceful restart */
+  u32 spf_runs;			/* Number of routing table calculations */
+  u32 sum_gen;			/* Summary decisions of older gens are invalid, see rt.c */
+  u32 rt_sum_gen;		/* sum_gen of the last decisions for all entries */
+  u32 adj_full;			/* Number of adjacencies that reached Full */
+  u32 adj_full_time;		/* Total time from ExStart to Full */
+  u32 tx_packets[LSACK_P + 1];	/* Sent packets, indexed by type */
+  u64 tx_bytes[LSACK_P + 1];
+  u32 ack_lsas;			/* Acknowledged LSAs */
+  u32 ack_packets;		/* LSACK packets they were packed in */
+  struct ospf_phase_stats *stats; /* Timing of OSPF_PH_* phases, see stats.c */
+  bird_clock_t stats_since;	/* Start of statistics collection */
+  void *capture;		/* Packet capture FILE, or NULL */
+  char *capture_name;
   struct ospf_area *backbone;	/* If exists */
   void *lsab;			/* LSA buffer used when originating router LSAs */
   int lsab_size, lsab_used;
-  linpool *nhpool;		/* Linpool used for next hops computed in SPF */
+  linpool *nhpool;		/* Linpool used for merging next hops in SPF */
+  struct ospf_nhs **nh_hash;	/* Interned next hop sets, see rt.c:nh_intern() */
+  unsigned int nh_hash_order, nh_count;
+  u32 nh_gen;			/* Number of current SPF run */
   u32 router_id;
   u32 last_vlink_id;		/* Interface IDs for vlinks (starts at 0x80000000) */
   byte rid_is_random;           /* Whether or not RID was generated by a PRNG */
@@ -823,11 +919,13 @@ struct ospf_iface_patt
   u32 vid;
   int tx_tos;
   int tx_priority;
+  u32 tx_rate;
+  u32 tx_burst;
   u16 rxbuf;
 #define OSPF_RXBUF_NORMAL 0
 #define OSPF_RXBUF_LARGE 1
 #define OSPF_RXBUF_MINSIZE 256	/* Minimal allowed size */
-  u16 autype;			/* Not really used in OSPFv3 */
+  u16 autype;
 #define OSPF_AUTH_NONE 0
 #define OSPF_AUTH_SIMPLE 1
 #define OSPF_AUTH_CRYPT 2
@@ -839,9 +937,7 @@ struct ospf_iface_patt
   u8 ptp_netmask;		/* bool + 2 for unspecified */
   u8 ttl_security;		/* bool + 2 for TX only */
 
-#ifdef OSPFv2
   list *passwords;
-#endif
 
 #ifdef OSPFv3
   u8 instance_id;
@@ -908,6 +1004,10 @@ void ospf_sh_lsadb(struct lsadb_show_data *ld);
 #include "proto/ospf/lsreq.h"
 #include "proto/ospf/lsupd.h"
 #include "proto/ospf/lsack.h"
+#include "proto/ospf/rxmt.h"
+#include "proto/ospf/gr.h"
+#include "proto/ospf/capture.h"
+#include "proto/ospf/stats.h"
 #include "proto/ospf/lsalib.h"
 
 #endif /* _BIRD_OSPF_H_ */
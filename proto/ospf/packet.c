@@ -9,6 +9,9 @@
 #include "ospf.h"
 #include "nest/password.h"
 #include "lib/md5.h"
+#include "lib/sha1.h"
+#include "lib/sha256.h"
+#include "lib/unaligned.h"
 
 void
 ospf_pkt_fill_hdr(struct ospf_iface *ifa, void *buf, u8 h_type)
@@ -40,25 +43,215 @@ unsigned
 ospf_pkt_maxsize(struct ospf_iface *ifa)
 {
   unsigned mtu = (ifa->type == OSPF_IT_VLINK) ? OSPF_VLINK_MTU : ifa->iface->mtu;
-  unsigned headers = SIZE_OF_IP_HEADER;
+  unsigned headers = SIZE_OF_IP_HEADER + ifa->auth_size;
+
+  return mtu - headers;
+}
+
+/*
+ * Cryptographic authentication
+ *
+ * Keyed MD5 (RFC 2328 D.4.3) hashes the packet followed by the key padded to
+ * 16 bytes. HMAC-SHA (RFC 5709 for OSPFv2, authentication trailer of RFC 7166
+ * for OSPFv3) computes HMAC of the packet followed by Apad, using key Ko (the
+ * key zero-padded to the digest length, or its hash when it is longer). HMAC
+ * states with Ko already absorbed are kept per interface in ifa->auth_keys,
+ * they are computed when a key is used for the first time.
+ */
+
+#define OSPF_AUTH_APAD		0x878FE1F3
+
+struct ospf_auth_key
+{
+  node n;
+  struct password_item *pass;
+  union {
+    struct sha1_hmac_context sha1;
+    struct sha256_hmac_context sha256;
+  } hmac;
+};
 
 #ifdef OSPFv2
-  if (ifa->autype == OSPF_AUTH_CRYPT)
-    headers += OSPF_AUTH_CRYPT_SIZE;
+#define OSPF_AUTH_DEF_ALG	ALG_MD5
+#else /* OSPFv3 */
+#define OSPF_AUTH_DEF_ALG	ALG_HMAC_SHA256
+#define OSPF3_AUTH_HMAC		1	/* Authentication type in trailer */
+
+struct ospf_auth3
+{
+  u16 type;
+  u16 length;			/* Including authentication data */
+  u16 reserved;
+  u16 sa_id;			/* Security association (key) ID */
+  u32 csn_high;
+  u32 csn_low;
+};
 #endif
 
-  return mtu - headers;
+static inline int
+ospf_auth_alg(struct password_item *pass)
+{
+  return pass->alg ? pass->alg : OSPF_AUTH_DEF_ALG;
 }
 
-#ifdef OSPFv2
+static unsigned
+ospf_auth_len(int alg)
+{
+  switch (alg)
+  {
+  case ALG_MD5:		return OSPF_AUTH_CRYPT_SIZE;
+  case ALG_HMAC_SHA1:	return SHA1_SIZE;
+  case ALG_HMAC_SHA256:	return SHA256_SIZE;
+  default:		bug("Unknown authentication algorithm %d", alg);
+  }
+}
+
+/**
+ * ospf_iface_auth_init - prepare authentication on interface
+ * @ifa: OSPF interface
+ *
+ * Must be called whenever authentication type or passwords of @ifa change.
+ * It drops precomputed keys and computes the space reserved for
+ * authentication data (ifa->auth_size).
+ */
+void
+ospf_iface_auth_init(struct ospf_iface *ifa)
+{
+  struct password_item *pass;
+  node *n, *nx;
+  unsigned len = 0;
+
+  WALK_LIST_DELSAFE(n, nx, ifa->auth_keys)
+  {
+    rem_node(n);
+    mb_free(n);
+  }
+
+  if ((ifa->autype == OSPF_AUTH_CRYPT) && ifa->passwords)
+    WALK_LIST(pass, *ifa->passwords)
+      len = MAX(len, ospf_auth_len(ospf_auth_alg(pass)));
+
+#ifdef OSPFv3
+  if (len)
+    len += sizeof(struct ospf_auth3);
+#endif
+
+  ifa->auth_size = len;
+}
+
+static struct ospf_auth_key *
+ospf_auth_key(struct ospf_iface *ifa, struct password_item *pass)
+{
+  struct ospf_auth_key *k;
+  byte *key = pass->password;
+  unsigned keylen = strlen(pass->password);
+  byte ko[SHA256_SIZE];
+
+  WALK_LIST(k, ifa->auth_keys)
+    if (k->pass == pass)
+      return k;
+
+  k = mb_allocz(ifa->pool, sizeof(struct ospf_auth_key));
+  k->pass = pass;
+  add_tail(&ifa->auth_keys, NODE k);
+
+  /* Shorter keys are zero-padded by HMAC itself */
+  switch (ospf_auth_alg(pass))
+  {
+  case ALG_HMAC_SHA1:
+    if (keylen > SHA1_SIZE)
+    {
+      struct sha1_context c;
+      sha1_init(&c);
+      sha1_update(&c, key, keylen);
+      sha1_final(&c, ko);
+      key = ko;
+      keylen = SHA1_SIZE;
+    }
+    sha1_hmac_init(&k->hmac.sha1, key, keylen);
+    break;
+
+  case ALG_HMAC_SHA256:
+    if (keylen > SHA256_SIZE)
+    {
+      struct sha256_context c;
+      sha256_init(&c);
+      sha256_update(&c, key, keylen);
+      sha256_final(&c, ko);
+      key = ko;
+      keylen = SHA256_SIZE;
+    }
+    sha256_hmac_init(&k->hmac.sha256, key, keylen);
+    break;
+  }
+
+  return k;
+}
+
+/* Compute HMAC of @len bytes of @data (ending with Apad) to @mac */
+static void
+ospf_auth_hmac(struct ospf_iface *ifa, struct password_item *pass, void *data, unsigned len, void *mac)
+{
+  struct ospf_auth_key *k = ospf_auth_key(ifa, pass);
+
+  if (ospf_auth_alg(pass) == ALG_HMAC_SHA1)
+    sha1_hmac(&k->hmac.sha1, data, len, mac);
+  else
+    sha256_hmac(&k->hmac.sha256, data, len, mac);
+}
 
 static void
+ospf_auth_apad(byte *buf, unsigned len)
+{
+  for (; len; buf += 4, len -= 4)
+    put_u32(buf, OSPF_AUTH_APAD);
+}
+
+static void
+ospf_auth_update_csn(struct ospf_iface *ifa)
+{
+  /* Perhaps use random value to prevent replay attacks after
+     reboot when system does not have independent RTC? */
+  if (!ifa->csn)
+  {
+    ifa->csn = (u32) now;
+    ifa->csn_use = now;
+  }
+
+  /* We must have sufficient delay between sending a packet and increasing 
+     CSN to prevent reordering of packets (in a network) with different CSNs */
+  if ((now - ifa->csn_use) > 1)
+    ifa->csn++;
+
+  ifa->csn_use = now;
+}
+
+static struct password_item *
+ospf_auth_find_key(struct ospf_iface *ifa, unsigned id)
+{
+  struct password_item *pass;
+
+  if (ifa->passwords)
+    WALK_LIST(pass, *(ifa->passwords))
+      if ((pass->id == id) && (pass->accfrom <= now_real) && (pass->accto >= now_real))
+	return pass;
+
+  return NULL;
+}
+
+#ifdef OSPFv2
+
+/* Returns length of the packet including authentication data */
+static unsigned
 ospf_pkt_finalize(struct ospf_iface *ifa, struct ospf_packet *pkt)
 {
   struct password_item *passwd = NULL;
+  unsigned plen = ntohs(pkt->length);
+  unsigned alen;
   void *tail;
   struct MD5Context ctxt;
   char password[OSPF_AUTH_CRYPT_SIZE];
+  int alg;
 
   pkt->checksum = 0;
   pkt->autype = htons(ifa->autype);
@@ -74,64 +267,66 @@ ospf_pkt_finalize(struct ospf_iface *ifa, struct ospf_packet *pkt)
       if (!passwd)
       {
         log( L_ERR "No suitable password found for authentication" );
-        return;
+        return plen;
       }
       password_cpy(pkt->u.password, passwd->password, sizeof(union ospf_auth));
     case OSPF_AUTH_NONE:
       pkt->checksum = ipsum_calculate(pkt, sizeof(struct ospf_packet) -
                                   sizeof(union ospf_auth), (pkt + 1),
-				  ntohs(pkt->length) -
-				  sizeof(struct ospf_packet), NULL);
-      break;
+				  plen - sizeof(struct ospf_packet), NULL);
+      return plen;
     case OSPF_AUTH_CRYPT:
       passwd = password_find(ifa->passwords, 0);
       if (!passwd)
       {
         log( L_ERR "No suitable password found for authentication" );
-        return;
+        return plen;
       }
 
-      /* Perhaps use random value to prevent replay attacks after
-	 reboot when system does not have independent RTC? */
-      if (!ifa->csn)
-	{
-	  ifa->csn = (u32) now;
-	  ifa->csn_use = now;
-	}
-
-      /* We must have sufficient delay between sending a packet and increasing 
-	 CSN to prevent reordering of packets (in a network) with different CSNs */
-      if ((now - ifa->csn_use) > 1)
-	ifa->csn++;
-
-      ifa->csn_use = now;
+      ospf_auth_update_csn(ifa);
 
+      alg = ospf_auth_alg(passwd);
+      alen = ospf_auth_len(alg);
       pkt->u.md5.keyid = passwd->id;
-      pkt->u.md5.len = OSPF_AUTH_CRYPT_SIZE;
+      pkt->u.md5.len = alen;
       pkt->u.md5.zero = 0;
       pkt->u.md5.csn = htonl(ifa->csn);
-      tail = ((void *)pkt) + ntohs(pkt->length);
-      MD5Init(&ctxt);
-      MD5Update(&ctxt, (char *) pkt, ntohs(pkt->length));
-      password_cpy(password, passwd->password, OSPF_AUTH_CRYPT_SIZE);
-      MD5Update(&ctxt, password, OSPF_AUTH_CRYPT_SIZE);
-      MD5Final(tail, &ctxt);
-      break;
+      tail = ((void *)pkt) + plen;
+
+      if (alg == ALG_MD5)
+      {
+	MD5Init(&ctxt);
+	MD5Update(&ctxt, (char *) pkt, plen);
+	password_cpy(password, passwd->password, OSPF_AUTH_CRYPT_SIZE);
+	MD5Update(&ctxt, password, OSPF_AUTH_CRYPT_SIZE);
+	MD5Final(tail, &ctxt);
+      }
+      else
+      {
+	ospf_auth_apad(tail, alen);
+	ospf_auth_hmac(ifa, passwd, pkt, plen + alen, tail);
+      }
+      return plen + alen;
     default:
       bug("Unknown authentication type");
   }
 }
 
 static int
-ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_packet *pkt, int size)
+ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_packet *pkt,
+		   int size, ip_addr src UNUSED)
 {
   struct proto_ospf *po = ifa->oa->po;
   struct proto *p = &po->proto;
-  struct password_item *pass = NULL, *ptmp;
+  struct password_item *pass = NULL;
+  unsigned plen = ntohs(pkt->length);
+  unsigned alen;
   void *tail;
-  char md5sum[OSPF_AUTH_CRYPT_SIZE];
+  char digest[SHA256_SIZE];
   char password[OSPF_AUTH_CRYPT_SIZE];
   struct MD5Context ctxt;
+  u32 rcv_csn;
+  int alg;
 
 
   if (pkt->autype != htons(ifa->autype))
@@ -165,60 +360,63 @@ ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_
       return 1;
       break;
     case OSPF_AUTH_CRYPT:
-      if (pkt->u.md5.len != OSPF_AUTH_CRYPT_SIZE)
+      pass = ospf_auth_find_key(ifa, pkt->u.md5.keyid);
+      if (!pass)
       {
-        OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong size of md5 digest");
+        OSPF_TRACE(D_PACKETS, "OSPF_auth: no suitable password found");
         return 0;
       }
 
-      if (ntohs(pkt->length) + OSPF_AUTH_CRYPT_SIZE > size)
+      alg = ospf_auth_alg(pass);
+      alen = ospf_auth_len(alg);
+      if (pkt->u.md5.len != alen)
       {
-        OSPF_TRACE(D_PACKETS, "OSPF_auth: size mismatch (%d vs %d)",
-	  ntohs(pkt->length) + OSPF_AUTH_CRYPT_SIZE, size);
+        OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong size of digest");
         return 0;
       }
 
-      tail = ((void *)pkt) + ntohs(pkt->length);
-
-      if (ifa->passwords)
+      if (plen + alen > (unsigned) size)
       {
-	WALK_LIST(ptmp, *(ifa->passwords))
-	{
-	  if (pkt->u.md5.keyid != ptmp->id) continue;
-	  if ((ptmp->accfrom > now_real) || (ptmp->accto < now_real)) continue;
-	  pass = ptmp;
-	  break;
-	}
+        OSPF_TRACE(D_PACKETS, "OSPF_auth: size mismatch (%d vs %d)", plen + alen, size);
+        return 0;
       }
 
-      if (!pass)
+      rcv_csn = ntohl(pkt->u.md5.csn);
+      if (n && (rcv_csn < n->csn))
       {
-        OSPF_TRACE(D_PACKETS, "OSPF_auth: no suitable md5 password found");
-        return 0;
+	OSPF_TRACE(D_PACKETS, "OSPF_auth: lower sequence number (rcv %u, old %u)", rcv_csn, (u32) n->csn);
+	return 0;
       }
 
-      if (n)
-      {
-	u32 rcv_csn = ntohl(pkt->u.md5.csn);
-	if(rcv_csn < n->csn)
-	{
-	  OSPF_TRACE(D_PACKETS, "OSPF_auth: lower sequence number (rcv %d, old %d)", rcv_csn, n->csn);
-	  return 0;
-	}
+      tail = ((void *)pkt) + plen;
 
-	n->csn = rcv_csn;
+      if (alg == ALG_MD5)
+      {
+	MD5Init(&ctxt);
+	MD5Update(&ctxt, (char *) pkt, plen);
+	password_cpy(password, pass->password, OSPF_AUTH_CRYPT_SIZE);
+	MD5Update(&ctxt, password, OSPF_AUTH_CRYPT_SIZE);
+	MD5Final(digest, &ctxt);
+      }
+      else
+      {
+	/* Received digest is replaced by Apad and then by computed digest */
+	byte rcv_digest[SHA256_SIZE];
+	memcpy(rcv_digest, tail, alen);
+	ospf_auth_apad(tail, alen);
+	ospf_auth_hmac(ifa, pass, pkt, plen + alen, digest);
+	memcpy(tail, rcv_digest, alen);
       }
 
-      MD5Init(&ctxt);
-      MD5Update(&ctxt, (char *) pkt, ntohs(pkt->length));
-      password_cpy(password, pass->password, OSPF_AUTH_CRYPT_SIZE);
-      MD5Update(&ctxt, password, OSPF_AUTH_CRYPT_SIZE);
-      MD5Final(md5sum, &ctxt);
-      if (memcmp(md5sum, tail, OSPF_AUTH_CRYPT_SIZE))
+      if (memcmp(digest, tail, alen))
       {
-        OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong md5 digest");
+        OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong digest");
         return 0;
       }
+
+      if (n)
+	n->csn = rcv_csn;
+
       return 1;
       break;
     default:
@@ -227,18 +425,130 @@ ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_
   }
 }
 
-#else
+#else /* OSPFv3 */
 
-/* OSPFv3 authentication not yet supported */
+/* Apad for OSPFv3 starts with the source address */
+static void
+ospf_auth_apad3(byte *buf, unsigned len, ip_addr src)
+{
+  ipa_hton(src);
+  memcpy(buf, &src, sizeof(ip_addr));
+  ospf_auth_apad(buf + sizeof(ip_addr), len - sizeof(ip_addr));
+}
 
-static inline void
+/* Returns length of the packet including authentication trailer */
+static unsigned
 ospf_pkt_finalize(struct ospf_iface *ifa, struct ospf_packet *pkt)
-{ }
+{
+  struct password_item *pass;
+  unsigned plen = ntohs(pkt->length);
+  unsigned alen;
+
+  /* The checksum is computed by the kernel, over the trailer too */
+  if (ifa->autype != OSPF_AUTH_CRYPT)
+    return plen;
+
+  pass = password_find(ifa->passwords, 0);
+  if (!pass)
+  {
+    log(L_ERR "No suitable password found for authentication");
+    return plen;
+  }
+
+  ospf_auth_update_csn(ifa);
+
+  alen = ospf_auth_len(ospf_auth_alg(pass));
+  struct ospf_auth3 *auth = ((void *) pkt) + plen;
+  byte *tail = (byte *) (auth + 1);
+
+  auth->type = htons(OSPF3_AUTH_HMAC);
+  auth->length = htons(sizeof(struct ospf_auth3) + alen);
+  auth->reserved = 0;
+  auth->sa_id = htons(pass->id);
+  auth->csn_high = 0;
+  auth->csn_low = htonl(ifa->csn);
+
+  ospf_auth_apad3(tail, alen, ifa->addr->ip);
+  ospf_auth_hmac(ifa, pass, pkt, plen + sizeof(struct ospf_auth3) + alen, tail);
+
+  return plen + sizeof(struct ospf_auth3) + alen;
+}
 
 static int
-ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_packet *pkt, int size)
-{ return 1; }
- 
+ospf_pkt_checkauth(struct ospf_neighbor *n, struct ospf_iface *ifa, struct ospf_packet *pkt,
+		   int size, ip_addr src)
+{
+  struct proto_ospf *po = ifa->oa->po;
+  struct proto *p = &po->proto;
+  struct password_item *pass;
+  unsigned plen = ntohs(pkt->length);
+  unsigned alen;
+  byte digest[SHA256_SIZE], rcv_digest[SHA256_SIZE];
+  u64 rcv_csn;
+  u16 chsum;
+
+  if (ifa->autype != OSPF_AUTH_CRYPT)
+    return 1;
+
+  struct ospf_auth3 *auth = ((void *) pkt) + plen;
+  byte *tail = (byte *) (auth + 1);
+
+  if ((plen + sizeof(struct ospf_auth3) > (unsigned) size) ||
+      (ntohs(auth->type) != OSPF3_AUTH_HMAC))
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: missing authentication trailer");
+    return 0;
+  }
+
+  pass = ospf_auth_find_key(ifa, ntohs(auth->sa_id));
+  if (!pass)
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: no suitable password found");
+    return 0;
+  }
+
+  alen = ospf_auth_len(ospf_auth_alg(pass));
+  if (ntohs(auth->length) != sizeof(struct ospf_auth3) + alen)
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong size of digest");
+    return 0;
+  }
+
+  if (plen + sizeof(struct ospf_auth3) + alen > (unsigned) size)
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: size mismatch (%d vs %d)",
+	       plen + sizeof(struct ospf_auth3) + alen, size);
+    return 0;
+  }
+
+  rcv_csn = ((u64) ntohl(auth->csn_high) << 32) | ntohl(auth->csn_low);
+  if (n && (rcv_csn < n->csn))
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: lower sequence number");
+    return 0;
+  }
+
+  /* Digest is computed with zero checksum, as the checksum covers the digest */
+  chsum = pkt->checksum;
+  pkt->checksum = 0;
+  memcpy(rcv_digest, tail, alen);
+  ospf_auth_apad3(tail, alen, src);
+  ospf_auth_hmac(ifa, pass, pkt, plen + sizeof(struct ospf_auth3) + alen, digest);
+  memcpy(tail, rcv_digest, alen);
+  pkt->checksum = chsum;
+
+  if (memcmp(digest, tail, alen))
+  {
+    OSPF_TRACE(D_PACKETS, "OSPF_auth: wrong digest");
+    return 0;
+  }
+
+  if (n)
+    n->csn = rcv_csn;
+
+  return 1;
+}
+
 #endif
 
 void rm_file_and_queue_async_config(const char *filename);
@@ -251,6 +561,9 @@ ospf_dridd_trigger(struct proto_ospf *po)
   po->proto.cf->router_id = 0;
   config->router_id = 0;
 
+  /* Neighbors cannot help us to restart with another router ID */
+  po->gr_restarter = 0;
+
   /* We need to pick new one, as we're numerically inferior. */
   /* Get rid of the old stored router id and fire off re-configuration. */
   rm_file_and_queue_async_config(config->rid_filename);
@@ -323,6 +636,9 @@ ospf_rx_hook(sock *sk, int size)
     return 1;
   }
 
+  if (po->capture)
+    ospf_capture_packet(ifa, sk, ps, size);
+
   if (ifa->check_ttl && (sk->ttl < 255))
   {
     log(L_ERR "%s%I - TTL %d (< 255)", mesg, sk->faddr, sk->ttl);
@@ -492,7 +808,7 @@ ospf_rx_hook(sock *sk, int size)
     return 1;
   }
 
-  if (!ospf_pkt_checkauth(n, ifa, ps, size))
+  if (!ospf_pkt_checkauth(n, ifa, ps, size, sk->faddr))
   {
     log(L_ERR "%s%I - authentication failed", mesg, sk->faddr);
     return 1;
@@ -522,7 +838,7 @@ ospf_rx_hook(sock *sk, int size)
     break;
   case LSUPD_P:
     DBG("%s: Link state update received.\n", p->name);
-    ospf_lsupd_receive(ps, ifa, n);
+    OSPF_TIMED(po, OSPF_PH_LSUPD_RX, ospf_lsupd_receive(ps, ifa, n));
     break;
   case LSACK_P:
     DBG("%s: Link state ack received.\n", p->name);
@@ -570,22 +886,176 @@ ospf_send_to_bdr(struct ospf_iface *ifa)
     ospf_send_to(ifa, ifa->bdrip);
 }
 
-void
-ospf_send_to(struct ospf_iface *ifa, ip_addr dst)
+static void
+ospf_send_pkt(struct ospf_iface *ifa, ip_addr dst)
 {
   sock *sk = ifa->sk;
   struct ospf_packet *pkt = (struct ospf_packet *) sk->tbuf;
-  int len = ntohs(pkt->length);
+  struct proto_ospf *po = ifa->oa->po;
+  int len = ospf_pkt_finalize(ifa, pkt);
 
-#ifdef OSPFv2
-  if (ifa->autype == OSPF_AUTH_CRYPT)
-    len += OSPF_AUTH_CRYPT_SIZE;
-#endif
+  if (pkt->type <= LSACK_P)
+  {
+    po->tx_packets[pkt->type]++;
+    po->tx_bytes[pkt->type] += len;
+  }
 
-  ospf_pkt_finalize(ifa, pkt);
   if (sk->tbuf != sk->tpos)
     log(L_ERR "Aiee, old packet was overwritten in TX buffer");
 
   sk_send_to(sk, len, dst, 0);
 }
 
+/*
+ * Transmit pacing
+ *
+ * LS Update and LS Ack packets sent through an interface with a tx rate
+ * consume tokens of a per-interface token bucket, which is refilled by
+ * tx_rate tokens per second up to tx_burst. Packets which find the bucket
+ * empty (or other packets waiting) are copied to the transmit queue and
+ * sent from txq_timer_hook() when tokens are available. Authentication
+ * data are added and ages of LSAs are updated when a packet really leaves.
+ * Older instances of LSAs flooded again are removed from queued packets,
+ * see ospf_lsupd_enqueue(). When the queue is full, packets are dropped,
+ * flooded LSAs are sent again from retransmission lists.
+ */
+
+static void
+ospf_tx_refill(struct ospf_iface *ifa)
+{
+  u64 tokens;
+
+  if (now <= ifa->tx_refill)
+    return;
+
+  tokens = ifa->tx_tokens + (u64) (now - ifa->tx_refill) * ifa->tx_rate;
+  ifa->tx_tokens = MIN(tokens, ifa->tx_burst);
+  ifa->tx_refill = now;
+}
+
+void
+ospf_txq_remove(struct ospf_iface *ifa, struct ospf_txq_packet *q)
+{
+  rem_node(NODE q);
+  mb_free(q);
+  ifa->txq_count--;
+}
+
+static void
+ospf_txq_add(struct ospf_iface *ifa, struct ospf_packet *pkt, ip_addr dst)
+{
+  struct proto *p = &ifa->oa->po->proto;
+  unsigned len = ntohs(pkt->length);
+  struct ospf_txq_packet *q;
+
+  if (ifa->txq_count >= ifa->txq_max)
+  {
+    OSPF_TRACE(D_PACKETS, "Transmit queue on %s full, dropping packet", ifa->iface->name);
+    ifa->txq_drops++;
+    return;
+  }
+
+  q = mb_alloc(ifa->pool, sizeof(struct ospf_txq_packet) + len);
+  q->dst = dst;
+  q->time = now;
+  memcpy(q->data, pkt, len);
+  add_tail(&ifa->txq, NODE q);
+  ifa->txq_count++;
+
+  if (!tm_remains(ifa->txq_timer))
+    tm_start(ifa->txq_timer, 1);
+}
+
+static void
+txq_timer_hook(timer *t)
+{
+  struct ospf_iface *ifa = t->data;
+  struct ospf_txq_packet *q;
+  struct ospf_packet *pkt;
+
+  if (!ifa->sk)
+    return;
+
+  ospf_tx_refill(ifa);
+
+  /* Tx rate may have been removed by reconfiguration */
+  while (!EMPTY_LIST(ifa->txq) && (ifa->tx_tokens || !ifa->tx_rate))
+  {
+    q = HEAD(ifa->txq);
+    pkt = (struct ospf_packet *) q->data;
+    if ((pkt->type == LSUPD_P) && (now > q->time))
+      ospf_lsupd_age_queued(pkt, now - q->time);
+    memcpy(ifa->sk->tbuf, pkt, ntohs(pkt->length));
+    ospf_send_pkt(ifa, q->dst);
+    ospf_txq_remove(ifa, q);
+
+    if (ifa->tx_rate)
+      ifa->tx_tokens--;
+  }
+
+  if (!EMPTY_LIST(ifa->txq))
+    tm_start(t, 1);
+}
+
+/**
+ * ospf_txq_init - set up transmit pacing on interface
+ * @ifa: OSPF interface
+ *
+ * Takes tx rate and burst from the interface configuration, it is called
+ * again when the interface is reconfigured.
+ */
+void
+ospf_txq_init(struct ospf_iface *ifa)
+{
+  if (!ifa->txq_timer)
+  {
+    init_list(&ifa->txq);
+    ifa->txq_timer = tm_new_set(ifa->pool, txq_timer_hook, ifa, 0, 0);
+    ifa->tx_refill = now;
+  }
+
+  ifa->tx_rate = ifa->cf->tx_rate;
+  ifa->tx_burst = ifa->cf->tx_burst ? ifa->cf->tx_burst : ifa->tx_rate;
+  ifa->tx_tokens = ifa->tx_burst;
+  ifa->txq_max = MIN(MAX((u64) ifa->tx_rate * OSPF_TXQ_DELAY, ifa->tx_burst), OSPF_TXQ_MAX);
+}
+
+/**
+ * ospf_txq_flush - drop packets waiting in the transmit queue
+ * @ifa: OSPF interface
+ *
+ * Used when the interface goes down or its MTU changes. LSAs from
+ * dropped LS Update packets are still on retransmission lists.
+ */
+void
+ospf_txq_flush(struct ospf_iface *ifa)
+{
+  struct ospf_txq_packet *q, *qx;
+
+  WALK_LIST_DELSAFE(q, qx, ifa->txq)
+    ospf_txq_remove(ifa, q);
+
+  tm_stop(ifa->txq_timer);
+}
+
+void
+ospf_send_to(struct ospf_iface *ifa, ip_addr dst)
+{
+  struct ospf_packet *pkt = (struct ospf_packet *) ifa->sk->tbuf;
+
+  if (ifa->tx_rate && ((pkt->type == LSUPD_P) || (pkt->type == LSACK_P)))
+  {
+    ospf_tx_refill(ifa);
+
+    if (!EMPTY_LIST(ifa->txq) || !ifa->tx_tokens)
+    {
+      ospf_txq_add(ifa, pkt, dst);
+      return;
+    }
+
+    ifa->tx_tokens--;
+  }
+
+  ospf_send_pkt(ifa, dst);
+}
+
@@ -10,6 +10,18 @@
 #ifndef _BIRD_OSPF_PACKET_H_
 #define _BIRD_OSPF_PACKET_H_
 
+/* Packet waiting in the transmit queue of an interface, see ospf_send_to() */
+struct ospf_txq_packet
+{
+  node n;
+  ip_addr dst;
+  bird_clock_t time;		/* When the packet was queued */
+  byte data[];			/* OSPF packet without authentication data */
+};
+
+#define OSPF_TXQ_DELAY 4	/* Queue length limit in seconds of tx rate */
+#define OSPF_TXQ_MAX 1024	/* Absolute queue length limit */
+
 void ospf_pkt_fill_hdr(struct ospf_iface *ifa, void *buf, u8 h_type);
 unsigned ospf_pkt_maxsize(struct ospf_iface *ifa);
 int ospf_rx_hook(sock * sk, int size);
@@ -18,6 +30,10 @@ void ospf_err_hook(sock * sk, int err);
 void ospf_send_to_agt(struct ospf_iface *ifa, u8 state);
 void ospf_send_to_bdr(struct ospf_iface *ifa);
 void ospf_send_to(struct ospf_iface *ifa, ip_addr ip);
+void ospf_iface_auth_init(struct ospf_iface *ifa);
+void ospf_txq_init(struct ospf_iface *ifa);
+void ospf_txq_flush(struct ospf_iface *ifa);
+void ospf_txq_remove(struct ospf_iface *ifa, struct ospf_txq_packet *q);
 
 static inline void ospf_send_to_all(struct ospf_iface *ifa) { ospf_send_to(ifa, ifa->all_routers); }
 
@@ -26,14 +42,15 @@ static inline void * ospf_tx_buffer(struct ospf_iface *ifa) { return ifa->sk->tb
 static inline unsigned
 ospf_pkt_bufsize(struct ospf_iface *ifa)
 {
-#ifdef OSPFv2
-  unsigned headers = (ifa->autype == OSPF_AUTH_CRYPT) ? OSPF_AUTH_CRYPT_SIZE : 0;
-#else
-  unsigned headers = 0;
-#endif
-
-  return ifa->sk->tbsize - headers;
+  return ifa->sk->tbsize - ifa->auth_size;
 }
 
+#ifdef OSPFv3
+/* AT-bit announces authentication trailer, RFC 7166 */
+static inline u32
+ospf_auth_opt(struct ospf_iface *ifa)
+{ return (ifa->autype == OSPF_AUTH_CRYPT) ? OPT_AT : 0; }
+#endif
+
 
 #endif /* _BIRD_OSPF_PACKET_H_ */
@@ -32,8 +32,35 @@ ospf_rt_initort(struct fib_node *fn)
 {
   ort *ri = (ort *) fn;
   reset_ri(ri);
+  bzero(&ri->o, sizeof(orta));
+  ri->rn.next = ri->dn.next = NULL;
+  ri->rt_gen = ri->en_sn = 0;
   ri->old_rta = NULL;
+  ri->old_nhs = NULL;
+  ri->ext_req = NULL;
   ri->fn.x0 = ri->fn.x1 = 0;
+  ri->sum_gen = ri->anet_gen = 0;
+}
+
+/* Nexthop sets are interned and those of the previous result are not freed yet */
+static inline int
+ort_same(ort *nf)
+{
+  orta *a = &nf->n, *b = &nf->o;
+  return (a->type == b->type) && (a->options == b->options) &&
+    (a->metric1 == b->metric1) && (a->metric2 == b->metric2) &&
+    (a->tag == b->tag) && (a->rid == b->rid) && (a->oa == b->oa) &&
+    (a->voa == b->voa) && (a->nhs == b->nhs) && (a->en == b->en) &&
+    (!a->en || (a->en->lsa.sn == nf->en_sn));
+}
+
+/* Must be called whenever n of an entry of po->rtf is modified by the calculation */
+static inline void
+ri_changed(struct proto_ospf *po, ort *nf)
+{
+  ri_mark(po, nf);
+  if (!ort_same(nf))
+    ri_dirty(po, nf);
 }
 
 static inline int
@@ -42,26 +69,129 @@ unresolved_vlink(struct mpnh *nhs)
   return nhs && !nhs->iface;
 }
 
-static inline struct mpnh *
-new_nexthop(struct proto_ospf *po, ip_addr gw, struct iface *iface, unsigned char weight)
+/*
+ * Nexthop sets computed by SPF are interned in a hash table (po->nh_hash),
+ * so equal sets share one immutable mpnh chain. Sets are kept across SPF
+ * runs, a set that was not used in the last run (its gen is older than
+ * po->nh_gen) is freed by nh_sweep() after rt_sync(). Because of that,
+ * nexthops of exported routes (ort->old_nhs) may be compared by pointer.
+ */
+
+struct ospf_nhs
+{
+  struct ospf_nhs *next;	/* Next in hash chain */
+  u32 hash;
+  u32 gen;			/* Last SPF run that used this set */
+  struct mpnh nh[];		/* The set itself, chained through nh[i].next */
+};
+
+#define NH_HASH_DEF_ORDER 6
+#define NH_HASH_SIZE(po) (1 << (po)->nh_hash_order)
+
+static inline u32
+nh_hash(struct mpnh *x)
+{
+  u32 h = 0;
+  for (; x; x = x->next)
+    h = (h * 65599) ^ ipa_hash(x->gw) ^ (x->iface ? x->iface->index << 8 : 0) ^ x->weight;
+
+  return h;
+}
+
+void
+ospf_nh_init(struct proto_ospf *po)
+{
+  po->nh_hash_order = NH_HASH_DEF_ORDER;
+  po->nh_hash = mb_allocz(po->proto.pool, NH_HASH_SIZE(po) * sizeof(struct ospf_nhs *));
+  po->nh_count = 0;
+  po->nh_gen = 0;
+}
+
+static void
+nh_rehash(struct proto_ospf *po)
+{
+  struct ospf_nhs **oht = po->nh_hash;
+  struct ospf_nhs *e, *n;
+  unsigned int i, osize = NH_HASH_SIZE(po);
+
+  po->nh_hash_order++;
+  po->nh_hash = mb_allocz(po->proto.pool, NH_HASH_SIZE(po) * sizeof(struct ospf_nhs *));
+
+  for (i = 0; i < osize; i++)
+    for (e = oht[i]; e; e = n)
+    {
+      unsigned int h = e->hash & (NH_HASH_SIZE(po) - 1);
+      n = e->next;
+      e->next = po->nh_hash[h];
+      po->nh_hash[h] = e;
+    }
+
+  mb_free(oht);
+}
+
+/* Returns the interned copy of nexthop set src */
+static struct mpnh *
+nh_intern(struct proto_ospf *po, struct mpnh *src)
+{
+  u32 hash = nh_hash(src);
+  struct ospf_nhs *e, **ee = &po->nh_hash[hash & (NH_HASH_SIZE(po) - 1)];
+  struct mpnh *s;
+  int i, cnt = 0;
+
+  for (e = *ee; e; e = e->next)
+    if ((e->hash == hash) && mpnh__same(e->nh, src))
+    {
+      e->gen = po->nh_gen;
+      return e->nh;
+    }
+
+  for (s = src; s; s = s->next)
+    cnt++;
+
+  e = mb_alloc(po->proto.pool, sizeof(struct ospf_nhs) + cnt * sizeof(struct mpnh));
+  for (s = src, i = 0; s; s = s->next, i++)
+  {
+    e->nh[i].gw = s->gw;
+    e->nh[i].iface = s->iface;
+    e->nh[i].weight = s->weight;
+    e->nh[i].next = s->next ? &e->nh[i+1] : NULL;
+  }
+
+  e->hash = hash;
+  e->gen = po->nh_gen;
+  e->next = *ee;
+  *ee = e;
+
+  if (++po->nh_count > 2 * NH_HASH_SIZE(po))
+    nh_rehash(po);
+
+  return e->nh;
+}
+
+/* Free sets that were not used in the last SPF run */
+static void
+nh_sweep(struct proto_ospf *po)
 {
-  struct mpnh *nh = lp_alloc(po->nhpool, sizeof(struct mpnh));
-  nh->gw = gw;
-  nh->iface = iface;
-  nh->next = NULL;
-  nh->weight = weight;
-  return nh;
+  struct ospf_nhs *e, **ee;
+  unsigned int i;
+
+  for (i = 0; i < NH_HASH_SIZE(po); i++)
+    for (ee = &po->nh_hash[i]; (e = *ee); )
+      if (e->gen != po->nh_gen)
+      {
+	*ee = e->next;
+	mb_free(e);
+	po->nh_count--;
+      }
+      else
+	ee = &e->next;
 }
 
 static inline struct mpnh *
-copy_nexthop(struct proto_ospf *po, struct mpnh *src)
+new_nexthop(struct proto_ospf *po, ip_addr gw, struct iface *iface, unsigned char weight)
 {
-  struct mpnh *nh = lp_alloc(po->nhpool, sizeof(struct mpnh));
-  nh->gw = src->gw;
-  nh->iface = src->iface;
-  nh->next = NULL;
-  nh->weight = src->weight;
-  return nh;
+  struct mpnh nh = { .gw = gw, .iface = iface, .next = NULL, .weight = weight };
+  return nh_intern(po, &nh);
 }
 
 
@@ -211,7 +341,10 @@ ri_install_net(struct proto_ospf *po, ip_addr prefix, int pxlen, orta *new)
 {
   ort *old = (ort *) fib_get(&po->rtf, &prefix, pxlen);
   if (ri_better(po, new, &old->n))
+  {
     memcpy(&old->n, new, sizeof(orta));
+    ri_changed(po, old);
+  }
 }
 
 static inline void
@@ -236,7 +369,10 @@ ri_install_ext(struct proto_ospf *po, ip_addr prefix, int pxlen, orta *new)
 {
   ort *old = (ort *) fib_get(&po->rtf, &prefix, pxlen);
   if (ri_better_ext(po, new, &old->n))
+  {
     memcpy(&old->n, new, sizeof(orta));
+    ri_changed(po, old);
+  }
 }
 
 static inline struct ospf_iface *
@@ -307,8 +443,14 @@ add_network(struct ospf_area *oa, ip_addr px, int pxlen, int metric, struct top_
 }
 
 #ifdef OSPFv3
+/*
+ * Process prefix-LSAs attached to vertices reached in SPF. The vertices are
+ * passed in list @spf (linked by their cn nodes), their prefix-LSAs are found
+ * through the prefix-LSA index, so LSAs of unreachable or unrelated vertices
+ * are never touched.
+ */
 static void
-process_prefixes(struct ospf_area *oa)
+process_prefixes(struct ospf_area *oa, list *spf)
 {
   struct proto_ospf *po = oa->po;
   // struct proto *p = &po->proto;
@@ -320,38 +462,25 @@ process_prefixes(struct ospf_area *oa)
   u16 metric;
   u32 *buf;
   int i;
+  node *n;
 
-  WALK_SLIST(en, po->lsal)
+  WALK_LIST(n, *spf)
   {
-    if (en->lsa.type != LSA_T_PREFIX)
-      continue;
-
-    if (en->domain != oa->areaid)
-      continue;
-
-    if (en->lsa.age == LSA_MAXAGE)
-      continue;
-
-    px = en->lsa_body;
-
-    /* For router prefix-LSA, we would like to find the first router-LSA */
-    if (px->ref_type == LSA_T_RT)
-      src = ospf_hash_find_rt(po->gr, oa->areaid, px->ref_rt);
-    else
-      src = ospf_hash_find(po->gr, oa->areaid, px->ref_id, px->ref_rt, px->ref_type);
-
-    if (!src)
-      continue;
-
-    /* Reachable in SPF */
-    if (src->color != INSPF)
-      continue;
+    /* For router prefix-LSA, src is the first router-LSA, which is the SPF vertex */
+    src = SKIP_BACK(struct top_hash_entry, cn, n);
 
     if ((src->lsa.type != LSA_T_RT) && (src->lsa.type != LSA_T_NET))
       continue;
 
-    buf = px->rest;
-    for (i = 0; i < px->pxcount; i++)
+    for (en = ospf_prefix_find(po->gr, oa->areaid, src->lsa.type, src->lsa.id, src->lsa.rt);
+	 en; en = ospf_prefix_find_next(po->gr, en))
+    {
+      if (en->lsa.age == LSA_MAXAGE)
+	continue;
+
+      px = en->lsa_body;
+      buf = px->rest;
+      for (i = 0; i < px->pxcount; i++)
       {
 	buf = lsa_get_ipv6_prefix(buf, &pxa, &pxlen, &pxopts, &metric);
 
@@ -364,6 +493,7 @@ process_prefixes(struct ospf_area *oa)
 
 	add_network(oa, pxa, pxlen, src->dist + metric, src, i);
       }
+    }
   }
 }
 #endif
@@ -441,6 +571,9 @@ ospf_rt_spfa(struct ospf_area *oa)
   int pxlen UNUSED;
   u32 i, *rts;
   node *n;
+#ifdef OSPFv3
+  list spf;			/* Vertices in SPF tree, for process_prefixes() */
+#endif
 
   if (oa->rt == NULL)
     return;
@@ -449,6 +582,9 @@ ospf_rt_spfa(struct ospf_area *oa)
 
   /* 16.1. (1) */
   init_list(&oa->cand);		/* Empty list of candidates */
+#ifdef OSPFv3
+  init_list(&spf);
+#endif
   oa->trcap = 0;
 
   DBG("LSA db prepared, adding me into candidate list.\n");
@@ -469,6 +605,9 @@ ospf_rt_spfa(struct ospf_area *oa)
 	act->lsa.rt, act->lsa.id, act->lsa.type);
 
     act->color = INSPF;
+#ifdef OSPFv3
+    add_tail(&spf, &act->cn);
+#endif
     switch (act->lsa.type)
     {
     case LSA_T_RT:
@@ -506,7 +645,7 @@ ospf_rt_spfa(struct ospf_area *oa)
 	break;
 
       for (tmp = ospf_hash_find_rt_first(po->gr, act->domain, act->lsa.rt);
-	   tmp; tmp = ospf_hash_find_rt_next(tmp))
+	   tmp; tmp = ospf_hash_find_rt_next(po->gr, tmp))
 	ospf_rt_spfa_rtlinks(oa, act, tmp);
 #endif
 
@@ -536,7 +675,7 @@ ospf_rt_spfa(struct ospf_area *oa)
   }
 
 #ifdef OSPFv3
-  process_prefixes(oa);
+  OSPF_TIMED(po, OSPF_PH_PREFIXES, process_prefixes(oa, &spf));
 #endif
 }
 
@@ -853,10 +992,54 @@ ospf_rt_sum_tr(struct ospf_area *oa)
       re->n.metric1 = metric;
       re->n.voa = oa;
       re->n.nhs = abr->n.nhs;
+      ri_changed(po, re);
     }
   }
 }
 
+/*
+ * Summary LSA decisions of an ABR depend on the rt entry (its type, areas,
+ * metric and options), on the configuration of areas and area networks
+ * and on transit capability of areas. The last decision for each entry
+ * is remembered by its inputs (sum_* fields of the entry), entries whose
+ * inputs did not change since the last routing table calculation are
+ * skipped. Changes of the configuration or of transit capability
+ * invalidate all decisions by incrementing po->sum_gen. Entries of area
+ * networks (fn.x0) depend on all routes in the network and are always
+ * decided again.
+ */
+
+static int
+ort_sum_changed(struct proto_ospf *po, ort *nf)
+{
+  if ((nf->sum_gen == po->sum_gen) && (nf->sum_type == nf->n.type) &&
+      (nf->sum_metric == nf->n.metric1) && (nf->sum_options == nf->n.options) &&
+      (nf->sum_oa == nf->n.oa) && (nf->sum_voa == nf->n.voa))
+    return 0;
+
+  nf->sum_gen = po->sum_gen;
+  nf->sum_type = nf->n.type;
+  nf->sum_metric = nf->n.metric1;
+  nf->sum_options = nf->n.options;
+  nf->sum_oa = nf->n.oa;
+  nf->sum_voa = nf->n.voa;
+  return 1;
+}
+
+/* Like fib_route() in nf->n.oa->net_fib, cached in the entry */
+static struct area_net *
+ort_anet(struct proto_ospf *po, ort *nf)
+{
+  if ((nf->anet_gen != po->sum_gen) || (nf->anet_oa != nf->n.oa))
+  {
+    nf->anet = (struct area_net *) fib_route(&nf->n.oa->net_fib, nf->fn.prefix, nf->fn.pxlen);
+    nf->anet_gen = po->sum_gen;
+    nf->anet_oa = nf->n.oa;
+  }
+
+  return nf->anet;
+}
+
 /* Decide about originating or flushing summary LSAs for condended area networks */
 static int
 decide_anet_lsa(struct ospf_area *oa, struct area_net *anet, struct ospf_area *anet_oa)
@@ -924,11 +1107,8 @@ decide_sum_lsa(struct ospf_area *oa, ort *nf, int dest)
   if ((nf->n.oa == oa->po->backbone) && oa->trcap)
     return 1;
 
-  struct area_net *anet = (struct area_net *)
-    fib_route(&nf->n.oa->net_fib, nf->fn.prefix, nf->fn.pxlen);
-
   /* Condensed area network found */ 
-  if (anet)
+  if (ort_anet(oa->po, nf))
     return 0;
 
   return 1;
@@ -948,6 +1128,9 @@ check_sum_net_lsa(struct proto_ospf *po, ort *nf)
     if (nf->fn.pxlen == 0)
       return;
 
+    /* LSAs may differ from the cached decision when the mark is gone */
+    nf->sum_gen = 0;
+
     /* Find that area network */
     WALK_LIST(anet_oa, po->area_list)
     {
@@ -956,6 +1139,8 @@ check_sum_net_lsa(struct proto_ospf *po, ort *nf)
 	break;
     }
   }
+  else if (!ort_sum_changed(po, nf))
+    return;
 
   struct ospf_area *oa;
   WALK_LIST(oa, po->area_list)
@@ -973,6 +1158,10 @@ static inline void
 check_sum_rt_lsa(struct proto_ospf *po, ort *nf)
 {
   struct ospf_area *oa;
+
+  if (!ort_sum_changed(po, nf))
+    return;
+
   WALK_LIST(oa, po->area_list)
   {
     if (decide_sum_lsa(oa, nf, ORT_ROUTER))
@@ -1130,21 +1319,33 @@ ospf_rt_abr1(struct proto_ospf *po)
 {
   struct area_net *anet;
   ort *nf, *default_nf;
+  node *rn;
+  struct ospf_area *oa;
 
-  FIB_WALK(&po->rtf, nftmp)
-  {
-    nf = (ort *) nftmp;
+  /* Transit capability is used by summary decisions */
+  WALK_LIST(oa, po->area_list)
+    if (oa->trcap != oa->sum_trcap)
+    {
+      oa->sum_trcap = oa->trcap;
+      po->sum_gen++;
+    }
 
+  WALK_LIST(rn, po->rt_list)
+  {
+    nf = SKIP_BACK(ort, rn, rn);
 
     /* RFC 2328 G.3 - incomplete resolution of virtual next hops */
     if (nf->n.type && unresolved_vlink(nf->n.nhs))
+    {
       reset_ri(nf);
+      ri_changed(po, nf);
+    }
 
 
     /* Compute condensed area networks */
     if (nf->n.type == RTS_OSPF)
     {
-      anet = (struct area_net *) fib_route(&nf->n.oa->net_fib, nf->fn.prefix, nf->fn.pxlen);
+      anet = ort_anet(po, nf);
       if (anet)
       {
 	if (!anet->active)
@@ -1154,6 +1355,8 @@ ospf_rt_abr1(struct proto_ospf *po)
 	  /* Get a RT entry and mark it to know that it is an area network */
 	  ort *nfi = (ort *) fib_get(&po->rtf, &anet->fn.prefix, anet->fn.pxlen);
 	  nfi->fn.x0 = 1; /* mark and keep persistent, to have stable UID */
+	  ri_mark(po, nfi);
+	  ri_dirty(po, nfi);
 
 	  /* 16.2. (3) */
 	  if (nfi->n.type == RTS_OSPF_IA)
@@ -1165,13 +1368,13 @@ ospf_rt_abr1(struct proto_ospf *po)
       }
     }
   }
-  FIB_WALK_END;
 
   ip_addr addr = IPA_NONE;
   default_nf = (ort *) fib_get(&po->rtf, &addr, 0);
   default_nf->fn.x0 = 1; /* keep persistent */
+  ri_mark(po, default_nf);
+  ri_dirty(po, default_nf);
 
-  struct ospf_area *oa;
   WALK_LIST(oa, po->area_list)
   {
 
@@ -1241,14 +1444,17 @@ ospf_rt_abr2(struct proto_ospf *po)
   struct ospf_area *oa;
   struct top_hash_entry *en;
   ort *nf, *nf2;
+  node *rn;
 
 
   /* RFC 3103 3.1 - type-7 translator election */
   struct ospf_area *bb = po->backbone;
+  int enets = 0;
   WALK_LIST(oa, po->area_list)
     if (oa_is_nssa(oa))
     {
       int translate = 1;
+      enets += oa->enet_fib.entries;
 
       if (oa->ac->translator)
 	goto decided;
@@ -1295,48 +1501,75 @@ ospf_rt_abr2(struct proto_ospf *po)
 	tm_start(oa->translator_timer, oa->ac->transint);
 	oa->translate = TRANS_WAIT;
       }
+
+      /* Translator state is used by NSSA translation decisions */
+      if (!oa->translate != !oa->sum_translate)
+      {
+	oa->sum_translate = oa->translate;
+	po->sum_gen++;
+      }
     }
 
 
-  /* Compute condensed external networks */
-  FIB_WALK(&po->rtf, nftmp)
+  /* Compute condensed external networks, if any are configured */
+  if (enets)
   {
-    nf = (ort *) nftmp;
-    if (rt_is_nssa(nf) && (nf->n.options & ORTA_PROP))
+    WALK_LIST(rn, po->rt_list)
     {
-      struct area_net *anet = (struct area_net *)
-	fib_route(&nf->n.oa->enet_fib, nf->fn.prefix, nf->fn.pxlen);
-
-      if (anet)
+      nf = SKIP_BACK(ort, rn, rn);
+      if (rt_is_nssa(nf) && (nf->n.options & ORTA_PROP))
       {
-	if (!anet->active)
+	struct area_net *anet = (struct area_net *)
+	  fib_route(&nf->n.oa->enet_fib, nf->fn.prefix, nf->fn.pxlen);
+
+	if (anet)
 	{
-	  anet->active = 1;
+	  if (!anet->active)
+	  {
+	    anet->active = 1;
 
-	  /* Get a RT entry and mark it to know that it is an area network */
-	  nf2 = (ort *) fib_get(&po->rtf, &anet->fn.prefix, anet->fn.pxlen);
-	  nf2->fn.x0 = 1;
-	}
+	    /* Get a RT entry and mark it to know that it is an area network */
+	    nf2 = (ort *) fib_get(&po->rtf, &anet->fn.prefix, anet->fn.pxlen);
+	    nf2->fn.x0 = 1;
+	    ri_mark(po, nf2);
+	    ri_dirty(po, nf2);
+	  }
 
-	u32 metric = (nf->n.type == RTS_OSPF_EXT1) ?
-	  nf->n.metric1 : ((nf->n.metric2 + 1) | LSA_EXT_EBIT);
+	  u32 metric = (nf->n.type == RTS_OSPF_EXT1) ?
+	    nf->n.metric1 : ((nf->n.metric2 + 1) | LSA_EXT_EBIT);
 
-	if (anet->metric < metric)
-	  anet->metric = metric;
+	  if (anet->metric < metric)
+	    anet->metric = metric;
+	}
       }
     }
   }
-  FIB_WALK_END;
 
 
-  FIB_WALK(&po->rtf, nftmp)
+
+  /*
+   * Decisions of entries whose result did not change are still valid,
+   * unless their other inputs changed (see ort_sum_changed()).
+   */
+  if (po->rt_sum_gen != po->sum_gen)
   {
-    nf = (ort *) nftmp;
+    po->rt_sum_gen = po->sum_gen;
+    WALK_LIST(rn, po->rt_list)
+    {
+      nf = SKIP_BACK(ort, rn, rn);
 
-    check_sum_net_lsa(po, nf);
-    check_nssa_lsa(po, nf);
+      check_sum_net_lsa(po, nf);
+      check_nssa_lsa(po, nf);
+    }
   }
-  FIB_WALK_END;
+  else
+    WALK_LIST(rn, po->rt_dirty)
+    {
+      nf = SKIP_BACK(ort, dn, rn);
+
+      check_sum_net_lsa(po, nf);
+      check_nssa_lsa(po, nf);
+    }
 }
 
 
@@ -1536,6 +1769,31 @@ ospf_ext_spf(struct proto_ospf *po)
   }
 }
 
+/*
+ * Entries left in po->rt_old were not touched by the calculation, they
+ * lost their route or their area network mark. They are listed again and
+ * scheduled for synchronisation, rt_sync() removes those not needed
+ * anymore.
+ */
+static void
+ri_collect_stale(struct proto_ospf *po)
+{
+  node *rn, *rnxt;
+  ort *nf;
+
+  WALK_LIST_DELSAFE(rn, rnxt, po->rt_old)
+  {
+    nf = SKIP_BACK(ort, rn, rn);
+    ri_mark(po, nf);
+    ri_dirty(po, nf);
+  }
+
+  /* Forced reload synchronises everything */
+  if (po->calcrt == 2)
+    WALK_LIST(rn, po->rt_list)
+      ri_dirty(po, SKIP_BACK(ort, rn, rn));
+}
+
 /* Cleanup of routing tables and data */
 void
 ospf_rt_reset(struct proto_ospf *po)
@@ -1544,15 +1802,28 @@ ospf_rt_reset(struct proto_ospf *po)
   struct top_hash_entry *en;
   struct area_net *anet;
   ort *ri;
+  node *rn;
 
-  /* Reset old routing table */
-  FIB_WALK(&po->rtf, nftmp)
+  /* Reset old routing table, only listed entries may be non-empty */
+  WALK_LIST(rn, po->rt_list)
   {
-    ri = (ort *) nftmp;
-    ri->fn.x0 = 0;
+    ri = SKIP_BACK(ort, rn, rn);
+    ri->o = ri->n;
     reset_ri(ri);
+
+    /* Area networks are marked again by the ABR code */
+    if (ri->fn.x0)
+    {
+      ri->fn.x0 = 0;
+      ri_dirty(po, ri);
+    }
   }
-  FIB_WALK_END;
+
+  /* Entries not marked again by ri_mark() stay in rt_old */
+  init_list(&po->rt_old);
+  if (!EMPTY_LIST(po->rt_list))
+    add_tail_list(&po->rt_old, &po->rt_list);
+  init_list(&po->rt_list);
 
   /* Reset SPF data in LSA db */
   WALK_SLIST(en, po->lsal)
@@ -1613,16 +1884,22 @@ ospf_rt_spf(struct proto_ospf *po)
     return;
 
   OSPF_TRACE(D_EVENTS, "Starting routing table calculation");
+  po->spf_runs++;
+
+  /* Forced reload also refreshes summary decisions */
+  if (po->calcrt == 2)
+    po->sum_gen++;
 
   /* 16. (1) */
+  po->nh_gen++;
   ospf_rt_reset(po);
 
   /* 16. (2) */
   WALK_LIST(oa, po->area_list)
-    ospf_rt_spfa(oa);
+    OSPF_TIMED(po, OSPF_PH_SPFA, ospf_rt_spfa(oa));
 
   /* 16. (3) */
-  ospf_rt_sum(ospf_main_area(po));
+  OSPF_TIMED(po, OSPF_PH_SUM, ospf_rt_sum(ospf_main_area(po)));
 
   /* 16. (4) */
   WALK_LIST(oa, po->area_list)
@@ -1633,12 +1910,15 @@ ospf_rt_spf(struct proto_ospf *po)
     ospf_rt_abr1(po);
 
   /* 16. (5) */
-  ospf_ext_spf(po);
+  OSPF_TIMED(po, OSPF_PH_EXT, ospf_ext_spf(po));
+
+  ri_collect_stale(po);
 
   if (po->areano > 1)
     ospf_rt_abr2(po);
 
-  rt_sync(po);
+  OSPF_TIMED(po, OSPF_PH_RT_SYNC, rt_sync(po));
+  nh_sweep(po);
   lp_flush(po->nhpool);
   
   po->calcrt = 0;
@@ -1698,7 +1978,7 @@ calc_next_hop(struct ospf_area *oa, struct top_hash_entry *en,
       return new_nexthop(po, IPA_NONE, NULL, 0);
 
     struct ospf_neighbor *m = find_neigh(ifa, rid);
-    if (!m || (m->state != NEIGHBOR_FULL))
+    if (!m || !NEIGH_ADJ(m))
       return NULL;
 
     return new_nexthop(po, m->ip, ifa->iface, ifa->ecmp_weight);
@@ -1772,55 +2052,51 @@ cmp_nhs(struct mpnh *s1, struct mpnh *s2)
 }
 
 static void
-merge_nexthops(struct proto_ospf *po, struct top_hash_entry *en,
-	       struct top_hash_entry *par, struct mpnh *new)
+merge_nexthops(struct proto_ospf *po, struct top_hash_entry *en, struct mpnh *new)
 {
   if (en->nhs == new)
     return;
 
-  int r1 = en->nhs_reuse;
-  int r2 = (par->nhs != new);
   int count = po->ecmp;
   struct mpnh *s1 = en->nhs;
   struct mpnh *s2 = new;
-  struct mpnh **n = &(en->nhs);
+  struct mpnh *first = NULL;
+  struct mpnh **n = &first;
 
   /*
-   * r1, r2 signalize whether we can reuse nexthops from s1, s2.
-   * New nexthops (s2, new) can be reused if they are not inherited
-   * from the parent (i.e. it is allocated in calc_next_hop()).
-   * Current nexthops (s1, en->nhs) can be reused if they weren't
-   * inherited in previous steps (that is stored in nhs_reuse,
-   * i.e. created by merging or allocalted in calc_next_hop()).
-   *
-   * Generally, a node first inherits shared nexthops from its
-   * parent and later possibly gets reusable copy during merging.
+   * Interned sets are shared and immutable, so the merged set is built
+   * in the temporary linpool and then interned.
    */
 
   while ((s1 || s2) && count--)
   {
     int cmp = cmp_nhs(s1, s2);
+    struct mpnh *src;
+
     if (cmp < 0)
     {
-      *n = r1 ? s1 : copy_nexthop(po, s1);
+      src = s1;
       s1 = s1->next;
     }
     else if (cmp > 0)
     {
-      *n = r2 ? s2 : copy_nexthop(po, s2);
+      src = s2;
       s2 = s2->next;
     }
     else
     {
-      *n = r1 ? s1 : (r2 ? s2 : copy_nexthop(po, s1));
+      src = s1;
       s1 = s1->next;
       s2 = s2->next;
     }
+
+    *n = lp_alloc(po->nhpool, sizeof(struct mpnh));
+    memcpy(*n, src, sizeof(struct mpnh));
     n = &((*n)->next);
   }
   *n = NULL;
 
-  en->nhs_reuse=1;
+  en->nhs = nh_intern(po, first);
 }
 
 /* Add LSA into list of candidates in Dijkstra's algorithm */
@@ -1888,7 +2164,7 @@ add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
     /* Merge old and new */
     if (ipa_nonzero(nhs->gw) && ipa_nonzero(onhs->gw))
     {
-      merge_nexthops(po, en, par, nhs);
+      merge_nexthops(po, en, nhs);
       return;
     }
 
@@ -1905,7 +2181,6 @@ add_cand(list * l, struct top_hash_entry *en, struct top_hash_entry *par,
   en->nhs = nhs;
   en->dist = dist;
   en->color = CANDIDATE;
-  en->nhs_reuse = (par->nhs != nhs);
 
   prev = NULL;
 
@@ -1942,12 +2217,12 @@ static inline int
 ort_changed(ort *nf, rta *nr)
 {
   rta *or = nf->old_rta;
+
+  /* Nexthop sets are interned, dest, iface and gw are derived from them */
   return !or ||
     (nf->n.metric1 != nf->old_metric1) || (nf->n.metric2 != nf->old_metric2) ||
     (nf->n.tag != nf->old_tag) || (nf->n.rid != nf->old_rid) ||
-    (nr->source != or->source) || (nr->dest != or->dest) ||
-    (nr->iface != or->iface) || !ipa_equal(nr->gw, or->gw) ||
-    !mpnh_same(nr->nexthops, or->nexthops);
+    (nr->source != or->source) || (nf->n.nhs != nf->old_nhs);
 }
 
 static void
@@ -1956,6 +2231,8 @@ rt_sync(struct proto_ospf *po)
   struct proto *p = &po->proto;
   struct fib_iterator fit;
   struct fib *fib = &po->rtf;
+  struct mpnh *checked = NULL;
+  node *rn, *rnxt;
   ort *nf;
   struct ospf_area *oa;
 
@@ -1965,14 +2242,26 @@ rt_sync(struct proto_ospf *po)
   OSPF_TRACE(D_EVENTS, "Starting routing table synchronisation");
 
   DBG("Now syncing my rt table with nest's\n");
-  FIB_ITERATE_INIT(&fit, fib);
-again1:
-  FIB_ITERATE_START(fib, &fit, nftmp)
+
+  /*
+   * Only entries whose result changed since the last calculation (and
+   * entries that lost it) are in rt_dirty, others are in sync already.
+   */
+  WALK_LIST_DELSAFE(rn, rnxt, po->rt_dirty)
   {
-    nf = (ort *) nftmp;
+    nf = SKIP_BACK(ort, dn, rn);
+    rem_node(rn);
+    rn->next = NULL;
+
+    /*
+     * Entries valid in this calculation stay listed until the next one,
+     * so check_sum_net_lsa() sees them even if they are reset below.
+     */
+    int valid = nf->n.type;
 
-    /* Sanity check of next-hop addresses, failure should not happen */
-    if (nf->n.type)
+    /* Sanity check of next-hop addresses, failure should not happen.
+       Nexthop lists are often shared, skip the one just checked. */
+    if (nf->n.type && (nf->n.nhs != checked))
     {
       struct mpnh *nh;
       for (nh = nf->n.nhs; nh; nh = nh->next)
@@ -1982,6 +2271,8 @@ again1:
 	  if (!ng || (ng->scope == SCOPE_HOST))
 	    { reset_ri(nf); break; }
 	}
+
+      checked = nf->n.nhs;
     }
 
     /* Remove configured stubnets */
@@ -2022,6 +2313,7 @@ again1:
 
 	rta_free(nf->old_rta);
 	nf->old_rta = rta_clone(a);
+	nf->old_nhs = nf->n.nhs;
 	e->u.ospf.metric1 = nf->old_metric1 = nf->n.metric1;
 	e->u.ospf.metric2 = nf->old_metric2 = nf->n.metric2;
 	e->u.ospf.tag = nf->old_tag = nf->n.tag;
@@ -2040,20 +2332,26 @@ again1:
       /* Remove the route */
       rta_free(nf->old_rta);
       nf->old_rta = NULL;
+      nf->old_nhs = NULL;
 
       net *ne = net_get(p->table, nf->fn.prefix, nf->fn.pxlen);
       rte_update(p->table, ne, p, p, NULL);
     }
 
-    /* Remove unused rt entry. Entries with fn.x0 == 1 are persistent. */
-    if (!nf->n.type && !nf->fn.x0 && !nf->fn.x1)
+    /* Remove unused rt entry. Entries with fn.x0 == 1 are persistent,
+       entries with fn.x1 are kept for exported external routes and
+       entries with ext_req until the pending export is processed. */
+    nf->en_sn = nf->n.en ? nf->n.en->lsa.sn : 0;
+
+    if (!valid && !nf->old_rta && !nf->fn.x0)
     {
-      FIB_ITERATE_PUT(&fit, nftmp);
-      fib_delete(fib, nftmp);
-      goto again1;
+      rem_node(&nf->rn);
+      nf->rn.next = NULL;
+
+      if (!nf->fn.x1 && !nf->ext_req)
+	fib_delete(fib, nf);
     }
   }
-  FIB_ITERATE_END(nftmp);
 
 
   WALK_LIST(oa, po->area_list)
@@ -65,14 +65,69 @@ typedef struct ort
    * is cached (we keep reference), mainly for multipath nexthops.
    * old_rta == NULL means route wasn not in the last update, in that
    * case other old_* values are not valid.
+   *
+   * rn links the entry to po->rt_list, the list of entries that are
+   * processed by the routing table calculation, rt_gen is the calculation
+   * in which it was linked there. dn links the entry to po->rt_dirty, the
+   * list of entries whose result changed and has to be synchronised. o is
+   * the result of the previous calculation and en_sn the sequence number
+   * of its LSA. See ri_mark() and ri_changed().
+   *
+   * ext_req is the pending batched export of the entry, see
+   * ospf_ext_enqueue().
+   *
+   * sum_* values are the inputs of the last summary LSA decision for the
+   * entry and anet_* cache the area network of anet_oa covering it, see
+   * check_sum_net_lsa(). Both are valid only while their gen equals
+   * po->sum_gen.
    */
   struct fib_node fn;
+  node rn, dn;
+  u32 rt_gen, en_sn;
   orta n;
+  orta o;
   u32 old_metric1, old_metric2, old_tag, old_rid;
   rta *old_rta;
+  struct mpnh *old_nhs;		/* Interned nexthops of old_rta */
+  struct ospf_ext_req *ext_req;	/* Pending export, or NULL */
+  u32 sum_gen, anet_gen;
+  int sum_type;
+  u32 sum_metric, sum_options;
+  struct ospf_area *sum_oa, *sum_voa, *anet_oa;
+  struct area_net *anet;
 }
 ort;
 
+/*
+ * Entries of po->rtf that are valid (n.type != 0), exported to the nest
+ * (old_rta != NULL) or persistent area networks (fn.x0) are kept in
+ * po->rt_list. Other entries are ignored by ospf_rt_spf(), they are not
+ * changed by the calculation and they have nothing to synchronise.
+ *
+ * ospf_rt_reset() moves all listed entries to po->rt_old, ri_mark() moves
+ * an entry back when the calculation touches it. Entries left in rt_old
+ * lost their result (see ri_collect_stale()).
+ */
+static inline void
+ri_mark(struct proto_ospf *po, ort *nf)
+{
+  if (!nf->rn.next || (nf->rt_gen != po->nh_gen))
+  {
+    if (nf->rn.next)
+      rem_node(&nf->rn);
+    add_tail(&po->rt_list, &nf->rn);
+    nf->rt_gen = po->nh_gen;
+  }
+}
+
+/* Schedule the entry for rt_sync() and the ABR summary decisions */
+static inline void
+ri_dirty(struct proto_ospf *po, ort *nf)
+{
+  if (!nf->dn.next)
+    add_tail(&po->rt_dirty, &nf->dn);
+}
+
 static inline int rt_is_nssa(ort *nf)
 { return nf->n.options & ORTA_NSSA; }
 
@@ -87,6 +142,8 @@ static inline int rt_is_nssa(ort *nf)
  * - dist < LSINFINITY (or 2*LSINFINITY for ext-LSAs)
  * - nhs is non-NULL unless the node is oa->rt (calculating router itself)
  * - beware, nhs is not valid after SPF calculation
+ * - nhs fields in both LSA db and fib tables point to interned sets,
+ *   equal sets are the same pointer (see rt.c:nh_intern())
  *
  * Invariants for structs orta nodes of fib tables po->rtf, oa->rtr:
  * - nodes may be invalid (fn.type == 0), in that case other invariants don't hold
@@ -107,6 +164,7 @@ static inline int rt_is_nssa(ort *nf)
 
 void ospf_rt_spf(struct proto_ospf *po);
 void ospf_rt_initort(struct fib_node *fn);
+void ospf_nh_init(struct proto_ospf *po);
 
 
 #endif /* _BIRD_OSPF_RT_H_ */
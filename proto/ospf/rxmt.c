@@ -0,0 +1,272 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "ospf.h"
+
+/*
+ * Link state retransmission lists (RFC 2328 10.) are kept per interface
+ * instead of per neighbor. When an LSA is flooded through an interface,
+ * one entry is created (or updated) and each neighbor that should
+ * acknowledge it gets its bit set in the entry. The entry is freed when
+ * the last bit is cleared. Neighbors own a slot number in the bitmaps,
+ * bitmaps are enlarged when slots run out.
+ */
+
+#define RXMT_HASH_DEF_ORDER 6
+#define RXMT_HASH_SIZE(ifa) (1 << (ifa)->rxmt_hash_order)
+#define RXMT_SIZE(words) (sizeof(struct ospf_rxmt) + (words) * sizeof(u32))
+
+static inline unsigned int
+rxmt_hash(struct ospf_iface *ifa, u32 domain, struct ospf_lsa_header *h)
+{
+  u32 x = (h->id * 0x9e3779b9) ^ h->rt ^ (h->type << 16) ^ domain;
+  return (x ^ (x >> 16)) & (RXMT_HASH_SIZE(ifa) - 1);
+}
+
+static inline int
+rxmt_match(struct ospf_rxmt *e, u32 domain, struct ospf_lsa_header *h)
+{
+  return (e->lsa.id == h->id) && (e->lsa.rt == h->rt) &&
+    (e->lsa.type == h->type) && (e->domain == domain);
+}
+
+static void
+rxmt_rebuild_hash(struct ospf_iface *ifa)
+{
+  struct ospf_rxmt *e;
+  unsigned int h;
+
+  bzero(ifa->rxmt_hash, RXMT_HASH_SIZE(ifa) * sizeof(struct ospf_rxmt *));
+  WALK_LIST(e, ifa->rxmt_list)
+  {
+    h = rxmt_hash(ifa, e->domain, &e->lsa);
+    e->next = ifa->rxmt_hash[h];
+    ifa->rxmt_hash[h] = e;
+  }
+}
+
+static void
+rxmt_rehash(struct ospf_iface *ifa)
+{
+  mb_free(ifa->rxmt_hash);
+  ifa->rxmt_hash_order++;
+  ifa->rxmt_hash = mb_alloc(ifa->pool, RXMT_HASH_SIZE(ifa) * sizeof(struct ospf_rxmt *));
+  rxmt_rebuild_hash(ifa);
+}
+
+/* Enlarge bitmaps of all entries to words */
+static void
+rxmt_grow(struct ospf_iface *ifa, unsigned int words)
+{
+  struct ospf_rxmt *e, *en, *ex;
+
+  WALK_LIST_DELSAFE(e, ex, ifa->rxmt_list)
+  {
+    en = mb_allocz(ifa->pool, RXMT_SIZE(words));
+    memcpy(en, e, RXMT_SIZE(ifa->rxmt_words));
+    insert_node(&en->n, &e->n);
+    rem_node(&e->n);
+    mb_free(e);
+  }
+
+  ifa->rxmt_words = words;
+  rxmt_rebuild_hash(ifa);
+}
+
+static void
+rxmt_free(struct ospf_iface *ifa, struct ospf_rxmt *e)
+{
+  struct ospf_rxmt **ee = &ifa->rxmt_hash[rxmt_hash(ifa, e->domain, &e->lsa)];
+
+  while (*ee != e)
+    ee = &(*ee)->next;
+
+  *ee = e->next;
+  rem_node(&e->n);
+  mb_free(e);
+  ifa->rxmt_count--;
+}
+
+/* Clear bits of all neighbors */
+static void
+rxmt_reset(struct ospf_iface *ifa, struct ospf_rxmt *e)
+{
+  struct ospf_neighbor *n;
+
+  WALK_LIST(n, ifa->neigh_list)
+    if (ospf_rxmt_test(e, n))
+      n->rxmt_count--;
+
+  bzero(e->map, ifa->rxmt_words * sizeof(u32));
+  e->refs = 0;
+}
+
+void
+ospf_rxmt_init(struct ospf_iface *ifa)
+{
+  init_list(&ifa->rxmt_list);
+  ifa->rxmt_hash_order = RXMT_HASH_DEF_ORDER;
+  ifa->rxmt_hash = mb_allocz(ifa->pool, RXMT_HASH_SIZE(ifa) * sizeof(struct ospf_rxmt *));
+  ifa->rxmt_words = 1;
+  ifa->rxmt_count = 0;
+}
+
+/**
+ * ospf_rxmt_add_neigh - assign a bitmap slot to a new neighbor
+ * @n: OSPF neighbor, already linked in the neighbor list of its interface
+ *
+ * The lowest slot not used by other neighbors on the interface is taken.
+ */
+void
+ospf_rxmt_add_neigh(struct ospf_neighbor *n)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct ospf_neighbor *x;
+  unsigned int slot, words;
+  int used;
+
+  for (slot = 0; ; slot++)
+  {
+    used = 0;
+    WALK_LIST(x, ifa->neigh_list)
+      if ((x != n) && (x->rxmt_slot == slot))
+      {
+	used = 1;
+	break;
+      }
+
+    if (!used)
+      break;
+  }
+
+  n->rxmt_slot = slot;
+  n->rxmt_count = 0;
+
+  for (words = ifa->rxmt_words; slot >= words * 32; words *= 2)
+    ;
+
+  if (words != ifa->rxmt_words)
+    rxmt_grow(ifa, words);
+}
+
+/**
+ * ospf_rxmt_flush_neigh - empty retransmission list of a neighbor
+ * @n: OSPF neighbor
+ */
+void
+ospf_rxmt_flush_neigh(struct ospf_neighbor *n)
+{
+  struct ospf_rxmt *e, *ex;
+
+  if (!n->rxmt_count)
+    return;
+
+  WALK_LIST_DELSAFE(e, ex, n->ifa->rxmt_list)
+    if (ospf_rxmt_test(e, n))
+      ospf_rxmt_clear(n, e);
+}
+
+struct ospf_rxmt *
+ospf_rxmt_find(struct ospf_iface *ifa, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_rxmt *e;
+
+  for (e = ifa->rxmt_hash[rxmt_hash(ifa, domain, h)]; e; e = e->next)
+    if (rxmt_match(e, domain, h))
+      return e;
+
+  return NULL;
+}
+
+/**
+ * ospf_rxmt_add - add LSA to retransmission list of a neighbor
+ * @n: OSPF neighbor
+ * @domain: LSA domain
+ * @h: LSA header in host order
+ *
+ * If the interface entry holds a different instance of the LSA, the old
+ * instance is removed from retransmission lists of all neighbors first.
+ */
+void
+ospf_rxmt_add(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_iface *ifa = n->ifa;
+  struct ospf_rxmt *e = ospf_rxmt_find(ifa, domain, h);
+
+  if (!e)
+  {
+    unsigned int hi = rxmt_hash(ifa, domain, h);
+
+    /* The header must be set before rxmt_rehash() */
+    e = mb_allocz(ifa->pool, RXMT_SIZE(ifa->rxmt_words));
+    e->domain = domain;
+    memcpy(&e->lsa, h, sizeof(struct ospf_lsa_header));
+    e->next = ifa->rxmt_hash[hi];
+    ifa->rxmt_hash[hi] = e;
+    add_tail(&ifa->rxmt_list, &e->n);
+
+    if (++ifa->rxmt_count > 2 * RXMT_HASH_SIZE(ifa))
+      rxmt_rehash(ifa);
+  }
+  else if (lsa_comp(h, &e->lsa) != CMP_SAME)
+  {
+    rxmt_reset(ifa, e);
+    rem_node(&e->n);
+    add_tail(&ifa->rxmt_list, &e->n);
+  }
+
+  memcpy(&e->lsa, h, sizeof(struct ospf_lsa_header));
+
+  if (!ospf_rxmt_test(e, n))
+  {
+    e->map[n->rxmt_slot / 32] |= 1U << (n->rxmt_slot % 32);
+    e->refs++;
+    n->rxmt_count++;
+  }
+}
+
+/**
+ * ospf_rxmt_clear - remove entry from retransmission list of a neighbor
+ * @n: OSPF neighbor
+ * @e: entry, must have the bit of @n set
+ *
+ * The entry may be freed.
+ */
+void
+ospf_rxmt_clear(struct ospf_neighbor *n, struct ospf_rxmt *e)
+{
+  e->map[n->rxmt_slot / 32] &= ~(1U << (n->rxmt_slot % 32));
+  n->rxmt_count--;
+
+  if (!--e->refs)
+    rxmt_free(n->ifa, e);
+}
+
+/* Returns 1 if the LSA was in retransmission list of the neighbor */
+int
+ospf_rxmt_remove(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_rxmt *e = ospf_rxmt_find(n->ifa, domain, h);
+
+  if (!e || !ospf_rxmt_test(e, n))
+    return 0;
+
+  ospf_rxmt_clear(n, e);
+  return 1;
+}
+
+/* Remove the LSA from retransmission lists of all neighbors on the iface */
+void
+ospf_rxmt_remove_all(struct ospf_iface *ifa, u32 domain, struct ospf_lsa_header *h)
+{
+  struct ospf_rxmt *e = ospf_rxmt_find(ifa, domain, h);
+
+  if (!e)
+    return;
+
+  rxmt_reset(ifa, e);
+  rxmt_free(ifa, e);
+}
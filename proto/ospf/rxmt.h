@@ -0,0 +1,38 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_OSPF_RXMT_H_
+#define _BIRD_OSPF_RXMT_H_
+
+/*
+ * Link state retransmission entry. Entries are shared by all neighbors
+ * of an interface, an entry exists while at least one neighbor has its
+ * bit (indexed by ospf_neighbor->rxmt_slot) set in the map.
+ */
+struct ospf_rxmt
+{
+  node n;			/* Node in ifa->rxmt_list */
+  struct ospf_rxmt *next;	/* Next in hash chain */
+  struct ospf_lsa_header lsa;	/* Instance to be acknowledged */
+  u32 domain;
+  u32 refs;			/* Number of bits set in map */
+  u32 map[];
+};
+
+static inline int
+ospf_rxmt_test(struct ospf_rxmt *e, struct ospf_neighbor *n)
+{ return e->map[n->rxmt_slot / 32] & (1U << (n->rxmt_slot % 32)); }
+
+void ospf_rxmt_init(struct ospf_iface *ifa);
+void ospf_rxmt_add_neigh(struct ospf_neighbor *n);
+void ospf_rxmt_flush_neigh(struct ospf_neighbor *n);
+struct ospf_rxmt *ospf_rxmt_find(struct ospf_iface *ifa, u32 domain, struct ospf_lsa_header *h);
+void ospf_rxmt_add(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h);
+void ospf_rxmt_clear(struct ospf_neighbor *n, struct ospf_rxmt *e);
+int ospf_rxmt_remove(struct ospf_neighbor *n, u32 domain, struct ospf_lsa_header *h);
+void ospf_rxmt_remove_all(struct ospf_iface *ifa, u32 domain, struct ospf_lsa_header *h);
+
+#endif /* _BIRD_OSPF_RXMT_H_ */
@@ -0,0 +1,110 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#include "ospf.h"
+
+/*
+ * Timing of the main OSPF phases. Each timed call reads the monotonic
+ * clock before and after (see OSPF_TIMED()) and the duration is added to
+ * the phase counters and to a log2 histogram, so both the average cost
+ * and the latency outliers can be seen by 'show ospf statistics'.
+ */
+
+char *ospf_phase_names[OSPF_PH_MAX] = {
+  "SPF area",
+  "Prefixes",
+  "Summary",
+  "External",
+  "RT sync",
+  "Aging",
+  "LSUPD receive",
+  "Flood",
+#ifdef ELSA_ENABLED
+  "ELSA dispatch",
+  "ELSA changed",
+  "ELSA deleting",
+  "ELSA duplicate",
+#endif
+};
+
+void
+ospf_stats_init(struct proto_ospf *po)
+{
+  po->stats = mb_allocz(po->proto.pool, OSPF_PH_MAX * sizeof(struct ospf_phase_stats));
+  po->stats_since = now;
+}
+
+void
+ospf_stats_add(struct proto_ospf *po, int phase, u64 start)
+{
+  struct ospf_phase_stats *s = &po->stats[phase];
+  u64 d = tm_now_us() - start;
+  u32 t = (d < 0xffffffff) ? d : 0xffffffff;
+  int b = t ? u32_log2(t) + 1 : 0;
+
+  s->count++;
+  s->total += d;
+  if (t > s->max)
+    s->max = t;
+  s->hist[MIN(b, OSPF_STATS_BUCKETS - 1)]++;
+}
+
+static void
+ospf_sh_stats_hist(struct ospf_phase_stats *s)
+{
+  char buf[OSPF_STATS_BUCKETS * 24], *pos = buf;
+  int i;
+
+  for (i = 0; i < OSPF_STATS_BUCKETS; i++)
+  {
+    if (!s->hist[i])
+      continue;
+
+    if (i < OSPF_STATS_BUCKETS - 1)
+      pos += bsprintf(pos, " <%u:%u", 1U << i, s->hist[i]);
+    else
+      pos += bsprintf(pos, " >=%u:%u", 1U << (i - 1), s->hist[i]);
+  }
+
+  if (pos != buf)
+    cli_msg(-1020, "\t\tHistogram (us):%s", buf);
+}
+
+void
+ospf_sh_stats(struct proto *p, int reset)
+{
+  struct proto_ospf *po = (struct proto_ospf *) p;
+  struct ospf_phase_stats *s;
+  int i;
+
+  if (p->proto_state != PS_UP)
+  {
+    cli_msg(-1020, "%s: is not up", p->name);
+    cli_msg(0, "");
+    return;
+  }
+
+  cli_msg(-1020, "%s: collected for %d s", p->name, (int) (now - po->stats_since));
+  cli_msg(-1020, "\t%-15s %10s %12s %10s %10s", "Phase", "Runs", "Total (us)", "Avg (us)", "Max (us)");
+
+  for (i = 0; i < OSPF_PH_MAX; i++)
+  {
+    s = &po->stats[i];
+    cli_msg(-1020, "\t%-15s %10u %12lu %10lu %10u", ospf_phase_names[i], s->count,
+	    (unsigned long) s->total, (unsigned long) (s->count ? s->total / s->count : 0),
+	    s->max);
+    ospf_sh_stats_hist(s);
+  }
+
+  if (reset)
+  {
+    bzero(po->stats, OSPF_PH_MAX * sizeof(struct ospf_phase_stats));
+    po->stats_since = now;
+    cli_msg(-1020, "Statistics reset");
+  }
+
+  cli_msg(0, "");
+}
@@ -0,0 +1,52 @@
+/*
+ *	BIRD -- OSPF
+ *
+ *	Can be freely distributed and used under the terms of the GNU GPL.
+ */
+
+#ifndef _BIRD_OSPF_STATS_H_
+#define _BIRD_OSPF_STATS_H_
+
+/* Timed phases, phases may nest (e.g. OSPF_PH_PREFIXES in OSPF_PH_SPFA) */
+#define OSPF_PH_SPFA		0	/* ospf_rt_spfa(), one run per area */
+#define OSPF_PH_PREFIXES	1	/* process_prefixes() */
+#define OSPF_PH_SUM		2	/* ospf_rt_sum() */
+#define OSPF_PH_EXT		3	/* ospf_ext_spf() */
+#define OSPF_PH_RT_SYNC		4	/* rt_sync() */
+#define OSPF_PH_AGE		5	/* ospf_age() */
+#define OSPF_PH_LSUPD_RX	6	/* ospf_lsupd_receive() */
+#define OSPF_PH_FLOOD		7	/* ospf_lsupd_flood() */
+#ifdef ELSA_ENABLED
+#define OSPF_PH_ELSA_DISPATCH	8	/* elsa_dispatch() */
+#define OSPF_PH_ELSA_CHANGED	9	/* elsa_notify_changed_lsa() */
+#define OSPF_PH_ELSA_DELETING	10	/* elsa_notify_deleting_lsa() */
+#define OSPF_PH_ELSA_DUPLICATE	11	/* elsa_notify_duplicate_lsa() */
+#define OSPF_PH_MAX		12
+#else
+#define OSPF_PH_MAX		8
+#endif
+
+/*
+ * Bucket 0 counts runs shorter than 1 us, bucket i runs of [2^(i-1), 2^i) us,
+ * the last bucket also everything longer.
+ */
+#define OSPF_STATS_BUCKETS	24
+
+struct ospf_phase_stats
+{
+  u32 count;			/* Number of runs */
+  u32 max;			/* Longest run (us) */
+  u64 total;			/* Sum of all runs (us) */
+  u32 hist[OSPF_STATS_BUCKETS];	/* Runs by log2 of duration */
+};
+
+#define OSPF_TIMED(po, phase, call) \
+do { u64 _start = tm_now_us(); call; ospf_stats_add(po, phase, _start); } while(0)
+
+extern char *ospf_phase_names[OSPF_PH_MAX];
+
+void ospf_stats_init(struct proto_ospf *po);
+void ospf_stats_add(struct proto_ospf *po, int phase, u64 start);
+void ospf_sh_stats(struct proto *p, int reset);
+
+#endif /* _BIRD_OSPF_STATS_H_ */
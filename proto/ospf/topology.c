@@ -8,17 +8,19 @@
  */
 
 #include "nest/bird.h"
+#include "nest/cmds.h"
 #include "lib/string.h"
+#include "lib/bitops.h"
 
 #include "ospf.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define HASH_DEF_ORDER 6
-#define HASH_HI_MARK *4
-#define HASH_HI_STEP 2
-#define HASH_HI_MAX 16
-#define HASH_LO_MARK /5
-#define HASH_LO_STEP 2
-#define HASH_LO_MIN 8
+#define PX_HASH_DEF_ORDER 6
+#define PX_HASH_SIZE(f) (1U << (f)->px_order)
 
 void originate_prefix_rt_lsa(struct ospf_area *oa);
 void originate_prefix_net_lsa(struct ospf_iface *ifa);
@@ -119,7 +121,7 @@ lsab_allocz(struct proto_ospf *po, unsigned size)
 static inline void *
 lsab_flush(struct proto_ospf *po)
 {
-  void *r = mb_alloc(po->proto.pool, po->lsab_used);
+  void *r = ospf_lsa_alloc(po->gr, po->lsab_used);
   memcpy(r, po->lsab, po->lsab_used);
   po->lsab_used = 0;
   return r;
@@ -137,7 +139,7 @@ lsab_end(struct proto_ospf *po)
   return ((byte *) po->lsab) + po->lsab_used;
 }
 
-static s32
+s32
 get_seqnum(struct top_hash_entry *en)
 {
   if (!en)
@@ -188,7 +190,7 @@ bcast_net_active(struct ospf_iface *ifa)
 
   WALK_LIST(neigh, ifa->neigh_list)
     {
-      if (neigh->state == NEIGHBOR_FULL)
+      if (NEIGH_ADJ(neigh))
 	{
 	  if (neigh->rid == ifa->drid)
 	    return 1;
@@ -239,7 +241,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
 	(!EMPTY_LIST(ifa->neigh_list)))
     {
       neigh = (struct ospf_neighbor *) HEAD(ifa->neigh_list);
-      if ((neigh->state == NEIGHBOR_FULL) && (ifa->cost <= 0xffff))
+      if (NEIGH_ADJ(neigh) && (ifa->cost <= 0xffff))
 	bitv = 1;
     }
 
@@ -254,7 +256,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
       case OSPF_IT_PTP:
       case OSPF_IT_PTMP:
 	WALK_LIST(neigh, ifa->neigh_list)
-	  if (neigh->state == NEIGHBOR_FULL)
+	  if (NEIGH_ADJ(neigh))
 	  {
 	    ln = lsab_alloc(po, sizeof(struct ospf_lsa_rt_link));
 	    ln->type = LSART_PTP;
@@ -292,7 +294,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
 
       case OSPF_IT_VLINK:
 	neigh = (struct ospf_neighbor *) HEAD(ifa->neigh_list);
-	if ((!EMPTY_LIST(ifa->neigh_list)) && (neigh->state == NEIGHBOR_FULL) && (ifa->cost <= 0xffff))
+	if ((!EMPTY_LIST(ifa->neigh_list)) && NEIGH_ADJ(neigh) && (ifa->cost <= 0xffff))
 	{
 	  ln = lsab_alloc(po, sizeof(struct ospf_lsa_rt_link));
 	  ln->type = LSART_VLNK;
@@ -414,7 +416,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
 	(!EMPTY_LIST(ifa->neigh_list)))
     {
       neigh = (struct ospf_neighbor *) HEAD(ifa->neigh_list);
-      if ((neigh->state == NEIGHBOR_FULL) && (ifa->cost <= 0xffff))
+      if (NEIGH_ADJ(neigh) && (ifa->cost <= 0xffff))
 	bitv = 1;
     }
 
@@ -429,7 +431,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
       case OSPF_IT_PTP:
       case OSPF_IT_PTMP:
 	WALK_LIST(neigh, ifa->neigh_list)
-	  if (neigh->state == NEIGHBOR_FULL)
+	  if (NEIGH_ADJ(neigh))
 	    add_lsa_rt_link(po, ifa, LSART_PTP, neigh->iface_id, neigh->rid), i++;
 	break;
 
@@ -441,7 +443,7 @@ originate_rt_lsa_body(struct ospf_area *oa, u16 *length)
 
       case OSPF_IT_VLINK:
 	neigh = (struct ospf_neighbor *) HEAD(ifa->neigh_list);
-	if ((!EMPTY_LIST(ifa->neigh_list)) && (neigh->state == NEIGHBOR_FULL) && (ifa->cost <= 0xffff))
+	if ((!EMPTY_LIST(ifa->neigh_list)) && NEIGH_ADJ(neigh) && (ifa->cost <= 0xffff))
 	  add_lsa_rt_link(po, ifa, LSART_VLNK, neigh->iface_id, neigh->rid), i++;
         break;
 
@@ -509,6 +511,10 @@ update_rt_lsa(struct ospf_area *oa)
 {
   struct proto_ospf *po = oa->po;
 
+  /* Keep pre-restart router-LSA during graceful restart */
+  if (po->gr_restart)
+    return;
+
   if ((oa->rt) && ((oa->rt->inst_t + MINLSINTERVAL)) > now)
     return;
   /*
@@ -535,8 +541,8 @@ originate_net_lsa_body(struct ospf_iface *ifa, u16 *length,
   struct ospf_lsa_net *net;
   int nodes = ifa->fadj + 1;
 
-  net = mb_alloc(po->proto.pool, sizeof(struct ospf_lsa_net)
-		 + nodes * sizeof(u32));
+  net = ospf_lsa_alloc(po->gr, sizeof(struct ospf_lsa_net)
+		       + nodes * sizeof(u32));
 
 #ifdef OSPFv2
   net->netmask = ipa_mkmask(ifa->addr->pxlen);
@@ -552,7 +558,7 @@ originate_net_lsa_body(struct ospf_iface *ifa, u16 *length,
 
   WALK_LIST(n, ifa->neigh_list)
   {
-    if (n->state == NEIGHBOR_FULL)
+    if (NEIGH_ADJ(n))
     {
 #ifdef OSPFv3
       en = ospf_hash_find(po->gr, ifa->iface_id, n->iface_id, n->rid, LSA_T_LINK);
@@ -641,6 +647,9 @@ void
 update_net_lsa(struct ospf_iface *ifa)
 {
   struct proto_ospf *po = ifa->oa->po;
+
+  if (po->gr_restart)
+    return;
  
   if (ifa->net_lsa && ((ifa->net_lsa->inst_t + MINLSINTERVAL) > now))
     return;
@@ -673,7 +682,7 @@ update_net_lsa(struct ospf_iface *ifa)
 static inline void *
 originate_sum_lsa_body(struct proto_ospf *po, u16 *length, u32 mlen, u32 metric)
 {
-  struct ospf_lsa_sum *sum = mb_alloc(po->proto.pool, sizeof(struct ospf_lsa_sum));
+  struct ospf_lsa_sum *sum = ospf_lsa_alloc(po->gr, sizeof(struct ospf_lsa_sum));
   *length = sizeof(struct ospf_lsa_header) + sizeof(struct ospf_lsa_sum);
 
   sum->netmask = ipa_mkmask(mlen);
@@ -716,7 +725,7 @@ static inline void *
 originate_sum_net_lsa_body(struct proto_ospf *po, u16 *length, struct fib_node *fn, u32 metric)
 {
   int size = sizeof(struct ospf_lsa_sum_net) + IPV6_PREFIX_SPACE(fn->pxlen);
-  struct ospf_lsa_sum_net *sum = mb_alloc(po->proto.pool, size);
+  struct ospf_lsa_sum_net *sum = ospf_lsa_alloc(po->gr, size);
   *length = sizeof(struct ospf_lsa_header) + size;
 
   sum->metric = metric;
@@ -749,7 +758,7 @@ check_sum_net_lsa_same(struct top_hash_entry *en, u32 metric)
 static inline void *
 originate_sum_rt_lsa_body(struct proto_ospf *po, u16 *length, u32 drid, u32 metric, u32 options)
 {
-  struct ospf_lsa_sum_rt *sum = mb_alloc(po->proto.pool, sizeof(struct ospf_lsa_sum_rt));
+  struct ospf_lsa_sum_rt *sum = ospf_lsa_alloc(po->gr, sizeof(struct ospf_lsa_sum_rt));
   *length = sizeof(struct ospf_lsa_header) + sizeof(struct ospf_lsa_sum_rt);
 
   sum->options = options;
@@ -797,11 +806,17 @@ originate_sum_net_lsa(struct ospf_area *oa, struct fib_node *fn, int metric)
     {
       log(L_ERR "%s: LSAID collision for %I/%d",
 	  p->name, fn->prefix, fn->pxlen);
+
+      /* Try again in the next calculation, see ort_sum_changed() */
+      po->sum_gen++;
       return;
     }
 
     if (check_sum_net_lsa_same(en, metric))
+    {
+      en->stale = 0;
       return;
+    }
   }
   lsa.sn = get_seqnum(en);
 
@@ -838,7 +853,10 @@ originate_sum_rt_lsa(struct ospf_area *oa, struct fib_node *fn, int metric, u32
   if ((en = ospf_hash_find_header(po->gr, dom, &lsa)) != NULL)
   {
     if (check_sum_rt_lsa_same(en, lsa.id, metric, options))
+    {
+      en->stale = 0;
       return;
+    }
   }
   lsa.sn = get_seqnum(en);
 
@@ -884,6 +902,8 @@ flush_sum_lsa(struct ospf_area *oa, struct fib_node *fn, int type)
       struct ospf_lsa_sum *sum = en->lsa_body;
       en->lsa.age = LSA_MAXAGE;
       en->lsa.sn = LSA_MAXSEQNO;
+      po->lsdb_gen++;
+      lsa_age_schedule(po, en);
       lsasum_calculate(&en->lsa, sum);
       ospf_lsupd_flood(po, NULL, NULL, &en->lsa, oa->areaid, 1);
       if (can_flush_lsa(po)) flush_lsa(en, po);
@@ -896,7 +916,7 @@ static inline void *
 originate_ext_lsa_body(struct proto_ospf *po, u16 *length, struct fib_node *fn,
 		       u32 metric, ip_addr fwaddr, u32 tag, int pbit UNUSED)
 {
-  struct ospf_lsa_ext *ext = mb_alloc(po->proto.pool, sizeof(struct ospf_lsa_ext));
+  struct ospf_lsa_ext *ext = ospf_lsa_alloc(po->gr, sizeof(struct ospf_lsa_ext));
   *length = sizeof(struct ospf_lsa_header) + sizeof(struct ospf_lsa_ext);
 
   ext->metric = metric; 
@@ -945,7 +965,7 @@ originate_ext_lsa_body(struct proto_ospf *po, u16 *length, struct fib_node *fn,
     + (ipa_nonzero(fwaddr) ? 16 : 0)
     + (tag ? 4 : 0);
 
-  struct ospf_lsa_ext *ext = mb_alloc(po->proto.pool, size);
+  struct ospf_lsa_ext *ext = ospf_lsa_alloc(po->gr, size);
   *length = sizeof(struct ospf_lsa_header) + size;
 
   ext->metric = metric;
@@ -1116,7 +1136,10 @@ originate_ext_lsa(struct ospf_area *oa, struct fib_node *fn, int src,
     }
 
     if (rv > 0)
+    {
+      en->stale = 0;
       return;
+    }
   }
   lsa.sn = get_seqnum(en);
 
@@ -1167,6 +1190,101 @@ flush_ext_lsa(struct ospf_area *oa, struct fib_node *fn, int nssa)
     }
 }
 
+/*
+ * Batched export: when po->export_delay is set, ospf_rt_notify() does not
+ * originate external LSAs one by one. The requested state of the route is
+ * kept in a struct ospf_ext_req attached to its rt entry, further updates of
+ * the same prefix within the window just overwrite it. When the window ends,
+ * all pending requests are processed at once, so a route that flapped
+ * during the window causes at most one new LSA instance (or none, when it
+ * ended in its original state), and the resulting LSAs are packed into
+ * common link state updates by the flood queues (see ospf_lsupd_enqueue()).
+ */
+
+/**
+ * ospf_ext_enqueue - record an export for batched origination
+ * @po: OSPF protocol
+ * @nf: rt entry of the exported prefix
+ * @metric: the metric of a route
+ * @gw: the forwarding address
+ * @tag: the route tag
+ * @withdraw: the route was withdrawn, other values are ignored
+ */
+void
+ospf_ext_enqueue(struct proto_ospf *po, ort *nf, u32 metric, ip_addr gw,
+		 u32 tag, int withdraw)
+{
+  struct ospf_ext_req *r = nf->ext_req;
+
+  if (!r)
+  {
+    /* Nothing to flush */
+    if (withdraw && (nf->fn.x1 != EXT_EXPORT))
+      return;
+
+    r = sl_alloc(po->ext_slab);
+    r->nf = nf;
+    nf->ext_req = r;
+    add_tail(&po->ext_queue, NODE r);
+  }
+
+  r->metric = metric;
+  r->gw = gw;
+  r->tag = tag;
+  r->withdraw = withdraw;
+
+  if (!po->ext_timer->expires)
+    tm_start(po->ext_timer, po->export_delay);
+}
+
+/**
+ * ospf_ext_flush - originate all pending external LSAs
+ * @po: OSPF protocol
+ */
+void
+ospf_ext_flush(struct proto_ospf *po)
+{
+  struct ospf_area *oa = ospf_main_area(po);
+  struct ospf_ext_req *r, *rx;
+  int flushed = 0;
+
+  tm_stop(po->ext_timer);
+
+  WALK_LIST_DELSAFE(r, rx, po->ext_queue)
+  {
+    ort *nf = r->nf;
+    nf->ext_req = NULL;
+
+    if (!r->withdraw)
+      originate_ext_lsa(oa, &nf->fn, EXT_EXPORT, r->metric, r->gw, r->tag, 1);
+    else
+    {
+      if (nf->fn.x1 == EXT_EXPORT)
+      {
+	flush_ext_lsa(oa, &nf->fn, oa_is_nssa(oa));
+	flushed = 1;
+      }
+
+      /* rt_sync() may have skipped the entry because of the request */
+      ri_mark(po, nf);
+      ri_dirty(po, nf);
+    }
+
+    rem_node(NODE r);
+    sl_free(po->ext_slab, r);
+  }
+
+  /* Old external routes might have blocked some NSSA translation */
+  if (flushed && (po->areano > 1))
+    schedule_rtcalc(po);
+}
+
+void
+ospf_ext_timer(timer *t)
+{
+  ospf_ext_flush(t->data);
+}
+
 
 #ifdef OSPFv3
 
@@ -1479,7 +1597,7 @@ originate_prefix_net_lsa_body(struct ospf_iface *ifa, u16 *length)
     add_link_lsa(po, ifa->link_lsa, offset, &pxc);
 
   WALK_LIST(n, ifa->neigh_list)
-    if ((n->state == NEIGHBOR_FULL) &&
+    if (NEIGH_ADJ(n) &&
       	(en = ospf_hash_find(po->gr, ifa->iface_id, n->iface_id, n->rid, LSA_T_LINK)))
       add_link_lsa(po, en, offset, &pxc);
 
@@ -1539,30 +1657,55 @@ flush_prefix_net_lsa(struct ospf_iface *ifa)
 #endif
 
 
-static void
-ospf_top_ht_alloc(struct top_graph *f)
-{
-  f->hash_size = 1 << f->hash_order;
-  f->hash_mask = f->hash_size - 1;
-  if (f->hash_order > HASH_HI_MAX - HASH_HI_STEP)
-    f->hash_entries_max = ~0;
-  else
-    f->hash_entries_max = f->hash_size HASH_HI_MARK;
-  if (f->hash_order < HASH_LO_MIN + HASH_LO_STEP)
-    f->hash_entries_min = 0;
-  else
-    f->hash_entries_min = f->hash_size HASH_LO_MARK;
-  DBG("Allocating OSPF hash of order %d: %d hash_entries, %d low, %d high\n",
-      f->hash_order, f->hash_size, f->hash_entries_min, f->hash_entries_max);
-  f->hash_table =
-    mb_alloc(f->pool, f->hash_size * sizeof(struct top_hash_entry *));
-  bzero(f->hash_table, f->hash_size * sizeof(struct top_hash_entry *));
-}
+/*
+ * The LSA database index is an open addressing hash table with linear
+ * probing. Each slot has a 16 B key (domain, LSA ID, router ID, type),
+ * stored apart from entry pointers, so a probe sequence runs through
+ * consecutive keys and each slot is checked by one SSE2 compare. Deleted
+ * slots are marked by TOP_TOMB.
+ *
+ * When the table is too full (including tombstones), or too sparse, a new
+ * table is allocated and entries are moved to it incrementally, a few slots
+ * on each insert or delete, instead of rehashing all at once. Until the
+ * move is finished, the old table is searched too.
+ *
+ * In OSPFv2, we don't know Router ID when looking for network LSAs. In
+ * OSPFv3, we don't know LSA ID when looking for router LSAs. In both cases
+ * the unknown part is left out from the hash, so all candidates are in one
+ * probe sequence and they are matched with the part masked out.
+ */
+
+#define TOP_TOMB ((struct top_hash_entry *) 1)
+
+#define TOP_KEY_DOMAIN	0x000f		/* Masks for top_key_match() */
+#define TOP_KEY_ID	0x00f0
+#define TOP_KEY_RT	0x0f00
+#define TOP_KEY_TYPE	0xf000
+
+#define TOP_MOVE_STEP 16		/* Slots of old table moved per update */
 
 static inline void
-ospf_top_ht_free(struct top_hash_entry **h)
+top_key_set(struct top_key *k, u32 domain, u32 lsa, u32 rtr, u32 type)
 {
-  mb_free(h);
+  k->domain = domain;
+  k->id = lsa;
+  k->rt = rtr;
+  k->type = type;
+}
+
+static inline int
+top_key_match(struct top_key *a, struct top_key *b, int ignore)
+{
+#ifdef __SSE2__
+  __m128i x = _mm_loadu_si128((__m128i *) a);
+  __m128i y = _mm_loadu_si128((__m128i *) b);
+  return (_mm_movemask_epi8(_mm_cmpeq_epi32(x, y)) | ignore) == 0xffff;
+#else
+  return ((ignore & TOP_KEY_DOMAIN) || (a->domain == b->domain)) &&
+    ((ignore & TOP_KEY_ID) || (a->id == b->id)) &&
+    ((ignore & TOP_KEY_RT) || (a->rt == b->rt)) &&
+    ((ignore & TOP_KEY_TYPE) || (a->type == b->type));
+#endif
 }
 
 static inline u32
@@ -1574,28 +1717,165 @@ ospf_top_hash_u32(u32 a)
   return a;
 }
 
-static inline unsigned
-ospf_top_hash(struct top_graph *f, u32 domain, u32 lsaid, u32 rtrid, u32 type)
+static inline u32
+ospf_top_hash(struct top_key *k)
 {
-  /* In OSPFv2, we don't know Router ID when looking for network LSAs.
-     In OSPFv3, we don't know LSA ID when looking for router LSAs.
-     In both cases, there is (usually) just one (or small number)
-     appropriate LSA, so we just clear unknown part of key. */
-
-  return (
+  u32 h = (
 #ifdef OSPFv2
-	  ((type == LSA_T_NET) ? 0 : ospf_top_hash_u32(rtrid)) +
-	  ospf_top_hash_u32(lsaid) + 
+	   ((k->type == LSA_T_NET) ? 0 : ospf_top_hash_u32(k->rt)) +
+	   ospf_top_hash_u32(k->id) +
 #else /* OSPFv3 */
-	  ospf_top_hash_u32(rtrid) +
-	  ((type == LSA_T_RT) ? 0 : ospf_top_hash_u32(lsaid)) +
+	   ospf_top_hash_u32(k->rt) +
+	   ((k->type == LSA_T_RT) ? 0 : ospf_top_hash_u32(k->id)) +
 #endif
-	  type + domain) & f->hash_mask;
+	   k->type + k->domain);
 
-  /*
-  return (ospf_top_hash_u32(lsaid) + ospf_top_hash_u32(rtrid) +
-	  type + areaid) & f->hash_mask;
-  */
+  /* Fibonacci hashing, the slot is taken from the upper bits */
+  return h * 0x9e3779b9;
+}
+
+static inline unsigned
+top_slot(struct top_index *t, u32 hash)
+{
+  return hash >> (32 - t->order);
+}
+
+static void
+top_index_alloc(struct top_graph *f, struct top_index *t, unsigned order)
+{
+  unsigned size = 1 << order;
+
+  t->order = order;
+  t->mask = size - 1;
+  t->used = t->count = 0;
+  t->keys = mb_alloc(f->pool, size * sizeof(struct top_key));
+  t->ents = mb_allocz(f->pool, size * sizeof(struct top_hash_entry *));
+}
+
+static void
+top_index_free(struct top_index *t)
+{
+  mb_free(t->keys);
+  mb_free(t->ents);
+  t->keys = NULL;
+  t->ents = NULL;
+}
+
+/* Find slot of entry matching key k, or -1 */
+static inline int
+top_index_find(struct top_index *t, struct top_key *k, u32 hash, int ignore)
+{
+  unsigned i;
+  struct top_hash_entry *e;
+
+  if (!t->ents)
+    return -1;
+
+  for (i = top_slot(t, hash); e = t->ents[i]; i = (i + 1) & t->mask)
+    if ((e != TOP_TOMB) && top_key_match(&t->keys[i], k, ignore))
+      return i;
+
+  return -1;
+}
+
+/* Find slot of entry e, or -1 */
+static inline int
+top_index_find_entry(struct top_index *t, struct top_hash_entry *e, u32 hash)
+{
+  unsigned i;
+  struct top_hash_entry *x;
+
+  if (!t->ents)
+    return -1;
+
+  for (i = top_slot(t, hash); x = t->ents[i]; i = (i + 1) & t->mask)
+    if (x == e)
+      return i;
+
+  return -1;
+}
+
+/* Add entry known to be not present */
+static inline void
+top_index_add(struct top_index *t, struct top_key *k, u32 hash, struct top_hash_entry *e)
+{
+  unsigned i = top_slot(t, hash);
+
+  while (t->ents[i] && (t->ents[i] != TOP_TOMB))
+    i = (i + 1) & t->mask;
+
+  if (!t->ents[i])
+    t->used++;
+
+  t->keys[i] = *k;
+  t->ents[i] = e;
+  t->count++;
+}
+
+/* Move some slots (or all when steps is 0) of old table to the current one */
+static void
+ospf_top_move(struct top_graph *f, unsigned steps)
+{
+  struct top_index *o = &f->old;
+  struct top_hash_entry *e;
+  int all = !steps;
+
+  if (!o->ents)
+    return;
+
+  for (; f->move_pos <= o->mask; f->move_pos++)
+  {
+    if (!all && !steps--)
+      return;
+
+    e = o->ents[f->move_pos];
+    if (e && (e != TOP_TOMB))
+    {
+      top_index_add(&f->tab, &o->keys[f->move_pos], ospf_top_hash(&o->keys[f->move_pos]), e);
+      o->ents[f->move_pos] = TOP_TOMB;
+      o->count--;
+    }
+  }
+
+  DBG("OSPF hash move to order %d finished\n", f->tab.order);
+  top_index_free(o);
+}
+
+/*
+ * The new table is at most four times smaller than the current one and its
+ * load is at most 1/2 after the move, so TOP_MOVE_STEP is large enough to
+ * finish the move before the new table can fill up.
+ */
+static void
+ospf_top_resize(struct top_graph *f)
+{
+  struct top_index *t = &f->tab;
+  unsigned order = MAX(HASH_DEF_ORDER, t->order - 2);
+
+  /* Finish previous move, so there are at most two tables */
+  ospf_top_move(f, 0);
+
+  while ((1U << order) < 2 * f->hash_entries)
+    order++;
+
+  DBG("OSPF hash resize from order %d to %d, %d entries, %d used\n",
+      t->order, order, f->hash_entries, t->used);
+
+  f->old = *t;
+  f->move_pos = 0;
+  top_index_alloc(f, t, order);
+}
+
+/* Check load of the current table, including tombstones */
+static inline void
+ospf_top_check(struct top_graph *f)
+{
+  struct top_index *t = &f->tab;
+  unsigned size = t->mask + 1;
+
+  if ((4 * t->used > 3 * size) ||
+      ((t->order > HASH_DEF_ORDER) && (16 * t->count < size) && !f->old.ents))
+    ospf_top_resize(f);
 }
 
 /**
@@ -1613,48 +1893,149 @@ ospf_top_new(pool *pool)
   f = mb_allocz(pool, sizeof(struct top_graph));
   f->pool = pool;
   f->hash_slab = sl_new(f->pool, sizeof(struct top_hash_entry));
-  f->hash_order = HASH_DEF_ORDER;
-  ospf_top_ht_alloc(f);
+  top_index_alloc(f, &f->tab, HASH_DEF_ORDER);
   f->hash_entries = 0;
-  f->hash_entries_min = 0;
+#ifdef OSPFv3
+  f->px_order = PX_HASH_DEF_ORDER;
+  f->px_hash = mb_allocz(pool, PX_HASH_SIZE(f) * sizeof(struct top_hash_entry *));
+  f->px_count = 0;
+#endif
+
+  int i;
+  for (i = 0; i < LSA_CLASSES; i++)
+    init_list(&f->lsa_class[i].cache);
+
   return f;
 }
 
 void
 ospf_top_free(struct top_graph *f)
 {
+  struct ospf_lsa_class *c;
+  node *n, *nx;
+  int i;
+
+  for (i = 0; i < LSA_CLASSES; i++)
+  {
+    c = &f->lsa_class[i];
+    if (c->slab)
+      rfree(c->slab);
+    WALK_LIST_DELSAFE(n, nx, c->cache)
+      mb_free(n);
+  }
+
   rfree(f->hash_slab);
-  ospf_top_ht_free(f->hash_table);
+  top_index_free(&f->tab);
+  if (f->old.ents)
+    top_index_free(&f->old);
+#ifdef OSPFv3
+  mb_free(f->px_hash);
+#endif
   mb_free(f);
 }
 
-static void
-ospf_top_rehash(struct top_graph *f, int step)
+static inline unsigned
+lsa_class_order(unsigned size)
 {
-  unsigned int oldn, oldh;
-  struct top_hash_entry **n, **oldt, **newt, *e, *x;
+  if (size <= (1 << LSA_CLASS_MIN_ORDER))
+    return LSA_CLASS_MIN_ORDER;
 
-  oldn = f->hash_size;
-  oldt = f->hash_table;
-  DBG("re-hashing topology hash from order %d to %d\n", f->hash_order,
-      f->hash_order + step);
-  f->hash_order += step;
-  ospf_top_ht_alloc(f);
-  newt = f->hash_table;
+  return u32_log2(size - 1) + 1;
+}
 
-  for (oldh = 0; oldh < oldn; oldh++)
+/**
+ * ospf_lsa_alloc - allocate an LSA body
+ * @f: topology graph owning the body
+ * @size: size of the body (without LSA header)
+ *
+ * Bodies are allocated from power of two size classes, so the memory of
+ * replaced or flushed LSAs is reused by later LSAs of a similar size
+ * instead of fragmenting the heap. The body must be freed by
+ * ospf_lsa_free() with the same @f and @size.
+ */
+void *
+ospf_lsa_alloc(struct top_graph *f, unsigned size)
+{
+  unsigned order = lsa_class_order(size);
+  struct ospf_lsa_class *c;
+  void *r;
+
+  ASSERT(order <= LSA_CLASS_MAX_ORDER);
+  c = &f->lsa_class[order - LSA_CLASS_MIN_ORDER];
+  c->used++;
+
+  if (order <= LSA_CLASS_SLAB_ORDER)
   {
-    e = oldt[oldh];
-    while (e)
-    {
-      x = e->next;
-      n = newt + ospf_top_hash(f, e->domain, e->lsa.id, e->lsa.rt, e->lsa.type);
-      e->next = *n;
-      *n = e;
-      e = x;
-    }
+    if (!c->slab)
+      c->slab = sl_new(f->pool, 1 << order);
+    return sl_alloc(c->slab);
+  }
+
+  if (!EMPTY_LIST(c->cache))
+  {
+    r = HEAD(c->cache);
+    rem_node(r);
+    c->cached--;
+    return r;
+  }
+
+  return mb_alloc(f->pool, 1 << order);
+}
+
+void
+ospf_lsa_free(struct top_graph *f, void *body, unsigned size)
+{
+  unsigned order = lsa_class_order(size);
+  struct ospf_lsa_class *c = &f->lsa_class[order - LSA_CLASS_MIN_ORDER];
+
+  c->used--;
+
+  if (order <= LSA_CLASS_SLAB_ORDER)
+    sl_free(c->slab, body);
+  else if (c->cached < LSA_CLASS_CACHE)
+  {
+    add_head(&c->cache, body);
+    c->cached++;
+  }
+  else
+    mb_free(body);
+}
+
+/**
+ * ospf_lsa_same_class - test whether buffer may be reused
+ * @size1: size of the allocated body
+ * @size2: requested size
+ *
+ * Returns nonzero if a body allocated for @size1 may be reused in place
+ * for @size2 (and later freed with @size2).
+ */
+int
+ospf_lsa_same_class(unsigned size1, unsigned size2)
+{
+  return lsa_class_order(size1) == lsa_class_order(size2);
+}
+
+void
+ospf_top_show_memory(struct top_graph *f)
+{
+  struct ospf_lsa_class *c;
+  size_t total = 0;
+  int i;
+
+  for (i = 0; i < LSA_CLASSES; i++)
+  {
+    c = &f->lsa_class[i];
+    total += (size_t) (c->used + c->cached) << (i + LSA_CLASS_MIN_ORDER);
+  }
+
+  print_size("  LSA bodies:", total);
+
+  for (i = 0; i < LSA_CLASSES; i++)
+  {
+    c = &f->lsa_class[i];
+    if (c->used || c->cached)
+      cli_msg(-1018, "    %5u B class: %8u used %4u cached", 1 << (i + LSA_CLASS_MIN_ORDER), c->used, c->cached);
   }
-  ospf_top_ht_free(oldt);
 }
 
 #ifdef OSPFv2
@@ -1662,7 +2043,18 @@ ospf_top_rehash(struct top_graph *f, int step)
 u32
 ospf_lsa_domain(u32 type, struct ospf_iface *ifa)
 {
-  return (type == LSA_T_EXT) ? 0 : ifa->oa->areaid;
+  switch (type)
+    {
+    case LSA_T_EXT:
+    case LSA_T_OPQ_AS:
+      return 0;
+
+    case LSA_T_GR:
+      return ifa->iface_id;
+
+    default:
+      return ifa->oa->areaid;
+    }
 }
 
 #else /* OSPFv3 */
@@ -1698,16 +2090,44 @@ ospf_hash_get_header(struct top_graph *f, u32 domain, struct ospf_lsa_header *h)
   return ospf_hash_get(f, domain, h->id, h->rt, h->type);
 }
 
+/**
+ * ospf_hash_prefetch - prefetch index slot of an LSA
+ * @f: topology graph
+ * @domain: LSA domain
+ * @h: LSA header (in host byte order)
+ *
+ * Just a hint, issued for a batch of LSAs before they are looked up, so the
+ * cache misses on index slots overlap.
+ */
+void
+ospf_hash_prefetch(struct top_graph *f, u32 domain, struct ospf_lsa_header *h)
+{
+  struct top_key k;
+  unsigned i;
+
+  top_key_set(&k, domain, h->id, h->rt, h->type);
+  i = top_slot(&f->tab, ospf_top_hash(&k));
+  __builtin_prefetch(&f->tab.keys[i]);
+  __builtin_prefetch(&f->tab.ents[i]);
+}
+
 struct top_hash_entry *
 ospf_hash_find(struct top_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
 {
-  struct top_hash_entry *e;
-  e = f->hash_table[ospf_top_hash(f, domain, lsa, rtr, type)];
+  struct top_key k;
+  u32 hash;
+  int i;
 
-  while (e && (e->lsa.id != lsa || e->lsa.type != type || e->lsa.rt != rtr || e->domain != domain))
-    e = e->next;
+  top_key_set(&k, domain, lsa, rtr, type);
+  hash = ospf_top_hash(&k);
 
-  return e;
+  if ((i = top_index_find(&f->tab, &k, hash, 0)) >= 0)
+    return f->tab.ents[i];
+
+  if ((i = top_index_find(&f->old, &k, hash, 0)) >= 0)
+    return f->old.ents[i];
+
+  return NULL;
 }
 
 
@@ -1718,13 +2138,20 @@ ospf_hash_find(struct top_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
 struct top_hash_entry *
 ospf_hash_find_net(struct top_graph *f, u32 domain, u32 lsa)
 {
-  struct top_hash_entry *e;
-  e = f->hash_table[ospf_top_hash(f, domain, lsa, 0, LSA_T_NET)];
+  struct top_key k;
+  u32 hash;
+  int i;
 
-  while (e && (e->lsa.id != lsa || e->lsa.type != LSA_T_NET || e->domain != domain))
-    e = e->next;
+  top_key_set(&k, domain, lsa, 0, LSA_T_NET);
+  hash = ospf_top_hash(&k);
 
-  return e;
+  if ((i = top_index_find(&f->tab, &k, hash, TOP_KEY_RT)) >= 0)
+    return f->tab.ents[i];
+
+  if ((i = top_index_find(&f->old, &k, hash, TOP_KEY_RT)) >= 0)
+    return f->old.ents[i];
+
+  return NULL;
 }
 
 #endif
@@ -1732,6 +2159,41 @@ ospf_hash_find_net(struct top_graph *f, u32 domain, u32 lsa)
 
 #ifdef OSPFv3
 
+/* Find the first router LSA of rtr in domain after prev (or the first one) */
+static struct top_hash_entry *
+ospf_hash_rt_after(struct top_graph *f, u32 domain, u32 rtr, struct top_hash_entry *prev)
+{
+  struct top_index *ts[2] = { &f->tab, &f->old };
+  struct top_hash_entry *e;
+  struct top_key k;
+  unsigned i, j;
+  u32 hash;
+  int skip = !!prev;
+
+  top_key_set(&k, domain, 0, rtr, LSA_T_RT);
+  hash = ospf_top_hash(&k);
+
+  for (j = 0; j < 2; j++)
+  {
+    struct top_index *t = ts[j];
+
+    if (!t->ents)
+      continue;
+
+    for (i = top_slot(t, hash); e = t->ents[i]; i = (i + 1) & t->mask)
+      if ((e != TOP_TOMB) && top_key_match(&t->keys[i], &k, TOP_KEY_ID))
+      {
+	if (!skip)
+	  return e;
+
+	if (e == prev)
+	  skip = 0;
+      }
+  }
+
+  return NULL;
+}
+
 /* In OSPFv3, usually we don't know LSA ID when looking for router
    LSAs. We return matching LSA with smallest LSA ID. */
 struct top_hash_entry *
@@ -1739,57 +2201,166 @@ ospf_hash_find_rt(struct top_graph *f, u32 domain, u32 rtr)
 {
   struct top_hash_entry *rv = NULL;
   struct top_hash_entry *e;
-  e = f->hash_table[ospf_top_hash(f, domain, 0, rtr, LSA_T_RT)];
-  
-  while (e)
-    {
-      if (e->lsa.rt == rtr && e->lsa.type == LSA_T_RT && e->domain == domain)
-	if (!rv || e->lsa.id < rv->lsa.id)
-	  rv = e;
-      e = e->next;
-    }
+
+  for (e = ospf_hash_rt_after(f, domain, rtr, NULL); e;
+       e = ospf_hash_rt_after(f, domain, rtr, e))
+    if (!rv || e->lsa.id < rv->lsa.id)
+      rv = e;
 
   return rv;
 }
 
-static inline struct top_hash_entry *
-find_matching_rt(struct top_hash_entry *e, u32 domain, u32 rtr)
+struct top_hash_entry *
+ospf_hash_find_rt_first(struct top_graph *f, u32 domain, u32 rtr)
 {
-  while (e && (e->lsa.rt != rtr || e->lsa.type != LSA_T_RT || e->domain != domain))
-    e = e->next;
-  return e;
+  return ospf_hash_rt_after(f, domain, rtr, NULL);
 }
 
 struct top_hash_entry *
-ospf_hash_find_rt_first(struct top_graph *f, u32 domain, u32 rtr)
+ospf_hash_find_rt_next(struct top_graph *f, struct top_hash_entry *e)
 {
-  struct top_hash_entry *e;
-  e = f->hash_table[ospf_top_hash(f, domain, 0, rtr, LSA_T_RT)];
-  return find_matching_rt(e, domain, rtr);
+  return ospf_hash_rt_after(f, e->domain, e->lsa.rt, e);
 }
 
+
+/*
+ * Prefix-LSA index. Intra-area-prefix-LSAs are chained through px_next into
+ * buckets hashed by the LS they reference, so the prefixes attached to a
+ * router or network vertex are found without walking the LSA database.
+ * Router prefix-LSAs reference the router as a whole, their ref_id is
+ * ignored (as in ospf_hash_find_rt()).
+ */
+
+static inline unsigned
+px_slot(struct top_graph *f, u32 domain, u32 type, u32 id, u32 rt)
+{
+  struct top_key k;
+
+  top_key_set(&k, domain, id, rt, type);
+  return ospf_top_hash(&k) >> (32 - f->px_order);
+}
+
+static inline unsigned
+px_entry_slot(struct top_graph *f, struct top_hash_entry *e)
+{
+  struct ospf_lsa_prefix *px = e->lsa_body;
+  return px_slot(f, e->domain, px->ref_type, px->ref_id, px->ref_rt);
+}
+
+static inline int
+px_match(struct top_hash_entry *e, u32 domain, u32 type, u32 id, u32 rt)
+{
+  struct ospf_lsa_prefix *px = e->lsa_body;
+  return (e->domain == domain) && (px->ref_type == type) && (px->ref_rt == rt) &&
+    ((type == LSA_T_RT) || (px->ref_id == id));
+}
+
+static void
+px_rehash(struct top_graph *f, unsigned order)
+{
+  struct top_hash_entry **old = f->px_hash;
+  struct top_hash_entry *e, *nx;
+  unsigned i, size = PX_HASH_SIZE(f), h;
+
+  f->px_order = order;
+  f->px_hash = mb_allocz(f->pool, PX_HASH_SIZE(f) * sizeof(struct top_hash_entry *));
+
+  for (i = 0; i < size; i++)
+    for (e = old[i]; e; e = nx)
+    {
+      nx = e->px_next;
+      h = px_entry_slot(f, e);
+      e->px_next = f->px_hash[h];
+      f->px_hash[h] = e;
+    }
+
+  mb_free(old);
+}
+
+/**
+ * ospf_prefix_add - add prefix-LSA to the prefix-LSA index
+ * @f: topology graph
+ * @e: LSA entry with a valid body
+ *
+ * Does nothing for other LSA types. Must be paired with ospf_prefix_remove()
+ * before the body is replaced or freed.
+ */
+void
+ospf_prefix_add(struct top_graph *f, struct top_hash_entry *e)
+{
+  unsigned h;
+
+  if (e->lsa.type != LSA_T_PREFIX)
+    return;
+
+  if (++f->px_count > 2 * PX_HASH_SIZE(f))
+    px_rehash(f, f->px_order + 2);
+
+  h = px_entry_slot(f, e);
+  e->px_next = f->px_hash[h];
+  f->px_hash[h] = e;
+}
+
+void
+ospf_prefix_remove(struct top_graph *f, struct top_hash_entry *e)
+{
+  struct top_hash_entry **ee;
+
+  if (e->lsa.type != LSA_T_PREFIX)
+    return;
+
+  for (ee = &f->px_hash[px_entry_slot(f, e)]; *ee != e; ee = &(*ee)->px_next)
+    if (!*ee)
+      bug("ospf_prefix_remove() called for invalid node");
+
+  *ee = e->px_next;
+  f->px_count--;
+}
+
+/**
+ * ospf_prefix_find - find prefix-LSAs referencing given LS
+ * @f: topology graph
+ * @domain: area ID
+ * @type: referenced LS type (LSA_T_RT or LSA_T_NET)
+ * @id: referenced LS ID, ignored for LSA_T_RT
+ * @rt: referenced advertising router
+ *
+ * Returns the first matching prefix-LSA, use ospf_prefix_find_next() to get
+ * the others. MaxAge LSAs are returned too.
+ */
 struct top_hash_entry *
-ospf_hash_find_rt_next(struct top_hash_entry *e)
+ospf_prefix_find(struct top_graph *f, u32 domain, u32 type, u32 id, u32 rt)
 {
-  return find_matching_rt(e->next, e->domain, e->lsa.rt);
+  struct top_hash_entry *e = f->px_hash[px_slot(f, domain, type, id, rt)];
+
+  while (e && !px_match(e, domain, type, id, rt))
+    e = e->px_next;
+
+  return e;
 }
 
+struct top_hash_entry *
+ospf_prefix_find_next(struct top_graph *f UNUSED, struct top_hash_entry *e)
+{
+  struct ospf_lsa_prefix *px = e->lsa_body;
+  u32 domain = e->domain, type = px->ref_type, id = px->ref_id, rt = px->ref_rt;
+
+  do
+    e = e->px_next;
+  while (e && !px_match(e, domain, type, id, rt));
+
+  return e;
+}
 #endif
 
 
 struct top_hash_entry *
 ospf_hash_get(struct top_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
 {
-  struct top_hash_entry **ee;
   struct top_hash_entry *e;
+  struct top_key k;
 
-  ee = f->hash_table + ospf_top_hash(f, domain, lsa, rtr, type);
-  e = *ee;
-
-  while (e && (e->lsa.id != lsa || e->lsa.rt != rtr || e->lsa.type != type || e->domain != domain))
-    e = e->next;
-
-  if (e)
+  if (e = ospf_hash_find(f, domain, lsa, rtr, type))
     return e;
 
   e = sl_alloc(f->hash_slab);
@@ -1801,33 +2372,77 @@ ospf_hash_get(struct top_graph *f, u32 domain, u32 lsa, u32 rtr, u32 type)
   e->lsa.rt = rtr;
   e->lsa.type = type;
   e->lsa_body = NULL;
+  e->lsa_wire = NULL;
+  e->an.next = NULL;
   e->domain = domain;
-  e->next = *ee;
-  *ee = e;
-  if (f->hash_entries++ > f->hash_entries_max)
-    ospf_top_rehash(f, HASH_HI_STEP);
+
+  top_key_set(&k, domain, lsa, rtr, type);
+  top_index_add(&f->tab, &k, ospf_top_hash(&k), e);
+  f->hash_entries++;
+
+  ospf_top_move(f, TOP_MOVE_STEP);
+  ospf_top_check(f);
   return e;
 }
 
 void
 ospf_hash_delete(struct top_graph *f, struct top_hash_entry *e)
 {
-  struct top_hash_entry **ee = f->hash_table + 
-    ospf_top_hash(f, e->domain, e->lsa.id, e->lsa.rt, e->lsa.type);
+  struct top_index *t = &f->tab;
+  struct top_key k;
+  u32 hash;
+  int i;
 
-  while (*ee)
+  top_key_set(&k, e->domain, e->lsa.id, e->lsa.rt, e->lsa.type);
+  hash = ospf_top_hash(&k);
+
+  if ((i = top_index_find_entry(t, e, hash)) < 0)
   {
-    if (*ee == e)
-    {
-      *ee = e->next;
-      sl_free(f->hash_slab, e);
-      if (f->hash_entries-- < f->hash_entries_min)
-	ospf_top_rehash(f, -HASH_LO_STEP);
-      return;
-    }
-    ee = &((*ee)->next);
+    t = &f->old;
+    if ((i = top_index_find_entry(t, e, hash)) < 0)
+      bug("ospf_hash_delete() called for invalid node");
   }
-  bug("ospf_hash_delete() called for invalid node");
+
+  t->ents[i] = TOP_TOMB;
+  t->count--;
+  f->hash_entries--;
+  sl_free(f->hash_slab, e);
+
+  ospf_top_move(f, TOP_MOVE_STEP);
+  ospf_top_check(f);
+}
+
+/**
+ * ospf_hash_walk - walk through all LSA database entries
+ * @f: topology graph
+ * @pos: position, should be zero initially
+ *
+ * Returns the entry at the first occupied position not lower than @pos and
+ * updates @pos to that position, or NULL at the end. Increment @pos to
+ * continue. Entries inserted or deleted in the meantime may be skipped or
+ * returned twice.
+ */
+struct top_hash_entry *
+ospf_hash_walk(struct top_graph *f, unsigned *pos)
+{
+  struct top_index *ts[2] = { &f->tab, &f->old };
+  struct top_hash_entry *e;
+  unsigned base = 0;
+  int j;
+
+  for (j = 0; j < 2; base += ts[j]->mask + 1, j++)
+  {
+    struct top_index *t = ts[j];
+
+    if (!t->ents)
+      continue;
+
+    for (; *pos - base <= t->mask; (*pos)++)
+      if ((e = t->ents[*pos - base]) && (e != TOP_TOMB))
+	return e;
+  }
+
+  return NULL;
 }
 
 /*
@@ -1876,12 +2491,9 @@ ospf_top_dump(struct top_graph *f, struct proto *p)
   unsigned int i;
   OSPF_TRACE(D_EVENTS, "Hash entries: %d", f->hash_entries);
 
-  for (i = 0; i < f->hash_size; i++)
-  {
-    struct top_hash_entry *e;
-    for (e = f->hash_table[i]; e != NULL; e = e->next)
-      ospf_dump_lsa(e, p);
-  }
+  struct top_hash_entry *e;
+  for (i = 0; e = ospf_hash_walk(f, &i); i++)
+    ospf_dump_lsa(e, p);
 }
 */
 
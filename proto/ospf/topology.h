@@ -9,64 +9,134 @@
 #ifndef _BIRD_OSPF_TOPOLOGY_H_
 #define _BIRD_OSPF_TOPOLOGY_H_
 
+/*
+ * LSA database entry, also used as a vertex in SPF. The fields are ordered
+ * by use: after the list node, the lookup part (key and body) and the
+ * SPF part come first, so hash lookups and the SPF calculation touch as few
+ * cache lines as possible; fields used only for database maintenance come
+ * last.
+ * Link state request lists use the lighter struct ospf_lsr.
+ */
 struct top_hash_entry
 {				/* Index for fast mapping (type,rtrid,LSid)->vertex */
-  snode n;
-  node cn;			/* For adding into list of candidates
-				   in intra-area routing table calculation */
-  struct top_hash_entry *next;	/* Next in hash chain */
-  struct ospf_lsa_header lsa;
+  snode n;			/* Node in po->lsal, must be first */
+
+  /* Lookup part */
   u32 domain;			/* Area ID for area-wide LSAs, Iface ID for link-wide LSAs */
-  //  struct ospf_area *oa;
+  struct ospf_lsa_header lsa;
   void *lsa_body;
-  bird_clock_t inst_t;		/* Time of installation into DB */
-  struct mpnh *nhs;		/* Computed nexthops - valid only in ospf_rt_spf() */
-  ip_addr lb;			/* In OSPFv2, link back address. In OSPFv3, any global address in the area useful for vlinks */
-#ifdef OSPFv3
-  u32 lb_id;			/* Interface ID of link back iface (for bcast or NBMA networks) */
-#endif
+
+  /* SPF part, valid only in ospf_rt_spf() */
   u32 dist;			/* Distance from the root */
-  u16 ini_age;
   u8 color;
 #define OUTSPF 0
 #define CANDIDATE 1
 #define INSPF 2
-  u8 nhs_reuse;			/* Whether nhs nodes can be reused during merging.
-				   See a note in rt.c:merge_nexthops() */
+  u8 stale;			/* Self-originated, received during graceful restart */
+  u16 ini_age;
+  struct mpnh *nhs;		/* Computed nexthops */
+  node cn;			/* For adding into list of candidates
+				   in intra-area routing table calculation */
+  ip_addr lb;			/* In OSPFv2, link back address. In OSPFv3, any global address in the area useful for vlinks */
+#ifdef OSPFv3
+  u32 lb_id;			/* Interface ID of link back iface (for bcast or NBMA networks) */
+#endif
+
+  /* Database maintenance part */
+  node an;			/* For adding into aging wheel bucket */
+  void *lsa_wire;		/* Body in network byte order if sent, see lsa_get_wire() */
+  bird_clock_t inst_t;		/* Time of installation into DB */
+  bird_clock_t age_t;		/* Time of next aging event (refresh or MaxAge) */
+#ifdef OSPFv3
+  struct top_hash_entry *px_next; /* Next in prefix-LSA index chain */
+#endif
+};
+
+/*
+ * LSA bodies (and their network order copies) are allocated in power of two
+ * size classes from 16 B to 64 KiB owned by the top_graph. Classes up to
+ * 512 B use slabs, which pack at least seven of them into a slab page. Larger
+ * ones are allocated by mb_alloc() and keep a few freed blocks for reuse.
+ */
+#define LSA_CLASS_MIN_ORDER	4
+#define LSA_CLASS_MAX_ORDER	16
+#define LSA_CLASSES		(LSA_CLASS_MAX_ORDER - LSA_CLASS_MIN_ORDER + 1)
+#define LSA_CLASS_SLAB_ORDER	9	/* Largest class allocated from slab */
+#define LSA_CLASS_CACHE		4	/* Cached free blocks per large class */
+
+struct ospf_lsa_class
+{
+  slab *slab;			/* Allocated on first use */
+  list cache;			/* Free blocks of large classes */
+  unsigned int cached;
+  unsigned int used;		/* Number of allocated blocks */
+};
+
+/* Key of LSA database index, compared as one 16 B vector */
+struct top_key
+{
+  u32 domain;
+  u32 id;
+  u32 rt;
+  u32 type;
+};
+
+/* Open addressing table, see ospf_hash_find() */
+struct top_index
+{
+  struct top_key *keys;
+  struct top_hash_entry **ents;	/* NULL for empty slots */
+  unsigned int order, mask;
+  unsigned int count;		/* Number of entries */
+  unsigned int used;		/* Number of entries and tombstones */
 };
 
 struct top_graph
 {
   pool *pool;			/* Pool we allocate from */
   slab *hash_slab;		/* Slab for hash entries */
-  struct top_hash_entry **hash_table;	/* Hashing (modelled a`la fib) */
-  unsigned int hash_size;
-  unsigned int hash_order;
-  unsigned int hash_mask;
+  struct top_index tab;		/* Current index */
+  struct top_index old;		/* Index being moved to tab, if any */
+  unsigned int move_pos;	/* First slot of old not moved yet */
   unsigned int hash_entries;
-  unsigned int hash_entries_min, hash_entries_max;
+#ifdef OSPFv3
+  struct top_hash_entry **px_hash; /* Prefix-LSAs by referenced LS */
+  unsigned int px_order, px_count;
+#endif
+  struct ospf_lsa_class lsa_class[LSA_CLASSES];
 };
 
 struct top_graph *ospf_top_new(pool *);
 void ospf_top_free(struct top_graph *);
 void ospf_top_dump(struct top_graph *, struct proto *);
+void *ospf_lsa_alloc(struct top_graph *f, unsigned size);
+void ospf_lsa_free(struct top_graph *f, void *body, unsigned size);
+int ospf_lsa_same_class(unsigned size1, unsigned size2);
+void ospf_top_show_memory(struct top_graph *f);
 u32 ospf_lsa_domain(u32 type, struct ospf_iface *ifa);
 struct top_hash_entry *ospf_hash_find_header(struct top_graph *f, u32 domain,
 					     struct ospf_lsa_header *h);
 struct top_hash_entry *ospf_hash_get_header(struct top_graph *f, u32 domain,
 					    struct ospf_lsa_header *h);
+void ospf_hash_prefetch(struct top_graph *f, u32 domain, struct ospf_lsa_header *h);
 
 struct top_hash_entry *ospf_hash_find(struct top_graph *, u32 domain, u32 lsa, u32 rtr,
 				      u32 type);
 struct top_hash_entry *ospf_hash_get(struct top_graph *, u32 domain, u32 lsa, u32 rtr,
 				     u32 type);
 void ospf_hash_delete(struct top_graph *, struct top_hash_entry *);
+struct top_hash_entry *ospf_hash_walk(struct top_graph *f, unsigned *pos);
 void originate_rt_lsa(struct ospf_area *oa);
+#ifdef OSPFv3
+void originate_prefix_rt_lsa(struct ospf_area *oa);
+#endif
 void update_rt_lsa(struct ospf_area *oa);
 void originate_net_lsa(struct ospf_iface *ifa);
 void update_net_lsa(struct ospf_iface *ifa);
 void update_link_lsa(struct ospf_iface *ifa);
 int can_flush_lsa(struct proto_ospf *po);
+int bcast_net_active(struct ospf_iface *ifa);
+s32 get_seqnum(struct top_hash_entry *en);
 
 void originate_sum_net_lsa(struct ospf_area *oa, struct fib_node *fn, int metric);
 void originate_sum_rt_lsa(struct ospf_area *oa, struct fib_node *fn, int metric, u32 options UNUSED);
@@ -74,6 +144,21 @@ void flush_sum_lsa(struct ospf_area *oa, struct fib_node *fn, int type);
 void originate_ext_lsa(struct ospf_area *oa, struct fib_node *fn, int src, u32 metric, ip_addr fwaddr, u32 tag, int pbit);
 void flush_ext_lsa(struct ospf_area *oa, struct fib_node *fn, int nssa);
 
+/* Pending export of an external route, see ospf_ext_enqueue() */
+struct ospf_ext_req
+{
+  node n;			/* Node in po->ext_queue */
+  ort *nf;
+  u32 metric;
+  u32 tag;
+  ip_addr gw;
+  byte withdraw;
+};
+
+void ospf_ext_enqueue(struct proto_ospf *po, ort *nf, u32 metric, ip_addr gw, u32 tag, int withdraw);
+void ospf_ext_flush(struct proto_ospf *po);
+void ospf_ext_timer(timer *t);
+
 
 #ifdef OSPFv2
 struct top_hash_entry * ospf_hash_find_net(struct top_graph *f, u32 domain, u32 lsa);
@@ -87,7 +172,11 @@ ospf_hash_find_rt(struct top_graph *f, u32 domain, u32 rtr)
 #else /* OSPFv3 */
 struct top_hash_entry * ospf_hash_find_rt(struct top_graph *f, u32 domain, u32 rtr);
 struct top_hash_entry * ospf_hash_find_rt_first(struct top_graph *f, u32 domain, u32 rtr);
-struct top_hash_entry * ospf_hash_find_rt_next(struct top_hash_entry *e);
+struct top_hash_entry * ospf_hash_find_rt_next(struct top_graph *f, struct top_hash_entry *e);
+void ospf_prefix_add(struct top_graph *f, struct top_hash_entry *e);
+void ospf_prefix_remove(struct top_graph *f, struct top_hash_entry *e);
+struct top_hash_entry *ospf_prefix_find(struct top_graph *f, u32 domain, u32 type, u32 id, u32 rt);
+struct top_hash_entry *ospf_prefix_find_next(struct top_graph *f, struct top_hash_entry *e);
 #endif
 
 
@@ -14,6 +14,7 @@
 #define CONFIG_ALL_TABLES_AT_ONCE
 
 #define CONFIG_RESTRICTED_PRIVILEGES
+#define CONFIG_RECVMMSG
 
 /*
 Link: sysdep/linux
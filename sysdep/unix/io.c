@@ -176,6 +176,26 @@ init_times(void)
    log(L_WARN "Monotonic timer is missing");
 }
 
+/**
+ * tm_now_us - read current time in microseconds
+ *
+ * Unlike @now, which is updated once per main loop iteration, this
+ * function reads the clock on each call, so it is suitable for measuring
+ * how long some code runs. Monotonic clock is used when available.
+ */
+u64
+tm_now_us(void)
+{
+  struct timespec ts;
+  struct timeval tv;
+
+  if (clock_monotonic_available && !clock_gettime(CLOCK_MONOTONIC, &ts))
+    return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+  gettimeofday(&tv, NULL);
+  return (u64) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 
 static void
 tm_free(resource *r)
@@ -1419,6 +1439,89 @@ sk_send_full(sock *s, unsigned len, struct iface *ifa,
 }
 */
 
+#ifdef CONFIG_RECVMMSG
+
+/*
+ *	Batched reception of datagrams. Up to SK_RX_BATCH datagrams are
+ *	received by one recvmmsg() call and passed to rx_hook one by one,
+ *	each of them copied to the socket receive buffer.
+ */
+
+#define SK_RX_BATCH 8
+
+static byte *sk_rx_batch_buf;
+static unsigned sk_rx_batch_size;
+static int sk_rx_batch_unsupported;
+
+static int
+sk_read_batch(sock *s)
+{
+  struct mmsghdr msgs[SK_RX_BATCH];
+  struct iovec iov[SK_RX_BATCH];
+  sockaddr sa[SK_RX_BATCH];
+  byte cmsg_buf[SK_RX_BATCH][CMSG_RX_SPACE];
+  unsigned size = s->rbsize;
+  int i, n;
+
+  if (sk_rx_batch_size < size * SK_RX_BATCH)
+    {
+      xfree(sk_rx_batch_buf);
+      sk_rx_batch_size = size * SK_RX_BATCH;
+      sk_rx_batch_buf = xmalloc(sk_rx_batch_size);
+    }
+
+  for (i = 0; i < SK_RX_BATCH; i++)
+    {
+      iov[i].iov_base = sk_rx_batch_buf + i * size;
+      iov[i].iov_len = size;
+
+      msgs[i].msg_hdr = (struct msghdr) {
+	.msg_name = &sa[i],
+	.msg_namelen = sizeof(sa[i]),
+	.msg_iov = &iov[i],
+	.msg_iovlen = 1,
+	.msg_control = cmsg_buf[i],
+	.msg_controllen = sizeof(cmsg_buf[i]),
+	.msg_flags = 0};
+      msgs[i].msg_len = 0;
+    }
+
+  n = recvmmsg(s->fd, msgs, SK_RX_BATCH, 0, NULL);
+
+  if (n < 0)
+    {
+      if (errno == ENOSYS)
+	sk_rx_batch_unsupported = 1;
+      else if (errno != EINTR && errno != EAGAIN)
+	s->err_hook(s, errno);
+      return 0;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      unsigned len = msgs[i].msg_len;
+
+      /* Receive buffer may be reallocated by rx_hook */
+      if (len > s->rbsize)
+	continue;
+
+      memcpy(s->rbuf, iov[i].iov_base, len);
+      s->rpos = s->rbuf + len;
+      get_sockaddr(&sa[i], &s->faddr, NULL, &s->fport, 1);
+      sysio_process_rx_cmsgs(s, &msgs[i].msg_hdr);
+
+      s->rx_hook(s, len);
+
+      /* The socket could have been deleted by the hook */
+      if ((current_sock != s) || !s->rx_hook)
+	break;
+    }
+
+  return 1;
+}
+
+#endif
+
 static int
 sk_read(sock *s)
 {
@@ -1466,6 +1569,11 @@ sk_read(sock *s)
 	sockaddr sa;
 	int e;
 
+#ifdef CONFIG_RECVMMSG
+	if (!sk_rx_batch_unsupported)
+	  return sk_read_batch(s);
+#endif
+
 	struct iovec iov = {s->rbuf, s->rbsize};
 	byte cmsg_buf[CMSG_RX_SPACE];
 
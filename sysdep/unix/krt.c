@@ -699,6 +699,76 @@ krt_export_rte(struct krt_proto *p, rte **new, ea_list **tmpa)
   return f_run(filter, new, tmpa, krt_filter_lp, FF_FORCE_TMPATTR) <= F_ACCEPT;
 }
 
+/*
+ *	Graceful restart
+ *
+ *	Routes withdrawn by a gracefully restarting protocol stay in the kernel
+ *	until the protocol relearns them or the restart is done. They are kept
+ *	in the gr_kept fib, with the ID of the restart (see proto_gr_active())
+ *	in the x0 field, as the routing table entries may be freed meanwhile.
+ */
+
+static void
+krt_gr_init_node(struct fib_node *f)
+{
+  f->x0 = 0;
+}
+
+static int
+krt_gr_keep(struct krt_proto *p, net *n, rte *old)
+{
+  unsigned id = proto_gr_active(old->attrs->proto);
+
+  if (!id)
+    return 0;
+
+  struct fib_node *f = fib_get(&p->gr_kept, &n->n.prefix, n->n.pxlen);
+  f->x0 = id;
+  krt_trace_in(p, old, "kept during graceful restart");
+  return 1;
+}
+
+static void
+krt_gr_release(struct krt_proto *p, net *n)
+{
+  struct fib_node *f;
+
+  if (p->gr_kept.entries && (f = fib_find(&p->gr_kept, &n->n.prefix, n->n.pxlen)))
+    fib_delete(&p->gr_kept, f);
+}
+
+static int
+krt_gr_kept(struct krt_proto *p, net *n)
+{
+  struct fib_node *f = p->gr_kept.entries ? fib_find(&p->gr_kept, &n->n.prefix, n->n.pxlen) : NULL;
+
+  return f && proto_gr_id_active(f->x0);
+}
+
+/* Forget routes kept for restarts which are done */
+static void
+krt_gr_prune(struct krt_proto *p)
+{
+  struct fib *fib = &p->gr_kept;
+  struct fib_iterator fit;
+
+  if (!fib->entries)
+    return;
+
+  FIB_ITERATE_INIT(&fit, fib);
+again:
+  FIB_ITERATE_START(fib, &fit, f)
+    {
+      if (!proto_gr_id_active(f->x0))
+	{
+	  FIB_ITERATE_PUT(&fit, f);
+	  fib_delete(fib, f);
+	  goto again;
+	}
+    }
+  FIB_ITERATE_END(f);
+}
+
 static void
 krt_prune(struct krt_proto *p)
 {
@@ -757,6 +827,11 @@ krt_prune(struct krt_proto *p)
 	  krt_replace_rte(p, n, new, old, tmpa);
 	  break;
 	case KRF_DELETE:
+	  if (krt_gr_kept(p, n))
+	    {
+	      krt_trace_in(p, old, "kept during graceful restart");
+	      break;
+	    }
 	  krt_trace_in(p, old, "deleting");
 	  krt_replace_rte(p, n, NULL, old, NULL);
 	  break;
@@ -773,6 +848,8 @@ krt_prune(struct krt_proto *p)
     }
   FIB_WALK_END;
 
+  krt_gr_prune(p);
+
 #ifdef KRT_ALLOW_LEARN
   if (KRT_CF->learn)
     krt_learn_prune(p);
@@ -964,6 +1041,10 @@ krt_notify(struct proto *P, struct rtable *table UNUSED, net *net,
     net->n.flags |= KRF_INSTALLED;
   else
     net->n.flags &= ~KRF_INSTALLED;
+  if (!new && old && krt_gr_keep(p, net, old))
+    return;			/* Keep the route until graceful restart is done */
+  if (new)
+    krt_gr_release(p, net);
   if (p->initialized)		/* Before first scan we don't touch the routes */
     krt_replace_rte(p, net, new, old, eattrs);
 }
@@ -1004,6 +1085,7 @@ krt_start(struct proto *P)
   struct krt_proto *p = (struct krt_proto *) P;
 
   add_tail(&krt_proto_list, &p->krt_node);
+  fib_init(&p->gr_kept, p->p.pool, sizeof(struct fib_node), 0, krt_gr_init_node);
 
 #ifdef KRT_ALLOW_LEARN
   krt_learn_init(p);
@@ -62,6 +62,7 @@ struct krt_proto {
   timer *scan_timer;
 #endif
 
+  struct fib gr_kept;		/* Routes kept for graceful restart of their source */
   node krt_node;		/* Node in krt_proto_list */
   int initialized;		/* First scan has already been finished */
 };
@@ -29,6 +29,7 @@ timer *tm_new(pool *);
 void tm_start(timer *, unsigned after);
 void tm_stop(timer *);
 void tm_dump_all(void);
+u64 tm_now_us(void);
 
 extern bird_clock_t now; 		/* Relative, monotonic time in seconds */
 extern bird_clock_t now_real;		/* Time in seconds since fixed known epoch */